@@ -11,12 +11,14 @@ All Global variable names shall start with "G_"
 ***********************************************************************************************************************/
 /* New variables */
 volatile u32 G_u32SystemTime1ms = 0;                   /*!< @brief Global system time incremented every ms, max 2^32 (~49 days) */
+volatile u32 G_u32SystemTime1msWraps = 0;              /*!< @brief Times G_u32SystemTime1ms has wrapped: the upper 32 bits of a 64-bit ms time */
 volatile u32 G_u32SystemTime1s = 0;                    /*!< @brief Global system time incremented every second, max 2^32 (~136 years) */
 volatile u32 G_u32SystemFlags = 0;                     /*!< @brief Global system flags */
 volatile u32 G_u32ApplicationFlags = 0;                /*!< @brief Global system application flags: set when application is successfully initialized */
 
 /*--------------------------------------------------------------------------------------------------------------------*/
 /* External global variables defined in other files (must indicate which file they are defined in) */
+extern u32 G_u32SchedulerReady;                        /*!< @brief From scheduler.c */
 
 
 /***********************************************************************************************************************
@@ -33,47 +35,63 @@ Main has two sections:
 
 1. Initialization which is run once on power-up or reset.  All drivers and applications are setup here without timing
 contraints but must complete execution regardless of success or failure of starting the application. 
+Each call is timed with PROFILER_BOOT() (debug command "boot").  Setup that needs delays, like the LCD power-up, is
+left to the task's state machine so the super loop starts as soon as possible.
 
 2. Super loop which runs infinitely giving processor time to each application.  The total loop time should not exceed
 1ms of execution time counting all application execution.  SystemSleep() will execute to complete the remaining time in
-the 1ms period.
+the 1ms period.  Tasks that have made themselves event-driven are skipped unless they were signalled (scheduler.c).
+Tasks are called by priority so that when a pass runs late the critical drivers have already run and the lower
+priority tasks are the ones deferred to the next pass.
 ***********************************************************************************************************************/
 
 void main(void)
 {
   G_u32SystemFlags |= _SYSTEM_INITIALIZING;
+  ProfilerBootStart();
 
   /* Low level initialization */
-  WatchDogSetup(); /* During development, does not reset processor if timeout */
-  GpioSetup();
-  ClockSetup();
-  InterruptSetup();
-  SysTickSetup();
+  PROFILER_BOOT(WatchDogSetup()); /* During development, does not reset processor if timeout */
+  PROFILER_BOOT(GpioSetup());
+  PROFILER_BOOT(ClockSetup());
+  PROFILER_BOOT(InterruptSetup());
+  PROFILER_BOOT(DeferredInitialize());
+  PROFILER_BOOT(SysTickSetup());
+  PROFILER_BOOT(RealTimeClockSetup());
+  PROFILER_BOOT(StackMonInitialize());
+  PROFILER_BOOT(SchedulerInitialize());
+  PROFILER_BOOT(SoftTimerInitialize());
 
   /* Driver initialization */
-  MessagingInitialize();
-  UartInitialize();
-  DebugInitialize();
+  PROFILER_BOOT(MessagingInitialize());
+  PROFILER_BOOT(UartInitialize());
+  PROFILER_BOOT(DebugInitialize());
+  PROFILER_BOOT(TokenLogInitialize());
+  PROFILER_BOOT(TraceInitialize());
+  PROFILER_BOOT(CrashLogInitialize());
 
   /* Debug messages through DebugPrintf() are available from here */
-  ButtonInitialize();
-  TimerInitialize();  
-  SspInitialize();
-  TWIInitialize();
-  Adc12Initialize();
+  PROFILER_BOOT(ButtonInitialize());
+  PROFILER_BOOT(TimerInitialize());  
+  PROFILER_BOOT(SspInitialize());
+  PROFILER_BOOT(TWIInitialize());
+  PROFILER_BOOT(Adc12Initialize());
   
-  LcdInitialize();
-  LedInitialize();
-  SdCardInitialize();
+  PROFILER_BOOT(LcdInitialize());
+  PROFILER_BOOT(LedInitialize());
+  PROFILER_BOOT(SdCardInitialize());
+  PROFILER_BOOT(FatLogInitialize());
+  PROFILER_BOOT(RawLogInitialize());
 
   /* Application initialization */
-  UserApp1Initialize();
-  UserApp2Initialize();
-  UserApp3Initialize();
+  PROFILER_BOOT(UserApp1Initialize());
+  PROFILER_BOOT(UserApp2Initialize());
+  PROFILER_BOOT(UserApp3Initialize());
 
   
   /* Exit initialization */
-  SystemStatusReport();
+  PROFILER_BOOT(ProfilerInitialize());
+  PROFILER_BOOT(SystemStatusReport());
   G_u32SystemFlags &= ~_SYSTEM_INITIALIZING;
     
   /* Super loop */  
@@ -81,25 +99,39 @@ void main(void)
   {
     WATCHDOG_BONE();
     SystemTimeCheck();
+    StackMonCheck();
+    DeferredCheck();
+    ProfilerLoopStart();
+    SchedulerLoopStart();
     
+    /* Critical drivers: always run (Scheduler_aePriority in scheduler.c) */
+    SCHEDULER_RUN(PROFILER_TASK_UART,      UartRunActiveState());
+    SCHEDULER_RUN(PROFILER_TASK_TIMER,     TimerRunActiveState()); 
+    SCHEDULER_RUN(PROFILER_TASK_SOFTTIMER, SoftTimerRunActiveState());
+    SCHEDULER_RUN(PROFILER_TASK_SSP,       SspRunActiveState());
+    SCHEDULER_RUN(PROFILER_TASK_TWI,       TWIRunActiveState());
+    SCHEDULER_RUN(PROFILER_TASK_MESSAGING, MessagingRunActiveState());
+
     /* Drivers */
-    LedUpdate();
-    ButtonRunActiveState();
-    UartRunActiveState();
-    TimerRunActiveState(); 
-    SspRunActiveState();
-    TWIRunActiveState();
-    Adc12RunActiveState();
-    MessagingRunActiveState();
-    DebugRunActiveState();
-    LcdRunActiveState();
-    SdCardRunActiveState();
+    SCHEDULER_RUN(PROFILER_TASK_LED,       LedUpdate());
+    SCHEDULER_RUN(PROFILER_TASK_BUTTON,    ButtonRunActiveState());
+    SCHEDULER_RUN(PROFILER_TASK_ADC,       Adc12RunActiveState());
+    SCHEDULER_RUN(PROFILER_TASK_DEBUG,     DebugRunActiveState());
+    SCHEDULER_RUN(PROFILER_TASK_SDCARD,    SdCardRunActiveState());
 
     /* Applications */
-    UserApp1RunActiveState();
-    UserApp2RunActiveState();
-    UserApp3RunActiveState();
+    SCHEDULER_RUN(PROFILER_TASK_USERAPP1,  UserApp1RunActiveState());
+    SCHEDULER_RUN(PROFILER_TASK_USERAPP2,  UserApp2RunActiveState());
+    SCHEDULER_RUN(PROFILER_TASK_USERAPP3,  UserApp3RunActiveState());
+
+    /* Background: first to be deferred when the pass runs late */
+    SCHEDULER_RUN(PROFILER_TASK_TOKENLOG,  TokenLogRunActiveState());
+    SCHEDULER_RUN(PROFILER_TASK_TRACE,     TraceRunActiveState());
+    SCHEDULER_RUN(PROFILER_TASK_LCD,       LcdRunActiveState());
+    SCHEDULER_RUN(PROFILER_TASK_FATLOG,    FatLogRunActiveState());
+    SCHEDULER_RUN(PROFILER_TASK_RAWLOG,    RawLogRunActiveState());
     
+    ProfilerLoopEnd();
     HEARTBEAT_OFF();
 
     /* System sleep until next Systick */
@@ -37,15 +37,21 @@ FIRMWARE_SUB_REV1: should be updated when a pull request is made to the MASTER b
 #ifdef EIE1
 /* EIE1 specific application flags */
 #define _APPLICATION_FLAGS_SDCARD       0x00000040        /*!< G_u32ApplicationFlags  SdCardStateMachine */
+#define _APPLICATION_FLAGS_FATLOG       0x00000080        /*!< G_u32ApplicationFlags  FatLogStateMachine */
+#define _APPLICATION_FLAGS_RAWLOG       0x00000100        /*!< G_u32ApplicationFlags  RawLogStateMachine */
+#define _APPLICATION_FLAGS_TOKENLOG     0x00000200        /*!< G_u32ApplicationFlags  TokenLogStateMachine */
+#define _APPLICATION_FLAGS_TRACE        0x00000400        /*!< G_u32ApplicationFlags  TraceStateMachine */
 
-#define NUMBER_APPLICATIONS             (u8)7             /*!< Total number of system applications */
+#define NUMBER_APPLICATIONS             (u8)11            /*!< Total number of system applications */
 #endif /* EIE1 specific application flags */
 
 #ifdef MPGL2
 /* MPGL2 specific application flags */
 #define _APPLICATION_FLAGS_CAPTOUCH     0x00000040        /*!< G_u32ApplicationFlags  CapTouchStateMachine */
+#define _APPLICATION_FLAGS_TOKENLOG     0x00000080        /*!< G_u32ApplicationFlags  TokenLogStateMachine */
+#define _APPLICATION_FLAGS_TRACE        0x00000100        /*!< G_u32ApplicationFlags  TraceStateMachine */
 
-#define NUMBER_APPLICATIONS             (u8)7             /*!< Total number of system applications */
+#define NUMBER_APPLICATIONS             (u8)9             /*!< Total number of system applications */
 #endif /* MPGL2 specific application flags */
 
 /* G_u32SystemFlags */
@@ -55,6 +61,7 @@ FIRMWARE_SUB_REV1: should be updated when a pull request is made to the MASTER b
 #define _SYSTEM_CLOCK_OSC_FAIL          (u32)0x00000008   /*!< G_u32SystemFlags set if oscillator start-up fails */
 #define _SYSTEM_CLOCK_PLL_NO_LOCK       (u32)0x00000010   /*!< G_u32SystemFlags set if PLL0 does not lock on startup */
 #define _SYSTEM_TIME_WARNING            (u32)0x00000020   /*!< G_u32SystemFlags set if a 1ms violation has occurred */
+#define _SYSTEM_CLOCK_NO_STOP_MASK      (u32)0x00000007   /*!< G_u32SystemFlags any module preventing STOP (wait) mode */
 
 #define _SYSTEM_SLEEPING                (u32)0x40000000   /*!< G_u32SystemFlags set into sleep mode to go back to sleep if woken before 1ms period */
 #define _SYSTEM_INITIALIZING            (u32)0x80000000   /*!< G_u32SystemFlags set when system is in initialization phase */
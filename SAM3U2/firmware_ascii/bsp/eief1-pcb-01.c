@@ -8,6 +8,16 @@ are one-time configurations for the processor.
 PWM Audio functions are provided here since they are very specific to the processor peripheral
 but also simple in operation.
 
+SystemSleep() picks how deeply to sleep from the scheduler's next wake-up: the normal 1ms sleep, 
+a tickless sleep, or (with DEEP_SLEEP) wait mode with the RTT keeping time.  Drivers with a 
+transfer in progress that needs the master clock hold off wait mode with SystemDeepSleepVeto().
+A button or a debug character ends wait mode through the fast startup inputs, after which wait mode 
+is held off for WAIT_MODE_HOLDOFF_MS so the rest of the input is received at full clock speed.
+
+SystemGetTimeMs() and SystemGetTimeUs() give a 64-bit time that does not wrap like G_u32SystemTime1ms.  
+The microseconds come from the SysTick counter within the current tick.  Neither disables interrupts: 
+they read the time again if a tick came in the middle, so they are safe from ISRs and tasks alike.
+
 ------------------------------------------------------------------------------------------------------------------------
 GLOBALS
 - NONE
@@ -22,7 +32,11 @@ PUBLIC FUNCTIONS
 - void PWMAudioSetFrequency(u32 u32Channel_, u16 u16Frequency_)
 - void PWMAudioOn(u32 u32Channel_)
 - void PWMAudioOff(u32 u32Channel_)
-
+- void SystemDeepSleepVeto(u8 u8PeripheralId_)
+- void SystemDeepSleepRelease(u8 u8PeripheralId_)
+- void SystemDeepSleepHoldoff(void)
+- u64 SystemGetTimeMs(void)
+- u64 SystemGetTimeUs(void)
 
 PROTECTED FUNCTIONS
 - void ClockSetup(void)
@@ -47,11 +61,15 @@ All Global variable names shall start with "G_xxBsp"
 /*--------------------------------------------------------------------------------------------------------------------*/
 /* Existing variables (defined in other files -- should all contain the "extern" keyword) */
 extern volatile u32 G_u32SystemTime1ms;                /*!< @brief From main.c */
+extern volatile u32 G_u32SystemTime1msWraps;           /*!< @brief From main.c */
 extern volatile u32 G_u32SystemTime1s;                 /*!< @brief From main.c */
 extern volatile u32 G_u32SystemFlags;                  /*!< @brief From main.c */
 extern volatile u32 G_u32ApplicationFlags;             /*!< @brief From main.c */
 
 extern u32 G_u32DebugFlags;                            /*!< @brief From debug.c */
+extern volatile u32 G_u32TokenLogFlags;                /*!< @brief From tokenlog.c */
+extern volatile u32 G_u32TraceFlags;                   /*!< @brief From trace.c */
+extern volatile u32 G_u32ISRTickStepMs;                /*!< @brief From interrupts.c */
 
 
 /***********************************************************************************************************************
@@ -59,6 +77,13 @@ Global variable definitions with scope limited to this local application.
 Variable names shall start with "Bsp_" and be declared as static.
 ***********************************************************************************************************************/
 static u32 Bsp_u32TimingViolationsCounter = 0;        
+static u32 Bsp_u32TicklessMs = 0;                      /*!< @brief Ticks skipped by the last tickless sleep beyond the normal 1 */
+
+static volatile u32 Bsp_u32DeepSleepVetoes = 0;        /*!< @brief One bit per peripheral ID holding off wait mode */
+static u32 Bsp_u32DeepSleepHoldoff = 0;                /*!< @brief G_u32SystemTime1ms when the last wait mode holdoff started */
+static u32 Bsp_u32RttRate = 0;                         /*!< @brief SysTick counts per RTT count x 256; 0 until measured */
+static u32 Bsp_u32RttReference = 0;                    /*!< @brief RTT value at the start of the calibration window */
+static u32 Bsp_u32RttReferenceMs = 0;                  /*!< @brief G_u32SystemTime1ms at the start of the calibration window */
 
 
 /***********************************************************************************************************************
@@ -193,6 +218,166 @@ void PWMAudioOff(u32 u32Channel_)
 } /* end PWMAudioOff() */
 
 
+/*!---------------------------------------------------------------------------------------------------------------------
+@fn void SystemDeepSleepVeto(u8 u8PeripheralId_)
+
+@brief Keeps the system out of wait mode while a peripheral needs the master clock.
+
+Call when starting a PDC transfer (or anything else that must finish at full clock speed) 
+and call SystemDeepSleepRelease() with the same ID when it completes.  Safe to call from ISRs.
+
+Example:
+
+SystemDeepSleepVeto(AT91C_ID_US0);
+
+Requires:
+@param u8PeripheralId_ is the AT91C_ID_xxx of the peripheral
+
+Promises:
+- SystemSleep() uses at most a tickless sleep until the veto is released
+
+*/
+void SystemDeepSleepVeto(u8 u8PeripheralId_)
+{
+  __disable_irq();
+  Bsp_u32DeepSleepVetoes |= ((u32)1 << u8PeripheralId_);
+  __enable_irq();
+
+} /* end SystemDeepSleepVeto() */
+
+
+/*!---------------------------------------------------------------------------------------------------------------------
+@fn void SystemDeepSleepRelease(u8 u8PeripheralId_)
+
+@brief Releases a veto set by SystemDeepSleepVeto().  Safe to call from ISRs.
+
+Example:
+
+SystemDeepSleepRelease(AT91C_ID_US0);
+
+Requires:
+@param u8PeripheralId_ is the AT91C_ID_xxx of the peripheral
+
+Promises:
+- The peripheral no longer holds off wait mode
+
+*/
+void SystemDeepSleepRelease(u8 u8PeripheralId_)
+{
+  __disable_irq();
+  Bsp_u32DeepSleepVetoes &= ~((u32)1 << u8PeripheralId_);
+  __enable_irq();
+
+} /* end SystemDeepSleepRelease() */
+
+
+/*!---------------------------------------------------------------------------------------------------------------------
+@fn void SystemDeepSleepHoldoff(void)
+
+@brief Keeps the system out of wait mode for the next WAIT_MODE_HOLDOFF_MS.  Safe to call from ISRs.
+
+For input that arrives at unknown times, such as characters typed at the debug port: a character 
+that arrives in wait mode is lost, so each one received holds wait mode off for the next.
+
+Requires:
+- NONE
+
+Promises:
+- SystemSleep() uses at most a tickless sleep until WAIT_MODE_HOLDOFF_MS have passed
+
+*/
+void SystemDeepSleepHoldoff(void)
+{
+  Bsp_u32DeepSleepHoldoff = G_u32SystemTime1ms;
+
+} /* end SystemDeepSleepHoldoff() */
+
+
+/*!---------------------------------------------------------------------------------------------------------------------
+@fn u64 SystemGetTimeMs(void)
+
+@brief Returns the system time in ms as a 64-bit value that does not wrap.
+
+The same time as G_u32SystemTime1ms in the low 32 bits.  Safe to call from ISRs.
+
+Requires:
+- NONE
+
+Promises:
+- Returns G_u32SystemTime1msWraps:G_u32SystemTime1ms read from the same tick
+
+*/
+u64 SystemGetTimeMs(void)
+{
+  u32 u32Ms;
+  u32 u32Wraps;
+
+  /* SysTick_Handler() changes G_u32SystemTime1ms every time it runs, so an unchanged value means no tick 
+  came in the middle and the pair belongs together */
+  do
+  {
+    u32Ms    = G_u32SystemTime1ms;
+    u32Wraps = G_u32SystemTime1msWraps;
+  } while(u32Ms != G_u32SystemTime1ms);
+
+  return( ((u64)u32Wraps << 32) | u32Ms );
+
+} /* end SystemGetTimeMs() */
+
+
+/*!---------------------------------------------------------------------------------------------------------------------
+@fn u64 SystemGetTimeUs(void)
+
+@brief Returns a 64-bit monotonic time in microseconds for timestamps and latency measurements.
+
+The system time in ms plus the SysTick counts already done in the current tick.  Safe to call from ISRs 
+and with interrupts disabled: a tick whose SysTick_Handler() has not run yet is counted too.
+
+Example:
+u64 u64Start = SystemGetTimeUs();
+...
+u32 u32LatencyUs = (u32)(SystemGetTimeUs() - u64Start);
+
+Requires:
+- SysTickSetup() has run
+
+Promises:
+- Returns the time since SysTickSetup() in us, with the SysTick resolution of 1/6us truncated
+
+*/
+u64 SystemGetTimeUs(void)
+{
+  u32 u32Ms;
+  u32 u32Wraps;
+  u32 u32StepMs;
+  u32 u32Count;
+  s32 s32Counts;
+
+  do
+  {
+    u32Ms     = G_u32SystemTime1ms;
+    u32Wraps  = G_u32SystemTime1msWraps;
+    u32StepMs = 0;
+    u32Count  = AT91C_BASE_NVIC->NVIC_STICKCVR;
+    
+    /* If the counter reloaded before the pending bit was read, read it again past the reload and count the 
+    tick the handler is about to add.  If the bit was clear, the first read came before any reload. */
+    if(AT91C_BASE_NVIC->NVIC_ICSR & AT91C_NVIC_PENDSTSET)
+    {
+      u32Count  = AT91C_BASE_NVIC->NVIC_STICKCVR;
+      u32StepMs = G_u32ISRTickStepMs;
+    }
+  } while(u32Ms != G_u32SystemTime1ms);
+
+  /* Counts since the last 1ms boundary.  SystemTickResume() keeps the SysTick periods in phase with the ms 
+  boundaries, and the one period it makes longer than 1ms starts a tick early, so this goes negative then. */
+  s32Counts = (s32)(SYSTICK_COUNT - 1) - (s32)u32Count;
+
+  return( ((((u64)u32Wraps << 32) | u32Ms) + u32StepMs) * 1000 + (s32Counts / SYSTICK_COUNTS_PER_US) );
+
+} /* end SystemGetTimeUs() */
+
+
 /*--------------------------------------------------------------------------------------------------------------------*/
 /*! @protectedsection */                                                                                            
 /*--------------------------------------------------------------------------------------------------------------------*/
@@ -222,22 +407,8 @@ void ClockSetup(void)
   AT91C_BASE_PMC->PMC_PCKR[0] = AT91C_PMC_CSS_SYS_CLK | AT91C_PMC_PRES_CLK;
   AT91C_BASE_PMC->PMC_SCER = AT91C_PMC_PCK0;
 
-  /* Turn on the main oscillator and wait for it to start up */
-  AT91C_BASE_PMC->PMC_MOR = PMC_MOR_INIT;
-  while ( !(AT91C_BASE_PMC->PMC_SR & AT91C_PMC_MOSCXTS) );
-
-  /* Assign main clock as crystal */
-  AT91C_BASE_PMC->PMC_MOR |= (AT91C_CKGR_MOSCSEL | MOR_KEY);
-  
-  /* Initialize PLLA and wait for lock */
-  AT91C_BASE_PMC->PMC_PLLAR = PMC_PLAAR_INIT;
-  while ( !(AT91C_BASE_PMC->PMC_SR & AT91C_PMC_LOCKA) );
-  
-  /* Assign the PLLA as the main system clock with prescaler active using the sequence suggested on pg. 472 */
-  AT91C_BASE_PMC->PMC_MCKR = PMC_MCKR_INIT;
-  while ( !(AT91C_BASE_PMC->PMC_SR & AT91C_PMC_MCKRDY) );
-  AT91C_BASE_PMC->PMC_MCKR = PMC_MCKR_PLLA;
-  while ( !(AT91C_BASE_PMC->PMC_SR & AT91C_PMC_MCKRDY) );
+  /* Crystal, PLLA and master clock (also used on the way out of wait mode) */
+  ClockStartPll();
 
   /* Initialize UTMI for USB usage */
   AT91C_BASE_CKGR->CKGR_UCKR |= (AT91C_CKGR_UPLLCOUNT & (3 << 20)) | AT91C_CKGR_UPLLEN;
@@ -249,17 +420,28 @@ void ClockSetup(void)
 /*!---------------------------------------------------------------------------------------------------------------------
 @fn RealTimeClockSetup
 
-@brief Loads all registers required to set up the real time clock.
+@brief Starts the Real-time Timer that keeps time while the system is in wait mode.
+
+The RTT runs from SLCK, the internal RC, which varies from 20kHz to 44kHz, so its rate 
+is measured against SysTick (see SystemRttCalibrate()) before wait mode is used.
 
 Requires:
-- TBD
+- SysTickSetup() has run
 
 Promises:
-- TBD
+- RTT is counting SLCK / RTT_PRESCALER with no alarm
+- The first RTT calibration window starts now
 
 */
 void RealTimeClockSetup(void)
 {
+  AT91C_BASE_RTTC->RTTC_RTMR = RTT_PRESCALER | AT91C_RTTC_RTTRST;
+  AT91C_BASE_RTTC->RTTC_RTAR = RTT_ALARM_OFF;
+
+  Bsp_u32RttRate = 0;
+  Bsp_u32RttReference = SystemRttRead();
+  Bsp_u32RttReferenceMs = G_u32SystemTime1ms;
+
 } /* end RealTimeClockSetup() */
 
 
@@ -278,6 +460,7 @@ Promises:
 void SysTickSetup(void)
 {
   G_u32SystemTime1ms = 0;      
+  G_u32SystemTime1msWraps = 0;
   G_u32SystemTime1s  = 0;   
   
   /* Load the SysTick Counter Value */
@@ -298,25 +481,30 @@ Requires:
 
 Promises:
 @Bsp_u32TimingViolationsCounter is incremented if G_u32SystemTime1ms has
-increased by more than one since this function was last called
+increased by more than one since this function was last called, not counting
+ticks skipped on purpose by a tickless sleep
+- The violation is added to the profiler's history (debug command 07)
 
 */
 void SystemTimeCheck(void)
 {    
    static u32 u32PreviousSystemTick = 0;
+   u32 u32ElapsedMs = G_u32SystemTime1ms - u32PreviousSystemTick - Bsp_u32TicklessMs;
    
   /* Check system timing */
-  if( (G_u32SystemTime1ms - u32PreviousSystemTick) != 1)
+  Bsp_u32TicklessMs = 0;
+  if(u32ElapsedMs != 1)
   {
     /* Flag, count and optionally display warning */
     Bsp_u32TimingViolationsCounter++;
     G_u32SystemFlags |= _SYSTEM_TIME_WARNING;
+    TOKENLOG2(TOKENLOG_TIMING_VIOLATION, Bsp_u32TimingViolationsCounter, u32ElapsedMs);
+    TRACE(TRACE_TIMING_VIOLATION, u32ElapsedMs);
+    ProfilerTimingViolation(Bsp_u32TimingViolationsCounter, u32ElapsedMs);
     
     if(G_u32DebugFlags & _DEBUG_TIME_WARNING_ENABLE)
     {
-      DebugPrintf("\n\r*** 1ms timing violation: ");
-      DebugPrintNumber(Bsp_u32TimingViolationsCounter);
-      DebugLineFeed();
+      DebugPrintFormat("\n\r*** 1ms timing violation: %u\n\r", Bsp_u32TimingViolationsCounter);
     }
   }
   
@@ -333,9 +521,16 @@ void SystemTimeCheck(void)
 _SYSTEM_SLEEPING is set here so if the system wakes up because of a non-Systick
 interrupt, it can go back to sleep.
 
-Deep sleep mode is currently disabled, so maximum processor power savings are 
-not yet realized.  To enable deep sleep, there are certain considerations for 
-waking up that must be taken care of.
+With TICKLESS_IDLE defined, if the scheduler reports that no task needs the 
+next ticks (every task is event-driven, none is signalled and no 
+SchedulerSignalAt() time is near) the ticks are skipped with one long SysTick 
+period instead of waking every ms.
+
+With DEEP_SLEEP also defined, idle times of WAIT_MODE_MIN_MS or more use wait 
+mode instead: the core and peripheral clocks stop and the RTT alarm, a button 
+or a debug character ends the sleep.  Wait mode is skipped while any 
+_SYSTEM_CLOCK_NO_STOP_xxx flag, SystemDeepSleepVeto() or SystemDeepSleepHoldoff() 
+is active, and until the RTT rate has been measured.
 
 Requires:
 - SysTick is running with interrupt enabled for wake from Sleep LPM
@@ -348,6 +543,10 @@ Promises:
 */
 void SystemSleep(void)
 {    
+#ifdef TICKLESS_IDLE
+  u32 u32IdleMs;
+#endif /* TICKLESS_IDLE */
+
   /* Set the system control register for Sleep (but not Deep Sleep) */
   AT91C_BASE_PMC->PMC_FSMR &= ~AT91C_PMC_LPM;
   AT91C_BASE_NVIC->NVIC_SCR &= ~AT91C_NVIC_SLEEPDEEP;
@@ -355,6 +554,32 @@ void SystemSleep(void)
   /* Set the sleep flag (cleared only in SysTick ISR */
   G_u32SystemFlags |= _SYSTEM_SLEEPING;
 
+#ifdef TICKLESS_IDLE
+#ifdef DEEP_SLEEP
+  SystemRttCalibrate();
+#endif /* DEEP_SLEEP */
+
+  /* Interrupts are held off while deciding so an event cannot slip in before the sleep */
+  __disable_irq();
+  u32IdleMs = SchedulerIdleTime(SYSTICK_MAX_IDLE_MS);
+  if( (u32IdleMs > 1) && (G_u32SystemFlags & _SYSTEM_SLEEPING) )
+  {
+#ifdef DEEP_SLEEP
+    if( (u32IdleMs >= WAIT_MODE_MIN_MS) && SystemDeepSleepAllowed() )
+    {
+      SystemSleepWait(u32IdleMs);
+    }
+    else
+    {
+      SystemSleepTickless(u32IdleMs);
+    }
+#else
+    SystemSleepTickless(u32IdleMs);
+#endif /* DEEP_SLEEP */
+  }
+  __enable_irq();
+#endif /* TICKLESS_IDLE */
+
   /* Now enter the selected LPM */
   while(G_u32SystemFlags & _SYSTEM_SLEEPING)
   {
@@ -487,6 +712,359 @@ void PWMSetupAudio(void)
 } /* end PWMSetupAudio() */
 
 
+/*--------------------------------------------------------------------------------------------------------------------*/
+/*! @privatesection */                                                                                            
+/*--------------------------------------------------------------------------------------------------------------------*/
+
+/*!---------------------------------------------------------------------------------------------------------------------
+@fn static void ClockStartPll(void)
+
+@brief Runs the master clock from PLLA off the crystal.
+
+Used by ClockSetup() and again on the way out of wait mode, when the crystal is 
+still running and only PLLA has to lock again.
+
+Requires:
+- MCK is MAINCK (PMC_MCKR_INIT or the reset value)
+
+Promises:
+- MCK is PLLACK / 2 (48MHz)
+
+*/
+static void ClockStartPll(void)
+{
+  /* Turn on the main oscillator and wait for it to start up */
+  AT91C_BASE_PMC->PMC_MOR = PMC_MOR_INIT;
+  while ( !(AT91C_BASE_PMC->PMC_SR & AT91C_PMC_MOSCXTS) );
+
+  /* Assign main clock as crystal */
+  AT91C_BASE_PMC->PMC_MOR |= (AT91C_CKGR_MOSCSEL | MOR_KEY);
+  
+  /* Initialize PLLA and wait for lock */
+  AT91C_BASE_PMC->PMC_PLLAR = PMC_PLAAR_INIT;
+  while ( !(AT91C_BASE_PMC->PMC_SR & AT91C_PMC_LOCKA) );
+  
+  /* Assign the PLLA as the main system clock with prescaler active using the sequence suggested on pg. 472 */
+  AT91C_BASE_PMC->PMC_MCKR = PMC_MCKR_INIT;
+  while ( !(AT91C_BASE_PMC->PMC_SR & AT91C_PMC_MCKRDY) );
+  AT91C_BASE_PMC->PMC_MCKR = PMC_MCKR_PLLA;
+  while ( !(AT91C_BASE_PMC->PMC_SR & AT91C_PMC_MCKRDY) );
+
+} /* end ClockStartPll() */
+
+
+/*!---------------------------------------------------------------------------------------------------------------------
+@fn static void SystemSleepTickless(u32 u32IdleMs_)
+
+@brief Sleeps through ticks that no task needs with one long SysTick period.
+
+The counts already done in the current ms are kept so the tick phase does not drift.  
+On wake-up (the long period ended, or another interrupt came first) the elapsed time is 
+measured from the SysTick counter and handed to SystemTickResume().
+
+Requires:
+- Interrupts are disabled; WFI still wakes on a pending interrupt
+- _SYSTEM_SLEEPING is set
+@param u32IdleMs_ is the number of ticks to skip, 2 to SYSTICK_MAX_IDLE_MS
+
+Promises:
+- SysTick is back to 1ms periods in phase with the ticks before the sleep
+- If at least 1ms passed, the SysTick interrupt is pending with G_u32ISRTickStepMs set to the ms that passed
+- Bsp_u32TicklessMs holds the extra ms SystemTimeCheck() should expect
+
+*/
+static void SystemSleepTickless(u32 u32IdleMs_)
+{
+  u32 u32Offset;
+  u32 u32Period;
+  u32 u32Status;
+
+  /* Stop the tick, unless it has just expired in which case there is nothing to skip */
+  AT91C_BASE_NVIC->NVIC_STICKCSR = SYSTICK_CTRL_INIT & ~AT91C_NVIC_STICKENABLE;
+  if( (AT91C_BASE_NVIC->NVIC_ICSR & AT91C_NVIC_PENDSTSET) || 
+      (AT91C_BASE_NVIC->NVIC_STICKCSR & AT91C_NVIC_STICKCOUNTFLAG) )
+  {
+    AT91C_BASE_NVIC->NVIC_STICKCSR = SYSTICK_CTRL_INIT;
+    return;
+  }
+
+  /* One long period from here to the end of the idle time.  Wait for the counter to load so an 
+  interrupt that is already pending does not read as a full period. */
+  u32Offset = SYSTICK_COUNT - 1 - AT91C_BASE_NVIC->NVIC_STICKCVR;
+  u32Period = (u32IdleMs_ * SYSTICK_COUNT) - u32Offset;
+  AT91C_BASE_NVIC->NVIC_STICKRVR = u32Period - 1;
+  AT91C_BASE_NVIC->NVIC_STICKCVR = 0;
+  AT91C_BASE_NVIC->NVIC_STICKCSR = SYSTICK_CTRL_INIT;
+  while(AT91C_BASE_NVIC->NVIC_STICKCVR == 0);
+
+  __DSB();
+  __WFI();
+
+  /* Measure the counts since the last 1ms boundary before the sleep */
+  u32Status = AT91C_BASE_NVIC->NVIC_STICKCSR;
+  AT91C_BASE_NVIC->NVIC_STICKCSR = SYSTICK_CTRL_INIT & ~AT91C_NVIC_STICKENABLE;
+  u32Offset += (u32Period - 1) - AT91C_BASE_NVIC->NVIC_STICKCVR;
+  if(u32Status & AT91C_NVIC_STICKCOUNTFLAG)
+  {
+    u32Offset += u32Period;
+  }
+  
+  SystemTickResume(u32Offset);
+
+} /* end SystemSleepTickless() */
+
+
+/*!---------------------------------------------------------------------------------------------------------------------
+@fn static void SystemSleepWait(u32 u32IdleMs_)
+
+@brief Sleeps in wait mode with the RTT alarm set for the end of the idle time.
+
+SysTick stops with the core clock, so the time asleep is measured with the RTT and 
+converted to SysTick counts at the rate measured by SystemRttCalibrate().  The master 
+clock runs from the fast RC on the way in and out; PLLA is stopped but the crystal is 
+left running because its start-up time (MOSCXTST) is longer than most sleeps.  The 
+alarm is set WAIT_MODE_WAKEUP_MS early to cover the PLLA lock time.
+
+Besides the RTT alarm, any interrupt that becomes pending ends the sleep (SEVONPEND), 
+as do the fast startup inputs in WAIT_MODE_FSTT_INIT (the buttons and debug RXD0).  
+The PIO and USART clocks are stopped, so the press is seen by the button task once the 
+clocks are back, but the debug character whose start bit ended the sleep is lost.  Any 
+wake-up before the alarm holds off wait mode for WAIT_MODE_HOLDOFF_MS, and the debug 
+task extends that with each character received, so the rest of a command gets through.
+
+Requires:
+- Interrupts are disabled
+- _SYSTEM_SLEEPING is set and SystemDeepSleepAllowed() is TRUE
+@param u32IdleMs_ is the number of ticks to skip, WAIT_MODE_MIN_MS or more (at most WAIT_MODE_MAX_MS are used)
+
+Promises:
+- MCK is back to 48MHz from PLLA
+- SysTick is running as SystemTickResume() promises
+- The RTT calibration window restarts
+- If the sleep ended before the RTT alarm, the wait mode holdoff restarts
+
+*/
+static void SystemSleepWait(u32 u32IdleMs_)
+{
+  u32 u32Offset;
+  u32 u32Start;
+  u32 u32RttCounts;
+  u32 u32Status;
+
+  /* An interrupt that is already pending would not end a WFE, so do not start */
+  if(AT91C_BASE_NVIC->NVIC_ISPR[0] & AT91C_BASE_NVIC->NVIC_ISER[0])
+  {
+    return;
+  }
+
+  /* Stop the tick, unless it has just expired in which case there is nothing to skip */
+  AT91C_BASE_NVIC->NVIC_STICKCSR = SYSTICK_CTRL_INIT & ~AT91C_NVIC_STICKENABLE;
+  if( (AT91C_BASE_NVIC->NVIC_ICSR & AT91C_NVIC_PENDSTSET) || 
+      (AT91C_BASE_NVIC->NVIC_STICKCSR & AT91C_NVIC_STICKCOUNTFLAG) )
+  {
+    AT91C_BASE_NVIC->NVIC_STICKCSR = SYSTICK_CTRL_INIT;
+    return;
+  }
+
+  if(u32IdleMs_ > WAIT_MODE_MAX_MS)
+  {
+    u32IdleMs_ = WAIT_MODE_MAX_MS;
+  }
+
+  /* Alarm at the end of the idle time less the part of this ms already done and the wake-up time */
+  u32Offset = SYSTICK_COUNT - 1 - AT91C_BASE_NVIC->NVIC_STICKCVR;
+  u32RttCounts = ((((u32IdleMs_ - WAIT_MODE_WAKEUP_MS) * SYSTICK_COUNT) - u32Offset) << 8) / Bsp_u32RttRate;
+  u32Start = SystemRttRead();
+  AT91C_BASE_RTTC->RTTC_RTAR = u32Start + u32RttCounts - 1;
+  AT91C_BASE_RTTC->RTTC_RTMR = RTT_PRESCALER | AT91C_RTTC_ALMIEN;
+
+  /* MCK to MAINCK, MAINCK to the fast RC, then stop PLLA */
+  AT91C_BASE_PMC->PMC_MCKR = PMC_MCKR_INIT;
+  while ( !(AT91C_BASE_PMC->PMC_SR & AT91C_PMC_MCKRDY) );
+  AT91C_BASE_PMC->PMC_MOR = PMC_MOR_INIT;
+  while ( !(AT91C_BASE_PMC->PMC_SR & AT91C_PMC_MOSCSELS) );
+  AT91C_BASE_PMC->PMC_PLLAR = PMC_PLLAR_OFF;
+
+  /* Wait mode is WFE with LPM set.  The first WFE only clears any earlier event. */
+  AT91C_BASE_PMC->PMC_FSPR = WAIT_MODE_FSPR_INIT;
+  AT91C_BASE_PMC->PMC_FSMR = WAIT_MODE_FSTT_INIT | AT91C_PMC_LPM;
+  AT91C_BASE_NVIC->NVIC_SCR |= AT91C_NVIC_SEVONPEND;
+  __SEV();
+  __WFE();
+  __WFE();
+  AT91C_BASE_NVIC->NVIC_SCR &= ~AT91C_NVIC_SEVONPEND;
+  AT91C_BASE_PMC->PMC_FSMR &= ~AT91C_PMC_LPM;
+
+  ClockStartPll();
+
+  /* Measure the sleep including the PLLA lock and clear the alarm.  Reading the status clears it. */
+  u32RttCounts = SystemRttRead() - u32Start;
+  AT91C_BASE_RTTC->RTTC_RTMR = RTT_PRESCALER;
+  AT91C_BASE_RTTC->RTTC_RTAR = RTT_ALARM_OFF;
+  u32Status = AT91C_BASE_RTTC->RTTC_RTSR;
+  AT91C_BASE_NVIC->NVIC_ICPR[0] = ((u32)1 << AT91C_ID_RTT);
+
+  SystemTickResume(u32Offset + ((u32RttCounts * Bsp_u32RttRate) >> 8));
+
+  /* The window has to be awake time measured by SysTick alone */
+  Bsp_u32RttReference = SystemRttRead();
+  Bsp_u32RttReferenceMs = G_u32SystemTime1ms + G_u32ISRTickStepMs;
+
+  /* Woken early by a button, a debug character or another interrupt: more is likely to follow */
+  if( !(u32Status & AT91C_RTTC_ALMS) )
+  {
+    Bsp_u32DeepSleepHoldoff = Bsp_u32RttReferenceMs;
+  }
+
+} /* end SystemSleepWait() */
+
+
+/*!---------------------------------------------------------------------------------------------------------------------
+@fn static void SystemTickResume(u32 u32Counts_)
+
+@brief Restarts SysTick after a tickless or wait mode sleep and credits the ticks that passed.
+
+SysTick is restarted to end the current ms on time, and the whole ms that passed are 
+handed to SysTick_Handler() through G_u32ISRTickStepMs.
+
+Requires:
+- Interrupts are disabled and SysTick is stopped
+@param u32Counts_ is the number of SysTick counts since the last 1ms boundary before the sleep
+
+Promises:
+- SysTick is back to 1ms periods in phase with the ticks before the sleep
+- If at least 1ms passed, the SysTick interrupt is pending with G_u32ISRTickStepMs set to the ms that passed
+- Bsp_u32TicklessMs holds the extra ms SystemTimeCheck() should expect
+
+*/
+static void SystemTickResume(u32 u32Counts_)
+{
+  u32 u32Offset;
+  u32 u32Period;
+  u32 u32ElapsedMs;
+
+  u32ElapsedMs = u32Counts_ / SYSTICK_COUNT;
+  u32Offset    = u32Counts_ % SYSTICK_COUNT;
+
+  /* Finish the current ms, then back to 1ms periods.  A boundary only a few counts away is taken now. */
+  u32Period = SYSTICK_COUNT - u32Offset;
+  if(u32Period < SYSTICK_TICKLESS_MIN_COUNTS)
+  {
+    u32Period += SYSTICK_COUNT;
+    u32ElapsedMs++;
+  }
+  
+  AT91C_BASE_NVIC->NVIC_STICKRVR = u32Period - 1;
+  AT91C_BASE_NVIC->NVIC_STICKCVR = 0;
+  AT91C_BASE_NVIC->NVIC_STICKCSR = SYSTICK_CTRL_INIT;
+  while(AT91C_BASE_NVIC->NVIC_STICKCVR == 0);
+  AT91C_BASE_NVIC->NVIC_STICKRVR = (u32)SYSTICK_COUNT - 1;
+
+  /* SysTick_Handler() catches the system time up as soon as interrupts are enabled */
+  Bsp_u32TicklessMs = 0;
+  if(u32ElapsedMs != 0)
+  {
+    G_u32ISRTickStepMs = u32ElapsedMs;
+    AT91C_BASE_NVIC->NVIC_ICSR = AT91C_NVIC_PENDSTSET;
+    Bsp_u32TicklessMs = u32ElapsedMs - 1;
+  }
+  
+} /* end SystemTickResume() */
+
+
+/*!---------------------------------------------------------------------------------------------------------------------
+@fn static u32 SystemRttRead(void)
+
+@brief Reads the RTT value.
+
+RTTC_RTVR changes asynchronously to MCK, so it is read until two reads agree.
+
+Requires:
+- RealTimeClockSetup() has run
+
+Promises:
+- Returns the current RTT value
+
+*/
+static u32 SystemRttRead(void)
+{
+  u32 u32Value;
+
+  do
+  {
+    u32Value = AT91C_BASE_RTTC->RTTC_RTVR;
+  } while(u32Value != AT91C_BASE_RTTC->RTTC_RTVR);
+
+  return u32Value;
+
+} /* end SystemRttRead() */
+
+
+/*!---------------------------------------------------------------------------------------------------------------------
+@fn static void SystemRttCalibrate(void)
+
+@brief Measures the RTT rate against SysTick once every RTT_CALIBRATION_MS of awake time.
+
+The rate follows the slow RC as it drifts with temperature and supply.  It is kept as 
+SysTick counts per RTT count x 256 so both conversions in SystemSleepWait() fit in 32 bits.
+
+Requires:
+- Called once per pass from SystemSleep()
+
+Promises:
+- Bsp_u32RttRate is updated at the end of each window and a new window starts
+
+*/
+static void SystemRttCalibrate(void)
+{
+  u32 u32WindowMs = G_u32SystemTime1ms - Bsp_u32RttReferenceMs;
+  u32 u32RttCounts;
+  u32 u32SysTickCounts;
+  u32 u32Rtt;
+
+  if( ((s32)u32WindowMs < 0) || (u32WindowMs < RTT_CALIBRATION_MS) )
+  {
+    return;
+  }
+
+  u32Rtt = SystemRttRead();
+  u32RttCounts = u32Rtt - Bsp_u32RttReference;
+  if(u32RttCounts != 0)
+  {
+    u32SysTickCounts = u32WindowMs * SYSTICK_COUNT;
+    Bsp_u32RttRate = ((u32SysTickCounts / u32RttCounts) << 8) + 
+                     (((u32SysTickCounts % u32RttCounts) << 8) / u32RttCounts);
+  }
+
+  Bsp_u32RttReference = u32Rtt;
+  Bsp_u32RttReferenceMs = G_u32SystemTime1ms;
+
+} /* end SystemRttCalibrate() */
+
+
+/*!---------------------------------------------------------------------------------------------------------------------
+@fn static bool SystemDeepSleepAllowed(void)
+
+@brief Checks that nothing holds off wait mode.
+
+Requires:
+- NONE
+
+Promises:
+- Returns TRUE if the RTT rate is known, no _SYSTEM_CLOCK_NO_STOP_xxx flag is set, 
+  no peripheral has called SystemDeepSleepVeto() and no holdoff is running
+
+*/
+static bool SystemDeepSleepAllowed(void)
+{
+  return( (Bsp_u32RttRate != 0) && 
+          !(G_u32SystemFlags & _SYSTEM_CLOCK_NO_STOP_MASK) &&
+          (Bsp_u32DeepSleepVetoes == 0) &&
+          IsTimeUp(&Bsp_u32DeepSleepHoldoff, WAIT_MODE_HOLDOFF_MS) );
+
+} /* end SystemDeepSleepAllowed() */
+
+
 
 
 /*--------------------------------------------------------------------------------------------------------------------*/
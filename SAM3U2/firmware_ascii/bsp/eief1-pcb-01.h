@@ -46,6 +46,19 @@ Type Definitions
 Should be 6000 for 48MHz CCLK. */
 #define SYSTICK_COUNT             (u32)(0.001 * (CCLK_VALUE / SYSTICK_DIVIDER) )
 
+#define SYSTICK_COUNTS_PER_US     (s32)(SYSTICK_COUNT / 1000)                /*!< @brief SysTick counts per microsecond (6) */
+#define SYSTICK_MAX_IDLE_MS       (u32)(AT91C_NVIC_STICKRELOAD / SYSTICK_COUNT) /*!< @brief Longest tickless sleep the 24-bit counter allows (2796) */
+#define SYSTICK_TICKLESS_MIN_COUNTS (u32)16                                  /*!< @brief Shortest SysTick period set after a tickless sleep */
+
+#define RTT_PRESCALER             (u32)3                                     /*!< @brief RTT counts SLCK / 3 (about 94us) */
+#define RTT_ALARM_OFF             (u32)0xFFFFFFFF                            /*!< @brief RTT alarm value that is never reached */
+#define RTT_CALIBRATION_MS        (u32)2048                                  /*!< @brief Awake time over which the RTT is measured against SysTick */
+
+#define WAIT_MODE_MIN_MS          (u32)20                                    /*!< @brief Shortest idle time that uses wait mode instead of tickless sleep */
+#define WAIT_MODE_MAX_MS          (u32)100                                   /*!< @brief Longest wait mode sleep so polled inputs are still seen promptly */
+#define WAIT_MODE_WAKEUP_MS       (u32)3                                     /*!< @brief Time to restart PLLA after wait mode (PLLACOUNT 63 SLCK) */
+#define WAIT_MODE_HOLDOFF_MS      (u32)2000                                  /*!< @brief No wait mode for this long after a wake-up input or debug character */
+
 
 /***********************************************************************************************************************
 * Macros
@@ -67,6 +80,11 @@ Should be 6000 for 48MHz CCLK. */
 void PWMAudioSetFrequency(u32 u32Channel_, u16 u16Frequency_);
 void PWMAudioOn(u32 u32Channel_);
 void PWMAudioOff(u32 u32Channel_);
+void SystemDeepSleepVeto(u8 u8PeripheralId_);
+void SystemDeepSleepRelease(u8 u8PeripheralId_);
+void SystemDeepSleepHoldoff(void);
+u64 SystemGetTimeMs(void);
+u64 SystemGetTimeUs(void);
 
 
 /*------------------------------------------------------------------------------------------------------------------*/
@@ -83,6 +101,18 @@ void GpioSetup(void);
 void PWMSetupAudio(void);
 
 
+/*------------------------------------------------------------------------------------------------------------------*/
+/*! @privatesection */                                                                                            
+/*--------------------------------------------------------------------------------------------------------------------*/
+static void ClockStartPll(void);
+static void SystemSleepTickless(u32 u32IdleMs_);
+static void SystemSleepWait(u32 u32IdleMs_);
+static void SystemTickResume(u32 u32Counts_);
+static u32 SystemRttRead(void);
+static void SystemRttCalibrate(void);
+static bool SystemDeepSleepAllowed(void);
+
+
 /***********************************************************************************************************************
 !!!!! GPIO pin names
 ***********************************************************************************************************************/
@@ -356,6 +386,62 @@ Since we want PLLACK at 96 MHz:
 #define SLEEP_MODE_STATUS_CLEAR (u32)0xfffff0ff
 
 
+#define PMC_PLLAR_OFF (u32)0x20000000
+/* PMC_PLAAR_INIT with MULA = 0, which stops PLLA (bit 29 must always be written 1) */
+
+
+#define WAIT_MODE_FSTT_INIT (u32)0x0001E140
+/* Fast startup inputs that end wait mode (PMC_FSMR).  The RTT alarm always ends it, and so do the 
+buttons and the debug receive line since the PIO and USART clocks are stopped in wait mode.  
+The blade UART receive line (PA_11) is not a WKUP pin.
+    31 [0] Reserved
+    30 [0] "
+    29 [0] "
+    28 [0] "
+
+    27 [0] "
+    26 [0] "
+    25 [0] "
+    24 [0] "
+
+    23 [0] "
+    22 [0] "
+    21 [0] "
+    20 [0] LPM is set by SystemSleepWait() on entry
+
+    19 [0] Reserved
+    18 [0] USBAL USB alarm does not end wait mode
+    17 [0] RTCAL RTC alarm does not end wait mode
+    16 [1] RTTAL RTT alarm ends wait mode
+
+    15 [1] FSTT15 WKUP15 PB_02_BUTTON3
+    14 [1] FSTT14 WKUP14 PB_01_BUTTON2
+    13 [1] FSTT13 WKUP13 PB_00_BUTTON1
+    12 [0] FSTT12 WKUP12 PA_25_ANT_USPI2_SCK
+
+    11 [0] FSTT11 WKUP11 PA_24_SD_USPI1_SCK
+    10 [0] FSTT10 WKUP10 PA_21_SD_USPI1_MISO
+    09 [0] FSTT9 WKUP9 PA_20_SD_USPI1_MOSI
+    08 [1] FSTT8 WKUP8 PA_19_DEBUG_U0_PIMO (RXD0)
+
+    07 [0] FSTT7 WKUP7 PA_18_DEBUG_U0_POMI
+    06 [1] FSTT6 WKUP6 PA_17_BUTTON0
+    05 [0] FSTT5 WKUP5 PA_16_BLADE_CS
+    04 [0] FSTT4 WKUP4 PA_10_I2C_SCL
+
+    03 [0] FSTT3 WKUP3 PA_09_I2C_SDA
+    02 [0] FSTT2 WKUP2 PA_02_SD_DETECT
+    01 [0] FSTT1 WKUP1 PA_01_SD_WP
+    00 [0] FSTT0 WKUP0 PA_00_TP54
+*/
+
+#define WAIT_MODE_FSPR_INIT (u32)0x00000000
+/* Fast startup polarity (PMC_FSPR): every input in WAIT_MODE_FSTT_INIT is active low.  The 
+buttons pull their lines low when pressed and a start bit pulls RXD0 low.
+ 15:00 [0] FSTP0-15 wake-up input active when low
+*/
+
+
 #define SYSTICK_CTRL_INIT (u32)0x00000003
 /* Bit Set Description
     31:20 Reserved 
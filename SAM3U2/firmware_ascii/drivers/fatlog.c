@@ -0,0 +1,1423 @@
+/*!*********************************************************************************************************************
+@file fatlog.c
+@brief Append-only log file writer for a FAT32 formatted SD card.
+
+The task creates one file in the root directory of the card and streams data into it.  It is tuned for
+continuous appends rather than general file access:
+
+- Clusters are reserved FATLOG_PREALLOC_CLUSTERS at a time as one contiguous extent, so the FAT is only
+written when a new extent is needed instead of every time a cluster fills.  Data sectors inside an extent
+are consecutive and need no FAT lookups.
+- The directory entry sector is cached in RAM and only written on a flush, so the file size is not
+rewritten for every sector of data.
+- A flush happens at least every FATLOG_FLUSH_PERIOD_MS while data is arriving.  If power is lost, at most
+that much data plus the RAM buffer (FATLOG_BUFFER_SIZE) is missing from the file on a PC.
+- Full sectors that are consecutive on the card and in the buffer go to the SD task as one multi-block
+write instead of one request per sector.
+- Reserved clusters that were not used are released when the file is closed.
+
+Limitations: FAT32 only with 512 byte sectors, the root directory is searched along its cluster chain but
+never extended (the open fails if every entry is used), and the FSInfo free cluster count is marked unknown
+so the host recalculates it.
+
+------------------------------------------------------------------------------------------------------------------------
+GLOBALS
+- NONE
+
+CONSTANTS
+- FATLOG_BUFFER_SECTORS, FATLOG_PREALLOC_CLUSTERS, FATLOG_FLUSH_PERIOD_MS
+
+TYPES
+- FatLogStatusType
+
+PUBLIC FUNCTIONS
+- bool FatLogOpen(u8* pu8FileName_)
+- u32 FatLogWrite(u8* pu8Data_, u32 u32Size_)
+- void FatLogFlush(void)
+- bool FatLogClose(void)
+- FatLogStatusType FatLogGetStatus(void)
+
+PROTECTED FUNCTIONS
+- void FatLogInitialize(void)
+- void FatLogRunActiveState(void)
+
+
+**********************************************************************************************************************/
+
+#include "configuration.h"
+
+/***********************************************************************************************************************
+Global variable definitions with scope across entire project.
+All Global variable names shall start with "G_<type>FatLog"
+***********************************************************************************************************************/
+/* New variables */
+
+
+/*--------------------------------------------------------------------------------------------------------------------*/
+/* Existing variables (defined in other files -- should all contain the "extern" keyword) */
+extern volatile u32 G_u32SystemTime1ms;                   /*!< @brief From main.c */
+extern volatile u32 G_u32SystemTime1s;                    /*!< @brief From main.c */
+extern volatile u32 G_u32SystemFlags;                     /*!< @brief From main.c */
+extern volatile u32 G_u32ApplicationFlags;                /*!< @brief From main.c */
+extern u32 G_au32DebugLogMask[];                          /*!< @brief From debug.c */
+
+
+/***********************************************************************************************************************
+Global variable definitions with scope limited to this local application.
+Variable names shall start with "FatLog_<type>" and be declared as static.
+***********************************************************************************************************************/
+static fnCode_type FatLog_pfStateMachine;                 /*!< @brief The state machine function pointer */
+static fnCode_type FatLog_pfIoReturnState;                /*!< @brief State to run when the current sector access is done */
+static fnCode_type FatLog_pfAllocReturnState;             /*!< @brief State to run when a new extent is ready */
+static fnCode_type FatLog_pfChainReturnState;             /*!< @brief State to run when a FAT chain update is done */
+
+static u32 FatLog_u32Flags;                               /*!< @brief Task flags */
+static FatLogStatusType FatLog_eStatus;                   /*!< @brief Status reported to the client */
+static u32 FatLog_u32Timeout;                             /*!< @brief Timeout counter used across states */
+static u32 FatLog_u32IoSector;                            /*!< @brief Sector for the current read or write */
+static u32 FatLog_u32IoSectors;                           /*!< @brief Consecutive sectors in the current write */
+static u8* FatLog_pu8IoBuffer;                            /*!< @brief Buffer for the current read or write */
+static u32 FatLog_u32IoToken;                             /*!< @brief SD request token for the current read or write */
+
+static u8 FatLog_au8Scratch[FATLOG_SECTOR_SIZE];          /*!< @brief Working sector for boot, FSInfo, FAT and directory scans */
+static u8 FatLog_au8DirSector[FATLOG_SECTOR_SIZE];        /*!< @brief Cached sector holding the file's directory entry */
+static u8 FatLog_au8Buffer[FATLOG_BUFFER_SIZE];           /*!< @brief Ring of data sectors waiting to be written */
+
+/* Volume geometry */
+static u32 FatLog_u32PartitionSector;                     /*!< @brief First sector of the FAT32 volume */
+static u32 FatLog_u32FatSector;                           /*!< @brief First sector of the first FAT */
+static u32 FatLog_u32FatSize;                             /*!< @brief Sectors in one FAT */
+static u32 FatLog_u32NumFats;                             /*!< @brief Number of FAT copies */
+static u32 FatLog_u32DataSector;                          /*!< @brief First sector of cluster 2 */
+static u32 FatLog_u32SectorsPerCluster;                   /*!< @brief Sectors in one cluster */
+static u32 FatLog_u32MaxCluster;                          /*!< @brief Highest valid cluster number */
+static u32 FatLog_u32RootCluster;                         /*!< @brief First cluster of the root directory */
+static u32 FatLog_u32FsInfoSector;                        /*!< @brief Sector of the FSInfo structure */
+static u32 FatLog_u32NextFreeHint;                        /*!< @brief Cluster where the next free space search starts */
+
+/* File */
+static u8 FatLog_au8FileName[FATLOG_NAME_SIZE];           /*!< @brief 8.3 name of the file in directory format */
+static u8 FatLog_au8HighestName[FATLOG_NAME_SIZE];        /*!< @brief Highest existing name in the same sequence */
+static u8 FatLog_u8DigitStart;                            /*!< @brief Index of the sequence digits in the base name */
+static u32 FatLog_u32DirScanCluster;                      /*!< @brief Root directory cluster being scanned */
+static u32 FatLog_u32DirScanSector;                       /*!< @brief Index of the directory sector being scanned in the cluster */
+static u32 FatLog_u32DirEntrySector;                      /*!< @brief Sector of the file's directory entry */
+static u32 FatLog_u32DirEntryOffset;                      /*!< @brief Byte offset of the entry in the directory sector */
+static u32 FatLog_u32FirstCluster;                        /*!< @brief First cluster of the file */
+static u32 FatLog_u32ExtentCluster;                       /*!< @brief First cluster of the current extent */
+static u32 FatLog_u32ExtentClusters;                      /*!< @brief Clusters in the current extent */
+static u32 FatLog_u32ExtentFileSector;                    /*!< @brief File sector number at the start of the current extent */
+static u32 FatLog_u32AcceptedBytes;                       /*!< @brief Bytes taken from the client */
+static u32 FatLog_u32WrittenBytes;                        /*!< @brief Bytes on the card in complete sectors */
+static u32 FatLog_u32FileSize;                            /*!< @brief Size currently recorded in the directory entry */
+static u32 FatLog_u32FlushTarget;                         /*!< @brief Size being recorded by the current flush */
+static u32 FatLog_u32FlushTimer;                          /*!< @brief Time of the last flush */
+static u32 FatLog_u32KeepCluster;                         /*!< @brief Last cluster that holds data when closing */
+
+/* Free space search and chain updates */
+static u32 FatLog_u32SearchCluster;                       /*!< @brief Next cluster to check for free space */
+static u32 FatLog_u32SearchRemaining;                     /*!< @brief Clusters not yet checked */
+static u32 FatLog_u32RunStart;                            /*!< @brief First cluster of the current free run */
+static u32 FatLog_u32RunLength;                           /*!< @brief Length of the current free run */
+static u32 FatLog_u32BestStart;                           /*!< @brief First cluster of the longest free run */
+static u32 FatLog_u32BestLength;                          /*!< @brief Length of the longest free run */
+static u32 FatLog_u32PreviousTail;                        /*!< @brief Last cluster of the previous extent (0 if none) */
+static u32 FatLog_u32ChainCluster;                        /*!< @brief Next cluster to update in the FAT */
+static u32 FatLog_u32ChainLast;                           /*!< @brief Last cluster to update in the FAT */
+static u32 FatLog_u32ChainTail;                           /*!< @brief Value written to the last cluster entry */
+static u32 FatLog_u32ChainFatSector;                      /*!< @brief FAT sector index being updated */
+static u32 FatLog_u32ChainCopy;                           /*!< @brief FAT copy being written */
+
+static u8 FatLog_au8ErrorNoCard[]   = "FatLog: card not ready\n\r";
+static u8 FatLog_au8ErrorIo[]       = "FatLog: card access failed\n\r";
+static u8 FatLog_au8ErrorVolume[]   = "FatLog: no FAT32 volume\n\r";
+static u8 FatLog_au8ErrorDirFull[]  = "FatLog: directory full\n\r";
+static u8 FatLog_au8ErrorNoName[]   = "FatLog: file sequence used up\n\r";
+static u8 FatLog_au8ErrorDiskFull[] = "FatLog: card full\n\r";
+static u8* FatLog_pu8ErrorMessage;                        /*!< @brief Message printed by the error state */
+
+
+/**********************************************************************************************************************
+Function Definitions
+**********************************************************************************************************************/
+
+/*--------------------------------------------------------------------------------------------------------------------*/
+/*! @publicsection */
+/*--------------------------------------------------------------------------------------------------------------------*/
+
+/*!----------------------------------------------------------------------------------------------------------------------
+@fn bool FatLogOpen(u8* pu8FileName_)
+
+@brief Requests a new log file in the root directory of the card.
+
+The name is in 8.3 directory format with no dot, space padded, e.g. "LOG00000CSV".  The base name must
+end in at least one digit: the digits at its end are a sequence number, and if files from the same
+sequence already exist, the new file takes the next number so earlier logs are never overwritten.
+
+Requires:
+@param pu8FileName_ points to FATLOG_NAME_SIZE upper case characters
+
+Promises:
+- If no file is open, the request is accepted, status goes to FATLOG_OPENING and TRUE is returned.
+  Status becomes FATLOG_OPEN once the file exists on the card or FATLOG_ERROR if it cannot be made
+  (including when every number of the sequence is already used).
+- Data may be written with FatLogWrite() while the file is opening.
+- Returns FALSE if a file is already open or the base name does not end in a digit
+
+*/
+bool FatLogOpen(u8* pu8FileName_)
+{
+  if( (FatLog_eStatus != FATLOG_CLOSED) && (FatLog_eStatus != FATLOG_ERROR) )
+  {
+    return FALSE;
+  }
+
+  /* Without sequence digits a second file would get the same name as the first */
+  if( (pu8FileName_[FATLOG_BASE_NAME_SIZE - 1] < '0') || (pu8FileName_[FATLOG_BASE_NAME_SIZE - 1] > '9') )
+  {
+    return FALSE;
+  }
+
+  for(u8 i = 0; i < FATLOG_NAME_SIZE; i++)
+  {
+    FatLog_au8FileName[i] = pu8FileName_[i];
+  }
+
+  FatLog_u32AcceptedBytes = 0;
+  FatLog_u32WrittenBytes  = 0;
+  FatLog_u32FileSize      = 0;
+  FatLog_u32Flags = _FATLOG_OPEN_REQUEST;
+  FatLog_eStatus = FATLOG_OPENING;
+  SchedulerSignal(PROFILER_TASK_FATLOG);
+
+  return TRUE;
+
+} /* end FatLogOpen() */
+
+
+/*!----------------------------------------------------------------------------------------------------------------------
+@fn u32 FatLogWrite(u8* pu8Data_, u32 u32Size_)
+
+@brief Appends data to the log file.
+
+The data is copied into the RAM buffer and written to the card in whole sectors by the task.
+
+Requires:
+@param pu8Data_ points to the data to append
+@param u32Size_ is the number of bytes to append
+
+Promises:
+- Copies as much of the data as fits in the buffer and returns the number of bytes taken
+- Returns 0 if the file is not open or opening
+
+*/
+u32 FatLogWrite(u8* pu8Data_, u32 u32Size_)
+{
+  u32 u32Space;
+
+  if( (FatLog_eStatus != FATLOG_OPEN) && (FatLog_eStatus != FATLOG_OPENING) )
+  {
+    return 0;
+  }
+
+  /* The buffer may only run FATLOG_BUFFER_SIZE bytes ahead of what is on the card */
+  u32Space = FATLOG_BUFFER_SIZE - (FatLog_u32AcceptedBytes - FatLog_u32WrittenBytes);
+  if(u32Size_ > u32Space)
+  {
+    u32Size_ = u32Space;
+  }
+
+  for(u32 i = 0; i < u32Size_; i++)
+  {
+    FatLog_au8Buffer[FatLog_u32AcceptedBytes & (FATLOG_BUFFER_SIZE - 1)] = *pu8Data_++;
+    FatLog_u32AcceptedBytes++;
+  }
+
+  SchedulerSignal(PROFILER_TASK_FATLOG);
+  return u32Size_;
+
+} /* end FatLogWrite() */
+
+
+/*!----------------------------------------------------------------------------------------------------------------------
+@fn void FatLogFlush(void)
+
+@brief Requests that all data taken so far is committed to the card right away.
+
+Requires:
+- NONE
+
+Promises:
+- The next time the task is idle, the partial sector and file size are written
+
+*/
+void FatLogFlush(void)
+{
+  FatLog_u32Flags |= _FATLOG_FLUSH_REQUEST;
+  SchedulerSignal(PROFILER_TASK_FATLOG);
+
+} /* end FatLogFlush() */
+
+
+/*!----------------------------------------------------------------------------------------------------------------------
+@fn bool FatLogClose(void)
+
+@brief Requests that the log file is flushed and closed.
+
+Requires:
+- NONE
+
+Promises:
+- If the file is open, status goes to FATLOG_CLOSING, no more data is accepted and TRUE is returned.
+  Status becomes FATLOG_CLOSED once all data is on the card and unused clusters are released.
+- Returns FALSE if there is no open file
+
+*/
+bool FatLogClose(void)
+{
+  if(FatLog_eStatus != FATLOG_OPEN)
+  {
+    return FALSE;
+  }
+
+  FatLog_u32Flags |= _FATLOG_CLOSE_REQUEST;
+  FatLog_eStatus = FATLOG_CLOSING;
+  SchedulerSignal(PROFILER_TASK_FATLOG);
+  return TRUE;
+
+} /* end FatLogClose() */
+
+
+/*!----------------------------------------------------------------------------------------------------------------------
+@fn FatLogStatusType FatLogGetStatus(void)
+
+@brief Reports the status of the log file.
+
+Requires:
+- NONE
+
+Promises:
+- Returns FatLog_eStatus
+
+*/
+FatLogStatusType FatLogGetStatus(void)
+{
+  return FatLog_eStatus;
+
+} /* end FatLogGetStatus() */
+
+
+/*--------------------------------------------------------------------------------------------------------------------*/
+/*! @protectedsection */
+/*--------------------------------------------------------------------------------------------------------------------*/
+
+/*!--------------------------------------------------------------------------------------------------------------------
+@fn void FatLogInitialize(void)
+
+@brief Initializes the State Machine and its variables.
+
+Should only be called once in main init section.
+
+Requires:
+- NONE
+
+Promises:
+- No file is open and the task waits for FatLogOpen()
+
+*/
+void FatLogInitialize(void)
+{
+  FatLog_u32Flags = 0;
+  FatLog_eStatus = FATLOG_CLOSED;
+  FatLog_pfStateMachine = FatLogSM_Idle;
+
+  /* The API functions signal the task and FatLogRunActiveState() keeps it going */
+  SchedulerSetEventDriven(PROFILER_TASK_FATLOG);
+  G_u32ApplicationFlags |= _APPLICATION_FLAGS_FATLOG;
+
+} /* end FatLogInitialize() */
+
+
+/*!----------------------------------------------------------------------------------------------------------------------
+@fn void FatLogRunActiveState(void)
+
+@brief Selects and runs one iteration of the current state in the state machine.
+
+All state machines have a TOTAL of 1ms to execute, so on average n state machines
+may take 1ms / n to execute.
+
+Requires:
+- State machine function pointer points at current state
+
+Promises:
+- Calls the function to pointed by the state machine function pointer
+- The task is signalled for the next pass while it has work, when the flush period ends while data is 
+  waiting in Logging, and by FatLogIoCallback() or the I/O timeout while a sector is with the SD task
+
+*/
+void FatLogRunActiveState(void)
+{
+  FatLog_pfStateMachine();
+
+  if(FatLog_pfStateMachine == FatLogSM_Logging)
+  {
+    /* Logging has work now for a full sector or a requested flush, otherwise only when the flush period ends */
+    if( ((FatLog_u32AcceptedBytes - FatLog_u32WrittenBytes) >= FATLOG_SECTOR_SIZE) ||
+        (FatLog_u32Flags & (_FATLOG_FLUSH_REQUEST | _FATLOG_CLOSE_REQUEST)) )
+    {
+      SchedulerSignal(PROFILER_TASK_FATLOG);
+    }
+    else if(FatLog_u32AcceptedBytes != FatLog_u32FileSize)
+    {
+      SchedulerSignalAt(PROFILER_TASK_FATLOG, FatLog_u32FlushTimer + FATLOG_FLUSH_PERIOD_MS);
+    }
+  }
+  else if( (FatLog_pfStateMachine == FatLogSM_WaitRead) || (FatLog_pfStateMachine == FatLogSM_WaitWrite) )
+  {
+    SchedulerSignalAt(PROFILER_TASK_FATLOG, FatLog_u32Timeout + FATLOG_IO_TIMEOUT_MS);
+  }
+  else if(FatLog_pfStateMachine != FatLogSM_Idle)
+  {
+    SchedulerSignal(PROFILER_TASK_FATLOG);
+  }
+
+} /* end FatLogRunActiveState */
+
+
+/*------------------------------------------------------------------------------------------------------------------*/
+/*! @privatesection */
+/*--------------------------------------------------------------------------------------------------------------------*/
+
+/*!----------------------------------------------------------------------------------------------------------------------
+@fn static u16 FatLogGetU16(u8* pu8Source_)
+
+@brief Reads a little endian u16 from a sector buffer at any alignment.
+
+*/
+static u16 FatLogGetU16(u8* pu8Source_)
+{
+  return( (u16)pu8Source_[0] | ((u16)pu8Source_[1] << 8) );
+
+} /* end FatLogGetU16() */
+
+
+/*!----------------------------------------------------------------------------------------------------------------------
+@fn static u32 FatLogGetU32(u8* pu8Source_)
+
+@brief Reads a little endian u32 from a sector buffer at any alignment.
+
+*/
+static u32 FatLogGetU32(u8* pu8Source_)
+{
+  return( (u32)pu8Source_[0]         | ((u32)pu8Source_[1] << 8) |
+         ((u32)pu8Source_[2] << 16) | ((u32)pu8Source_[3] << 24) );
+
+} /* end FatLogGetU32() */
+
+
+/*!----------------------------------------------------------------------------------------------------------------------
+@fn static void FatLogPutU16(u8* pu8Target_, u16 u16Value_)
+
+@brief Writes a little endian u16 into a sector buffer at any alignment.
+
+*/
+static void FatLogPutU16(u8* pu8Target_, u16 u16Value_)
+{
+  pu8Target_[0] = (u8)u16Value_;
+  pu8Target_[1] = (u8)(u16Value_ >> 8);
+
+} /* end FatLogPutU16() */
+
+
+/*!----------------------------------------------------------------------------------------------------------------------
+@fn static void FatLogPutU32(u8* pu8Target_, u32 u32Value_)
+
+@brief Writes a little endian u32 into a sector buffer at any alignment.
+
+*/
+static void FatLogPutU32(u8* pu8Target_, u32 u32Value_)
+{
+  pu8Target_[0] = (u8)u32Value_;
+  pu8Target_[1] = (u8)(u32Value_ >> 8);
+  pu8Target_[2] = (u8)(u32Value_ >> 16);
+  pu8Target_[3] = (u8)(u32Value_ >> 24);
+
+} /* end FatLogPutU32() */
+
+
+/*!----------------------------------------------------------------------------------------------------------------------
+@fn static u32 FatLogClusterToSector(u32 u32Cluster_)
+
+@brief Returns the card sector where a cluster starts.
+
+*/
+static u32 FatLogClusterToSector(u32 u32Cluster_)
+{
+  return( FatLog_u32DataSector + ((u32Cluster_ - FAT32_FIRST_CLUSTER) * FatLog_u32SectorsPerCluster) );
+
+} /* end FatLogClusterToSector() */
+
+
+/*!----------------------------------------------------------------------------------------------------------------------
+@fn static void FatLogReadSector(u32 u32Sector_, u8* pu8Buffer_, fnCode_type pfNextState_)
+
+@brief Starts reading one sector from the card.
+
+Requires:
+@param u32Sector_ is the card sector to read
+@param pu8Buffer_ points to FATLOG_SECTOR_SIZE bytes for the data
+@param pfNextState_ is the state to run once the data is in the buffer
+
+Promises:
+- The state machine runs the read then continues at pfNextState_, or goes to the error state
+
+*/
+static void FatLogReadSector(u32 u32Sector_, u8* pu8Buffer_, fnCode_type pfNextState_)
+{
+  FatLog_u32IoSector = u32Sector_;
+  FatLog_pu8IoBuffer = pu8Buffer_;
+  FatLog_pfIoReturnState = pfNextState_;
+  FatLog_u32Timeout = G_u32SystemTime1ms;
+  FatLog_pfStateMachine = FatLogSM_StartRead;
+
+} /* end FatLogReadSector() */
+
+
+/*!----------------------------------------------------------------------------------------------------------------------
+@fn static void FatLogWriteSector(u32 u32Sector_, u8* pu8Buffer_, fnCode_type pfNextState_)
+
+@brief Starts writing one sector to the card.
+
+Requires:
+@param u32Sector_ is the card sector to write
+@param pu8Buffer_ points to FATLOG_SECTOR_SIZE bytes of data that must not change until pfNextState_ runs
+@param pfNextState_ is the state to run once the card has programmed the sector
+
+Promises:
+- The state machine runs the write then continues at pfNextState_, or goes to the error state
+
+*/
+static void FatLogWriteSector(u32 u32Sector_, u8* pu8Buffer_, fnCode_type pfNextState_)
+{
+  FatLogWriteSectors(u32Sector_, 1, pu8Buffer_, pfNextState_);
+
+} /* end FatLogWriteSector() */
+
+
+/*!----------------------------------------------------------------------------------------------------------------------
+@fn static void FatLogWriteSectors(u32 u32Sector_, u32 u32Count_, u8* pu8Buffer_, fnCode_type pfNextState_)
+
+@brief Starts writing consecutive sectors to the card as one request.
+
+Requires:
+@param u32Sector_ is the first card sector to write
+@param u32Count_ is the number of sectors (at least 1)
+@param pu8Buffer_ points to u32Count_ * FATLOG_SECTOR_SIZE bytes of data that must not change until pfNextState_ runs
+@param pfNextState_ is the state to run once the card has programmed all the sectors
+
+Promises:
+- FatLog_u32IoSectors holds u32Count_ while the write runs
+- The state machine runs the write then continues at pfNextState_, or goes to the error state
+
+*/
+static void FatLogWriteSectors(u32 u32Sector_, u32 u32Count_, u8* pu8Buffer_, fnCode_type pfNextState_)
+{
+  FatLog_u32IoSector = u32Sector_;
+  FatLog_u32IoSectors = u32Count_;
+  FatLog_pu8IoBuffer = pu8Buffer_;
+  FatLog_pfIoReturnState = pfNextState_;
+  FatLog_u32Timeout = G_u32SystemTime1ms;
+  FatLog_pfStateMachine = FatLogSM_StartWrite;
+
+} /* end FatLogWriteSectors() */
+
+
+/*!----------------------------------------------------------------------------------------------------------------------
+@fn static void FatLogAllocateExtent(fnCode_type pfNextState_)
+
+@brief Starts reserving the next contiguous run of clusters for the file.
+
+The FAT is scanned from the free space hint for FATLOG_PREALLOC_CLUSTERS free clusters in a row.  If the
+card has no run that long, the longest run found is used.  The run is linked to the end of the file.
+
+Requires:
+- FatLog_u32ExtentCluster / FatLog_u32ExtentClusters describe the current extent (0 clusters if none)
+@param pfNextState_ is the state to run once the new extent is ready
+
+Promises:
+- The state machine searches and updates the FAT then continues at pfNextState_
+
+*/
+static void FatLogAllocateExtent(fnCode_type pfNextState_)
+{
+  FatLog_pfAllocReturnState = pfNextState_;
+
+  FatLog_u32PreviousTail = 0;
+  if(FatLog_u32ExtentClusters != 0)
+  {
+    FatLog_u32PreviousTail = FatLog_u32ExtentCluster + FatLog_u32ExtentClusters - 1;
+  }
+
+  FatLog_u32SearchCluster   = FatLog_u32NextFreeHint;
+  FatLog_u32SearchRemaining = FatLog_u32MaxCluster - 1;
+  FatLog_u32RunLength  = 0;
+  FatLog_u32BestLength = 0;
+  FatLog_pfStateMachine = FatLogSM_FatSearchRead;
+
+} /* end FatLogAllocateExtent() */
+
+
+/*!----------------------------------------------------------------------------------------------------------------------
+@fn static void FatLogChain(u32 u32First_, u32 u32Last_, u32 u32Tail_, fnCode_type pfNextState_)
+
+@brief Starts updating a run of FAT entries in every FAT copy.
+
+Each entry from u32First_ to u32Last_ - 1 is linked to the next cluster and u32Last_ gets u32Tail_.  If
+_FATLOG_CHAIN_FREE is set, every entry in the run is released instead.  Each FAT sector touched is read
+once and written once per FAT copy.
+
+Requires:
+@param u32First_ is the first cluster to update
+@param u32Last_ is the last cluster to update
+@param u32Tail_ is the value for the last entry (next extent or FAT32_EOC)
+@param pfNextState_ is the state to run once all FAT copies are updated
+
+Promises:
+- The state machine updates the FAT then continues at pfNextState_
+
+*/
+static void FatLogChain(u32 u32First_, u32 u32Last_, u32 u32Tail_, fnCode_type pfNextState_)
+{
+  FatLog_u32ChainCluster = u32First_;
+  FatLog_u32ChainLast    = u32Last_;
+  FatLog_u32ChainTail    = u32Tail_;
+  FatLog_pfChainReturnState = pfNextState_;
+  FatLog_pfStateMachine = FatLogSM_ChainRead;
+
+} /* end FatLogChain() */
+
+
+/*!----------------------------------------------------------------------------------------------------------------------
+@fn static void FatLogFail(u8* pu8Message_)
+
+@brief Sends the task to the error state with a message.
+
+*/
+static void FatLogFail(u8* pu8Message_)
+{
+  FatLog_pu8ErrorMessage = pu8Message_;
+  FatLog_pfStateMachine = FatLogSM_Error;
+
+} /* end FatLogFail() */
+
+
+/*!----------------------------------------------------------------------------------------------------------------------
+@fn static void FatLogIoCallback(u32 u32Token_, SdRequestStatusType eResult_)
+
+@brief SD request callback that wakes the task when its sector read or write finishes.
+
+*/
+static void FatLogIoCallback(u32 u32Token_, SdRequestStatusType eResult_)
+{
+  SchedulerSignal(PROFILER_TASK_FATLOG);
+
+} /* end FatLogIoCallback() */
+
+
+/**********************************************************************************************************************
+State Machine Function Definitions
+**********************************************************************************************************************/
+
+/*-------------------------------------------------------------------------------------------------------------------*/
+/* No file open: wait for FatLogOpen() */
+static void FatLogSM_Idle(void)
+{
+  if(FatLog_u32Flags & _FATLOG_OPEN_REQUEST)
+  {
+    FatLog_u32Flags &= ~_FATLOG_OPEN_REQUEST;
+    FatLog_u32Timeout = G_u32SystemTime1ms;
+    FatLog_pfStateMachine = FatLogSM_WaitCard;
+  }
+
+} /* end FatLogSM_Idle() */
+
+
+/*-------------------------------------------------------------------------------------------------------------------*/
+/* Wait for the SD card task to have a card ready (it may be busy with other clients) then read sector 0 */
+static void FatLogSM_WaitCard(void)
+{
+  SdCardStateType eCardState = SdGetStatus();
+
+  if( (eCardState != SD_NO_CARD) && (eCardState != SD_CARD_ERROR) )
+  {
+    FatLogReadSector(0, FatLog_au8Scratch, FatLogSM_ParseMbr);
+  }
+  else if( IsTimeUp(&FatLog_u32Timeout, FATLOG_MOUNT_TIMEOUT_MS) )
+  {
+    FatLogFail(FatLog_au8ErrorNoCard);
+  }
+
+} /* end FatLogSM_WaitCard() */
+
+
+/*-------------------------------------------------------------------------------------------------------------------*/
+/* Sector 0 is either a partition table or (on cards formatted without one) the FAT32 boot sector itself */
+static void FatLogSM_ParseMbr(void)
+{
+  u8 u8PartitionType;
+
+  if(FatLogGetU16(&FatLog_au8Scratch[FAT_SIGNATURE_OFFSET]) != FAT_SIGNATURE)
+  {
+    FatLogFail(FatLog_au8ErrorVolume);
+    return;
+  }
+
+  /* A boot sector starts with a jump and reports 512 byte sectors */
+  if( ( (FatLog_au8Scratch[0] == FAT_BPB_JUMP_SHORT) || (FatLog_au8Scratch[0] == FAT_BPB_JUMP_NEAR) ) &&
+      (FatLogGetU16(&FatLog_au8Scratch[FAT_BPB_BYTES_PER_SEC]) == FATLOG_SECTOR_SIZE) )
+  {
+    FatLog_u32PartitionSector = 0;
+    FatLogSM_ParseBpb();
+    return;
+  }
+
+  /* Otherwise use the first partition */
+  u8PartitionType = FatLog_au8Scratch[FAT_MBR_PART1_TYPE];
+  if( (u8PartitionType == FAT_PART_TYPE_FAT32_CHS) || (u8PartitionType == FAT_PART_TYPE_FAT32_LBA) )
+  {
+    FatLog_u32PartitionSector = FatLogGetU32(&FatLog_au8Scratch[FAT_MBR_PART1_LBA]);
+    FatLogReadSector(FatLog_u32PartitionSector, FatLog_au8Scratch, FatLogSM_ParseBpb);
+  }
+  else
+  {
+    FatLogFail(FatLog_au8ErrorVolume);
+  }
+
+} /* end FatLogSM_ParseMbr() */
+
+
+/*-------------------------------------------------------------------------------------------------------------------*/
+/* Capture the volume geometry from the boot sector then read FSInfo */
+static void FatLogSM_ParseBpb(void)
+{
+  u32 u32TotalSectors;
+  u32 u32Clusters;
+
+  /* Only FAT32 with 512 byte sectors is supported (FAT12/16 have a non-zero 16-bit FAT size) */
+  if( (FatLogGetU16(&FatLog_au8Scratch[FAT_SIGNATURE_OFFSET]) != FAT_SIGNATURE) ||
+      (FatLogGetU16(&FatLog_au8Scratch[FAT_BPB_BYTES_PER_SEC]) != FATLOG_SECTOR_SIZE) ||
+      (FatLogGetU16(&FatLog_au8Scratch[FAT_BPB_FATSZ16]) != 0) ||
+      (FatLog_au8Scratch[FAT_BPB_SEC_PER_CLUS] == 0) )
+  {
+    FatLogFail(FatLog_au8ErrorVolume);
+    return;
+  }
+
+  FatLog_u32SectorsPerCluster = FatLog_au8Scratch[FAT_BPB_SEC_PER_CLUS];
+  FatLog_u32NumFats   = FatLog_au8Scratch[FAT_BPB_NUM_FATS];
+  FatLog_u32FatSize   = FatLogGetU32(&FatLog_au8Scratch[FAT_BPB_FATSZ32]);
+  FatLog_u32FatSector = FatLog_u32PartitionSector + FatLogGetU16(&FatLog_au8Scratch[FAT_BPB_RSVD_SEC_CNT]);
+  FatLog_u32DataSector = FatLog_u32FatSector + (FatLog_u32NumFats * FatLog_u32FatSize);
+  FatLog_u32RootCluster = FatLogGetU32(&FatLog_au8Scratch[FAT_BPB_ROOT_CLUS]);
+  FatLog_u32FsInfoSector = FatLog_u32PartitionSector + FatLogGetU16(&FatLog_au8Scratch[FAT_BPB_FSINFO]);
+
+  u32TotalSectors = FatLogGetU32(&FatLog_au8Scratch[FAT_BPB_TOTSEC32]);
+  u32Clusters = (u32TotalSectors - (FatLog_u32DataSector - FatLog_u32PartitionSector)) / FatLog_u32SectorsPerCluster;
+  FatLog_u32MaxCluster = u32Clusters + 1;
+
+  FatLogReadSector(FatLog_u32FsInfoSector, FatLog_au8Scratch, FatLogSM_UpdateFsInfo);
+
+} /* end FatLogSM_ParseBpb() */
+
+
+/*-------------------------------------------------------------------------------------------------------------------*/
+/* Take the free cluster hint and mark the free count unknown since clusters are about to be allocated */
+static void FatLogSM_UpdateFsInfo(void)
+{
+  FatLog_u32NextFreeHint = FAT32_FIRST_CLUSTER;
+
+  if(FatLogGetU32(&FatLog_au8Scratch[0]) != FAT_FSI_LEAD_SIG)
+  {
+    FatLogSM_StartDirScan();
+    return;
+  }
+
+  FatLog_u32NextFreeHint = FatLogGetU32(&FatLog_au8Scratch[FAT_FSI_NEXT_FREE]);
+  if( (FatLog_u32NextFreeHint < FAT32_FIRST_CLUSTER) || (FatLog_u32NextFreeHint > FatLog_u32MaxCluster) )
+  {
+    FatLog_u32NextFreeHint = FAT32_FIRST_CLUSTER;
+  }
+
+  FatLogPutU32(&FatLog_au8Scratch[FAT_FSI_FREE_COUNT], FAT_FSI_UNKNOWN);
+  FatLogWriteSector(FatLog_u32FsInfoSector, FatLog_au8Scratch, FatLogSM_StartDirScan);
+
+} /* end FatLogSM_UpdateFsInfo() */
+
+
+/*-------------------------------------------------------------------------------------------------------------------*/
+/* Prepare to scan the root directory for a free entry and for files from the same sequence */
+static void FatLogSM_StartDirScan(void)
+{
+  /* Find where the trailing sequence digits of the base name start */
+  FatLog_u8DigitStart = FATLOG_BASE_NAME_SIZE;
+  while( (FatLog_u8DigitStart != 0) &&
+         (FatLog_au8FileName[FatLog_u8DigitStart - 1] >= '0') &&
+         (FatLog_au8FileName[FatLog_u8DigitStart - 1] <= '9') )
+  {
+    FatLog_u8DigitStart--;
+  }
+
+  FatLog_u32Flags &= ~(_FATLOG_NAME_MATCH | _FATLOG_DIR_END);
+  FatLog_u32DirEntrySector = 0;
+  FatLog_u32DirScanCluster = FatLog_u32RootCluster;
+  FatLog_u32DirScanSector = 0;
+  FatLogReadSector(FatLogClusterToSector(FatLog_u32DirScanCluster), FatLog_au8Scratch, FatLogSM_DirScan);
+
+} /* end FatLogSM_StartDirScan() */
+
+
+/*-------------------------------------------------------------------------------------------------------------------*/
+/* Check the 16 entries of one directory sector */
+static void FatLogSM_DirScan(void)
+{
+  u8* pu8Entry;
+  u8 u8Index;
+  bool bSameSequence;
+
+  for(u32 i = 0; i < (FATLOG_SECTOR_SIZE / FAT_DIR_ENTRY_SIZE); i++)
+  {
+    pu8Entry = &FatLog_au8Scratch[i * FAT_DIR_ENTRY_SIZE];
+
+    /* Remember the first free entry */
+    if( (pu8Entry[0] == FAT_DIR_END_MARKER) || (pu8Entry[0] == FAT_DIR_DELETED) )
+    {
+      if(FatLog_u32DirEntrySector == 0)
+      {
+        FatLog_u32DirEntrySector = FatLogClusterToSector(FatLog_u32DirScanCluster) + FatLog_u32DirScanSector;
+        FatLog_u32DirEntryOffset = i * FAT_DIR_ENTRY_SIZE;
+      }
+
+      if(pu8Entry[0] == FAT_DIR_END_MARKER)
+      {
+        FatLog_u32Flags |= _FATLOG_DIR_END;
+        break;
+      }
+      continue;
+    }
+
+    /* Skip long name parts and the volume label */
+    if( ((pu8Entry[FAT_DIR_ATTR] & FAT_ATTR_LONG_NAME) == FAT_ATTR_LONG_NAME) ||
+         (pu8Entry[FAT_DIR_ATTR] & FAT_ATTR_VOLUME_ID) )
+    {
+      continue;
+    }
+
+    /* Same prefix, same extension and digits where the sequence number is */
+    bSameSequence = TRUE;
+    for(u8Index = 0; u8Index < FATLOG_NAME_SIZE; u8Index++)
+    {
+      if( (u8Index >= FatLog_u8DigitStart) && (u8Index < FATLOG_BASE_NAME_SIZE) )
+      {
+        if( (pu8Entry[u8Index] < '0') || (pu8Entry[u8Index] > '9') )
+        {
+          bSameSequence = FALSE;
+        }
+      }
+      else if(pu8Entry[u8Index] != FatLog_au8FileName[u8Index])
+      {
+        bSameSequence = FALSE;
+      }
+    }
+
+    /* Digits have the same width so the highest number is the highest string */
+    if(bSameSequence)
+    {
+      if( !(FatLog_u32Flags & _FATLOG_NAME_MATCH) ||
+          (memcmp(pu8Entry, FatLog_au8HighestName, FATLOG_NAME_SIZE) > 0) )
+      {
+        memcpy(FatLog_au8HighestName, pu8Entry, FATLOG_NAME_SIZE);
+      }
+      FatLog_u32Flags |= _FATLOG_NAME_MATCH;
+    }
+  }
+
+  FatLog_u32DirScanSector++;
+  if(FatLog_u32Flags & _FATLOG_DIR_END)
+  {
+    FatLog_pfStateMachine = FatLogSM_NameFile;
+  }
+  else if(FatLog_u32DirScanSector == FatLog_u32SectorsPerCluster)
+  {
+    /* Look up the next cluster of the directory in the FAT */
+    FatLogReadSector(FatLog_u32FatSector + (FatLog_u32DirScanCluster >> FAT32_ENTRIES_PER_SECTOR_SHIFT),
+                     FatLog_au8Scratch, FatLogSM_DirNextCluster);
+  }
+  else
+  {
+    FatLogReadSector(FatLogClusterToSector(FatLog_u32DirScanCluster) + FatLog_u32DirScanSector,
+                     FatLog_au8Scratch, FatLogSM_DirScan);
+  }
+
+} /* end FatLogSM_DirScan() */
+
+
+/*-------------------------------------------------------------------------------------------------------------------*/
+/* Continue the scan in the next root directory cluster or stop at the end of the chain */
+static void FatLogSM_DirNextCluster(void)
+{
+  u32 u32Next;
+
+  u32Next = FatLogGetU32(&FatLog_au8Scratch[(FatLog_u32DirScanCluster & FAT32_ENTRY_INDEX_MASK) << 2]) &
+            FAT32_ENTRY_MASK;
+
+  /* End of chain, or an entry that cannot be a cluster of this volume, ends the directory */
+  if( (u32Next < FAT32_FIRST_CLUSTER) || (u32Next > FatLog_u32MaxCluster) )
+  {
+    FatLog_pfStateMachine = FatLogSM_NameFile;
+    return;
+  }
+
+  FatLog_u32DirScanCluster = u32Next;
+  FatLog_u32DirScanSector = 0;
+  FatLogReadSector(FatLogClusterToSector(FatLog_u32DirScanCluster), FatLog_au8Scratch, FatLogSM_DirScan);
+
+} /* end FatLogSM_DirNextCluster() */
+
+
+/*-------------------------------------------------------------------------------------------------------------------*/
+/* Pick the next name in the sequence and reserve the first extent */
+static void FatLogSM_NameFile(void)
+{
+  u8 u8Index;
+
+  if(FatLog_u32DirEntrySector == 0)
+  {
+    FatLogFail(FatLog_au8ErrorDirFull);
+    return;
+  }
+
+  /* Increment the highest existing sequence number as text */
+  if(FatLog_u32Flags & _FATLOG_NAME_MATCH)
+  {
+    memcpy(FatLog_au8FileName, FatLog_au8HighestName, FATLOG_NAME_SIZE);
+
+    u8Index = FATLOG_BASE_NAME_SIZE;
+    while(u8Index > FatLog_u8DigitStart)
+    {
+      u8Index--;
+      if(FatLog_au8FileName[u8Index] != '9')
+      {
+        FatLog_au8FileName[u8Index]++;
+        break;
+      }
+      FatLog_au8FileName[u8Index] = '0';
+    }
+
+    /* Every digit rolled over from 9, so the number wrapped onto a name that may already exist */
+    if(FatLog_au8FileName[u8Index] == '0')
+    {
+      FatLogFail(FatLog_au8ErrorNoName);
+      return;
+    }
+  }
+
+  FatLog_u32FirstCluster = 0;
+  FatLog_u32ExtentCluster = 0;
+  FatLog_u32ExtentClusters = 0;
+  FatLog_u32ExtentFileSector = 0;
+  FatLogAllocateExtent(FatLogSM_CreateEntry);
+
+} /* end FatLogSM_NameFile() */
+
+
+/*-------------------------------------------------------------------------------------------------------------------*/
+/* Load the directory sector that will hold the entry into the cache */
+static void FatLogSM_CreateEntry(void)
+{
+  FatLogReadSector(FatLog_u32DirEntrySector, FatLog_au8DirSector, FatLogSM_WriteEntry);
+
+} /* end FatLogSM_CreateEntry() */
+
+
+/*-------------------------------------------------------------------------------------------------------------------*/
+/* Fill in the directory entry and write it */
+static void FatLogSM_WriteEntry(void)
+{
+  u8* pu8Entry = &FatLog_au8DirSector[FatLog_u32DirEntryOffset];
+
+  memset(pu8Entry, 0, FAT_DIR_ENTRY_SIZE);
+  memcpy(pu8Entry, FatLog_au8FileName, FATLOG_NAME_SIZE);
+  pu8Entry[FAT_DIR_ATTR] = FAT_ATTR_ARCHIVE;
+  FatLogPutU16(&pu8Entry[FAT_DIR_CRT_DATE], FATLOG_DEFAULT_DATE);
+  FatLogPutU16(&pu8Entry[FAT_DIR_ACC_DATE], FATLOG_DEFAULT_DATE);
+  FatLogPutU16(&pu8Entry[FAT_DIR_WRT_DATE], FATLOG_DEFAULT_DATE);
+  FatLogPutU16(&pu8Entry[FAT_DIR_FST_CLUS_HI], (u16)(FatLog_u32FirstCluster >> 16));
+  FatLogPutU16(&pu8Entry[FAT_DIR_FST_CLUS_LO], (u16)FatLog_u32FirstCluster);
+  FatLogPutU32(&pu8Entry[FAT_DIR_FILE_SIZE], 0);
+
+  FatLogWriteSector(FatLog_u32DirEntrySector, FatLog_au8DirSector, FatLogSM_Opened);
+
+} /* end FatLogSM_WriteEntry() */
+
+
+/*-------------------------------------------------------------------------------------------------------------------*/
+/* File exists on the card */
+static void FatLogSM_Opened(void)
+{
+  FatLog_eStatus = FATLOG_OPEN;
+  FatLog_u32FlushTimer = G_u32SystemTime1ms;
+  FatLog_pfStateMachine = FatLogSM_Logging;
+
+} /* end FatLogSM_Opened() */
+
+
+/*-------------------------------------------------------------------------------------------------------------------*/
+/* Write full sectors as they fill and flush the file size periodically */
+static void FatLogSM_Logging(void)
+{
+  u32 u32FileSector = FatLog_u32WrittenBytes >> FATLOG_SECTOR_SHIFT;
+  u32 u32Sector = 0;
+  u32 u32Count;
+  u32 u32Limit;
+  bool bFullSector;
+  bool bFlush;
+
+  bFullSector = (FatLog_u32AcceptedBytes - FatLog_u32WrittenBytes) >= FATLOG_SECTOR_SIZE;
+  bFlush = (FatLog_u32Flags & (_FATLOG_FLUSH_REQUEST | _FATLOG_CLOSE_REQUEST)) ||
+           ( (FatLog_u32AcceptedBytes != FatLog_u32FileSize) &&
+             IsTimeUp(&FatLog_u32FlushTimer, FATLOG_FLUSH_PERIOD_MS) );
+
+  if( !bFullSector && !bFlush )
+  {
+    return;
+  }
+
+  /* Whole sectors always go first so the flush only ever has to write the last partial sector */
+  if(bFullSector || (FatLog_u32AcceptedBytes != FatLog_u32WrittenBytes) )
+  {
+    /* Make sure the sector is inside the reserved space */
+    if(u32FileSector >= (FatLog_u32ExtentFileSector + (FatLog_u32ExtentClusters * FatLog_u32SectorsPerCluster)) )
+    {
+      FatLogAllocateExtent(FatLogSM_Logging);
+      return;
+    }
+
+    u32Sector = FatLogClusterToSector(FatLog_u32ExtentCluster) + (u32FileSector - FatLog_u32ExtentFileSector);
+  }
+
+  if(bFullSector)
+  {
+    /* Send every full sector in one request as long as it stays in the extent and does not wrap the buffer */
+    u32Count = (FatLog_u32AcceptedBytes - FatLog_u32WrittenBytes) >> FATLOG_SECTOR_SHIFT;
+
+    u32Limit = FatLog_u32ExtentFileSector + (FatLog_u32ExtentClusters * FatLog_u32SectorsPerCluster) - u32FileSector;
+    if(u32Count > u32Limit)
+    {
+      u32Count = u32Limit;
+    }
+
+    u32Limit = FATLOG_BUFFER_SECTORS - (u32FileSector & (FATLOG_BUFFER_SECTORS - 1));
+    if(u32Count > u32Limit)
+    {
+      u32Count = u32Limit;
+    }
+
+    FatLogWriteSectors(u32Sector, u32Count, &FatLog_au8Buffer[FatLog_u32WrittenBytes & (FATLOG_BUFFER_SIZE - 1)],
+                       FatLogSM_SectorDone);
+  }
+  else
+  {
+    /* The partial sector is written as-is and rewritten once it fills */
+    FatLog_u32FlushTarget = FatLog_u32AcceptedBytes;
+    if(FatLog_u32FlushTarget != FatLog_u32WrittenBytes)
+    {
+      FatLogWriteSector(u32Sector, &FatLog_au8Buffer[FatLog_u32WrittenBytes & (FATLOG_BUFFER_SIZE - 1)],
+                        FatLogSM_FlushEntry);
+    }
+    else
+    {
+      FatLogSM_FlushEntry();
+    }
+  }
+
+} /* end FatLogSM_Logging() */
+
+
+/*-------------------------------------------------------------------------------------------------------------------*/
+/* Full sectors are on the card so their buffer space can be reused */
+static void FatLogSM_SectorDone(void)
+{
+  FatLog_u32WrittenBytes += FatLog_u32IoSectors << FATLOG_SECTOR_SHIFT;
+  FatLog_pfStateMachine = FatLogSM_Logging;
+
+} /* end FatLogSM_SectorDone() */
+
+
+/*-------------------------------------------------------------------------------------------------------------------*/
+/* Record the new file size in the cached directory sector and write it */
+static void FatLogSM_FlushEntry(void)
+{
+  FatLogPutU32(&FatLog_au8DirSector[FatLog_u32DirEntryOffset + FAT_DIR_FILE_SIZE], FatLog_u32FlushTarget);
+  FatLogWriteSector(FatLog_u32DirEntrySector, FatLog_au8DirSector, FatLogSM_Flushed);
+
+} /* end FatLogSM_FlushEntry() */
+
+
+/*-------------------------------------------------------------------------------------------------------------------*/
+/* Flush is complete */
+static void FatLogSM_Flushed(void)
+{
+  FatLog_u32FileSize = FatLog_u32FlushTarget;
+  FatLog_u32FlushTimer = G_u32SystemTime1ms;
+  FatLog_u32Flags &= ~_FATLOG_FLUSH_REQUEST;
+
+  if(FatLog_u32Flags & _FATLOG_CLOSE_REQUEST)
+  {
+    FatLog_pfStateMachine = FatLogSM_CloseTrim;
+  }
+  else
+  {
+    FatLog_pfStateMachine = FatLogSM_Logging;
+  }
+
+} /* end FatLogSM_Flushed() */
+
+
+/*-------------------------------------------------------------------------------------------------------------------*/
+/* Release the reserved clusters that were never used */
+static void FatLogSM_CloseTrim(void)
+{
+  u32 u32ExtentLast = FatLog_u32ExtentCluster + FatLog_u32ExtentClusters - 1;
+  u32 u32LastFileSector;
+
+  FatLog_u32Flags |= _FATLOG_CHAIN_FREE;
+
+  /* An empty file must not own any clusters */
+  if(FatLog_u32FileSize == 0)
+  {
+    FatLogChain(FatLog_u32ExtentCluster, u32ExtentLast, FAT32_FREE, FatLogSM_CloseEmptyEntry);
+    return;
+  }
+
+  /* The last data sector is always in the current extent since extents are only added when written */
+  u32LastFileSector = (FatLog_u32FileSize - 1) >> FATLOG_SECTOR_SHIFT;
+  FatLog_u32KeepCluster = FatLog_u32ExtentCluster +
+                          ((u32LastFileSector - FatLog_u32ExtentFileSector) / FatLog_u32SectorsPerCluster);
+  FatLog_u32NextFreeHint = FatLog_u32KeepCluster + 1;
+
+  if(FatLog_u32KeepCluster < u32ExtentLast)
+  {
+    FatLogChain(FatLog_u32KeepCluster + 1, u32ExtentLast, FAT32_FREE, FatLogSM_CloseTerminate);
+  }
+  else
+  {
+    FatLogSM_CloseTerminate();
+  }
+
+} /* end FatLogSM_CloseTrim() */
+
+
+/*-------------------------------------------------------------------------------------------------------------------*/
+/* End the chain at the last cluster with data */
+static void FatLogSM_CloseTerminate(void)
+{
+  FatLog_u32Flags &= ~_FATLOG_CHAIN_FREE;
+  FatLogChain(FatLog_u32KeepCluster, FatLog_u32KeepCluster, FAT32_EOC, FatLogSM_Closed);
+
+} /* end FatLogSM_CloseTerminate() */
+
+
+/*-------------------------------------------------------------------------------------------------------------------*/
+/* Detach the released clusters from the directory entry of an empty file */
+static void FatLogSM_CloseEmptyEntry(void)
+{
+  FatLog_u32Flags &= ~_FATLOG_CHAIN_FREE;
+  FatLog_u32NextFreeHint = FatLog_u32ExtentCluster;
+
+  FatLogPutU16(&FatLog_au8DirSector[FatLog_u32DirEntryOffset + FAT_DIR_FST_CLUS_HI], 0);
+  FatLogPutU16(&FatLog_au8DirSector[FatLog_u32DirEntryOffset + FAT_DIR_FST_CLUS_LO], 0);
+  FatLogWriteSector(FatLog_u32DirEntrySector, FatLog_au8DirSector, FatLogSM_Closed);
+
+} /* end FatLogSM_CloseEmptyEntry() */
+
+
+/*-------------------------------------------------------------------------------------------------------------------*/
+/* File is closed and complete */
+static void FatLogSM_Closed(void)
+{
+  FatLog_u32Flags = 0;
+  FatLog_eStatus = FATLOG_CLOSED;
+  FatLog_pfStateMachine = FatLogSM_Idle;
+
+} /* end FatLogSM_Closed() */
+
+
+/*-------------------------------------------------------------------------------------------------------------------*/
+/* Load the FAT sector holding the next cluster to check */
+static void FatLogSM_FatSearchRead(void)
+{
+  FatLogReadSector(FatLog_u32FatSector + (FatLog_u32SearchCluster >> FAT32_ENTRIES_PER_SECTOR_SHIFT),
+                   FatLog_au8Scratch, FatLogSM_FatSearch);
+
+} /* end FatLogSM_FatSearchRead() */
+
+
+/*-------------------------------------------------------------------------------------------------------------------*/
+/* Look for a run of free clusters in one FAT sector */
+static void FatLogSM_FatSearch(void)
+{
+  u32 u32Entry;
+  bool bFound = FALSE;
+
+  do
+  {
+    u32Entry = FatLogGetU32(&FatLog_au8Scratch[(FatLog_u32SearchCluster & FAT32_ENTRY_INDEX_MASK) << 2]);
+    if( (u32Entry & FAT32_ENTRY_MASK) == FAT32_FREE )
+    {
+      if(FatLog_u32RunLength == 0)
+      {
+        FatLog_u32RunStart = FatLog_u32SearchCluster;
+      }
+      FatLog_u32RunLength++;
+
+      if(FatLog_u32RunLength > FatLog_u32BestLength)
+      {
+        FatLog_u32BestStart  = FatLog_u32RunStart;
+        FatLog_u32BestLength = FatLog_u32RunLength;
+      }
+      bFound = (FatLog_u32RunLength == FATLOG_PREALLOC_CLUSTERS);
+    }
+    else
+    {
+      FatLog_u32RunLength = 0;
+    }
+
+    FatLog_u32SearchRemaining--;
+    FatLog_u32SearchCluster++;
+
+    /* Runs cannot wrap around the end of the FAT */
+    if(FatLog_u32SearchCluster > FatLog_u32MaxCluster)
+    {
+      FatLog_u32SearchCluster = FAT32_FIRST_CLUSTER;
+      FatLog_u32RunLength = 0;
+      break;
+    }
+  } while( !bFound && (FatLog_u32SearchRemaining != 0) &&
+           ((FatLog_u32SearchCluster & FAT32_ENTRY_INDEX_MASK) != 0) );
+
+  if( bFound || (FatLog_u32SearchRemaining == 0) )
+  {
+    if(FatLog_u32BestLength == 0)
+    {
+      FatLogFail(FatLog_au8ErrorDiskFull);
+      return;
+    }
+
+    /* Link the previous extent to the new one first if the file already has clusters */
+    FatLog_u32NextFreeHint = FatLog_u32BestStart + FatLog_u32BestLength;
+    if(FatLog_u32NextFreeHint > FatLog_u32MaxCluster)
+    {
+      FatLog_u32NextFreeHint = FAT32_FIRST_CLUSTER;
+    }
+
+    if(FatLog_u32PreviousTail != 0)
+    {
+      FatLogChain(FatLog_u32PreviousTail, FatLog_u32PreviousTail, FatLog_u32BestStart, FatLogSM_ChainExtent);
+    }
+    else
+    {
+      FatLogSM_ChainExtent();
+    }
+  }
+  else
+  {
+    FatLog_pfStateMachine = FatLogSM_FatSearchRead;
+  }
+
+} /* end FatLogSM_FatSearch() */
+
+
+/*-------------------------------------------------------------------------------------------------------------------*/
+/* Link all clusters of the new extent in one pass */
+static void FatLogSM_ChainExtent(void)
+{
+  FatLogChain(FatLog_u32BestStart, FatLog_u32BestStart + FatLog_u32BestLength - 1, FAT32_EOC, FatLogSM_ExtentReady);
+
+} /* end FatLogSM_ChainExtent() */
+
+
+/*-------------------------------------------------------------------------------------------------------------------*/
+/* The new extent is part of the file */
+static void FatLogSM_ExtentReady(void)
+{
+  if(FatLog_u32FirstCluster == 0)
+  {
+    FatLog_u32FirstCluster = FatLog_u32BestStart;
+  }
+
+  FatLog_u32ExtentFileSector += FatLog_u32ExtentClusters * FatLog_u32SectorsPerCluster;
+  FatLog_u32ExtentCluster  = FatLog_u32BestStart;
+  FatLog_u32ExtentClusters = FatLog_u32BestLength;
+
+  FatLog_pfStateMachine = FatLog_pfAllocReturnState;
+
+} /* end FatLogSM_ExtentReady() */
+
+
+/*-------------------------------------------------------------------------------------------------------------------*/
+/* Load the FAT sector holding the next entry to update */
+static void FatLogSM_ChainRead(void)
+{
+  FatLog_u32ChainFatSector = FatLog_u32ChainCluster >> FAT32_ENTRIES_PER_SECTOR_SHIFT;
+  FatLogReadSector(FatLog_u32FatSector + FatLog_u32ChainFatSector, FatLog_au8Scratch, FatLogSM_ChainModify);
+
+} /* end FatLogSM_ChainRead() */
+
+
+/*-------------------------------------------------------------------------------------------------------------------*/
+/* Update every entry of the run that is in this FAT sector then write the first FAT copy */
+static void FatLogSM_ChainModify(void)
+{
+  u8* pu8Entry;
+  u32 u32Value;
+
+  do
+  {
+    if(FatLog_u32Flags & _FATLOG_CHAIN_FREE)
+    {
+      u32Value = FAT32_FREE;
+    }
+    else if(FatLog_u32ChainCluster == FatLog_u32ChainLast)
+    {
+      u32Value = FatLog_u32ChainTail;
+    }
+    else
+    {
+      u32Value = FatLog_u32ChainCluster + 1;
+    }
+
+    /* The upper 4 bits of each entry are reserved and must be preserved */
+    pu8Entry = &FatLog_au8Scratch[(FatLog_u32ChainCluster & FAT32_ENTRY_INDEX_MASK) << 2];
+    FatLogPutU32(pu8Entry, (FatLogGetU32(pu8Entry) & ~FAT32_ENTRY_MASK) | u32Value);
+
+    FatLog_u32ChainCluster++;
+  } while( (FatLog_u32ChainCluster <= FatLog_u32ChainLast) &&
+           ((FatLog_u32ChainCluster & FAT32_ENTRY_INDEX_MASK) != 0) );
+
+  FatLog_u32ChainCopy = 0;
+  FatLogWriteSector(FatLog_u32FatSector + FatLog_u32ChainFatSector, FatLog_au8Scratch, FatLogSM_ChainWriteCopy);
+
+} /* end FatLogSM_ChainModify() */
+
+
+/*-------------------------------------------------------------------------------------------------------------------*/
+/* Mirror the sector to the other FAT copies then continue with the next FAT sector */
+static void FatLogSM_ChainWriteCopy(void)
+{
+  FatLog_u32ChainCopy++;
+  if(FatLog_u32ChainCopy < FatLog_u32NumFats)
+  {
+    FatLogWriteSector(FatLog_u32FatSector + (FatLog_u32ChainCopy * FatLog_u32FatSize) + FatLog_u32ChainFatSector,
+                      FatLog_au8Scratch, FatLogSM_ChainWriteCopy);
+  }
+  else if(FatLog_u32ChainCluster > FatLog_u32ChainLast)
+  {
+    FatLog_pfStateMachine = FatLog_pfChainReturnState;
+  }
+  else
+  {
+    FatLog_pfStateMachine = FatLogSM_ChainRead;
+  }
+
+} /* end FatLogSM_ChainWriteCopy() */
+
+
+/*-------------------------------------------------------------------------------------------------------------------*/
+/* Queue the sector read with the SD card task */
+static void FatLogSM_StartRead(void)
+{
+  FatLog_u32IoToken = SdQueueRead(FatLog_u32IoSector, 1, FatLog_pu8IoBuffer, FatLogIoCallback);
+  if(FatLog_u32IoToken != 0)
+  {
+    FatLog_pfStateMachine = FatLogSM_WaitRead;
+  }
+  else if( IsTimeUp(&FatLog_u32Timeout, FATLOG_IO_TIMEOUT_MS) )
+  {
+    FatLogFail(FatLog_au8ErrorIo);
+  }
+
+} /* end FatLogSM_StartRead() */
+
+
+/*-------------------------------------------------------------------------------------------------------------------*/
+/* Wait for the sector data */
+static void FatLogSM_WaitRead(void)
+{
+  SdRequestStatusType eResult = SdQueryRequest(FatLog_u32IoToken);
+
+  if(eResult == SD_REQUEST_DONE)
+  {
+    FatLog_pfStateMachine = FatLog_pfIoReturnState;
+  }
+  else if( (eResult == SD_REQUEST_FAILED) || (eResult == SD_REQUEST_UNKNOWN) ||
+           IsTimeUp(&FatLog_u32Timeout, FATLOG_IO_TIMEOUT_MS) )
+  {
+    FatLogFail(FatLog_au8ErrorIo);
+  }
+
+} /* end FatLogSM_WaitRead() */
+
+
+/*-------------------------------------------------------------------------------------------------------------------*/
+/* Queue the sector write with the SD card task */
+static void FatLogSM_StartWrite(void)
+{
+  FatLog_u32IoToken = SdQueueWrite(FatLog_u32IoSector, FatLog_u32IoSectors, FatLog_pu8IoBuffer, FatLogIoCallback);
+  if(FatLog_u32IoToken != 0)
+  {
+    FatLog_pfStateMachine = FatLogSM_WaitWrite;
+  }
+  else if( IsTimeUp(&FatLog_u32Timeout, FATLOG_IO_TIMEOUT_MS) )
+  {
+    FatLogFail(FatLog_au8ErrorIo);
+  }
+
+} /* end FatLogSM_StartWrite() */
+
+
+/*-------------------------------------------------------------------------------------------------------------------*/
+/* Wait for the card to program the sectors */
+static void FatLogSM_WaitWrite(void)
+{
+  SdRequestStatusType eResult = SdQueryRequest(FatLog_u32IoToken);
+
+  if(eResult == SD_REQUEST_DONE)
+  {
+    FatLog_pfStateMachine = FatLog_pfIoReturnState;
+  }
+  else if( (eResult == SD_REQUEST_FAILED) || (eResult == SD_REQUEST_UNKNOWN) ||
+           IsTimeUp(&FatLog_u32Timeout, FATLOG_IO_TIMEOUT_MS) )
+  {
+    FatLogFail(FatLog_au8ErrorIo);
+  }
+
+} /* end FatLogSM_WaitWrite() */
+
+
+/*-------------------------------------------------------------------------------------------------------------------*/
+/* Handle an error: the file is abandoned and a new one may be opened */
+static void FatLogSM_Error(void)
+{
+  LOG_ERROR(_DEBUG_LOG_FATLOG, "%s", FatLog_pu8ErrorMessage);
+
+  FatLog_u32Flags = 0;
+  FatLog_eStatus = FATLOG_ERROR;
+  FatLog_pfStateMachine = FatLogSM_Idle;
+
+} /* end FatLogSM_Error() */
+
+
+
+/*--------------------------------------------------------------------------------------------------------------------*/
+/* End of File                                                                                                        */
+/*--------------------------------------------------------------------------------------------------------------------*/
@@ -0,0 +1,182 @@
+/*!*********************************************************************************************************************
+@file fatlog.h
+@brief Header file for fatlog.c
+
+**********************************************************************************************************************/
+
+#ifndef __FATLOG_H
+#define __FATLOG_H
+
+/**********************************************************************************************************************
+Type Definitions
+**********************************************************************************************************************/
+
+/*!
+@enum FatLogStatusType
+@brief Status of the log file reported to clients.
+*/
+typedef enum {FATLOG_CLOSED, FATLOG_OPENING, FATLOG_OPEN, FATLOG_CLOSING, FATLOG_ERROR} FatLogStatusType;
+
+
+/**********************************************************************************************************************
+Function Declarations
+**********************************************************************************************************************/
+
+/*------------------------------------------------------------------------------------------------------------------*/
+/*! @publicsection */
+/*--------------------------------------------------------------------------------------------------------------------*/
+bool FatLogOpen(u8* pu8FileName_);
+u32 FatLogWrite(u8* pu8Data_, u32 u32Size_);
+void FatLogFlush(void);
+bool FatLogClose(void);
+FatLogStatusType FatLogGetStatus(void);
+
+
+/*------------------------------------------------------------------------------------------------------------------*/
+/*! @protectedsection */
+/*--------------------------------------------------------------------------------------------------------------------*/
+void FatLogInitialize(void);
+void FatLogRunActiveState(void);
+
+
+/*------------------------------------------------------------------------------------------------------------------*/
+/*! @privatesection */
+/*--------------------------------------------------------------------------------------------------------------------*/
+static u16 FatLogGetU16(u8* pu8Source_);
+static u32 FatLogGetU32(u8* pu8Source_);
+static void FatLogPutU16(u8* pu8Target_, u16 u16Value_);
+static void FatLogPutU32(u8* pu8Target_, u32 u32Value_);
+static u32 FatLogClusterToSector(u32 u32Cluster_);
+
+static void FatLogReadSector(u32 u32Sector_, u8* pu8Buffer_, fnCode_type pfNextState_);
+static void FatLogWriteSector(u32 u32Sector_, u8* pu8Buffer_, fnCode_type pfNextState_);
+static void FatLogWriteSectors(u32 u32Sector_, u32 u32Count_, u8* pu8Buffer_, fnCode_type pfNextState_);
+static void FatLogAllocateExtent(fnCode_type pfNextState_);
+static void FatLogChain(u32 u32First_, u32 u32Last_, u32 u32Tail_, fnCode_type pfNextState_);
+static void FatLogFail(u8* pu8Message_);
+static void FatLogIoCallback(u32 u32Token_, SdRequestStatusType eResult_);
+
+
+/***********************************************************************************************************************
+State Machine Declarations
+***********************************************************************************************************************/
+static void FatLogSM_Idle(void);
+static void FatLogSM_WaitCard(void);
+static void FatLogSM_ParseMbr(void);
+static void FatLogSM_ParseBpb(void);
+static void FatLogSM_UpdateFsInfo(void);
+static void FatLogSM_StartDirScan(void);
+static void FatLogSM_DirScan(void);
+static void FatLogSM_DirNextCluster(void);
+static void FatLogSM_NameFile(void);
+static void FatLogSM_CreateEntry(void);
+static void FatLogSM_WriteEntry(void);
+static void FatLogSM_Opened(void);
+
+static void FatLogSM_Logging(void);
+static void FatLogSM_SectorDone(void);
+static void FatLogSM_FlushEntry(void);
+static void FatLogSM_Flushed(void);
+
+static void FatLogSM_CloseTrim(void);
+static void FatLogSM_CloseTerminate(void);
+static void FatLogSM_CloseEmptyEntry(void);
+static void FatLogSM_Closed(void);
+
+static void FatLogSM_FatSearchRead(void);
+static void FatLogSM_FatSearch(void);
+static void FatLogSM_ChainExtent(void);
+static void FatLogSM_ExtentReady(void);
+static void FatLogSM_ChainRead(void);
+static void FatLogSM_ChainModify(void);
+static void FatLogSM_ChainWriteCopy(void);
+
+static void FatLogSM_StartRead(void);
+static void FatLogSM_WaitRead(void);
+static void FatLogSM_StartWrite(void);
+static void FatLogSM_WaitWrite(void);
+
+static void FatLogSM_Error(void);
+
+
+/**********************************************************************************************************************
+Constants / Definitions
+**********************************************************************************************************************/
+/* FatLog_u32Flags */
+#define _FATLOG_OPEN_REQUEST            (u32)0x00000001   /*!< @brief Set by FatLogOpen() */
+#define _FATLOG_FLUSH_REQUEST           (u32)0x00000002   /*!< @brief Set by FatLogFlush() */
+#define _FATLOG_CLOSE_REQUEST           (u32)0x00000004   /*!< @brief Set by FatLogClose() */
+#define _FATLOG_NAME_MATCH              (u32)0x00000008   /*!< @brief Set when the directory already holds a file from the same sequence */
+#define _FATLOG_DIR_END                 (u32)0x00000010   /*!< @brief Set when the end-of-directory marker is found */
+#define _FATLOG_CHAIN_FREE              (u32)0x00000020   /*!< @brief Set to release clusters instead of linking them */
+/* end of FatLog_u32Flags */
+
+#define FATLOG_SECTOR_SIZE              (u32)512          /*!< @brief Bytes per sector (only 512 is supported) */
+#define FATLOG_SECTOR_SHIFT             (u32)9            /*!< @brief log2(FATLOG_SECTOR_SIZE) */
+#define FATLOG_BUFFER_SECTORS           (u32)4            /*!< @brief Sectors of RAM buffering; must be a power of 2 */
+#define FATLOG_BUFFER_SIZE              (u32)(FATLOG_BUFFER_SECTORS * FATLOG_SECTOR_SIZE)
+#define FATLOG_PREALLOC_CLUSTERS        (u32)64           /*!< @brief Contiguous clusters reserved for the file each time it grows */
+#define FATLOG_FLUSH_PERIOD_MS          (u32)1000         /*!< @brief Maximum age of data that is not yet reflected in the file size */
+#define FATLOG_MOUNT_TIMEOUT_MS         (u32)5000         /*!< @brief Time to wait for the SD card to be ready when opening */
+#define FATLOG_IO_TIMEOUT_MS            (u32)2000         /*!< @brief Time allowed for one read or write request */
+#define FATLOG_NAME_SIZE                (u8)11            /*!< @brief 8.3 name in directory format */
+#define FATLOG_BASE_NAME_SIZE           (u8)8             /*!< @brief Characters before the extension */
+#define FATLOG_DEFAULT_DATE             (u16)0x4C21       /*!< @brief 2018-01-01: there is no calendar time available */
+
+/* Master boot record and FAT32 boot sector offsets */
+#define FAT_SIGNATURE_OFFSET            (u16)510
+#define FAT_SIGNATURE                   (u16)0xAA55
+#define FAT_MBR_PART1_TYPE              (u16)450
+#define FAT_MBR_PART1_LBA               (u16)454
+#define FAT_PART_TYPE_FAT32_CHS         (u8)0x0B
+#define FAT_PART_TYPE_FAT32_LBA         (u8)0x0C
+#define FAT_BPB_JUMP_SHORT              (u8)0xEB
+#define FAT_BPB_JUMP_NEAR               (u8)0xE9
+#define FAT_BPB_BYTES_PER_SEC           (u16)11
+#define FAT_BPB_SEC_PER_CLUS            (u16)13
+#define FAT_BPB_RSVD_SEC_CNT            (u16)14
+#define FAT_BPB_NUM_FATS                (u16)16
+#define FAT_BPB_FATSZ16                 (u16)22
+#define FAT_BPB_TOTSEC32                (u16)32
+#define FAT_BPB_FATSZ32                 (u16)36
+#define FAT_BPB_ROOT_CLUS               (u16)44
+#define FAT_BPB_FSINFO                  (u16)48
+
+/* FSInfo sector */
+#define FAT_FSI_LEAD_SIG                (u32)0x41615252
+#define FAT_FSI_FREE_COUNT              (u16)488
+#define FAT_FSI_NEXT_FREE               (u16)492
+#define FAT_FSI_UNKNOWN                 (u32)0xFFFFFFFF
+
+/* FAT32 table */
+#define FAT32_ENTRIES_PER_SECTOR_SHIFT  (u32)7            /*!< @brief 128 four-byte entries per sector */
+#define FAT32_ENTRY_INDEX_MASK          (u32)0x7F
+#define FAT32_ENTRY_MASK                (u32)0x0FFFFFFF   /*!< @brief Upper 4 bits of an entry are reserved */
+#define FAT32_FREE                      (u32)0x00000000
+#define FAT32_EOC                       (u32)0x0FFFFFFF
+#define FAT32_FIRST_CLUSTER             (u32)2
+
+/* Directory entries */
+#define FAT_DIR_ENTRY_SIZE              (u32)32
+#define FAT_DIR_ATTR                    (u8)11
+#define FAT_DIR_CRT_TIME                (u8)14
+#define FAT_DIR_CRT_DATE                (u8)16
+#define FAT_DIR_ACC_DATE                (u8)18
+#define FAT_DIR_FST_CLUS_HI             (u8)20
+#define FAT_DIR_WRT_TIME                (u8)22
+#define FAT_DIR_WRT_DATE                (u8)24
+#define FAT_DIR_FST_CLUS_LO             (u8)26
+#define FAT_DIR_FILE_SIZE               (u8)28
+#define FAT_DIR_END_MARKER              (u8)0x00
+#define FAT_DIR_DELETED                 (u8)0xE5
+#define FAT_ATTR_VOLUME_ID              (u8)0x08
+#define FAT_ATTR_ARCHIVE                (u8)0x20
+#define FAT_ATTR_LONG_NAME              (u8)0x0F
+
+
+#endif /* __FATLOG_H */
+
+
+/*--------------------------------------------------------------------------------------------------------------------*/
+/* End of File                                                                                                        */
+/*--------------------------------------------------------------------------------------------------------------------*/
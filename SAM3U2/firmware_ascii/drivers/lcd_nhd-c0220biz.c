@@ -17,7 +17,8 @@ Line #      Left most address             Last printed char           Right most
 ------------------------------------------------------------------------------------------------------------------------
 API
 void LcdInitialize(void)
-Initializes the LCD task and manually sends a message to the LCD.
+Initializes the LCD task and takes the LCD out of reset.  The power-up delays and the setup commands are run by the
+LCD state machine once the super loop has started, so the display comes on shortly after startup.
 This function must be run during the startup section of main.
 e.g.
 LcdInitialize();
@@ -108,12 +109,6 @@ void LCDCommand(u8 u8Command_)
   /* Queue the command to the IC application */
   TWI0WriteData(LCD_ADDRESS, sizeof(au8LCDWriteCommand), &au8LCDWriteCommand[0], STOP);
 
-  /* Add a delay during initialization to let the command send properly */
-  if(G_u32SystemFlags & _SYSTEM_INITIALIZING )
-  {
-    for(u32 i = 0; i < 100000; i++);
-  }
-  
 } /* end LCDCommand() */
 
 /*------------------------------------------------------------------------------
@@ -201,56 +196,27 @@ void LCDClearChars(u8 u8Address_, u8 u8CharactersToClear_)
 Function: LcdInitialize
 
 Description:
-Initializes the LCD task and manually sends a message to the LCD
+Initializes the LCD task and releases the LCD reset.  The rest of the setup
+takes 240 ms of delays, so it is done by LcdSM_PowerUp and LcdSM_ControlDelay
+after the super loop has started instead of holding up startup.
 
 Requires:
   - 
 
 Promises:
-  - LCD task Setup and LCD functions can now be called
+  - LCD is out of reset and the state machine is in LcdSM_PowerUp
+  - LCD functions can be called; messages queued before LcdSM_Idle is reached
+    are sent before the LCD setup commands and will not show
 */
 void LcdInitialize(void)
 {
-  u8 au8Commands[] = 
-  {
-    LCD_FUNCTION_CMD, LCD_FUNCTION2_CMD, LCD_BIAS_CMD, 
-    LCD_CONTRAST_CMD, LCD_DISPLAY_SET_CMD, LCD_FOLLOWER_CMD 
-  };
-                 /* "012345567890123456789" */
-  u8 au8Welcome[] = "RAZOR SAM3U2 ASCII   ";
-  
-  /* State to Idle */
-  Lcd_StateMachine = LcdSM_Idle;
-  
-  /* Turn on LCD wait 40 ms for it to setup */
+  /* Turn on LCD; LcdSM_PowerUp waits 40 ms for it to setup */
   AT91C_BASE_PIOB->PIO_SODR = PB_09_LCD_RST;
   Lcd_u32Timer = G_u32SystemTime1ms;
-  while( !IsTimeUp(&Lcd_u32Timer, LCD_STARTUP_DELAY) );
-  
-  /* Send Control Command */
-  TWI0WriteByte(LCD_ADDRESS, LCD_CONTROL_COMMAND, NO_STOP);
-  
-  /* Send Control Commands */
-  TWI0WriteData(LCD_ADDRESS, NUM_CONTROL_CMD, &au8Commands[0], NO_STOP);
-  
-  /* Wait for 200 ms */
-  Lcd_u32Timer = G_u32SystemTime1ms;
-  while( !IsTimeUp(&Lcd_u32Timer, LCD_CONTROL_COMMAND_DELAY) );
-  
-  /* Send Final Command to turn it on */
-  TWI0WriteByte(LCD_ADDRESS, LCD_DISPLAY_CMD | LCD_DISPLAY_ON, STOP);
-
-  /* Blacklight - White */
-  LedOn(LCD_RED);
-  LedOn(LCD_GREEN);
-  LedOn(LCD_BLUE);
+  Lcd_StateMachine = LcdSM_PowerUp;
   
-  TWI0WriteByte(LCD_ADDRESS, LCD_CONTROL_DATA, NO_STOP);
-  TWI0WriteData(LCD_ADDRESS, 20, &au8Welcome[0], STOP);
-  
-  LCDMessage(LINE2_START_ADDR, "EIE FW3 ANTTT");
-  
-  Lcd_u32Timer = G_u32SystemTime1ms;
+  /* The setup states wake the task for their delays and Idle has no work */
+  SchedulerSetEventDriven(PROFILER_TASK_LCD);
   G_u32ApplicationFlags |= _APPLICATION_FLAGS_LCD;
 
 } /* end LcdInitialize */
@@ -269,11 +235,21 @@ Requires:
 
 Promises:
   - Calls the function to pointed by the state machine function pointer
+  - During setup, the task is signalled when the current delay ends
 */
 void LcdRunActiveState(void)
 {
   Lcd_StateMachine();
 
+  if(Lcd_StateMachine == LcdSM_PowerUp)
+  {
+    SchedulerSignalAt(PROFILER_TASK_LCD, Lcd_u32Timer + LCD_STARTUP_DELAY);
+  }
+  else if(Lcd_StateMachine == LcdSM_ControlDelay)
+  {
+    SchedulerSignalAt(PROFILER_TASK_LCD, Lcd_u32Timer + LCD_CONTROL_COMMAND_DELAY);
+  }
+
 } /* end LcdRunActiveState */
 
 
@@ -281,6 +257,82 @@ void LcdRunActiveState(void)
 State Machine Function Declarations
 ***********************************************************************************************************************/
 
+/*------------------------------------------------------------------------------
+Function: LcdSM_PowerUp
+
+Description:
+Waits for the LCD to start after reset then sends the control commands.
+
+Requires:
+  - LCD reset was released at Lcd_u32Timer
+
+Promises:
+  - After LCD_STARTUP_DELAY, the control commands are queued and the state
+    machine moves to LcdSM_ControlDelay
+*/
+static void LcdSM_PowerUp(void)
+{
+  u8 au8Commands[] = 
+  {
+    LCD_FUNCTION_CMD, LCD_FUNCTION2_CMD, LCD_BIAS_CMD, 
+    LCD_CONTRAST_CMD, LCD_DISPLAY_SET_CMD, LCD_FOLLOWER_CMD 
+  };
+
+  if( IsTimeUp(&Lcd_u32Timer, LCD_STARTUP_DELAY) )
+  {
+    /* Send Control Command */
+    TWI0WriteByte(LCD_ADDRESS, LCD_CONTROL_COMMAND, NO_STOP);
+  
+    /* Send Control Commands */
+    TWI0WriteData(LCD_ADDRESS, NUM_CONTROL_CMD, &au8Commands[0], NO_STOP);
+
+    Lcd_u32Timer = G_u32SystemTime1ms;
+    Lcd_StateMachine = LcdSM_ControlDelay;
+  }
+  
+} /* end LcdSM_PowerUp() */
+
+
+/*------------------------------------------------------------------------------
+Function: LcdSM_ControlDelay
+
+Description:
+Waits for the LCD to apply the control commands then turns the display on and
+shows the welcome message.
+
+Requires:
+  - Control commands were queued at Lcd_u32Timer
+
+Promises:
+  - After LCD_CONTROL_COMMAND_DELAY, the display is on with the backlight white,
+    the welcome message is queued and the state machine moves to LcdSM_Idle
+*/
+static void LcdSM_ControlDelay(void)
+{
+                 /* "012345567890123456789" */
+  u8 au8Welcome[] = "RAZOR SAM3U2 ASCII   ";
+
+  if( IsTimeUp(&Lcd_u32Timer, LCD_CONTROL_COMMAND_DELAY) )
+  {
+    /* Send Final Command to turn it on */
+    TWI0WriteByte(LCD_ADDRESS, LCD_DISPLAY_CMD | LCD_DISPLAY_ON, STOP);
+
+    /* Blacklight - White */
+    LedOn(LCD_RED);
+    LedOn(LCD_GREEN);
+    LedOn(LCD_BLUE);
+  
+    TWI0WriteByte(LCD_ADDRESS, LCD_CONTROL_DATA, NO_STOP);
+    TWI0WriteData(LCD_ADDRESS, 20, &au8Welcome[0], STOP);
+  
+    LCDMessage(LINE2_START_ADDR, "EIE FW3 ANTTT");
+
+    Lcd_StateMachine = LcdSM_Idle;
+  }
+  
+} /* end LcdSM_ControlDelay() */
+
+
 /*------------------------------------------------------------------------------
 Function: LcdSM_Idle
 
@@ -120,6 +120,8 @@ void LcdRunActiveState(void);
 /***********************************************************************************************************************
 State Machine Declarations
 ***********************************************************************************************************************/
+static void LcdSM_PowerUp(void);
+static void LcdSM_ControlDelay(void);
 void LcdSM_Idle(void);
 
   
@@ -0,0 +1,724 @@
+/*!*********************************************************************************************************************
+@file rawlog.c
+@brief Log-structured recorder that writes fixed size records to a reserved raw region of the SD card.
+
+This is the high throughput alternative to fatlog.c.  There is no file system: records are packed into
+512 byte blocks that are written once, in order, around a circular region of the card.  Each block carries
+a sequence number and a CRC-32 so a reader can tell which blocks are valid and in what order they were
+written.  Since nothing but data blocks is ever written, every card access moves the log forward.
+
+On startup the head of the log (the next block to write) is found with a binary search over the region,
+which takes about log2(RAWLOG_SECTOR_COUNT) sector reads instead of a scan.  Before that, the card capacity
+and sector 0 are checked so the recorder never writes over a partition or into a card too small for the region.
+
+The region is read back on a PC with tools/rawlog_extract.py from an image of the card.
+
+------------------------------------------------------------------------------------------------------------------------
+GLOBALS
+- NONE
+
+CONSTANTS
+- RAWLOG_FIRST_SECTOR, RAWLOG_SECTOR_COUNT, RAWLOG_RECORD_SIZE, RAWLOG_FLUSH_PERIOD_MS
+
+TYPES
+- RawLogStatusType
+
+PUBLIC FUNCTIONS
+- bool RawLogWrite(u8* pu8Record_)
+- void RawLogFlush(void)
+- RawLogStatusType RawLogGetStatus(void)
+- u32 RawLogGetDroppedRecords(void)
+
+PROTECTED FUNCTIONS
+- void RawLogInitialize(void)
+- void RawLogRunActiveState(void)
+
+
+**********************************************************************************************************************/
+
+#include "configuration.h"
+
+/***********************************************************************************************************************
+Global variable definitions with scope across entire project.
+All Global variable names shall start with "G_<type>RawLog"
+***********************************************************************************************************************/
+/* New variables */
+
+
+/*--------------------------------------------------------------------------------------------------------------------*/
+/* Existing variables (defined in other files -- should all contain the "extern" keyword) */
+extern volatile u32 G_u32SystemTime1ms;                   /*!< @brief From main.c */
+extern volatile u32 G_u32SystemTime1s;                    /*!< @brief From main.c */
+extern volatile u32 G_u32SystemFlags;                     /*!< @brief From main.c */
+extern volatile u32 G_u32ApplicationFlags;                /*!< @brief From main.c */
+
+extern volatile u32 G_u32TokenLogFlags;                   /*!< @brief From tokenlog.c */
+extern u32 G_au32DebugLogMask[];                          /*!< @brief From debug.c */
+
+
+/***********************************************************************************************************************
+Global variable definitions with scope limited to this local application.
+Variable names shall start with "RawLog_<type>" and be declared as static.
+***********************************************************************************************************************/
+static fnCode_type RawLog_pfStateMachine;                 /*!< @brief The state machine function pointer */
+static fnCode_type RawLog_pfIoReturnState;                /*!< @brief State to run when the current read is done */
+
+static RawLogStatusType RawLog_eStatus;                   /*!< @brief Status reported to the client */
+static u32 RawLog_u32Timeout;                             /*!< @brief Timeout counter used across states */
+static u32 RawLog_u32IoSector;                            /*!< @brief Sector for the current read or write */
+static u32 RawLog_u32IoToken;                             /*!< @brief SD request token for the current read or write */
+
+static u8 RawLog_aau8Block[2][RAWLOG_BLOCK_SIZE];         /*!< @brief One block filling while the other is written */
+static u8 RawLog_u8FillBlock;                             /*!< @brief Index of the block taking records */
+static u32 RawLog_u32FillCount;                           /*!< @brief Records in the fill block */
+static u32 RawLog_u32FlushTimer;                          /*!< @brief Time the first record went into the fill block */
+static bool RawLog_bFlushRequest;                         /*!< @brief Set by RawLogFlush() */
+static bool RawLog_bWritePending;                         /*!< @brief TRUE while the other block is being written */
+static u32 RawLog_u32DroppedRecords;                      /*!< @brief Records refused because both blocks were busy */
+
+static u32 RawLog_u32Head;                                /*!< @brief Index in the region of the next block to write */
+static u32 RawLog_u32NextSequence;                        /*!< @brief Sequence number of the next block */
+static u32 RawLog_u32FirstSequence;                       /*!< @brief Sequence of block 0 during the head search */
+static u32 RawLog_u32Low;                                 /*!< @brief Lowest index that may be the head */
+static u32 RawLog_u32High;                                /*!< @brief Highest index that may be the head */
+static u32 RawLog_u32Middle;                              /*!< @brief Index being checked */
+
+static u8 RawLog_au8ErrorIo[] = "RawLog: card access failed\n\r";
+static u8 RawLog_au8ErrorSize[] = "RawLog: card too small for the region\n\r";
+static u8 RawLog_au8ErrorInUse[] = "RawLog: a partition overlaps the region\n\r";
+
+
+/**********************************************************************************************************************
+Function Definitions
+**********************************************************************************************************************/
+
+/*--------------------------------------------------------------------------------------------------------------------*/
+/*! @publicsection */
+/*--------------------------------------------------------------------------------------------------------------------*/
+
+/*!----------------------------------------------------------------------------------------------------------------------
+@fn bool RawLogWrite(u8* pu8Record_)
+
+@brief Adds one record to the log.
+
+Records are collected in RAM and written RAWLOG_RECORDS_PER_BLOCK at a time.  This must not be called from
+an interrupt.
+
+Requires:
+@param pu8Record_ points to RAWLOG_RECORD_SIZE bytes
+
+Promises:
+- Returns TRUE if the record was taken
+- Returns FALSE and counts a dropped record if the card has not kept up or the card is not available
+
+*/
+bool RawLogWrite(u8* pu8Record_)
+{
+  if( ( (RawLog_eStatus != RAWLOG_READY) && (RawLog_eStatus != RAWLOG_MOUNTING) ) ||
+      (RawLog_u32FillCount == RAWLOG_RECORDS_PER_BLOCK) )
+  {
+    RawLog_u32DroppedRecords++;
+    return FALSE;
+  }
+
+  /* The age of the oldest record decides when a partial block is written */
+  if(RawLog_u32FillCount == 0)
+  {
+    RawLog_u32FlushTimer = G_u32SystemTime1ms;
+  }
+
+  memcpy(&RawLog_aau8Block[RawLog_u8FillBlock][RAWLOG_HEADER_SIZE + (RawLog_u32FillCount * RAWLOG_RECORD_SIZE)],
+         pu8Record_, RAWLOG_RECORD_SIZE);
+  RawLog_u32FillCount++;
+  SchedulerSignal(PROFILER_TASK_RAWLOG);
+
+  return TRUE;
+
+} /* end RawLogWrite() */
+
+
+/*!----------------------------------------------------------------------------------------------------------------------
+@fn void RawLogFlush(void)
+
+@brief Requests that the records collected so far are written right away.
+
+Requires:
+- NONE
+
+Promises:
+- The partly filled block is written the next time the card is free
+
+*/
+void RawLogFlush(void)
+{
+  RawLog_bFlushRequest = TRUE;
+  SchedulerSignal(PROFILER_TASK_RAWLOG);
+
+} /* end RawLogFlush() */
+
+
+/*!----------------------------------------------------------------------------------------------------------------------
+@fn RawLogStatusType RawLogGetStatus(void)
+
+@brief Reports the status of the recorder.
+
+Requires:
+- NONE
+
+Promises:
+- Returns RawLog_eStatus
+
+*/
+RawLogStatusType RawLogGetStatus(void)
+{
+  return RawLog_eStatus;
+
+} /* end RawLogGetStatus() */
+
+
+/*!----------------------------------------------------------------------------------------------------------------------
+@fn u32 RawLogGetDroppedRecords(void)
+
+@brief Reports how many records could not be taken since startup.
+
+Requires:
+- NONE
+
+Promises:
+- Returns RawLog_u32DroppedRecords
+
+*/
+u32 RawLogGetDroppedRecords(void)
+{
+  return RawLog_u32DroppedRecords;
+
+} /* end RawLogGetDroppedRecords() */
+
+
+/*--------------------------------------------------------------------------------------------------------------------*/
+/*! @protectedsection */
+/*--------------------------------------------------------------------------------------------------------------------*/
+
+/*!--------------------------------------------------------------------------------------------------------------------
+@fn void RawLogInitialize(void)
+
+@brief Initializes the State Machine and its variables.
+
+Should only be called once in main init section.
+
+Requires:
+- NONE
+
+Promises:
+- The task waits for a card and then finds the head of the log
+
+*/
+void RawLogInitialize(void)
+{
+  RawLog_u8FillBlock = 0;
+  RawLog_u32FillCount = 0;
+  RawLog_bFlushRequest = FALSE;
+  RawLog_bWritePending = FALSE;
+  RawLog_u32DroppedRecords = 0;
+
+  RawLog_eStatus = RAWLOG_NO_CARD;
+  RawLog_pfStateMachine = RawLogSM_WaitCard;
+
+  /* RawLogWrite() and RawLogFlush() signal the task and RawLogRunActiveState() keeps it going */
+  SchedulerSetEventDriven(PROFILER_TASK_RAWLOG);
+  G_u32ApplicationFlags |= _APPLICATION_FLAGS_RAWLOG;
+
+} /* end RawLogInitialize() */
+
+
+/*!----------------------------------------------------------------------------------------------------------------------
+@fn void RawLogRunActiveState(void)
+
+@brief Selects and runs one iteration of the current state in the state machine.
+
+All state machines have a TOTAL of 1ms to execute, so on average n state machines
+may take 1ms / n to execute.
+
+Requires:
+- State machine function pointer points at current state
+
+Promises:
+- Calls the function to pointed by the state machine function pointer
+- The task is signalled for the next pass while it has work, every SD_CARD_DETECT_PERIOD_MS while it waits
+  for a card (or for an unusable card to be removed), when the oldest record is due in Idle, and by
+  RawLogIoCallback() or the I/O timeout while a block is with the SD task
+
+*/
+void RawLogRunActiveState(void)
+{
+  RawLog_pfStateMachine();
+
+  if( (RawLog_pfStateMachine == RawLogSM_WaitCard) || (RawLog_pfStateMachine == RawLogSM_Unusable) )
+  {
+    SchedulerSignalAt(PROFILER_TASK_RAWLOG, G_u32SystemTime1ms + SD_CARD_DETECT_PERIOD_MS);
+  }
+  else if(RawLog_pfStateMachine == RawLogSM_Idle)
+  {
+    /* Idle has work now for a full block or a flush, otherwise only when the flush period ends */
+    if( (RawLog_u32FillCount == RAWLOG_RECORDS_PER_BLOCK) || (RawLog_bFlushRequest && (RawLog_u32FillCount != 0)) )
+    {
+      SchedulerSignal(PROFILER_TASK_RAWLOG);
+    }
+    else if(RawLog_u32FillCount != 0)
+    {
+      SchedulerSignalAt(PROFILER_TASK_RAWLOG, RawLog_u32FlushTimer + RAWLOG_FLUSH_PERIOD_MS);
+    }
+  }
+  else if( (RawLog_pfStateMachine == RawLogSM_WaitRead) || (RawLog_pfStateMachine == RawLogSM_WaitWrite) )
+  {
+    SchedulerSignalAt(PROFILER_TASK_RAWLOG, RawLog_u32Timeout + RAWLOG_IO_TIMEOUT_MS);
+  }
+  else
+  {
+    SchedulerSignal(PROFILER_TASK_RAWLOG);
+  }
+
+} /* end RawLogRunActiveState */
+
+
+/*------------------------------------------------------------------------------------------------------------------*/
+/*! @privatesection */
+/*--------------------------------------------------------------------------------------------------------------------*/
+
+/*!----------------------------------------------------------------------------------------------------------------------
+@fn static u32 RawLogGetU32(u8* pu8Source_)
+
+@brief Reads a little endian u32 from a block at any alignment.
+
+*/
+static u32 RawLogGetU32(u8* pu8Source_)
+{
+  return( (u32)pu8Source_[0]         | ((u32)pu8Source_[1] << 8) |
+         ((u32)pu8Source_[2] << 16) | ((u32)pu8Source_[3] << 24) );
+
+} /* end RawLogGetU32() */
+
+
+/*!----------------------------------------------------------------------------------------------------------------------
+@fn static void RawLogPutU32(u8* pu8Target_, u32 u32Value_)
+
+@brief Writes a little endian u32 into a block at any alignment.
+
+*/
+static void RawLogPutU32(u8* pu8Target_, u32 u32Value_)
+{
+  pu8Target_[0] = (u8)u32Value_;
+  pu8Target_[1] = (u8)(u32Value_ >> 8);
+  pu8Target_[2] = (u8)(u32Value_ >> 16);
+  pu8Target_[3] = (u8)(u32Value_ >> 24);
+
+} /* end RawLogPutU32() */
+
+
+/*!----------------------------------------------------------------------------------------------------------------------
+@fn static bool RawLogIsValid(u8* pu8Block_)
+
+@brief Checks that a block was completely written by the recorder.
+
+Requires:
+@param pu8Block_ points to a block read from the region
+
+Promises:
+- Returns TRUE if the magic number and CRC are correct
+
+*/
+static bool RawLogIsValid(u8* pu8Block_)
+{
+  return( (RawLogGetU32(&pu8Block_[RAWLOG_INDEX_MAGIC]) == RAWLOG_MAGIC) &&
+          (RawLogGetU32(&pu8Block_[RAWLOG_INDEX_CRC]) == Crc32(0, pu8Block_, RAWLOG_INDEX_CRC)) );
+
+} /* end RawLogIsValid() */
+
+
+/*!----------------------------------------------------------------------------------------------------------------------
+@fn static bool RawLogOverlaps(u32 u32Start_, u32 u32Sectors_)
+
+@brief Checks whether a range of sectors shares any sector with the region.
+
+Requires:
+@param u32Start_ is the first sector of the range
+@param u32Sectors_ is the number of sectors in the range
+
+Promises:
+- Returns TRUE if the range overlaps RAWLOG_FIRST_SECTOR to RAWLOG_END_SECTOR - 1
+
+*/
+static bool RawLogOverlaps(u32 u32Start_, u32 u32Sectors_)
+{
+  if( (u32Sectors_ == 0) || (u32Start_ >= RAWLOG_END_SECTOR) )
+  {
+    return FALSE;
+  }
+
+  /* Compared this way round so a range near the end of the card cannot wrap */
+  return( (u32Start_ >= RAWLOG_FIRST_SECTOR) || (u32Sectors_ > (RAWLOG_FIRST_SECTOR - u32Start_)) );
+
+} /* end RawLogOverlaps() */
+
+
+/*!----------------------------------------------------------------------------------------------------------------------
+@fn static bool RawLogRegionIsFree(u8* pu8Sector0_)
+
+@brief Checks sector 0 of the card for anything that uses the region.
+
+Sector 0 is either a partition table or, on a card formatted without one, the boot sector of a volume that starts
+at sector 0.  A protective GPT entry (type 0xEE) covers the whole card, so GPT cards are refused too.
+
+Requires:
+@param pu8Sector0_ points to sector 0 of the card
+
+Promises:
+- Returns TRUE if sector 0 has no signature (blank card) or nothing it describes overlaps the region
+
+*/
+static bool RawLogRegionIsFree(u8* pu8Sector0_)
+{
+  u8* pu8Entry;
+  u32 u32Sectors;
+
+  if( (pu8Sector0_[RAWLOG_MBR_SIGNATURE] != 0x55) || (pu8Sector0_[RAWLOG_MBR_SIGNATURE + 1] != 0xAA) )
+  {
+    return TRUE;
+  }
+
+  /* A boot sector starts with a jump and reports 512 byte sectors; its size is the 16 or 32-bit total */
+  if( ( (pu8Sector0_[0] == RAWLOG_BPB_JUMP_SHORT) || (pu8Sector0_[0] == RAWLOG_BPB_JUMP_NEAR) ) &&
+      (pu8Sector0_[RAWLOG_BPB_BYTES_PER_SEC] == 0x00) && (pu8Sector0_[RAWLOG_BPB_BYTES_PER_SEC + 1] == 0x02) )
+  {
+    u32Sectors = (u32)pu8Sector0_[RAWLOG_BPB_TOTSEC16] | ((u32)pu8Sector0_[RAWLOG_BPB_TOTSEC16 + 1] << 8);
+    if(u32Sectors == 0)
+    {
+      u32Sectors = RawLogGetU32(&pu8Sector0_[RAWLOG_BPB_TOTSEC32]);
+    }
+
+    return( !RawLogOverlaps(0, u32Sectors) );
+  }
+
+  for(u32 i = 0; i < RAWLOG_MBR_ENTRIES; i++)
+  {
+    pu8Entry = &pu8Sector0_[RAWLOG_MBR_PARTITIONS + (i * RAWLOG_MBR_ENTRY_SIZE)];
+    if( (pu8Entry[RAWLOG_MBR_INDEX_TYPE] != 0) &&
+        RawLogOverlaps(RawLogGetU32(&pu8Entry[RAWLOG_MBR_INDEX_START]), RawLogGetU32(&pu8Entry[RAWLOG_MBR_INDEX_SECTORS])) )
+    {
+      return FALSE;
+    }
+  }
+
+  return TRUE;
+
+} /* end RawLogRegionIsFree() */
+
+
+/*!----------------------------------------------------------------------------------------------------------------------
+@fn static void RawLogSearchStep(void)
+
+@brief Reads the middle of the remaining search range or finishes the head search.
+
+Blocks 0 to head-1 hold the current lap; every other block is blank, torn or from the previous lap.
+The head is the first index in [RawLog_u32Low, RawLog_u32High] that is not part of the current lap.
+
+Requires:
+- RawLog_u32FirstSequence holds the sequence number of block 0
+
+Promises:
+- If the range holds more than one index, the middle block is read and RawLogSM_Search runs next
+- Otherwise RawLog_u32Head and RawLog_u32NextSequence are set and the recorder is ready
+
+*/
+static void RawLogSearchStep(void)
+{
+  u8 au8HeadFound[] = "RawLog head found\n\r";
+
+  if(RawLog_u32Low < RawLog_u32High)
+  {
+    RawLog_u32Middle = RawLog_u32Low + ((RawLog_u32High - RawLog_u32Low) >> 1);
+    RawLog_u32IoSector = RAWLOG_FIRST_SECTOR + RawLog_u32Middle;
+    RawLog_pfIoReturnState = RawLogSM_Search;
+    RawLog_u32Timeout = G_u32SystemTime1ms;
+    RawLog_pfStateMachine = RawLogSM_StartRead;
+    return;
+  }
+
+  RawLog_u32NextSequence = RawLog_u32FirstSequence + RawLog_u32Low;
+  RawLog_u32Head = RawLog_u32Low;
+  if(RawLog_u32Head == RAWLOG_SECTOR_COUNT)
+  {
+    RawLog_u32Head = 0;
+  }
+
+  LOG_INFO(_DEBUG_LOG_RAWLOG, "%s", au8HeadFound);
+  RawLog_eStatus = RAWLOG_READY;
+  RawLog_pfStateMachine = RawLogSM_Idle;
+
+} /* end RawLogSearchStep() */
+
+
+/*!----------------------------------------------------------------------------------------------------------------------
+@fn static void RawLogIoCallback(u32 u32Token_, SdRequestStatusType eResult_)
+
+@brief SD request callback that wakes the task when its block read or write finishes.
+
+*/
+static void RawLogIoCallback(u32 u32Token_, SdRequestStatusType eResult_)
+{
+  SchedulerSignal(PROFILER_TASK_RAWLOG);
+
+} /* end RawLogIoCallback() */
+
+
+/**********************************************************************************************************************
+State Machine Function Definitions
+**********************************************************************************************************************/
+
+/*-------------------------------------------------------------------------------------------------------------------*/
+/* Wait for a card that is big enough for the region then read sector 0. Block 1 is used for reads so records 
+can still be collected in block 0. */
+static void RawLogSM_WaitCard(void)
+{
+  SdCardStateType eCardState = SdGetStatus();
+
+  if( (eCardState != SD_NO_CARD) && (eCardState != SD_CARD_ERROR) )
+  {
+    RawLog_u8FillBlock = 0;
+
+    if(SdGetSectorCount() < RAWLOG_END_SECTOR)
+    {
+      LOG_ERROR(_DEBUG_LOG_RAWLOG, "%s", RawLog_au8ErrorSize);
+      RawLog_eStatus = RAWLOG_ERROR;
+      RawLog_pfStateMachine = RawLogSM_Unusable;
+      return;
+    }
+
+    RawLog_eStatus = RAWLOG_MOUNTING;
+    RawLog_u32IoSector = 0;
+    RawLog_pfIoReturnState = RawLogSM_CheckCard;
+    RawLog_u32Timeout = G_u32SystemTime1ms;
+    RawLog_pfStateMachine = RawLogSM_StartRead;
+  }
+
+} /* end RawLogSM_WaitCard() */
+
+
+/*-------------------------------------------------------------------------------------------------------------------*/
+/* Sector 0 is in: leave the card alone if anything uses the region, otherwise read the first block of the region */
+static void RawLogSM_CheckCard(void)
+{
+  if( !RawLogRegionIsFree(&RawLog_aau8Block[1][0]) )
+  {
+    LOG_ERROR(_DEBUG_LOG_RAWLOG, "%s", RawLog_au8ErrorInUse);
+    RawLog_u32FillCount = 0;
+    RawLog_eStatus = RAWLOG_ERROR;
+    RawLog_pfStateMachine = RawLogSM_Unusable;
+    return;
+  }
+
+  RawLog_u32IoSector = RAWLOG_FIRST_SECTOR;
+  RawLog_pfIoReturnState = RawLogSM_CheckFirst;
+  RawLog_u32Timeout = G_u32SystemTime1ms;
+  RawLog_pfStateMachine = RawLogSM_StartRead;
+
+} /* end RawLogSM_CheckCard() */
+
+
+/*-------------------------------------------------------------------------------------------------------------------*/
+/* The card cannot hold the region: nothing is written until it is taken out */
+static void RawLogSM_Unusable(void)
+{
+  if(SdGetStatus() == SD_NO_CARD)
+  {
+    RawLog_eStatus = RAWLOG_NO_CARD;
+    RawLog_pfStateMachine = RawLogSM_WaitCard;
+  }
+
+} /* end RawLogSM_Unusable() */
+
+
+/*-------------------------------------------------------------------------------------------------------------------*/
+/* Queue the read with the SD card task */
+static void RawLogSM_StartRead(void)
+{
+  RawLog_u32IoToken = SdQueueRead(RawLog_u32IoSector, 1, &RawLog_aau8Block[1][0], RawLogIoCallback);
+  if(RawLog_u32IoToken != 0)
+  {
+    RawLog_pfStateMachine = RawLogSM_WaitRead;
+  }
+  else if( IsTimeUp(&RawLog_u32Timeout, RAWLOG_IO_TIMEOUT_MS) )
+  {
+    RawLog_pfStateMachine = RawLogSM_Error;
+  }
+
+} /* end RawLogSM_StartRead() */
+
+
+/*-------------------------------------------------------------------------------------------------------------------*/
+/* Wait for the block data */
+static void RawLogSM_WaitRead(void)
+{
+  SdRequestStatusType eResult = SdQueryRequest(RawLog_u32IoToken);
+
+  if(eResult == SD_REQUEST_DONE)
+  {
+    RawLog_pfStateMachine = RawLog_pfIoReturnState;
+  }
+  else if( (eResult == SD_REQUEST_FAILED) || (eResult == SD_REQUEST_UNKNOWN) ||
+           IsTimeUp(&RawLog_u32Timeout, RAWLOG_IO_TIMEOUT_MS) )
+  {
+    RawLog_pfStateMachine = RawLogSM_Error;
+  }
+
+} /* end RawLogSM_WaitRead() */
+
+
+/*-------------------------------------------------------------------------------------------------------------------*/
+/* Block 0 sets the sequence of the current lap; a blank region starts a new log */
+static void RawLogSM_CheckFirst(void)
+{
+  if( RawLogIsValid(&RawLog_aau8Block[1][0]) )
+  {
+    RawLog_u32FirstSequence = RawLogGetU32(&RawLog_aau8Block[1][RAWLOG_INDEX_SEQUENCE]);
+    RawLog_u32Low  = 1;
+    RawLog_u32High = RAWLOG_SECTOR_COUNT;
+  }
+  else
+  {
+    RawLog_u32FirstSequence = 0;
+    RawLog_u32Low  = 0;
+    RawLog_u32High = 0;
+  }
+
+  RawLogSearchStep();
+
+} /* end RawLogSM_CheckFirst() */
+
+
+/*-------------------------------------------------------------------------------------------------------------------*/
+/* Narrow the search range with the block just read */
+static void RawLogSM_Search(void)
+{
+  u8* pu8Block = &RawLog_aau8Block[1][0];
+
+  if( RawLogIsValid(pu8Block) &&
+      (RawLogGetU32(&pu8Block[RAWLOG_INDEX_SEQUENCE]) == (RawLog_u32FirstSequence + RawLog_u32Middle)) )
+  {
+    RawLog_u32Low = RawLog_u32Middle + 1;
+  }
+  else
+  {
+    RawLog_u32High = RawLog_u32Middle;
+  }
+
+  RawLogSearchStep();
+
+} /* end RawLogSM_Search() */
+
+
+/*-------------------------------------------------------------------------------------------------------------------*/
+/* Seal the fill block when it is full, flushed or old enough and start writing it */
+static void RawLogSM_Idle(void)
+{
+  u8* pu8Block;
+
+  if( RawLog_bWritePending || (RawLog_u32FillCount == 0) )
+  {
+    return;
+  }
+
+  if( (RawLog_u32FillCount == RAWLOG_RECORDS_PER_BLOCK) || RawLog_bFlushRequest ||
+      IsTimeUp(&RawLog_u32FlushTimer, RAWLOG_FLUSH_PERIOD_MS) )
+  {
+    pu8Block = &RawLog_aau8Block[RawLog_u8FillBlock][0];
+
+    /* Unused record space is cleared so the CRC covers known data */
+    memset(&pu8Block[RAWLOG_HEADER_SIZE + (RawLog_u32FillCount * RAWLOG_RECORD_SIZE)], 0,
+           (RAWLOG_RECORDS_PER_BLOCK - RawLog_u32FillCount) * RAWLOG_RECORD_SIZE);
+
+    RawLogPutU32(&pu8Block[RAWLOG_INDEX_MAGIC], RAWLOG_MAGIC);
+    RawLogPutU32(&pu8Block[RAWLOG_INDEX_SEQUENCE], RawLog_u32NextSequence);
+    pu8Block[RAWLOG_INDEX_COUNT]           = (u8)RawLog_u32FillCount;
+    pu8Block[RAWLOG_INDEX_COUNT + 1]       = 0;
+    pu8Block[RAWLOG_INDEX_RECORD_SIZE]     = (u8)RAWLOG_RECORD_SIZE;
+    pu8Block[RAWLOG_INDEX_RECORD_SIZE + 1] = 0;
+    RawLogPutU32(&pu8Block[RAWLOG_INDEX_CRC], Crc32(0, pu8Block, RAWLOG_INDEX_CRC));
+
+    /* Swap blocks: new records go to the other one while this one is written */
+    RawLog_bWritePending = TRUE;
+    RawLog_bFlushRequest = FALSE;
+    RawLog_u32IoSector = RAWLOG_FIRST_SECTOR + RawLog_u32Head;
+    RawLog_u8FillBlock ^= 1;
+    RawLog_u32FillCount = 0;
+
+    RawLog_u32Timeout = G_u32SystemTime1ms;
+    RawLog_pfStateMachine = RawLogSM_StartWrite;
+  }
+
+} /* end RawLogSM_Idle() */
+
+
+/*-------------------------------------------------------------------------------------------------------------------*/
+/* Queue the sealed block with the SD card task */
+static void RawLogSM_StartWrite(void)
+{
+  RawLog_u32IoToken = SdQueueWrite(RawLog_u32IoSector, 1, &RawLog_aau8Block[RawLog_u8FillBlock ^ 1][0], RawLogIoCallback);
+  if(RawLog_u32IoToken != 0)
+  {
+    RawLog_pfStateMachine = RawLogSM_WaitWrite;
+  }
+  else if( IsTimeUp(&RawLog_u32Timeout, RAWLOG_IO_TIMEOUT_MS) )
+  {
+    RawLog_pfStateMachine = RawLogSM_Error;
+  }
+
+} /* end RawLogSM_StartWrite() */
+
+
+/*-------------------------------------------------------------------------------------------------------------------*/
+/* Wait for the card to program the block then advance the head */
+static void RawLogSM_WaitWrite(void)
+{
+  SdRequestStatusType eResult = SdQueryRequest(RawLog_u32IoToken);
+
+  if(eResult == SD_REQUEST_DONE)
+  {
+    TOKENLOG2(TOKENLOG_RAWLOG_BLOCK, RawLog_u32NextSequence, RAWLOG_FIRST_SECTOR + RawLog_u32Head);
+    RawLog_u32NextSequence++;
+    RawLog_u32Head++;
+    if(RawLog_u32Head == RAWLOG_SECTOR_COUNT)
+    {
+      RawLog_u32Head = 0;
+    }
+
+    RawLog_bWritePending = FALSE;
+    RawLog_pfStateMachine = RawLogSM_Idle;
+  }
+  else if( (eResult == SD_REQUEST_FAILED) || (eResult == SD_REQUEST_UNKNOWN) ||
+           IsTimeUp(&RawLog_u32Timeout, RAWLOG_IO_TIMEOUT_MS) )
+  {
+    RawLog_pfStateMachine = RawLogSM_Error;
+  }
+
+} /* end RawLogSM_WaitWrite() */
+
+
+/*-------------------------------------------------------------------------------------------------------------------*/
+/* Card access failed: drop the block in flight and find the head again once the card is back */
+static void RawLogSM_Error(void)
+{
+  LOG_ERROR(_DEBUG_LOG_RAWLOG, "%s", RawLog_au8ErrorIo);
+
+  RawLog_bWritePending = FALSE;
+  RawLog_u32FillCount = 0;
+  RawLog_eStatus = RAWLOG_NO_CARD;
+  RawLog_pfStateMachine = RawLogSM_WaitCard;
+
+} /* end RawLogSM_Error() */
+
+
+
+/*--------------------------------------------------------------------------------------------------------------------*/
+/* End of File                                                                                                        */
+/*--------------------------------------------------------------------------------------------------------------------*/
@@ -0,0 +1,133 @@
+/*!*********************************************************************************************************************
+@file rawlog.h
+@brief Header file for rawlog.c
+
+**********************************************************************************************************************/
+
+#ifndef __RAWLOG_H
+#define __RAWLOG_H
+
+/**********************************************************************************************************************
+Type Definitions
+**********************************************************************************************************************/
+
+/*!
+@enum RawLogStatusType
+@brief Status of the recorder reported to clients.
+*/
+typedef enum {RAWLOG_NO_CARD, RAWLOG_MOUNTING, RAWLOG_READY, RAWLOG_ERROR} RawLogStatusType;
+
+
+/**********************************************************************************************************************
+Function Declarations
+**********************************************************************************************************************/
+
+/*------------------------------------------------------------------------------------------------------------------*/
+/*! @publicsection */
+/*--------------------------------------------------------------------------------------------------------------------*/
+bool RawLogWrite(u8* pu8Record_);
+void RawLogFlush(void);
+RawLogStatusType RawLogGetStatus(void);
+u32 RawLogGetDroppedRecords(void);
+
+
+/*------------------------------------------------------------------------------------------------------------------*/
+/*! @protectedsection */
+/*--------------------------------------------------------------------------------------------------------------------*/
+void RawLogInitialize(void);
+void RawLogRunActiveState(void);
+
+
+/*------------------------------------------------------------------------------------------------------------------*/
+/*! @privatesection */
+/*--------------------------------------------------------------------------------------------------------------------*/
+static u32 RawLogGetU32(u8* pu8Source_);
+static void RawLogPutU32(u8* pu8Target_, u32 u32Value_);
+static bool RawLogIsValid(u8* pu8Block_);
+static bool RawLogOverlaps(u32 u32Start_, u32 u32Sectors_);
+static bool RawLogRegionIsFree(u8* pu8Sector0_);
+static void RawLogSearchStep(void);
+static void RawLogIoCallback(u32 u32Token_, SdRequestStatusType eResult_);
+
+
+/***********************************************************************************************************************
+State Machine Declarations
+***********************************************************************************************************************/
+static void RawLogSM_WaitCard(void);
+static void RawLogSM_CheckCard(void);
+static void RawLogSM_Unusable(void);
+static void RawLogSM_StartRead(void);
+static void RawLogSM_WaitRead(void);
+static void RawLogSM_CheckFirst(void);
+static void RawLogSM_Search(void);
+static void RawLogSM_Idle(void);
+static void RawLogSM_StartWrite(void);
+static void RawLogSM_WaitWrite(void);
+static void RawLogSM_Error(void);
+
+
+/**********************************************************************************************************************
+Constants / Definitions
+**********************************************************************************************************************/
+/*! @cond DOXYGEN_EXCLUDE */
+/*----------------------------------------------------------------------------------------------------------------------
+Reserved region
+
+The recorder owns RAWLOG_SECTOR_COUNT sectors starting at RAWLOG_FIRST_SECTOR.  The card must be partitioned so
+that any FAT volume ends before this region (e.g. a 512MB first partition on a card of 1GB or more).  Before the
+first write the recorder checks the card capacity and sector 0, and leaves the card alone (RAWLOG_ERROR) if the
+card is too small, a partition table entry overlaps the region, or sector 0 is a volume that covers it.
+
+Block format (one 512 byte sector, all values little endian)
+  [0]   u32 RAWLOG_MAGIC
+  [4]   u32 sequence number: increments by 1 for every block written, never reset
+  [8]   u16 number of records in the block
+  [10]  u16 RAWLOG_RECORD_SIZE
+  [12]  records
+  [508] u32 CRC-32 of bytes 0-507
+
+Block n of the region always holds sequence (first sequence of the current lap + n), so the blocks written in the
+current lap form a prefix of the region and the head is found with a binary search.
+*/
+#define RAWLOG_FIRST_SECTOR             (u32)0x00100000   /* First sector of the region (512MB into the card) */
+#define RAWLOG_SECTOR_COUNT             (u32)0x00100000   /* Sectors in the region (512MB) */
+#define RAWLOG_END_SECTOR               (u32)(RAWLOG_FIRST_SECTOR + RAWLOG_SECTOR_COUNT) /* First sector after the region */
+
+/* Sector 0: master boot record, or the boot sector of a volume on a card without a partition table */
+#define RAWLOG_MBR_SIGNATURE            (u32)510          /* 0x55 0xAA */
+#define RAWLOG_MBR_PARTITIONS           (u32)446          /* First of 4 partition entries */
+#define RAWLOG_MBR_ENTRY_SIZE           (u32)16
+#define RAWLOG_MBR_ENTRIES              (u32)4
+#define RAWLOG_MBR_INDEX_TYPE           (u32)4            /* 0 if the entry is unused */
+#define RAWLOG_MBR_INDEX_START          (u32)8
+#define RAWLOG_MBR_INDEX_SECTORS        (u32)12
+#define RAWLOG_BPB_JUMP_SHORT           (u8)0xEB
+#define RAWLOG_BPB_JUMP_NEAR            (u8)0xE9
+#define RAWLOG_BPB_BYTES_PER_SEC        (u32)11
+#define RAWLOG_BPB_TOTSEC16             (u32)19
+#define RAWLOG_BPB_TOTSEC32             (u32)32
+
+#define RAWLOG_MAGIC                    (u32)0x474F4C52   /* "RLOG" */
+#define RAWLOG_BLOCK_SIZE               (u32)512
+#define RAWLOG_HEADER_SIZE              (u32)12
+#define RAWLOG_CRC_SIZE                 (u32)4
+#define RAWLOG_RECORD_SIZE              (u32)16           /* Bytes per record */
+#define RAWLOG_RECORDS_PER_BLOCK        (u32)((RAWLOG_BLOCK_SIZE - RAWLOG_HEADER_SIZE - RAWLOG_CRC_SIZE) / RAWLOG_RECORD_SIZE)
+
+#define RAWLOG_INDEX_MAGIC              (u32)0
+#define RAWLOG_INDEX_SEQUENCE           (u32)4
+#define RAWLOG_INDEX_COUNT              (u32)8
+#define RAWLOG_INDEX_RECORD_SIZE        (u32)10
+#define RAWLOG_INDEX_CRC                (u32)(RAWLOG_BLOCK_SIZE - RAWLOG_CRC_SIZE)
+
+#define RAWLOG_FLUSH_PERIOD_MS          (u32)1000         /* A partly filled block is written after this time */
+#define RAWLOG_IO_TIMEOUT_MS            (u32)2000         /* Time allowed for one sector read or write */
+/*! @endcond */
+
+
+#endif /* __RAWLOG_H */
+
+
+/*--------------------------------------------------------------------------------------------------------------------*/
+/* End of File                                                                                                        */
+/*--------------------------------------------------------------------------------------------------------------------*/
@@ -11,18 +11,26 @@ Client applications may use the following functions to access this driver:
 SdGetStatus() - returns a variable of type SdCardStateType which may have the following value:
   SD_NO_CARD: no card is inserted.
   SD_CARD_ERROR: an inserted card has an error.
-  SD_IDLE: card is ready and waiting for a read or a write to be requested.
-  SD_READING: the card is being read and is not available for anything else 
-  SD_DATA_READY: a sector of data has been requested from the SD card is ready for the client.
-  SD_WRITING: the card is being written and is not available for anything else
+  SD_IDLE: card is ready and no request is running.
+  SD_READING, SD_WRITING, SD_ERASING: a request is running.
 
-bool SdReadBlock(u32 u32SectorAddress_) - initiates read of one 512 byte block of memory from the SD card.
-Returns TRUE if the card is available and can start reading. 
-User must use SdGetStatus() and wait until the card status is SD_DATA_READY which means the read is done.
+SdGetSectorCount() - returns the number of 512 byte sectors on the card, or 0 if no card has been initialized.
 
-bool SdWriteBlock(u32 u32BlockAddress_) - not yet implemented
+Reads, writes and erases are queued and run back-to-back by the driver, so any number of tasks can share the
+card without retrying.  Requests that continue at the next sector of the request before them and are of the
+same type are run as one multi-block command.  Each function returns a token (0 if the request could not 
+be queued) and takes an optional callback that is run from the SD task when the request finishes.
 
-bool SdGetReadData(u8* pu8Destination_) - transfers the read data to the client.  The card state will return to SD_IDLE.
+u32 SdQueueRead(u32 u32Sector_, u32 u32Blocks_, u8* pu8Destination_, SdCallbackType pfCallback_) - reads 
+u32Blocks_ blocks straight into the client's buffer.
+
+u32 SdQueueWrite(u32 u32Sector_, u32 u32Blocks_, u8* pu8Source_, SdCallbackType pfCallback_) - writes u32Blocks_ 
+blocks.  The data at pu8Source_ must not change until the request is finished.
+
+u32 SdQueueErase(u32 u32Sector_, u32 u32Blocks_, SdCallbackType pfCallback_) - erases u32Blocks_ blocks.
+
+SdRequestStatusType SdQueryRequest(u32 u32Token_) - SD_REQUEST_QUEUED, SD_REQUEST_ACTIVE, SD_REQUEST_DONE, 
+SD_REQUEST_FAILED or SD_REQUEST_UNKNOWN.
 
 
 **********************************************************************************************************************/
@@ -44,6 +52,10 @@ extern volatile u32 G_u32SystemTime1s;                 /*!< From main.c */
 extern volatile u32 G_u32SystemFlags;                  /*!< From main.c */
 extern volatile u32 G_u32ApplicationFlags;             /*!< From main.c */
 
+extern volatile u32 G_u32TokenLogFlags;                /*!< From tokenlog.c */
+extern volatile u32 G_u32TraceFlags;                   /*!< From trace.c */
+extern u32 G_au32DebugLogMask[];                       /*!< From debug.c */
+
 
 /***********************************************************************************************************************
 Global variable definitions with scope limited to this local application.
@@ -66,8 +78,25 @@ static u8 *SD_pu8RxBufferNextByte;                 /* Pointer to next spot in Rx
 //static u8 *SD_pu8RxBufferParser;                   /* Pointer to loop through the Rx buffer to read bytes */
 
 static u32 SD_u32Timeout;                          /* Timeout counter used across states */
+static SoftTimerType SD_sWaitTimer;                /* Times SdCardSM_WaitSSP and SdCardSM_WaitBusy */
 static u32 SD_u32CurrentMsgToken;                  /* Token of message currently being sent */
-static u32 SD_u32Address;                          /* Current read/write sector address */
+static u8* SD_pu8Command;                          /* Command being sent by SdCommandThread() */
+static ProtoThreadType SD_sCommandThread;          /* Sends SD_pu8Command and reads its response */
+static ProtoThreadType SD_sInitThread;             /* Card initialization sequence */
+static u16 SD_u16FastDivider;                      /* SPI clock divider for data transfers with the current card */
+static u32 SD_u32SectorCount;                      /* Capacity of the current card from its CSD; 0 until known */
+
+static SdRequestType SD_asQueue[SD_QUEUE_SIZE];    /* Circular queue of client requests */
+static u8 SD_u8QueueHead;                          /* Index of the oldest request */
+static u8 SD_u8QueueCount;                         /* Requests in the queue */
+static u8 SD_u8BatchRequests;                      /* Requests at the head being run as one command */
+static u8 SD_u8BatchIndex;                         /* Request in the batch that owns the current block */
+static u32 SD_u32BatchBlocks;                      /* Blocks left in the batch including the current one */
+static u32 SD_u32RequestBlock;                     /* Current block within its request */
+static u8* SD_pu8BlockData;                        /* Client data for the current block */
+static u32 SD_u32NextToken;                        /* Last request token issued */
+static SdResultType SD_asResults[SD_RESULT_HISTORY]; /* Results of the most recent requests */
+static u8 SD_u8ResultNext;                         /* Next entry in SD_asResults to overwrite */
 
 static u8 SD_au8CardInMessage[]    = "SD card inserted\n\r";
 static u8 SD_au8SspRequestFailed[] = "SdCard denied SSP\n\r";
@@ -79,17 +108,38 @@ static u8 SD_au8CardError2[]       = "CARD_VOLTAGE\n\r ";
 static u8 SD_au8CardError3[]       = "BAD_RESPONSE\n\r ";
 static u8 SD_au8CardError4[]       = "NO_TOKEN\n\r";
 static u8 SD_au8CardError5[]       = "NO_SD_TOKEN\n\r";
+static u8 SD_au8CardError6[]       = "WRITE_REJECTED\n\r";
+static u8 SD_au8ClockReduced[]     = "SD clock reduced\n\r";
 
 
 static u8 SD_au8CMD0[]   = {SD_HOST_CMD | SD_CMD0,  0, 0, 0, 0, SD_CMD0_CRC};
 static u8 SD_au8CMD8[]   = {SD_HOST_CMD | SD_CMD8,  0, 0, SD_VHS_VALUE, SD_CHECK_PATTERN, SD_CMD8_CRC};
+static u8 SD_au8CMD9[]   = {SD_HOST_CMD | SD_CMD9,  0, 0, 0, 0, SD_NO_CRC};
 static u8 SD_au8CMD16[]  = {SD_HOST_CMD | SD_CMD16, 0, 0, 0x02, 0x00, SD_NO_CRC};
+static u8 SD_au8CMD12[]  = {SD_HOST_CMD | SD_CMD12, 0, 0, 0, 0, SD_NO_CRC};
 static u8 SD_au8CMD17[]  = {SD_HOST_CMD | SD_CMD17, 0, 0, 0, 0, SD_NO_CRC};
+static u8 SD_au8CMD18[]  = {SD_HOST_CMD | SD_CMD18, 0, 0, 0, 0, SD_NO_CRC};
+static u8 SD_au8CMD24[]  = {SD_HOST_CMD | SD_CMD24, 0, 0, 0, 0, SD_NO_CRC};
+static u8 SD_au8CMD25[]  = {SD_HOST_CMD | SD_CMD25, 0, 0, 0, 0, SD_NO_CRC};
+static u8 SD_au8CMD32[]  = {SD_HOST_CMD | SD_CMD32, 0, 0, 0, 0, SD_NO_CRC};
+static u8 SD_au8CMD33[]  = {SD_HOST_CMD | SD_CMD33, 0, 0, 0, 0, SD_NO_CRC};
+static u8 SD_au8CMD38[]  = {SD_HOST_CMD | SD_CMD38, 0, 0, 0, 0, SD_NO_CRC};
 static u8 SD_au8CMD55[]  = {SD_HOST_CMD | SD_CMD55, 0, 0, 0 ,0, SD_NO_CRC};
 static u8 SD_au8CMD58[]  = {SD_HOST_CMD | SD_CMD58, 0, 0, 0 ,0, SD_NO_CRC};
 
 static u8 SD_au8ACMD41[] = {SD_HOST_CMD | SD_ACMD41,0, 0, 0, 0, SD_NO_CRC};
 
+static u8 SD_au8StartBlockToken[] = {TOKEN_START_BLOCK};
+static u8 SD_au8StartMultiToken[] = {TOKEN_START_BLOCK_MULT};
+static u8 SD_au8StopMultiToken[]  = {TOKEN_STOP_BLOCK_MULT};
+static u8 SD_au8DataCrc[]         = {SD_DUMMY_CRC, SD_DUMMY_CRC};
+
+/* Protothread helpers that work on the statics above */
+#define SD_WAIT_OVER(Done_, Timeout_)  ( (Done_) || IsTimeUp(&SD_u32Timeout, (Timeout_)) )  /* Done or timed out since SD_u32Timeout */
+#define SD_PT_COMMAND(psPt_, pau8Command_) \
+  do { SD_pu8Command = (pau8Command_); PT_SPAWN((psPt_), &SD_sCommandThread, SdCommandThread(&SD_sCommandThread)); \
+       if( PT_CHILD_EXITED(psPt_) ) { PT_EXIT(psPt_); } } while(0)  /* Runs a command; gives up if it fails */
+
 
 /**********************************************************************************************************************
 Function Definitions
@@ -137,10 +187,10 @@ Reports the current status of the SD card.
 
 SD_NO_CARD: no card is inserted.
 SD_CARD_ERROR: an inserted card has an error.
-SD_IDLE: card is ready and waiting for a read or a write to be requested.
-SD_READING: the card is being read and is not available for anything else 
-SD_DATA_READY: a sector of data has been requested from the SD card is ready for the client.
-SD_WRITING: the card is being written and is not available for anything else
+SD_IDLE: card is ready and no request is running.
+SD_READING: a read request is running
+SD_WRITING: a write request is running
+SD_ERASING: an erase request is running
 
 Requires:
   - SD_CardState up to date.
@@ -156,97 +206,146 @@ SdCardStateType SdGetStatus(void)
 
 
 /*----------------------------------------------------------------------------------------------------------------------
-Function: SdReadBlock
+Function: SdGetSectorCount
 
 Description:
-Reads a block at the sector address provided.
-Byte-addressable cards are automatically converted appropriately so user does not have to distinguish
-and can always read by 512 byte block.
+Reports the capacity of the card read from its CSD during initialization.  Clients that write outside a file 
+system use this to check that their region is on the card.
 
 Requires:
-  - _SD_TYPE_SD1, _SD_TYPE_SD2, _SD_CARD_HC are correctly set/clear to indicate card type.
-  - u32SectorAddress_ is a valid SD card address
+  - NONE
 
 Promises:
-  - If the card is currently SD_IDLE, initiates the read, changes card state to "SD_READING" and returns TRUE.
+  - Returns the number of 512 byte sectors on the card if it is initialized, otherwise 0
 */
-bool SdReadBlock(u32 u32SectorAddress_)
+u32 SdGetSectorCount(void)
 {
-  if(SD_CardState == SD_IDLE)
+  if( (SD_CardState == SD_NO_CARD) || (SD_CardState == SD_CARD_ERROR) )
   {
-    /* Capture the card address of interest with adjustment for byte-accessed cards as required */
-    SD_u32Address = u32SectorAddress_;
-    if( !(SD_u32Flags & _SD_CARD_HC) )
-    {
-      SD_u32Address *= 512;
-    }
-    
-    /* Update the card state which will trigger the start of the read sequence */
-    SD_CardState = SD_READING;
-    return TRUE;
+    return 0;
   }
   
-  return FALSE;
+  return SD_u32SectorCount;
   
-} /* end SdReadBlock() */
+} /* end SdGetSectorCount() */
 
 
 /*----------------------------------------------------------------------------------------------------------------------
-Function: SdWriteBlock
+Function: SdQueueRead
 
 Description:
-Writes a block at the address provided.
+Queues a read of u32Blocks_ consecutive 512 byte blocks starting at the sector address provided.
+Byte-addressable cards are automatically converted appropriately so user does not have to distinguish
+and can always read by 512 byte block.  The SSP receives the data directly into the client buffer; the 
+start token and CRC are read separately so only data lands there.
 
 Requires:
-  - 
+  - u32Sector_ is a valid SD card address
+  - u32Blocks_ > 0
+  - pu8Destination_ points to u32Blocks_ * 512 bytes that are not used until the request is finished
+  - pfCallback_ is called when the request finishes, or NULL to poll with SdQueryRequest()
 
 Promises:
-  - 
+  - Returns the request token if the request is queued
+  - Returns 0 if the queue is full or the card is not available
+*/
+u32 SdQueueRead(u32 u32Sector_, u32 u32Blocks_, u8* pu8Destination_, SdCallbackType pfCallback_)
+{
+  return SdQueueRequest(SD_OP_READ, u32Sector_, u32Blocks_, pu8Destination_, pfCallback_);
+  
+} /* end SdQueueRead() */
+
+
+/*----------------------------------------------------------------------------------------------------------------------
+Function: SdQueueWrite
+
+Description:
+Queues a write of u32Blocks_ consecutive 512 byte blocks starting at the sector address provided.
+
+Requires:
+  - u32Sector_ is a valid SD card address
+  - u32Blocks_ > 0
+  - pu8Source_ points to u32Blocks_ * 512 bytes that will not change until the request is finished
+  - pfCallback_ is called when the request finishes, or NULL to poll with SdQueryRequest()
+
+Promises:
+  - Returns the request token if the request is queued
+  - Returns 0 if the queue is full or the card is not available
+  - The request is done once the card has accepted and programmed every block
 */
-bool SdWriteBlock(u32 u32BlockAddress_)
+u32 SdQueueWrite(u32 u32Sector_, u32 u32Blocks_, u8* pu8Source_, SdCallbackType pfCallback_)
 {
-  return FALSE;
+  return SdQueueRequest(SD_OP_WRITE, u32Sector_, u32Blocks_, pu8Source_, pfCallback_);
     
-} /* end SdWriteBlock() */
+} /* end SdQueueWrite() */
 
 
 /*----------------------------------------------------------------------------------------------------------------------
-Function: SdGetReadData
+Function: SdQueueErase
 
 Description:
-Transfers the data that was just read from the card.
+Queues an erase of u32Blocks_ consecutive blocks starting at the sector address provided.  Erased blocks
+read back as all 0x00 or all 0xFF depending on the card.
 
 Requires:
-  - pu8Destination points to the start of a 512 byte buffer where the data will be read.
-  - The 512 bytes of data that was just read is at SD_au8RxBuffer[0] thru SD_au8RxBuffer[511] -
-    this will set SD_CardState to SD_DATA_READY.
+  - u32Sector_ is a valid SD card address
+  - u32Blocks_ > 0
+  - pfCallback_ is called when the request finishes, or NULL to poll with SdQueryRequest()
 
 Promises:
-  - if SD_CardState = SD_DATA_READY, loads 512 bytes to pu8Destination_ and returns TRUE
-  - else returns FALSE
+  - Returns the request token if the request is queued
+  - Returns 0 if the queue is full or the card is not available
 */
-bool SdGetReadData(u8* pu8Destination_)
+u32 SdQueueErase(u32 u32Sector_, u32 u32Blocks_, SdCallbackType pfCallback_)
 {
-  /* To ensure data integrity, card state must be SD_DATA_READY */
-  if(SD_CardState == SD_DATA_READY)
-  {
-    SD_CardState = SD_IDLE;
+  return SdQueueRequest(SD_OP_ERASE, u32Sector_, u32Blocks_, NULL, pfCallback_);
+    
+} /* end SdQueueErase() */
+
+
+/*----------------------------------------------------------------------------------------------------------------------
+Function: SdQueryRequest
 
-    for(u16 i = 0; i < 512; i++)
+Description:
+Reports the status of a request.
+
+Requires:
+  - u32Token_ was returned by SdQueueRead(), SdQueueWrite() or SdQueueErase()
+
+Promises:
+  - Returns SD_REQUEST_QUEUED or SD_REQUEST_ACTIVE while the request is in the queue
+  - Returns SD_REQUEST_DONE or SD_REQUEST_FAILED for one of the last SD_RESULT_HISTORY finished requests
+  - Returns SD_REQUEST_UNKNOWN otherwise
+*/
+SdRequestStatusType SdQueryRequest(u32 u32Token_)
+{
+  u8 u8Index;
+  
+  for(u8 i = 0; i < SD_u8QueueCount; i++)
+  {
+    u8Index = (SD_u8QueueHead + i) % SD_QUEUE_SIZE;
+    if(SD_asQueue[u8Index].u32Token == u32Token_)
     {
-      *pu8Destination_ = SD_au8RxBuffer[i];
-      pu8Destination_++;
+      if(i < SD_u8BatchRequests)
+      {
+        return SD_REQUEST_ACTIVE;
+      }
+      
+      return SD_REQUEST_QUEUED;
     }
-    
-    return TRUE;
   }
-  /* Otherwise return FALSE */
-  else
+  
+  for(u8 i = 0; i < SD_RESULT_HISTORY; i++)
   {
-    return FALSE;
+    if( (SD_asResults[i].u32Token == u32Token_) && (u32Token_ != 0) )
+    {
+      return SD_asResults[i].eResult;
+    }
   }
-    
-} /* end SdGetReadData() */
+  
+  return SD_REQUEST_UNKNOWN;
+  
+} /* end SdQueryRequest() */
 
 
 /*--------------------------------------------------------------------------------------------------------------------*/
@@ -285,6 +384,8 @@ void SdCardInitialize(void)
   SD_sSspConfig.u16RxBufferSize    = SDCARD_RX_BUFFER_SIZE;
   SD_sSspConfig.eBitOrder          = MSB_FIRST;
   SD_sSspConfig.eSspMode           = SPI_MASTER_MANUAL_CS;
+  SD_sSspConfig.u16ClockDivider    = 0;
+  SD_u16FastDivider = SD_US_BRGR_FAST;
   
   /* Always start in SdCardSM_IdleNoCard but display different message if card is already in */
   SD_pfStateMachine = SdCardSM_IdleNoCard;
@@ -292,7 +393,7 @@ void SdCardInitialize(void)
 
   if( SdIsCardInserted() )
   {
-    DebugPrintf(SD_au8CardInMessage);
+    LOG_INFO(_DEBUG_LOG_SD, "%s", SD_au8CardInMessage);
   }
 
   G_u32ApplicationFlags |= _APPLICATION_FLAGS_SDCARD;
@@ -303,6 +404,10 @@ void SdCardInitialize(void)
   SD_pfStateMachine = SdCardSM_Disabled;
   DebugPrintf(au8SdCardStartedMsg);
 #endif /* ENABLE_SD */
+
+  /* SdCardRunActiveState() keeps the task scheduled; new requests signal it */
+  SchedulerSetEventDriven(PROFILER_TASK_SDCARD);
+
 } /* end SdCardInitialize() */
 
 
@@ -319,11 +424,39 @@ Requires:
 
 Promises:
   - Calls the function to pointed by the state machine function pointer
+  - The task is signalled for the next pass while a card is initializing or a request is running, 
+    every SD_CARD_DETECT_PERIOD_MS to check the card detect switch while it is idle, and by 
+    SdWaitTimerCallback() at the end of SdCardSM_WaitSSP
 */
 void SdCardRunActiveState(void)
 {
+#ifdef EVENT_TRACE
+  static fnCode_type pfLastState = NULL;
+#endif /* EVENT_TRACE */
+
   SD_pfStateMachine();
 
+#ifdef ENABLE_SD
+  if( (SD_pfStateMachine == SdCardSM_IdleNoCard) || 
+     ((SD_pfStateMachine == SdCardSM_ReadyIdle) && (SD_u8QueueCount == 0)) )
+  {
+    SchedulerSignalAt(PROFILER_TASK_SDCARD, G_u32SystemTime1ms + SD_CARD_DETECT_PERIOD_MS);
+  }
+  else if(SD_pfStateMachine != SdCardSM_WaitSSP)
+  {
+    SchedulerSignal(PROFILER_TASK_SDCARD);
+  }
+#endif /* ENABLE_SD */
+
+#ifdef EVENT_TRACE
+  /* Record state changes by the address of the new state; tools/trace_export.py --symbols names them */
+  if(SD_pfStateMachine != pfLastState)
+  {
+    pfLastState = SD_pfStateMachine;
+    TRACE(TRACE_SD_STATE, pfLastState);
+  }
+#endif /* EVENT_TRACE */
+
 } /* end SdCardRunActiveState */
 
 
@@ -344,448 +477,822 @@ Requires:
   - pau8Command_ is a pointer to the first byte of the command byte array
 
 Promises:
-  - Requested command is queued to the SSP peripheral
-  - SD_u32CurrentMsgToken updated with the corresponding message token
-  - SD_u32Timeout loaded to start counting the timeout period for the command
-  - State machine set to wait command
+  - State machine set to SdCardSM_Command, which runs SdCommandThread() for pau8Command_ and then goes to
+    SD_pfWaitReturnState (set by the caller after this call)
 */
 void SdCommand(u8* pau8Command_)
 {
-  /* Queue the transmit message with this command */
-  SD_u32CurrentMsgToken = SspWriteData(SD_Ssp, SD_CMD_SIZE, pau8Command_);
-  if(SD_u32CurrentMsgToken)
-  {
-    SspAssertCS(SD_Ssp);
-
-    /* Set up time-outs and next state */
-    SD_u32Timeout = G_u32SystemTime1ms;
-    SD_pfStateMachine = SdCardSM_WaitCommand;
-  }
-  else
-  {
-    /* We didn't get a return token, so abort */
-    SD_u8ErrorCode = SD_ERROR_NO_TOKEN;
-    SD_pfStateMachine = SdCardSM_Error;
-  }
+  SD_pu8Command = pau8Command_;
+  PT_INIT(&SD_sCommandThread);
+  SD_pfStateMachine = SdCardSM_Command;
     
 } /* end SdCommand() */
 
 
 /*--------------------------------------------------------------------------------------------------------------------
-Function: CheckTimeout
+Function: SdCommandThread
 
 Description:
-Checks on timeout and updates the state machine if required.
+Protothread that sends the command at SD_pu8Command and polls for its response R1 (the first byte with BIT7 clear).
 
 Requires:
-  - State machine is running through states where timeouts are frequently checked and where the result of
-    a timeout should be a timeout error and redirection to the error state.
-  - u32Time_ is ms count for timeout
-  - SD_u32Timeout is the reference time
+  - No other commands should be queued for the SSP peripheral being used.
+  - PT_INIT(psPt_) before the first call for each command
 
 Promises:
-  - if the timeout has occured, sets the erorr code and directs the SM to SdCardSM_Error state
+  - PT_ENDED: the response is at SD_au8RxBuffer[0] and CS is still asserted
+  - PT_EXITED: SD_u8ErrorCode holds the reason
 */
-void CheckTimeout(u32 u32Time_)
+static PtStatusType SdCommandThread(ProtoThreadType* psPt_)
 {
-  if( IsTimeUp(&SD_u32Timeout, u32Time_) )
+  static u8 u8Retries;
+  
+  PT_BEGIN(psPt_);
+  
+  /* Queue the transmit message with this command */
+  SD_u32CurrentMsgToken = SspWriteData(SD_Ssp, SD_CMD_SIZE, SD_pu8Command);
+  if(SD_u32CurrentMsgToken == 0)
+  {
+    SD_u8ErrorCode = SD_ERROR_NO_TOKEN;
+    PT_EXIT(psPt_);
+  }
+  
+  SspAssertCS(SD_Ssp);
+  SD_u32Timeout = G_u32SystemTime1ms;
+  PT_WAIT_UNTIL(psPt_, SD_WAIT_OVER(QueryMessageStatus(SD_u32CurrentMsgToken) == COMPLETE, SD_WAIT_TIME));
+  if( QueryMessageStatus(SD_u32CurrentMsgToken) != COMPLETE )
   {
     SD_u8ErrorCode = SD_ERROR_TIMEOUT;
-    SD_pfStateMachine = SdCardSM_Error;
+    PT_EXIT(psPt_);
   }
 
-} /* end CheckTimeout() */
-
-#if 0
-/*--------------------------------------------------------------------------------------------------------------------
-Function: AdvanceSD_pu8RxBufferParser
-
-Description:
-Safely advances SD_pu8RxBufferParser by the number of bytes required.
-
-Requires:
-  - u32NumBytes_ is the number of bytes that the buffer pointer will be advanced
-
-Promises:
-  - SD_pu8RxBufferParser moved u32NumBytes_ with wrap-around protection.
-*/
-void AdvanceSD_pu8RxBufferParser(u32 u32NumBytes_)
-{
-  for(u32 i = 0; i < u32NumBytes_; i++)
+  /* Read one byte at a time until the card answers */
+  u8Retries = SD_CMD_RETRIES;
+  do
   {
-    SD_pu8RxBufferParser++;
-    if(SD_pu8RxBufferParser == &SD_au8RxBuffer[SDCARD_RX_BUFFER_SIZE])
+    if( !SspReadByte(SD_Ssp) )
     {
-      SD_pu8RxBufferParser = &SD_au8RxBuffer[0];
+      SD_u8ErrorCode = SD_ERROR_NO_TOKEN;
+      PT_EXIT(psPt_);
+    }
+    
+    PT_WAIT_UNTIL(psPt_, SD_WAIT_OVER(SspQueryReceiveStatus(SD_Ssp) == SSP_RX_COMPLETE, SD_WAIT_TIME));
+    if( SspQueryReceiveStatus(SD_Ssp) != SSP_RX_COMPLETE )
+    {
+      SD_u8ErrorCode = SD_ERROR_TIMEOUT;
+      PT_EXIT(psPt_);
     }
+    
+    u8Retries--;
+  } while( (SD_au8RxBuffer[0] & BIT7) && (u8Retries != 0) );
+  
+  if(SD_au8RxBuffer[0] & BIT7)
+  {
+    SD_u8ErrorCode = SD_ERROR_BAD_RESPONSE;
+    PT_EXIT(psPt_);
   }
   
-} /* end AdvanceSD_pu8RxBufferParser() */
+  PT_END(psPt_);
+  
+} /* end SdCommandThread() */
 
 
 /*--------------------------------------------------------------------------------------------------------------------
-Function: FlushSdRxBuffer
+Function: SdInitThread
 
 Description:
-Skips all new bytes currently in the RxBuffer.
+Protothread with the whole card initialization sequence: wake-up clocks, CMD0, CMD8, CMD55 + ACMD41 until the card
+is ready, then CMD58 (SDv2), CMD16 (standard capacity) and CMD9 for the capacity.  Each command runs as a child 
+SdCommandThread(), and the next command is queued in the same pass as the response to the last one arrives.
 
 Requires:
-  - 
+  - The SSP peripheral has been requested at the slow clock and CS is deasserted
+  - PT_INIT(psPt_) before the first call
 
 Promises:
-  - SD_pu8RxBufferParser set to SD_pu8RxBufferNextByte
+  - PT_ENDED: the card is ready, _SD_TYPE_SD1/_SD_TYPE_SD2 and _SD_CARD_HC describe it, SD_u32SectorCount holds
+    its capacity and CS is deasserted
+  - PT_EXITED: SD_u8ErrorCode holds the reason
 */
-void FlushSdRxBuffer(void)
+static PtStatusType SdInitThread(ProtoThreadType* psPt_)
 {
-  SD_pu8RxBufferParser = SD_pu8RxBufferNextByte;
+  PT_BEGIN(psPt_);
   
-} /* end FlushSdRxBuffer() */
-#endif
-
-/**********************************************************************************************************************
-State Machine Function Definitions
-**********************************************************************************************************************/
-
-/*-------------------------------------------------------------------------------------------------------------------*/
-/* Wait for a card to be inserted */
-static void SdCardSM_IdleNoCard(void)
-{
-
-  if( SdIsCardInserted() )
-  {
-    /* Request the SSP resource to talk to the card */
-    SD_Ssp = SspRequest(&SD_sSspConfig);
-    if(SD_Ssp == NULL)
-    {
-      /* Go to wait state if SSP is not available */
-      DebugPrintf(SD_au8SspRequestFailed);
-      SD_u32Timeout = G_u32SystemTime1ms;
-      SD_pfWaitReturnState = SdCardSM_IdleNoCard;
-      SD_pfStateMachine = SdCardSM_WaitSSP;
-    }
-    else
-    {
-      /* If card is in, set flag and then try to talk to card.  Note that the SSP peripheral will 
-      be allocated to the SD card for this whole initialization process. */
-      SD_u32Flags &= SD_CLEAR_CARD_TYPE_BITS;
-
-      /* CS is NOT asserted for initial dummy clocks */
-      SspDeAssertCS(SD_Ssp);
-      
-      /* Queue up a set of dummy transfers to make sure the card is awake; */
-      if(SspReadData(SD_Ssp, SD_WAKEUP_BYTES))
-      {
-        SD_pfStateMachine = SdCardSM_Dummies;
-      }
-      else
-      {
-        /* We didn't get a return token, so abort */
-        SD_u8ErrorCode = SD_ERROR_NO_TOKEN;
-        SD_pfStateMachine = SdCardSM_Error;
-      }
-    }
-  }  
+  SD_u32SectorCount = 0;
   
-} /* end SdCardSM_IdleNoCard() */
-
-
-/*-------------------------------------------------------------------------------------------------------------------*/
-/* Wait for the dummies to be sent to wake up card. Data that will clock in to RxBuffer is ignored. */
-static void SdCardSM_Dummies(void)
-{
-  if( SspQueryReceiveStatus(SD_Ssp) == SSP_RX_COMPLETE )
-  { 
-    /* Queue CMD0 to be sent. SdCommand sets SD_pfStateMachine for the next state. */
-    SdCommand(&SD_au8CMD0[0]);
-    SD_pfWaitReturnState = SdCardSM_ResponseCMD0;
-  }
-} /* end SdCardSM_Dummies() */
-
-
-/*-------------------------------------------------------------------------------------------------------------------*/
-/* Check the response to CMD0. SD_pu8RxBufferParser is pointing to the RxBuffer where a response R1 is sitting */
-/* This is not a state but more a call-back after CMD0 */
-
-static void SdCardSM_ResponseCMD0(void)
-{
-  /* CS is deasserted after CMD0 */
-  SspDeAssertCS(SD_Ssp);
-
-  /* Process the received byte */
-  if(SD_au8RxBuffer[0] == SD_STATUS_IDLE)
+  /* Queue up a set of dummy transfers to make sure the card is awake */
+  if( !SspReadData(SD_Ssp, SD_WAKEUP_BYTES) )
   {
-    /* Card is in Idle state, so issue CMD8 */
-    SdCommand(&SD_au8CMD8[0]);
-    SD_pfWaitReturnState = SdCardSM_ResponseCMD8;
+    SD_u8ErrorCode = SD_ERROR_NO_TOKEN;
+    PT_EXIT(psPt_);
   }
-  else
+  PT_WAIT_UNTIL(psPt_, SspQueryReceiveStatus(SD_Ssp) == SSP_RX_COMPLETE);
+  
+  /* CMD0 puts the card in Idle (SPI mode) */
+  SD_PT_COMMAND(psPt_, &SD_au8CMD0[0]);
+  SspDeAssertCS(SD_Ssp);
+  if(SD_au8RxBuffer[0] != SD_STATUS_IDLE)
   {
-    /* Unexpected response, go to error */
     SD_u8ErrorCode = SD_ERROR_BAD_RESPONSE;
-    SD_pfStateMachine = SdCardSM_Error;
+    PT_EXIT(psPt_);
   }
   
-  /* In any case, advance the buffer pointer */
-  //AdvanceSD_pu8RxBufferParser(1);
-       
-} /* end SdCardSM_ResponseCMD0() */
-
-
-/*-------------------------------------------------------------------------------------------------------------------*/
-/* Queue a read to get the CMD8 data. */
-/* This is not a state but more a call-back after CMD8 */
-static void SdCardSM_ResponseCMD8(void)
-{
-  /* Check the response byte (response R1) */
+  /* CMD8 is only accepted by SDv2 cards, which send 4 more bytes with the voltage range and check pattern */
+  SD_PT_COMMAND(psPt_, &SD_au8CMD8[0]);
   if(SD_au8RxBuffer[0] == SD_STATUS_IDLE)
   {
-    /* Command is good which means the card is at least SDv2 so we can read 4 more bytes of the CMD8 response. */
     SD_u32Flags |= _SD_TYPE_SD2;
     
     /* CS is still asserted since we are reading data */
-    if(SspReadData(SD_Ssp, 4))
+    if( !SspReadData(SD_Ssp, 4) )
     {
-      SD_pfStateMachine = SdCardSM_ReadCMD8;
-    }
-    else
-    {
-      /* SSP read error - we'll just abort */
       SD_u8ErrorCode = SD_ERROR_NO_TOKEN;
-      SD_pfStateMachine = SdCardSM_Error;
+      PT_EXIT(psPt_);
     }
-  }
-  /* CMD8 not supported => not SDv2 */
-  else
-  {
-    /* The card does not support CMD8 so Deassert CS and go directly to ACMD41 */
-    SD_u32Flags &= ~_SD_TYPE_SD2;
-    SspDeAssertCS(SD_Ssp);
-    /* Do we need a delay here since CS will be asserted almost immediately in SdCommand? */
-    
-    SdCommand(&SD_au8ACMD41[0]);
-    SD_pfWaitReturnState = SdCardSM_ResponseCMD55;
-  }
     
-  /* In either case, advance the buffer pointer */
-  //AdvanceSD_pu8RxBufferParser(1);
-   
-} /* end SdCardSM_ResponseCMD8() */
-     
-
-/*-------------------------------------------------------------------------------------------------------------------*/
-/* Wait for the 4 payload bytes from CMD8. */
-static void SdCardSM_ReadCMD8(void)
-{
-  /* Check to see if the SSP peripheral has sent the data request */
-//  if( QueryMessageStatus(SD_u32CurrentMsgToken) == COMPLETE )
-  if(SspQueryReceiveStatus(SD_Ssp) == SSP_RX_COMPLETE)
-  {
-    /* CMD8 is finished so deassert CS */
+    SD_u32Timeout = G_u32SystemTime1ms;
+    PT_WAIT_UNTIL(psPt_, SD_WAIT_OVER(SspQueryReceiveStatus(SD_Ssp) == SSP_RX_COMPLETE, SD_SPI_WAIT_TIME_MS));
     SspDeAssertCS(SD_Ssp);
-    
-    /* Process the four response bytes (only the last two matter) */
-    //SD_pu8RxBufferParser = ;
-    if(SD_au8RxBuffer[SD_CMD8_INDEX_VHS] == SD_VHS_VALUE)
+    if( SspQueryReceiveStatus(SD_Ssp) != SSP_RX_COMPLETE )
     {
-      //AdvanceSD_pu8RxBufferParser(1);
-      if(SD_au8RxBuffer[SD_CMD8_INDEX_CHECK] == SD_CHECK_PATTERN)
-      {
-        /* Card supports VCC 2.7 - 3.6V so we're good to go */
-        /* Next we need to send CMD55 so we can send ACMD41 */
-        SdCommand(&SD_au8CMD55[0]);
-        SD_pfWaitReturnState = SdCardSM_ResponseCMD55;
-      }
-      //AdvanceSD_pu8RxBufferParser(1);
+      SD_u8ErrorCode = SD_ERROR_TIMEOUT;
+      PT_EXIT(psPt_);
     }
-    else
+    
+    /* The card must support VCC 2.7 - 3.6V (only the last two bytes matter) */
+    if(SD_au8RxBuffer[SD_CMD8_INDEX_VHS] != SD_VHS_VALUE)
     {
-      /* The card does not support the voltage range so is not usable */
       SD_u8ErrorCode = SD_ERROR_CARD_VOLTAGE;
-      SD_pfStateMachine = SdCardSM_Error;
+      PT_EXIT(psPt_);
     }
-  }
-  
-  /* Watch for SSP timeout */
-  CheckTimeout(SD_SPI_WAIT_TIME_MS);
-     
-} /* end SdCardSM_ReadCMD8() */
-
-     
-/*-------------------------------------------------------------------------------------------------------------------*/
-/* Check the response to CMD55. */
-/* This is really a call-back to CMD55 */
-static void SdCardSM_ResponseCMD55(void)
-{
-  /* CMD55 is finished so deassert CS */
-  SspDeAssertCS(SD_Ssp);
-
-  /* Process the received byte from CMD55 */
-  if(SD_au8RxBuffer[0] == SD_STATUS_IDLE)
-  {
-    /* Card is ready for ACMD41 to configure Host Capacity Support (HCS) bit */
-    if(SD_u32Flags & _SD_TYPE_SD2)
+    
+    if(SD_au8RxBuffer[SD_CMD8_INDEX_CHECK] != SD_CHECK_PATTERN)
     {
-      SD_au8ACMD41[1] |= BIT6;
+      SD_u8ErrorCode = SD_ERROR_BAD_RESPONSE;
+      PT_EXIT(psPt_);
     }
-    SdCommand(&SD_au8ACMD41[0]);
-    SD_pfWaitReturnState = SdCardSM_ResponseACMD41;
   }
   else
   {
-    /* Unexpected response, go to error */
-    SD_u8ErrorCode = SD_ERROR_BAD_RESPONSE;
-    SD_pfStateMachine = SdCardSM_Error;
+    /* CMD8 not supported => not SDv2 */
+    SD_u32Flags &= ~_SD_TYPE_SD2;
+    SspDeAssertCS(SD_Ssp);
   }
   
-  /* In any case, advance the buffer pointer */
-  //AdvanceSD_pu8RxBufferParser(1);
-       
-} /* end SdCardSM_ResponseCMD55() */
-     
-     
-/*-------------------------------------------------------------------------------------------------------------------*/
-/* Check the response to ACMD41 which is waiting for the card to NOT be in idle (repeat CMD55 + ACMD41 sequence).
-Once the card is ready, can send CMD58.  The next step is different for version 1 and version 2 cards.  MMC will not be supported. */
-static void SdCardSM_ResponseACMD41(void)
-{
-  /* ACMD41 is finished so deassert CS */
-  SspDeAssertCS(SD_Ssp);
-
-  /* Process the received byte based on card type */
-  if(SD_au8RxBuffer[0] == SD_STATUS_READY)
+  /* Repeat CMD55 + ACMD41 until the card leaves Idle.  SDv2 hosts set Host Capacity Support (HCS). */
+  if(SD_u32Flags & _SD_TYPE_SD2)
   {
-    /* Card is ready for next command */
-    if(SD_u32Flags & _SD_TYPE_SD2)
-    {
-      /* SDv2 cards use CMD58 */
-      SdCommand(&SD_au8CMD58[0]);
-      SD_pfWaitReturnState = SdCardSM_ResponseCMD58;
-    }
-    else
-    {
-      /* SDv1 card: set flag and block access size */
-      SD_u32Flags |= _SD_TYPE_SD1;
-      
-      /* SDv1 cards are always low capacity, but can have variable block access.   
-      Set to 512 to match SDv2. */
-      SdCommand(&SD_au8CMD16[0]);
-      SD_pfWaitReturnState = SdCardSM_ResponseCMD16;
-    }
+    SD_au8ACMD41[1] |= BIT6;
   }
-  else 
+  
+  do
   {
-    /* Card is not idle yet, so repeat */
-    SdCommand(&SD_au8CMD55[0]);
-    SD_pfWaitReturnState = SdCardSM_ResponseCMD55;
-  }
+    SD_PT_COMMAND(psPt_, &SD_au8CMD55[0]);
+    SspDeAssertCS(SD_Ssp);
+    if(SD_au8RxBuffer[0] != SD_STATUS_IDLE)
+    {
+      SD_u8ErrorCode = SD_ERROR_BAD_RESPONSE;
+      PT_EXIT(psPt_);
+    }
+    
+    SD_PT_COMMAND(psPt_, &SD_au8ACMD41[0]);
+    SspDeAssertCS(SD_Ssp);
+  } while(SD_au8RxBuffer[0] != SD_STATUS_READY);
   
-  /* In any case, advance the buffer pointer */
-  //AdvanceSD_pu8RxBufferParser(1);
-       
-} /* end SdCardSM_ResponseCMD55() */     
-
-
-/*-------------------------------------------------------------------------------------------------------------------*/
-/* Queue a read to get the CMD58 data. RxBuffer has R1 response byte. */
-static void SdCardSM_ResponseCMD58(void)
-{
-  /* Check the response byte (response R1) */
-  if(SD_au8RxBuffer[0] == SD_STATUS_READY)
+  /* SDv2 cards report their capacity in the OCR (CMD58); SDv1 cards are always standard capacity */
+  SD_u32Flags &= ~_SD_CARD_HC;
+  if(SD_u32Flags & _SD_TYPE_SD2)
   {
-    /* Command is good so we can read 4 more bytes of the CMD58 response */
-    /* CS is still asserted since we are reading data */
-    if(SspReadData(SD_Ssp, 4))
+    SD_PT_COMMAND(psPt_, &SD_au8CMD58[0]);
+    if(SD_au8RxBuffer[0] != SD_STATUS_READY)
     {
-      SD_pfStateMachine = SdCardSM_ReadCMD58;
+      SD_u8ErrorCode = SD_ERROR_BAD_RESPONSE;
+      PT_EXIT(psPt_);
     }
-    else
+    
+    /* CS is still asserted since we are reading data */
+    if( !SspReadData(SD_Ssp, 4) )
     {
-      /* SSP read error - we'll just abort */
       SD_u8ErrorCode = SD_ERROR_NO_TOKEN;
-      SD_pfStateMachine = SdCardSM_Error;
+      PT_EXIT(psPt_);
+    }
+    
+    SD_u32Timeout = G_u32SystemTime1ms;
+    PT_WAIT_UNTIL(psPt_, SD_WAIT_OVER(SspQueryReceiveStatus(SD_Ssp) == SSP_RX_COMPLETE, SD_SPI_WAIT_TIME_MS));
+    SspDeAssertCS(SD_Ssp);
+    if( SspQueryReceiveStatus(SD_Ssp) != SSP_RX_COMPLETE )
+    {
+      SD_u8ErrorCode = SD_ERROR_TIMEOUT;
+      PT_EXIT(psPt_);
+    }
+    
+    /* Ignore the other 3 response bytes */
+    if(SD_au8RxBuffer[0] & _SD_OCR_CCS_BIT)
+    {
+      SD_u32Flags |= _SD_CARD_HC;
     }
   }
   else
+  {
+    SD_u32Flags |= _SD_TYPE_SD1;
+  }
+  
+  /* Standard capacity cards can have variable block access: set to 512 to match SDHC */
+  if( !(SD_u32Flags & _SD_CARD_HC) )
+  {
+    SD_PT_COMMAND(psPt_, &SD_au8CMD16[0]);
+    SspDeAssertCS(SD_Ssp);
+    if(SD_au8RxBuffer[0] != SD_STATUS_READY)
+    {
+      SD_u8ErrorCode = SD_ERROR_BAD_RESPONSE;
+      PT_EXIT(psPt_);
+    }
+  }
+  
+  /* CMD9 returns the CSD as a data block: poll for the start token, then 16 bytes and the CRC */
+  SD_PT_COMMAND(psPt_, &SD_au8CMD9[0]);
+  if(SD_au8RxBuffer[0] != SD_STATUS_READY)
   {
     SD_u8ErrorCode = SD_ERROR_BAD_RESPONSE;
+    PT_EXIT(psPt_);
+  }
+  
+  SD_u32Timeout = G_u32SystemTime1ms;
+  do
+  {
+    if( !SspReadByte(SD_Ssp) )
+    {
+      SD_u8ErrorCode = SD_ERROR_NO_TOKEN;
+      PT_EXIT(psPt_);
+    }
+    
+    PT_WAIT_UNTIL(psPt_, SD_WAIT_OVER(SspQueryReceiveStatus(SD_Ssp) == SSP_RX_COMPLETE, SD_READ_TOKEN_MS));
+  } while( (SspQueryReceiveStatus(SD_Ssp) == SSP_RX_COMPLETE) && (SD_au8RxBuffer[0] != TOKEN_START_BLOCK) &&
+           !IsTimeUp(&SD_u32Timeout, SD_READ_TOKEN_MS) );
+  
+  if( (SspQueryReceiveStatus(SD_Ssp) != SSP_RX_COMPLETE) || (SD_au8RxBuffer[0] != TOKEN_START_BLOCK) )
+  {
+    SD_u8ErrorCode = SD_ERROR_NO_SD_TOKEN;
+    PT_EXIT(psPt_);
+  }
+  
+  if( !SspReadData(SD_Ssp, SD_CSD_SIZE + SD_DATA_CRC_SIZE) )
+  {
+    SD_u8ErrorCode = SD_ERROR_NO_TOKEN;
+    PT_EXIT(psPt_);
+  }
+  
+  SD_u32Timeout = G_u32SystemTime1ms;
+  PT_WAIT_UNTIL(psPt_, SD_WAIT_OVER(SspQueryReceiveStatus(SD_Ssp) == SSP_RX_COMPLETE, SD_SPI_WAIT_TIME_MS));
+  SspDeAssertCS(SD_Ssp);
+  if( SspQueryReceiveStatus(SD_Ssp) != SSP_RX_COMPLETE )
+  {
+    SD_u8ErrorCode = SD_ERROR_TIMEOUT;
+    PT_EXIT(psPt_);
+  }
+  
+  SD_u32SectorCount = SdCsdSectors(&SD_au8RxBuffer[0]);
+  
+  PT_END(psPt_);
+  
+} /* end SdInitThread() */
+
+
+/*--------------------------------------------------------------------------------------------------------------------
+Function: SdCsdSectors
+
+Description:
+Works out the card capacity from the CSD register.  CSD version 1.0 (standard capacity) gives it as 
+(C_SIZE + 1) * 2^(C_SIZE_MULT + 2) blocks of 2^READ_BL_LEN bytes; version 2.0 (SDHC/SDXC) as (C_SIZE + 1) * 512kB.
+
+Requires:
+  - pu8Csd_ points to the SD_CSD_SIZE bytes of the CSD, most significant byte first
+
+Promises:
+  - Returns the number of 512 byte sectors, limited to 0xFFFFFFFF (0 for a CSD that makes no sense)
+*/
+static u32 SdCsdSectors(u8* pu8Csd_)
+{
+  u32 u32CSize;
+  u32 u32Shift;
+  
+  if( (pu8Csd_[0] & 0xC0) == SD_CSD_STRUCTURE_V2 )
+  {
+    /* C_SIZE is bits 69:48 */
+    u32CSize = ((u32)(pu8Csd_[7] & 0x3F) << 16) | ((u32)pu8Csd_[8] << 8) | (u32)pu8Csd_[9];
+    if(u32CSize >= SD_CSD_MAX_C_SIZE_V2)
+    {
+      return 0xFFFFFFFF;
+    }
+    
+    return( (u32CSize + 1) << 10 );
+  }
+  
+  /* READ_BL_LEN is bits 83:80, C_SIZE bits 73:62 and C_SIZE_MULT bits 49:47 */
+  u32CSize = ((u32)(pu8Csd_[6] & 0x03) << 10) | ((u32)pu8Csd_[7] << 2) | ((u32)pu8Csd_[8] >> 6);
+  u32Shift = (u32)(pu8Csd_[5] & 0x0F) + ((((u32)(pu8Csd_[9] & 0x03) << 1) | ((u32)pu8Csd_[10] >> 7)) + 2);
+  if(u32Shift < 9)
+  {
+    return 0;
+  }
+  
+  return( (u32CSize + 1) << (u32Shift - 9) );
+  
+} /* end SdCsdSectors() */
+
+
+/*--------------------------------------------------------------------------------------------------------------------
+Function: CheckTimeout
+
+Description:
+Checks on timeout and updates the state machine if required.
+
+Requires:
+  - State machine is running through states where timeouts are frequently checked and where the result of
+    a timeout should be a timeout error and redirection to the error state.
+  - u32Time_ is ms count for timeout
+  - SD_u32Timeout is the reference time
+
+Promises:
+  - if the timeout has occured, sets the erorr code and directs the SM to SdCardSM_Error state
+*/
+void CheckTimeout(u32 u32Time_)
+{
+  if( IsTimeUp(&SD_u32Timeout, u32Time_) )
+  {
+    SD_u8ErrorCode = SD_ERROR_TIMEOUT;
     SD_pfStateMachine = SdCardSM_Error;
   }
+
+} /* end CheckTimeout() */
+
+
+/*--------------------------------------------------------------------------------------------------------------------
+Function: SdQueueRequest
+
+Description:
+Adds a request to the end of the request queue.
+
+Requires:
+  - Parameters as described for SdQueueRead(), SdQueueWrite() and SdQueueErase()
+
+Promises:
+  - Returns a non-zero token if the request is queued
+  - Returns 0 if the queue is full, u32Blocks_ is 0, or the card is not available
+*/
+static u32 SdQueueRequest(SdOperationType eOperation_, u32 u32Sector_, u32 u32Blocks_, u8* pu8Data_, SdCallbackType pfCallback_)
+{
+  SdRequestType* psRequest;
+  
+  if( (SD_u8QueueCount == SD_QUEUE_SIZE) || (u32Blocks_ == 0) || 
+      (SD_CardState == SD_NO_CARD) || (SD_CardState == SD_CARD_ERROR) )
+  {
+    return 0;
+  }
+  
+  /* Token 0 is reserved for "not queued" */
+  SD_u32NextToken++;
+  if(SD_u32NextToken == 0)
+  {
+    SD_u32NextToken = 1;
+  }
+  
+  psRequest = &SD_asQueue[(SD_u8QueueHead + SD_u8QueueCount) % SD_QUEUE_SIZE];
+  psRequest->eOperation = eOperation_;
+  psRequest->u32Token   = SD_u32NextToken;
+  psRequest->u32Sector  = u32Sector_;
+  psRequest->u32Blocks  = u32Blocks_;
+  psRequest->pu8Data    = pu8Data_;
+  psRequest->pfCallback = pfCallback_;
+  SD_u8QueueCount++;
+  SchedulerSignal(PROFILER_TASK_SDCARD);
+  
+  return SD_u32NextToken;
+  
+} /* end SdQueueRequest() */
+
+
+/*--------------------------------------------------------------------------------------------------------------------
+Function: SdLoadAddress
+
+Description:
+Loads a sector address into the argument bytes of a command, converting to a byte address for
+standard capacity cards.
+
+Requires:
+  - _SD_CARD_HC is correctly set/clear to indicate card type.
+  - pau8Command_ points to a SD_CMD_SIZE command array
+
+Promises:
+  - pau8Command_[1] to pau8Command_[4] hold the address MSB first
+*/
+static void SdLoadAddress(u8* pau8Command_, u32 u32Sector_)
+{
+  u32 u32Address = u32Sector_;
+  
+  if( !(SD_u32Flags & _SD_CARD_HC) )
+  {
+    u32Address *= SD_BLOCK_SIZE;
+  }
+
+  pau8Command_[1] = (u8)(u32Address >> 24);
+  pau8Command_[2] = (u8)(u32Address >> 16);
+  pau8Command_[3] = (u8)(u32Address >> 8);
+  pau8Command_[4] = (u8)u32Address;
+  
+} /* end SdLoadAddress() */
+
+
+/*--------------------------------------------------------------------------------------------------------------------
+Function: SdStartBatch
+
+Description:
+Starts the request at the head of the queue.  Following requests of the same type that continue at the
+next sector are merged into the same batch so they run as one multi-block command.  Each block still
+goes to or from the buffer of the request it belongs to.
+
+Requires:
+  - SD_u8QueueCount > 0
+  - The SSP peripheral has been requested
+
+Promises:
+  - SD_u8BatchRequests holds the number of requests in the batch
+  - The first command of the batch is sent
+*/
+static void SdStartBatch(void)
+{
+  SdRequestType* psFirst = &SD_asQueue[SD_u8QueueHead];
+  SdRequestType* psNext;
+  u32 u32EndSector = psFirst->u32Sector + psFirst->u32Blocks;
+  u32 u32Blocks = psFirst->u32Blocks;
+  u8* pu8Command;
+  
+  /* Merge adjacent requests */
+  SD_u8BatchRequests = 1;
+  while(SD_u8BatchRequests < SD_u8QueueCount)
+  {
+    psNext = &SD_asQueue[(SD_u8QueueHead + SD_u8BatchRequests) % SD_QUEUE_SIZE];
+    if( (psNext->eOperation != psFirst->eOperation) || (psNext->u32Sector != u32EndSector) )
+    {
+      break;
+    }
     
-  /* In either case, advance the buffer pointer */
-  //AdvanceSD_pu8RxBufferParser(1);
-       
-} /* end SdCardSM_ResponseCMD8() */
-     
+    u32EndSector += psNext->u32Blocks;
+    u32Blocks    += psNext->u32Blocks;
+    SD_u8BatchRequests++;
+  }
+  
+  SD_u8BatchIndex = 0;
+  SD_u32BatchBlocks = u32Blocks;
+  SD_u32RequestBlock = 0;
+  SD_pu8BlockData = psFirst->pu8Data;
+  
+  SD_u32Flags &= ~_SD_MULTI_BLOCK;
+  if(u32Blocks > 1)
+  {
+    SD_u32Flags |= _SD_MULTI_BLOCK;
+  }
+  
+  switch(psFirst->eOperation)
+  {
+    case SD_OP_READ:
+    {
+      pu8Command = (u32Blocks > 1) ? &SD_au8CMD18[0] : &SD_au8CMD17[0];
+      SdLoadAddress(pu8Command, psFirst->u32Sector);
 
-/*-------------------------------------------------------------------------------------------------------------------*/
-/* Process response to CMD16. */
-/* Not a state, just a call back for CMD16 */
-static void SdCardSM_ResponseCMD16(void)
+      SD_CardState = SD_READING;
+      SdCommand(pu8Command);
+      SD_pfWaitReturnState = SdCardSM_ResponseRead;
+      break;
+    }
+    
+    case SD_OP_WRITE:
+    {
+      pu8Command = (u32Blocks > 1) ? &SD_au8CMD25[0] : &SD_au8CMD24[0];
+      SdLoadAddress(pu8Command, psFirst->u32Sector);
+
+      SD_CardState = SD_WRITING;
+      SdCommand(pu8Command);
+      SD_pfWaitReturnState = SdCardSM_ResponseWrite;
+      break;
+    }
+
+    default:
+    {
+      SdLoadAddress(&SD_au8CMD32[0], psFirst->u32Sector);
+      SdLoadAddress(&SD_au8CMD33[0], u32EndSector - 1);
+
+      SD_CardState = SD_ERASING;
+      SdCommand(&SD_au8CMD32[0]);
+      SD_pfWaitReturnState = SdCardSM_ResponseCMD32;
+      break;
+    }
+  } /* end switch */
+  
+} /* end SdStartBatch() */
+
+
+/*--------------------------------------------------------------------------------------------------------------------
+Function: SdNextBlock
+
+Description:
+Moves to the next block of the batch.
+
+Requires:
+  - The block at SD_pu8BlockData has just been transferred
+
+Promises:
+  - Returns FALSE if that was the last block of the batch
+  - Otherwise returns TRUE and SD_pu8BlockData points to the next block, which may be in the buffer
+    of the next request in the batch
+*/
+static bool SdNextBlock(void)
 {
-  /* Check the response byte (response R1) */
-  if(SD_au8RxBuffer[0] == SD_STATUS_READY)
+  SD_u32BatchBlocks--;
+  if(SD_u32BatchBlocks == 0)
   {
-    /* Success! Card is ready for read/write operations.  We can release the SSP resource for now. */
-    SspDeAssertCS(SD_Ssp);
-    SspRelease(SD_Ssp);
+    return FALSE;
+  }
+  
+  SD_u32RequestBlock++;
+  if(SD_u32RequestBlock == SD_asQueue[(SD_u8QueueHead + SD_u8BatchIndex) % SD_QUEUE_SIZE].u32Blocks)
+  {
+    SD_u8BatchIndex++;
+    SD_u32RequestBlock = 0;
+    SD_pu8BlockData = SD_asQueue[(SD_u8QueueHead + SD_u8BatchIndex) % SD_QUEUE_SIZE].pu8Data;
+  }
+  else
+  {
+    SD_pu8BlockData += SD_BLOCK_SIZE;
+  }
+  
+  return TRUE;
+  
+} /* end SdNextBlock() */
 
-    SD_CardState = SD_IDLE;
-    DebugPrintf(SD_au8CardReady);
 
-    SD_pfStateMachine = SdCardSM_ReadyIdle;
+/*--------------------------------------------------------------------------------------------------------------------
+Function: SdSendBlock
+
+Description:
+Queues one data packet: the start token, the block at SD_pu8BlockData and two CRC bytes.
+
+Requires:
+  - The card has accepted CMD24 or CMD25, or programmed the previous block of a CMD25
+
+Promises:
+  - State machine waits for the packet to be sent, or aborts if it could not be queued
+*/
+static void SdSendBlock(void)
+{
+  u8* pu8Token = &SD_au8StartBlockToken[0];
+  
+  if(SD_u32Flags & _SD_MULTI_BLOCK)
+  {
+    pu8Token = &SD_au8StartMultiToken[0];
+  }
+  
+  /* Queue the whole data packet. The messages go out in order, so only the last token needs to be watched. */
+  if( SspWriteData(SD_Ssp, 1, pu8Token) &&
+      SspWriteData(SD_Ssp, SD_BLOCK_SIZE, SD_pu8BlockData) )
+  {
+    SD_u32CurrentMsgToken = SspWriteData(SD_Ssp, SD_DATA_CRC_SIZE, &SD_au8DataCrc[0]);
+  }
+  else
+  {
+    SD_u32CurrentMsgToken = 0;
+  }
+  
+  if(SD_u32CurrentMsgToken)
+  {
+    SD_u32Timeout = G_u32SystemTime1ms;
+    SD_pfStateMachine = SdCardSM_WaitDataSent;
+  }
+  else
+  {
+    /* Messaging queue could not take the block, so abort */
+    SD_u8ErrorCode = SD_ERROR_NO_TOKEN;
+    SD_pfStateMachine = SdCardSM_FailedDataTransfer;
+  }
+  
+} /* end SdSendBlock() */
+
+
+/*--------------------------------------------------------------------------------------------------------------------
+Function: SdWaitBusy
+
+Description:
+Starts polling the card for the end of a busy period.
+
+Requires:
+  - u32Timeout_ is the longest the card may be busy in ms
+  - pfNextState_ is the state to run when the card is ready
+
+Promises:
+  - State machine goes to SdCardSM_WaitBusy, or aborts if the read could not be queued
+*/
+static void SdWaitBusy(u32 u32Timeout_, fnCode_type pfNextState_)
+{
+  if(SspReadByte(SD_Ssp))
+  {
+    SoftTimerStart(&SD_sWaitTimer, u32Timeout_, 0, SdWaitTimerCallback);
+    SD_pfWaitReturnState = pfNextState_;
+    SD_pfStateMachine = SdCardSM_WaitBusy;
   }
   else
   {
-    SD_u8ErrorCode = SD_ERROR_BAD_RESPONSE;
-    SD_pfStateMachine = SdCardSM_Error;
+    SD_u8ErrorCode = SD_ERROR_NO_TOKEN;
+    SD_pfStateMachine = SdCardSM_FailedDataTransfer;
   }
+  
+} /* end SdWaitBusy() */
+
+
+/*--------------------------------------------------------------------------------------------------------------------
+Function: SdFinishRequests
+
+Description:
+Removes requests from the head of the queue, records their result and calls their callbacks.
+
+Requires:
+  - u8Count_ <= SD_u8QueueCount
+
+Promises:
+  - u8Count_ requests are removed and their result is available to SdQueryRequest()
+  - Each callback runs after its request has left the queue, so it may queue a new request
+  - SD_u8BatchRequests is 0
+*/
+static void SdFinishRequests(u8 u8Count_, SdRequestStatusType eResult_)
+{
+  SdRequestType sRequest;
+  
+  SD_u8BatchRequests = 0;
+  for(u8 i = 0; i < u8Count_; i++)
+  {
+    sRequest = SD_asQueue[SD_u8QueueHead];
+    SD_u8QueueHead = (SD_u8QueueHead + 1) % SD_QUEUE_SIZE;
+    SD_u8QueueCount--;
     
-  /* In either case, advance the buffer pointer */
-  //AdvanceSD_pu8RxBufferParser(1);
-       
-} /* end SdCardSM_ResponseCMD8() */
-     
+    SD_asResults[SD_u8ResultNext].u32Token = sRequest.u32Token;
+    SD_asResults[SD_u8ResultNext].eResult  = eResult_;
+    if(eResult_ == SD_REQUEST_FAILED)
+    {
+      TOKENLOG1(TOKENLOG_SD_REQUEST_FAILED, sRequest.u32Token);
+    }
+    SD_u8ResultNext = (SD_u8ResultNext + 1) % SD_RESULT_HISTORY;
+    
+    if(sRequest.pfCallback != NULL)
+    {
+      sRequest.pfCallback(sRequest.u32Token, eResult_);
+    }
+  }
+  
+} /* end SdFinishRequests() */
+
+
+/*--------------------------------------------------------------------------------------------------------------------
+Function: SdWaitTimerCallback
+
+Description:
+SD_sWaitTimer callback (run from SoftTimerRunActiveState()) that wakes the SD task when a wait is over.
+
+Requires:
+  - 
+
+Promises:
+  - The SD task is signalled
+*/
+static void SdWaitTimerCallback(void)
+{
+  SchedulerSignal(PROFILER_TASK_SDCARD);
+
+} /* end SdWaitTimerCallback() */
+
+#if 0
+/*--------------------------------------------------------------------------------------------------------------------
+Function: AdvanceSD_pu8RxBufferParser
+
+Description:
+Safely advances SD_pu8RxBufferParser by the number of bytes required.
+
+Requires:
+  - u32NumBytes_ is the number of bytes that the buffer pointer will be advanced
+
+Promises:
+  - SD_pu8RxBufferParser moved u32NumBytes_ with wrap-around protection.
+*/
+void AdvanceSD_pu8RxBufferParser(u32 u32NumBytes_)
+{
+  for(u32 i = 0; i < u32NumBytes_; i++)
+  {
+    SD_pu8RxBufferParser++;
+    if(SD_pu8RxBufferParser == &SD_au8RxBuffer[SDCARD_RX_BUFFER_SIZE])
+    {
+      SD_pu8RxBufferParser = &SD_au8RxBuffer[0];
+    }
+  }
+  
+} /* end AdvanceSD_pu8RxBufferParser() */
+
+
+/*--------------------------------------------------------------------------------------------------------------------
+Function: FlushSdRxBuffer
+
+Description:
+Skips all new bytes currently in the RxBuffer.
+
+Requires:
+  - 
+
+Promises:
+  - SD_pu8RxBufferParser set to SD_pu8RxBufferNextByte
+*/
+void FlushSdRxBuffer(void)
+{
+  SD_pu8RxBufferParser = SD_pu8RxBufferNextByte;
+  
+} /* end FlushSdRxBuffer() */
+#endif
+
+/**********************************************************************************************************************
+State Machine Function Definitions
+**********************************************************************************************************************/
 
 /*-------------------------------------------------------------------------------------------------------------------*/
-/* Wait for a data for CMD58. RxBuffer will have four response bytes when SSP is complete. */
-static void SdCardSM_ReadCMD58(void)
+/* Wait for a card to be inserted */
+static void SdCardSM_IdleNoCard(void)
 {
-  /* Check to see if the SSP peripheral has sent the command */
-//  if( QueryMessageStatus(SD_u32CurrentMsgToken) == COMPLETE )
-  if(SspQueryReceiveStatus(SD_Ssp) == SSP_RX_COMPLETE)
+
+  if( SdIsCardInserted() )
   {
-    /* CMD58 is finished so deassert CS */
-    SspDeAssertCS(SD_Ssp);
+    /* Initialization always runs at the slow default clock */
+    SD_sSspConfig.u16ClockDivider = 0;
 
-    /* Determine card capacity */
-    SD_u32Flags &= ~_SD_CARD_HC;
-    if(SD_au8RxBuffer[0] & _SD_OCR_CCS_BIT)
+    /* Request the SSP resource to talk to the card */
+    SD_Ssp = SspRequest(&SD_sSspConfig);
+    if(SD_Ssp == NULL)
     {
-      SD_u32Flags |= _SD_CARD_HC;
+      /* Go to wait state if SSP is not available */
+      LOG_ERROR(_DEBUG_LOG_SD, "%s", SD_au8SspRequestFailed);
+      SoftTimerStart(&SD_sWaitTimer, SD_SPI_WAIT_TIME_MS, 0, SdWaitTimerCallback);
+      SD_pfWaitReturnState = SdCardSM_IdleNoCard;
+      SD_pfStateMachine = SdCardSM_WaitSSP;
+    }
+    else
+    {
+      /* If card is in, set flag and then try to talk to card.  Note that the SSP peripheral will 
+      be allocated to the SD card for this whole initialization process. */
+      SD_u32Flags &= SD_CLEAR_CARD_TYPE_BITS;
+
+      /* CS is NOT asserted for initial dummy clocks */
+      SspDeAssertCS(SD_Ssp);
       
-      /* Success! Card is ready for read/write operations */
-      SspRelease(SD_Ssp);
+      PT_INIT(&SD_sInitThread);
+      SD_pfStateMachine = SdCardSM_Initialize;
+    }
+  }  
   
-      SD_CardState = SD_IDLE;
-      DebugPrintf(SD_au8CardReady);
-    
-      SD_pfStateMachine = SdCardSM_ReadyIdle;
+} /* end SdCardSM_IdleNoCard() */
+
+
+/*-------------------------------------------------------------------------------------------------------------------*/
+/* Run the card initialization sequence (SdInitThread) until the card is ready or it fails */
+static void SdCardSM_Initialize(void)
+{
+  PtStatusType eStatus = SdInitThread(&SD_sInitThread);
+  
+  if(eStatus == PT_ENDED)
+  {
+    /* Success! Card is ready for read/write operations. */
+    SspDeAssertCS(SD_Ssp);
+
+    /* Data transfers run at the fast clock from the next SspRequest() */
+    SD_sSspConfig.u16ClockDivider = SD_u16FastDivider;
+
+    SD_CardState = SD_IDLE;
+    LOG_INFO(_DEBUG_LOG_SD, "%s", SD_au8CardReady);
+    TOKENLOG0(TOKENLOG_SD_CARD_READY);
+
+    /* Requests queued during initialization keep the SSP and switch it to the fast clock now; 
+    otherwise release the SSP resource until there is work */
+    if( (SD_u8QueueCount != 0) && SspSetClockDivider(SD_Ssp, SD_u16FastDivider) )
+    {
+      SdStartBatch();
     }
-    /* For standard capacity, make sure block size is 512 */
     else
     {
-      SdCommand(&SD_au8CMD16[0]);
-      SD_pfWaitReturnState = SdCardSM_ResponseCMD16;
+      SspRelease(SD_Ssp);
+      SD_pfStateMachine = SdCardSM_ReadyIdle;
     }
-    
-    /* Ignore the other 3 response bytes */
-    //AdvanceSD_pu8RxBufferParser(4);
+  }
+  else if(eStatus == PT_EXITED)
+  {
+    /* SD_u8ErrorCode has the reason */
+    SD_pfStateMachine = SdCardSM_Error;
   }
   
-  /* Watch for SSP timeout */
-  CheckTimeout(SD_SPI_WAIT_TIME_MS);
-     
-} /* end SdCardSM_ReadCMD58() */
+} /* end SdCardSM_Initialize() */
+
            
 #if 0     
 /*-------------------------------------------------------------------------------------------------------------------*/
@@ -827,102 +1334,35 @@ static void SdCardSM_WaitReady(void)
 #endif
 
 /*-------------------------------------------------------------------------------------------------------------------*/
-/* Kill time waiting for a command to finish sending; the first byte from all completed commands
-is response R1 which has BIT7 clear.
-     
-REQUIRES: 
-  - SD_u32CurrentMsgToken references the message that is being sent
-     
-PROMISES: 
-  - State machine set to either SdCardSM_WaitResponse or SdCardSM_Error
-*/
-static void SdCardSM_WaitCommand(void)
-{
-  /* Check to see if the SSP peripheral has sent the command */
-  if( QueryMessageStatus(SD_u32CurrentMsgToken) == COMPLETE )
-  {
-    /* Request 1 byte (response byte from card) */  
-    if( SspReadByte(SD_Ssp) )
-    {
-      SD_pfStateMachine = SdCardSM_WaitResponse;
-    }
-    else
-    {
-      /* We didn't get a return token, so abort */
-      SD_u8ErrorCode = SD_ERROR_NO_TOKEN;
-      SD_pfStateMachine = SdCardSM_Error;
-    }
-  }
-
-  /* Monitor time out */
-  if( IsTimeUp(&SD_u32Timeout, SD_WAIT_TIME) )
-  {
-    SD_u8ErrorCode = SD_ERROR_TIMEOUT;
-    SD_pfStateMachine = SdCardSM_Error;
-  }
-     
-} /* end SdCardSM_WaitCommand() */
-
-
-/*-------------------------------------------------------------------------------------------------------------------*/
-/* Kill time waiting for a response read to finish; the first byte from all completed commands
-is response R1 which has BIT7 clear.  This response will be at SD_au8RxBuffer[0].
+/* Run the command started by SdCommand() (SdCommandThread) until the response R1 is at SD_au8RxBuffer[0].
      
 REQUIRES: 
   - SD_pfWaitReturnState points to the function that should be accessed next.
      
 PROMISES: 
   - State machine set to either SD_pfWaitReturnState or SdCardSM_Error
-  - RxBuffer holds response byte 
 */
-static void SdCardSM_WaitResponse(void)
+static void SdCardSM_Command(void)
 {
-  static u8 u8Retries = SD_CMD_RETRIES;
+  PtStatusType eStatus = SdCommandThread(&SD_sCommandThread);
   
-  /* Check to see if the SSP peripheral has sent the read request */
-  if(SspQueryReceiveStatus(SD_Ssp) == SSP_RX_COMPLETE)
+  if(eStatus == PT_ENDED)
   {
-    /* If no response but retries left, queue another read */
-    if( (SD_au8RxBuffer[0] & BIT7) && (u8Retries != 0) )
-    {
-      u8Retries--;
-      
-      if(u8Retries == 0)
-      {
-        SD_u8ErrorCode = SD_ERROR_BAD_RESPONSE;
-        SD_pfStateMachine = SdCardSM_Error;
-      }
-      else if( !SspReadByte(SD_Ssp) )
-      {
-        /* We didn't get a return token, so abort */
-        SD_u8ErrorCode = SD_ERROR_NO_TOKEN;
-        SD_pfStateMachine = SdCardSM_Error;
-      }
-    }
-    else
-    {
-      /* Otherwise we have a good response, so return now */
-      u8Retries = SD_CMD_RETRIES;
-      SD_pfStateMachine = SD_pfWaitReturnState;
-    }
+    SD_pfStateMachine = SD_pfWaitReturnState;
   }
-
-  /* Monitor time out */
-  if( IsTimeUp(&SD_u32Timeout, SD_WAIT_TIME) )
+  else if(eStatus == PT_EXITED)
   {
-    u8Retries = SD_CMD_RETRIES;
-    SD_u8ErrorCode = SD_ERROR_TIMEOUT;
     SD_pfStateMachine = SdCardSM_Error;
   }
      
-} /* end SdCardSM_WaitResponse() */
+} /* end SdCardSM_Command() */
 
   
 /*-------------------------------------------------------------------------------------------------------------------*/
 /* Kill time before checking SSP availability again */
 static void SdCardSM_WaitSSP(void)          
 {
-  if( IsTimeUp(&SD_u32Timeout, SD_SPI_WAIT_TIME_MS) )
+  if( SoftTimerExpired(&SD_sWaitTimer) )
   {
     SD_pfStateMachine = SD_pfWaitReturnState;
   }
@@ -931,7 +1371,7 @@ static void SdCardSM_WaitSSP(void)
      
      
 /*-------------------------------------------------------------------------------------------------------------------*/
-/* SD card is initialized: wait for action request. */
+/* SD card is initialized: wait for a request to be queued. */
 static void SdCardSM_ReadyIdle(void)          
 {
   /* Check if the card is still in; if not return through WaitSSP to allow some debounce time */
@@ -939,46 +1379,36 @@ static void SdCardSM_ReadyIdle(void)
   {
     SD_u32Flags &= SD_CLEAR_CARD_TYPE_BITS;
     
+    /* A new card gets to try the fastest clock again */
+    SD_u16FastDivider = SD_US_BRGR_FAST;
+    
+    /* Nothing that is queued can run now */
+    SdFinishRequests(SD_u8QueueCount, SD_REQUEST_FAILED);
+    
     /* Exit through a wait state for effective debouncing */
-    SD_u32Timeout = G_u32SystemTime1ms;
+    SoftTimerStart(&SD_sWaitTimer, SD_SPI_WAIT_TIME_MS, 0, SdWaitTimerCallback);
     SD_pfWaitReturnState = SdCardSM_IdleNoCard;
     SD_pfStateMachine = SdCardSM_WaitSSP;
   }
   else
   {
-    /* Look for a request to read or write file data */
-    if( (SD_CardState == SD_WRITING) || (SD_CardState == SD_READING) )
+    /* Look for a queued request */
+    if(SD_u8QueueCount != 0)
     {
       /* Request the SSP resource to talk to the card */
       SD_Ssp = SspRequest(&SD_sSspConfig);
       if(SD_Ssp == NULL)
       {
         /* Go to wait state if SSP is not available */
-        DebugPrintf(SD_au8SspRequestFailed);
-        SD_u32Timeout = G_u32SystemTime1ms;
+        LOG_ERROR(_DEBUG_LOG_SD, "%s", SD_au8SspRequestFailed);
+        SoftTimerStart(&SD_sWaitTimer, SD_SPI_WAIT_TIME_MS, 0, SdWaitTimerCallback);
         SD_pfWaitReturnState = SdCardSM_ReadyIdle;
         SD_pfStateMachine = SdCardSM_WaitSSP;
       }
       else
       {
-        /* Got SSP, so start read or write */
-        if(SD_CardState == SD_WRITING)
-        {
-          /* Not yet implemented */
-          SD_pfStateMachine = SdCardSM_ReadyIdle;
-          SD_CardState = SD_IDLE;
-        }
-        else
-        {
-          /* Parse out the bytes of the address into the command array */
-          SD_au8CMD17[1] = (u8)(SD_u32Address >> 24);
-          SD_au8CMD17[2] = (u8)(SD_u32Address >> 16);
-          SD_au8CMD17[3] = (u8)(SD_u32Address >> 8);
-          SD_au8CMD17[4] = (u8)SD_u32Address;
-          
-          SdCommand(&SD_au8CMD17[0]);
-          SD_pfWaitReturnState = SdCardSM_ResponseCMD17;
-        }
+        /* Got SSP, so start the next batch of requests */
+        SdStartBatch();
       }
     }
   }
@@ -986,14 +1416,13 @@ static void SdCardSM_ReadyIdle(void)
      
 
 /*-------------------------------------------------------------------------------------------------------------------*/
-/* Start read sequence */
-static void SdCardSM_ResponseCMD17(void)
+/* Start read sequence (CMD17 or CMD18) */
+static void SdCardSM_ResponseRead(void)
 {
   /* Check the response byte (response R1) */
   if(SD_au8RxBuffer[0] == SD_STATUS_READY)
   {
     /* Queue a read looking to get TOKEN_START_BLOCK back from the card */
-    //SD_u32CurrentMsgToken = SspReadByte(SD_Ssp);
     if(SspReadByte(SD_Ssp))
     {
       SD_u32Timeout = G_u32SystemTime1ms;
@@ -1003,7 +1432,7 @@ static void SdCardSM_ResponseCMD17(void)
     {
       /* SSP read error - we'll just abort */
       SD_u8ErrorCode = SD_ERROR_NO_TOKEN;
-      SD_pfStateMachine = SdCardSM_Error;
+      SD_pfStateMachine = SdCardSM_FailedDataTransfer;
     }
   }
   else
@@ -1013,30 +1442,22 @@ static void SdCardSM_ResponseCMD17(void)
     SD_pfStateMachine = SdCardSM_FailedDataTransfer;
   }
 
-  /* Either way, advance the RxBuffer pointer */  
-  //AdvanceSD_pu8RxBufferParser(1);
-
-} /* end SdCardSM_ResponseCMD17() */
+} /* end SdCardSM_ResponseRead() */
 
 
 /*-------------------------------------------------------------------------------------------------------------------*/
-/* Look for the returned token that indicates the read or write process has begun */
+/* Look for the returned token that indicates the next data block is coming */
 static void SdCardSM_WaitStartToken(void)          
 {
   /* Check if the SSP peripheral has sent the data request */
-//  if( QueryMessageStatus(SD_u32CurrentMsgToken) == COMPLETE )
   if(SspQueryReceiveStatus(SD_Ssp) == SSP_RX_COMPLETE)
   {
     /* Check the response byte */
     if(SD_au8RxBuffer[0] == TOKEN_START_BLOCK)
     {
-      /* Set the RxBuffer pointers to the start of the RxBuffer so the sector data occupies the beginning */
-      //SD_pu8RxBufferNextByte = &SD_au8RxBuffer[0];
-      //SD_pu8RxBufferParser   = &SD_au8RxBuffer[0];
-      
-      /* Queue a read for the entire sector plus two checksum bytes */
+      /* Queue a read for the sector straight into the client buffer; the checksum follows separately */
       /* CS is still asserted since we are reading data */
-      if(SspReadData(SD_Ssp, 514))
+      if(SspReadDataDirect(SD_Ssp, SD_pu8BlockData, SD_BLOCK_SIZE))
       {
         SD_pfStateMachine = SdCardSM_DataTransfer;
       }
@@ -1044,7 +1465,7 @@ static void SdCardSM_WaitStartToken(void)
       {
         /* SSP read error - we'll just abort */
         SD_u8ErrorCode = SD_ERROR_NO_TOKEN;
-        SD_pfStateMachine = SdCardSM_Error;
+        SD_pfStateMachine = SdCardSM_FailedDataTransfer;
       }
     }
     else
@@ -1058,7 +1479,7 @@ static void SdCardSM_WaitStartToken(void)
       {
         /* SSP read error - we'll just abort */
         SD_u8ErrorCode = SD_ERROR_NO_TOKEN;
-        SD_pfStateMachine = SdCardSM_Error;
+        SD_pfStateMachine = SdCardSM_FailedDataTransfer;
       }
     }
   }
@@ -1080,26 +1501,335 @@ static void SdCardSM_DataTransfer(void)
   /* Check if the SSP peripheral is finished with the data request */
   if(SspQueryReceiveStatus(SD_Ssp) == SSP_RX_COMPLETE)
   {
-    SD_CardState = SD_DATA_READY;
+    /* Clock out the two CRC bytes into the driver's own buffer so the client only gets data */
+    if(SspReadData(SD_Ssp, SD_DATA_CRC_SIZE))
+    {
+      SD_pfStateMachine = SdCardSM_DataCrc;
+    }
+    else
+    {
+      /* SSP read error - we'll just abort */
+      SD_u8ErrorCode = SD_ERROR_NO_TOKEN;
+      SD_pfStateMachine = SdCardSM_FailedDataTransfer;
+    }
+  }
+
+  /* Monitor time */
+  if(IsTimeUp(&SD_u32Timeout, SD_SECTOR_READ_TIMEOUT_MS))
+  {
+    SD_u8ErrorCode = SD_ERROR_TIMEOUT;
+    SD_pfStateMachine = SdCardSM_FailedDataTransfer;
+  }
 
-    SspDeAssertCS(SD_Ssp);
-    SspRelease(SD_Ssp);
+} /* end SdCardSM_DataTransfer() */
 
-    /* Reset the RxBuffer pointers to the start of the RxBuffer */
-    //SD_pu8RxBufferNextByte = &SD_au8RxBuffer[0];
-    //SD_pu8RxBufferParser   = &SD_au8RxBuffer[0];
 
-    SD_pfStateMachine = SdCardSM_ReadyIdle;
+/*-------------------------------------------------------------------------------------------------------------------*/
+/* Block is in once the CRC bytes are read (the CRC is not checked; CRC is off in SPI mode).
+Wait for the next block of a multi-block read or stop the transmission after the last one. */
+static void SdCardSM_DataCrc(void)
+{
+  if(SspQueryReceiveStatus(SD_Ssp) == SSP_RX_COMPLETE)
+  {
+    if( SdNextBlock() )
+    {
+      if(SspReadByte(SD_Ssp))
+      {
+        SD_u32Timeout = G_u32SystemTime1ms;
+        SD_pfStateMachine = SdCardSM_WaitStartToken;
+      }
+      else
+      {
+        SD_u8ErrorCode = SD_ERROR_NO_TOKEN;
+        SD_pfStateMachine = SdCardSM_FailedDataTransfer;
+      }
+    }
+    else if(SD_u32Flags & _SD_MULTI_BLOCK)
+    {
+      SdCommand(&SD_au8CMD12[0]);
+      SD_pfWaitReturnState = SdCardSM_ResponseCMD12;
+    }
+    else
+    {
+      SD_pfStateMachine = SdCardSM_BatchDone;
+    }
   }
 
   /* Monitor time */
   if(IsTimeUp(&SD_u32Timeout, SD_SECTOR_READ_TIMEOUT_MS))
   {
     SD_u8ErrorCode = SD_ERROR_TIMEOUT;
-    SD_pfStateMachine = SdCardSM_Error;
+    SD_pfStateMachine = SdCardSM_FailedDataTransfer;
   }
 
-} /* end SdCardSM_DataTransfer() */
+} /* end SdCardSM_DataCrc() */
+
+
+/*-------------------------------------------------------------------------------------------------------------------*/
+/* CMD12 has response R1b: the card may hold the line busy after the response */
+static void SdCardSM_ResponseCMD12(void)
+{
+  SdWaitBusy(SD_WAIT_TIME, SdCardSM_BatchDone);
+
+} /* end SdCardSM_ResponseCMD12() */
+
+
+/*-------------------------------------------------------------------------------------------------------------------*/
+/* Start write sequence (CMD24 or CMD25) */
+static void SdCardSM_ResponseWrite(void)
+{
+  /* Check the response byte (response R1) */
+  if(SD_au8RxBuffer[0] == SD_STATUS_READY)
+  {
+    SdSendBlock();
+  }
+  else
+  {
+    /* Incorrect response from the SD card, so abort */
+    SD_u8ErrorCode = SD_ERROR_BAD_RESPONSE;
+    SD_pfStateMachine = SdCardSM_FailedDataTransfer;
+  }
+
+} /* end SdCardSM_ResponseWrite() */
+
+
+/*-------------------------------------------------------------------------------------------------------------------*/
+/* Wait for the data packet to be clocked out then read the data response token */
+static void SdCardSM_WaitDataSent(void)
+{
+  if( QueryMessageStatus(SD_u32CurrentMsgToken) == COMPLETE )
+  {
+    if(SspReadByte(SD_Ssp))
+    {
+      SD_pfStateMachine = SdCardSM_WaitDataResponse;
+    }
+    else
+    {
+      /* SSP read error - we'll just abort */
+      SD_u8ErrorCode = SD_ERROR_NO_TOKEN;
+      SD_pfStateMachine = SdCardSM_FailedDataTransfer;
+    }
+  }
+  
+  /* Monitor time */
+  if(IsTimeUp(&SD_u32Timeout, SD_WRITE_TIMEOUT_MS))
+  {
+    SD_u8ErrorCode = SD_ERROR_TIMEOUT;
+    SD_pfStateMachine = SdCardSM_FailedDataTransfer;
+  }
+
+} /* end SdCardSM_WaitDataSent() */
+
+
+/*-------------------------------------------------------------------------------------------------------------------*/
+/* Check the data response token: xxx0sss1 where sss = 010 means the data was accepted */
+static void SdCardSM_WaitDataResponse(void)
+{
+  if(SspQueryReceiveStatus(SD_Ssp) == SSP_RX_COMPLETE)
+  {
+    /* Idle bus: keep looking for the token */
+    if( (SD_au8RxBuffer[0] == SD_IDLE_BUS_BYTE) || (SD_au8RxBuffer[0] == SSP_DUMMY_BYTE) )
+    {
+      if(!SspReadByte(SD_Ssp))
+      {
+        SD_u8ErrorCode = SD_ERROR_NO_TOKEN;
+        SD_pfStateMachine = SdCardSM_FailedDataTransfer;
+      }
+    }
+    else if( (SD_au8RxBuffer[0] & SD_DATA_RESPONSE_MASK) == SD_DATA_ACCEPTED )
+    {
+      /* Card is now programming; it holds the data line low until it is done */
+      SdWaitBusy(SD_WRITE_TIMEOUT_MS, SdCardSM_WriteBlockDone);
+    }
+    else
+    {
+      /* CRC or write error reported by the card */
+      SD_u8ErrorCode = SD_ERROR_WRITE_REJECTED;
+      SD_pfStateMachine = SdCardSM_FailedDataTransfer;
+    }
+  }
+  
+  /* Monitor time */
+  if(IsTimeUp(&SD_u32Timeout, SD_WRITE_TIMEOUT_MS))
+  {
+    SD_u8ErrorCode = SD_ERROR_TIMEOUT;
+    SD_pfStateMachine = SdCardSM_FailedDataTransfer;
+  }
+
+} /* end SdCardSM_WaitDataResponse() */
+
+
+/*-------------------------------------------------------------------------------------------------------------------*/
+/* A block has been programmed: send the next one, or end a multi-block write with the stop token */
+static void SdCardSM_WriteBlockDone(void)
+{
+  if( SdNextBlock() )
+  {
+    SdSendBlock();
+  }
+  else if(SD_u32Flags & _SD_MULTI_BLOCK)
+  {
+    SD_u32CurrentMsgToken = SspWriteData(SD_Ssp, 1, &SD_au8StopMultiToken[0]);
+    if(SD_u32CurrentMsgToken)
+    {
+      SD_u32Timeout = G_u32SystemTime1ms;
+      SD_pfStateMachine = SdCardSM_WaitStopSent;
+    }
+    else
+    {
+      SD_u8ErrorCode = SD_ERROR_NO_TOKEN;
+      SD_pfStateMachine = SdCardSM_FailedDataTransfer;
+    }
+  }
+  else
+  {
+    SD_pfStateMachine = SdCardSM_BatchDone;
+  }
+
+} /* end SdCardSM_WriteBlockDone() */
+
+
+/*-------------------------------------------------------------------------------------------------------------------*/
+/* Wait for the stop token to go out then skip the one byte gap before the card goes busy */
+static void SdCardSM_WaitStopSent(void)
+{
+  if( QueryMessageStatus(SD_u32CurrentMsgToken) == COMPLETE )
+  {
+    if(SspReadByte(SD_Ssp))
+    {
+      SD_pfStateMachine = SdCardSM_StopGap;
+    }
+    else
+    {
+      SD_u8ErrorCode = SD_ERROR_NO_TOKEN;
+      SD_pfStateMachine = SdCardSM_FailedDataTransfer;
+    }
+  }
+  
+  /* Monitor time */
+  if(IsTimeUp(&SD_u32Timeout, SD_WRITE_TIMEOUT_MS))
+  {
+    SD_u8ErrorCode = SD_ERROR_TIMEOUT;
+    SD_pfStateMachine = SdCardSM_FailedDataTransfer;
+  }
+
+} /* end SdCardSM_WaitStopSent() */
+
+
+/*-------------------------------------------------------------------------------------------------------------------*/
+/* The gap byte is in: now wait for the card to finish programming */
+static void SdCardSM_StopGap(void)
+{
+  if(SspQueryReceiveStatus(SD_Ssp) == SSP_RX_COMPLETE)
+  {
+    SdWaitBusy(SD_WRITE_TIMEOUT_MS, SdCardSM_BatchDone);
+  }
+  
+  /* Monitor time */
+  if(IsTimeUp(&SD_u32Timeout, SD_WRITE_TIMEOUT_MS))
+  {
+    SD_u8ErrorCode = SD_ERROR_TIMEOUT;
+    SD_pfStateMachine = SdCardSM_FailedDataTransfer;
+  }
+
+} /* end SdCardSM_StopGap() */
+
+
+/*-------------------------------------------------------------------------------------------------------------------*/
+/* Erase sequence: CMD32 start address, CMD33 end address, CMD38 erase */
+static void SdCardSM_ResponseCMD32(void)
+{
+  if(SD_au8RxBuffer[0] == SD_STATUS_READY)
+  {
+    SdCommand(&SD_au8CMD33[0]);
+    SD_pfWaitReturnState = SdCardSM_ResponseCMD33;
+  }
+  else
+  {
+    SD_u8ErrorCode = SD_ERROR_BAD_RESPONSE;
+    SD_pfStateMachine = SdCardSM_FailedDataTransfer;
+  }
+
+} /* end SdCardSM_ResponseCMD32() */
+
+
+/*-------------------------------------------------------------------------------------------------------------------*/
+static void SdCardSM_ResponseCMD33(void)
+{
+  if(SD_au8RxBuffer[0] == SD_STATUS_READY)
+  {
+    SdCommand(&SD_au8CMD38[0]);
+    SD_pfWaitReturnState = SdCardSM_ResponseCMD38;
+  }
+  else
+  {
+    SD_u8ErrorCode = SD_ERROR_BAD_RESPONSE;
+    SD_pfStateMachine = SdCardSM_FailedDataTransfer;
+  }
+
+} /* end SdCardSM_ResponseCMD33() */
+
+
+/*-------------------------------------------------------------------------------------------------------------------*/
+/* CMD38 has response R1b: the card is busy until the erase is complete */
+static void SdCardSM_ResponseCMD38(void)
+{
+  if(SD_au8RxBuffer[0] == SD_STATUS_READY)
+  {
+    SdWaitBusy(SD_ERASE_TIMEOUT_MS, SdCardSM_BatchDone);
+  }
+  else
+  {
+    SD_u8ErrorCode = SD_ERROR_BAD_RESPONSE;
+    SD_pfStateMachine = SdCardSM_FailedDataTransfer;
+  }
+
+} /* end SdCardSM_ResponseCMD38() */
+
+
+/*-------------------------------------------------------------------------------------------------------------------*/
+/* Poll the card until it releases the busy signal then continue at SD_pfWaitReturnState */
+static void SdCardSM_WaitBusy(void)
+{
+  if(SspQueryReceiveStatus(SD_Ssp) == SSP_RX_COMPLETE)
+  {
+    if(SD_au8RxBuffer[0] == SD_CARD_BUSY_BYTE)
+    {
+      if(!SspReadByte(SD_Ssp))
+      {
+        SD_u8ErrorCode = SD_ERROR_NO_TOKEN;
+        SD_pfStateMachine = SdCardSM_FailedDataTransfer;
+      }
+    }
+    else
+    {
+      SoftTimerStop(&SD_sWaitTimer);
+      SD_pfStateMachine = SD_pfWaitReturnState;
+    }
+  }
+
+  /* Monitor time */
+  if( SoftTimerExpired(&SD_sWaitTimer) )
+  {
+    SD_u8ErrorCode = SD_ERROR_TIMEOUT;
+    SD_pfStateMachine = SdCardSM_FailedDataTransfer;
+  }
+
+} /* end SdCardSM_WaitBusy() */
+
+
+/*-------------------------------------------------------------------------------------------------------------------*/
+/* All requests in the batch are complete */
+static void SdCardSM_BatchDone(void)
+{
+  SspDeAssertCS(SD_Ssp);
+  SspRelease(SD_Ssp);
+
+  SD_CardState = SD_IDLE;
+  SdFinishRequests(SD_u8BatchRequests, SD_REQUEST_DONE);
+  SD_pfStateMachine = SdCardSM_ReadyIdle;
+
+} /* end SdCardSM_BatchDone() */
 
 
 /*-------------------------------------------------------------------------------------------------------------------*/
@@ -1109,10 +1839,26 @@ static void SdCardSM_FailedDataTransfer(void)
   /* Reset the system variables */
   SspDeAssertCS(SD_Ssp);
   SspRelease(SD_Ssp);
-  //FlushSdRxBuffer();
   SD_CardState = SD_CARD_ERROR;
   
-  SD_u32Timeout = G_u32SystemTime1ms;
+  /* Only the batch in progress fails; the rest of the queue runs after the card is re-initialized */
+  SdFinishRequests(SD_u8BatchRequests, SD_REQUEST_FAILED);
+  
+  /* Errors in data transfers are most likely signal integrity at the fast clock, so slow down */
+  if(SD_u16FastDivider < SD_US_BRGR_INIT)
+  {
+    SD_u16FastDivider <<= 1;
+    if(SD_u16FastDivider > SD_US_BRGR_INIT)
+    {
+      SD_u16FastDivider = SD_US_BRGR_INIT;
+    }
+    LOG_WARN(_DEBUG_LOG_SD, "%s", SD_au8ClockReduced);
+    TOKENLOG1(TOKENLOG_SD_CLOCK_REDUCED, SD_u16FastDivider);
+  }
+  
+  /* Re-initialize the card after the recovery delay */
+  SoftTimerStart(&SD_sWaitTimer, SD_SPI_WAIT_TIME_MS, 0, SdWaitTimerCallback);
+  SD_pfWaitReturnState = SdCardSM_IdleNoCard;
   SD_pfStateMachine = SdCardSM_WaitSSP;
   
 } /* end SdCardSM_FailedDataTransfer() */
@@ -1131,7 +1877,6 @@ static void SdCardSM_Error(void)
   //FlushSdRxBuffer();
 
   /* Indicate error and return through the SSP delay state to give the system some recovery time */
-  DebugPrintf(SD_au8CardError);
   switch (SD_u8ErrorCode)
   {
     case SD_ERROR_TIMEOUT:
@@ -1168,6 +1913,12 @@ static void SdCardSM_Error(void)
       pu8ErrorMessage = SD_au8CardError5;
       break;
     }
+
+    case SD_ERROR_WRITE_REJECTED:
+    {
+      pu8ErrorMessage = SD_au8CardError6;
+      break;
+    }
     
    default:
    {
@@ -1178,10 +1929,12 @@ static void SdCardSM_Error(void)
    
   } /* end switch */
   
-  DebugPrintf(pu8ErrorMessage);
+  LOG_ERROR(_DEBUG_LOG_SD, "%s%s", SD_au8CardError, pu8ErrorMessage);
   
+  /* The card must be found again so nothing queued will run */
   SD_CardState = SD_NO_CARD;
-  SD_u32Timeout = G_u32SystemTime1ms;
+  SdFinishRequests(SD_u8QueueCount, SD_REQUEST_FAILED);
+  SoftTimerStart(&SD_sWaitTimer, SD_SPI_WAIT_TIME_MS, 0, SdWaitTimerCallback);
   SD_pfWaitReturnState = SdCardSM_IdleNoCard;
   SD_pfStateMachine = SdCardSM_WaitSSP;
   
@@ -13,7 +13,27 @@ Header file for sdcard.c
 /**********************************************************************************************************************
 Type Definitions
 **********************************************************************************************************************/
-typedef enum {SD_NO_CARD, SD_CARD_ERROR, SD_IDLE, SD_READING, SD_DATA_READY, SD_WRITING} SdCardStateType;
+typedef enum {SD_NO_CARD, SD_CARD_ERROR, SD_IDLE, SD_READING, SD_WRITING, SD_ERASING} SdCardStateType;
+typedef enum {SD_OP_READ, SD_OP_WRITE, SD_OP_ERASE} SdOperationType;
+typedef enum {SD_REQUEST_UNKNOWN, SD_REQUEST_QUEUED, SD_REQUEST_ACTIVE, SD_REQUEST_DONE, SD_REQUEST_FAILED} SdRequestStatusType;
+
+typedef void(*SdCallbackType)(u32 u32Token_, SdRequestStatusType eResult_);
+
+typedef struct
+{
+  SdOperationType eOperation;         /* Read, write or erase */
+  u32 u32Token;                       /* Token returned to the client */
+  u32 u32Sector;                      /* First sector */
+  u32 u32Blocks;                      /* Number of 512 byte blocks */
+  u8* pu8Data;                        /* Client buffer of u32Blocks * 512 bytes (NULL for erase) */
+  SdCallbackType pfCallback;          /* Called when the request finishes (may be NULL) */
+} SdRequestType;
+
+typedef struct
+{
+  u32 u32Token;                       /* Token of a finished request */
+  SdRequestStatusType eResult;        /* SD_REQUEST_DONE or SD_REQUEST_FAILED */
+} SdResultType;
 
 
 /**********************************************************************************************************************
@@ -27,6 +47,7 @@ Constants / Definitions
 #define _SD_TYPE_SD2		          (u32)0x00000010		   /* SD ver 2 */
 #define _SD_TYPE_MMC		          (u32)0x00000020	     /* SD ver 3 */
 #define _SD_TYPE_BLOCK		        (u32)0x00000040		   /* Block addressing */
+#define _SD_MULTI_BLOCK           (u32)0x00000080      /* Set while the current batch uses a multi-block command */
 //#define _SD_TYPE_SDSC             (u32)0x00000000      /* Standard Capacity SD Memory Card (SDSC): Up to and including 2 GB */
 //#define _SD_TYPE_SDHC             (u32)0x00000000      /* High Capacity SD Memory Card (SDHC): More than 2GB and up to and including 32GB */
 //#define _SD_TYPE_SDXC             (u32)0x00000000      /* Extended Capacity SD Memory Card (SDXC): More than 32GB and up to and including 2TB */
@@ -35,7 +56,7 @@ Constants / Definitions
 #define SD_CLEAR_CARD_TYPE_BITS  ~(_SD_CARD_HC | _SD_TYPE_MMC | _SD_TYPE_SD1 | _SD_TYPE_SD2 |_SD_TYPE_BLOCK)
 #define _SD_TYPE_SDC		          (_SD_TYPE_SD1 | _SD_TYPE_SD2)	
 
-#define SDCARD_RX_BUFFER_SIZE     (u32)548             /* Size of buffer for incoming SD data */
+#define SDCARD_RX_BUFFER_SIZE     (u32)20              /* Responses and CRC only: sector data goes to the client buffer (>= SD_WAKEUP_BYTES) */
 
 #define SD_RESPONSE_TIMEOUT       (u32)100             /* Time in ms for the SD card to respond to a command */
 #define SD_WAIT_TIME              (u32)1000            /* Time in ms for waiting for SD stuff to occur */
@@ -49,6 +70,14 @@ Constants / Definitions
 #define SD_INIT_TIMEOUT_MS		    (u32)(1000)
 #define SD_SECTOR_READ_TIMEOUT_MS	(u32)(1000)
 #define SD_ERASE_TIMEOUT_MS	      (u32)(30000)
+#define SD_WRITE_TIMEOUT_MS       (u32)(500)           /* Time for a block to be sent and programmed */
+#define SD_CARD_DETECT_PERIOD_MS  (u32)(100)           /* Time between card detect checks while the task is idle */
+
+#define SD_BLOCK_SIZE             (u32)512             /* Bytes in one data block */
+#define SD_DATA_CRC_SIZE          (u16)2               /* CRC bytes that follow a data block */
+
+#define SD_QUEUE_SIZE             (u8)8                /* Requests that can be waiting */
+#define SD_RESULT_HISTORY         (u8)8                /* Finished requests remembered for SdQueryRequest() */
 
 
 /* SD Commands support in SPI mode */
@@ -85,6 +114,10 @@ Constants / Definitions
 
 #define _SD_OCR_CCS_BIT           (u8)0x40      /* Bit in OCR register that indicates card capacity (high == high capacity) */
 
+#define SD_CSD_SIZE               (u8)16        /* Bytes in the CSD register (CMD9) */
+#define SD_CSD_STRUCTURE_V2       (u8)0x40      /* CSD byte 0 bits 7:6 for the SDHC/SDXC layout */
+#define SD_CSD_MAX_C_SIZE_V2      (u32)0x003FFFFF /* C_SIZE at which (C_SIZE + 1) * 1024 sectors no longer fits a u32 */
+
 #define SD_R1_LEN	                (u8)(1)
 #define SD_R2_LEN	                (u8)(2)
 #define SD_R3_LEN	                (u8)(SD_R1_LEN + 4)	// 4-byte OCR
@@ -112,6 +145,12 @@ Constants / Definitions
 #define TOKEN_START_BLOCK_MULT    (u8)0xFC      /* First byte of each block in multiple block write */
 #define TOKEN_STOP_BLOCK_MULT     (u8)0xFD      /* Stop transmission request token for multi-block write */
 
+#define SD_DUMMY_CRC              (u8)0xFF      /* Data CRC is ignored unless CRC mode is turned on with CMD59 */
+#define SD_DATA_RESPONSE_MASK     (u8)0x1F      /* Bits of interest in the data response token */
+#define SD_DATA_ACCEPTED          (u8)0x05      /* Data response: data accepted */
+#define SD_CARD_BUSY_BYTE         (u8)0x00      /* Card holds the data line low while programming */
+#define SD_IDLE_BUS_BYTE          (u8)0xFF      /* Nothing driven by the card */
+
 /* SD Error Codes */
 #define SD_ERROR_NONE             (u8)0x00      /* No error */
 #define SD_ERROR_TIMEOUT          (u8)0x01      /* SSP application did not deliver expected response */
@@ -119,6 +158,7 @@ Constants / Definitions
 #define SD_ERROR_BAD_RESPONSE     (u8)0x03      /* Unexpected or no response to a command */
 #define SD_ERROR_NO_TOKEN         (u8)0x04      /* Got '0' for a message token => message task is broken */
 #define SD_ERROR_NO_SD_TOKEN      (u8)0x05      /* Expected a token from the SD card but didn't get it */
+#define SD_ERROR_WRITE_REJECTED   (u8)0x06      /* Card reported a CRC or write error in the data response */
 
 #define BIT6                      ((u8)0x40)
 #define BIT7                      ((u8)0x80)
@@ -136,9 +176,11 @@ Constants / Definitions
 /* Public functions */
 /*--------------------------------------------------------------------------------------------------------------------*/
 SdCardStateType SdGetStatus(void);
-bool SdReadBlock(u32 u32BlockAddress_);
-bool SdWriteBlock(u32 u32BlockAddress_);             
-bool SdGetReadData(u8* pu8Destination_);
+u32 SdGetSectorCount(void);
+u32 SdQueueRead(u32 u32Sector_, u32 u32Blocks_, u8* pu8Destination_, SdCallbackType pfCallback_);
+u32 SdQueueWrite(u32 u32Sector_, u32 u32Blocks_, u8* pu8Source_, SdCallbackType pfCallback_);
+u32 SdQueueErase(u32 u32Sector_, u32 u32Blocks_, SdCallbackType pfCallback_);
+SdRequestStatusType SdQueryRequest(u32 u32Token_);
 void CheckTimeout(u32 u32Time_);
 
 
@@ -155,6 +197,17 @@ bool SdIsCardInserted(void);
 /* Private functions */
 /*--------------------------------------------------------------------------------------------------------------------*/
 static void SdCommand(u8* pau8Command_);
+static PtStatusType SdCommandThread(ProtoThreadType* psPt_);
+static PtStatusType SdInitThread(ProtoThreadType* psPt_);
+static u32 SdCsdSectors(u8* pu8Csd_);
+static u32 SdQueueRequest(SdOperationType eOperation_, u32 u32Sector_, u32 u32Blocks_, u8* pu8Data_, SdCallbackType pfCallback_);
+static void SdLoadAddress(u8* pau8Command_, u32 u32Sector_);
+static void SdStartBatch(void);
+static bool SdNextBlock(void);
+static void SdSendBlock(void);
+static void SdWaitBusy(u32 u32Timeout_, fnCode_type pfNextState_);
+static void SdFinishRequests(u8 u8Count_, SdRequestStatusType eResult_);
+static void SdWaitTimerCallback(void);
 //static void AdvanceSD_pu8RxBufferParser(u32 u32NumBytes_);
 //static void FlushSdRxBuffer(void);
 
@@ -167,25 +220,29 @@ static void SdCardSM_Disabled(void);
 #endif /* ENABLE_SD */
 
 static void SdCardSM_IdleNoCard(void);     
-static void SdCardSM_Dummies(void);
-static void SdCardSM_ResponseCMD0(void);
-static void SdCardSM_ResponseCMD8(void);
-static void SdCardSM_ReadCMD8(void);
-static void SdCardSM_ResponseCMD55(void);
-static void SdCardSM_ResponseACMD41(void);
-static void SdCardSM_ResponseCMD58(void);
-static void SdCardSM_ResponseCMD16(void);
-static void SdCardSM_ReadCMD58(void);
+static void SdCardSM_Initialize(void);
 
 static void SdCardSM_ReadyIdle(void);          
-static void SdCardSM_ResponseCMD17(void);
+static void SdCardSM_ResponseRead(void);
 static void SdCardSM_WaitStartToken(void);          
 static void SdCardSM_DataTransfer(void);
+static void SdCardSM_DataCrc(void);
+static void SdCardSM_ResponseCMD12(void);
+static void SdCardSM_ResponseWrite(void);
+static void SdCardSM_WaitDataSent(void);
+static void SdCardSM_WaitDataResponse(void);
+static void SdCardSM_WriteBlockDone(void);
+static void SdCardSM_WaitStopSent(void);
+static void SdCardSM_StopGap(void);
+static void SdCardSM_ResponseCMD32(void);
+static void SdCardSM_ResponseCMD33(void);
+static void SdCardSM_ResponseCMD38(void);
+static void SdCardSM_WaitBusy(void);
+static void SdCardSM_BatchDone(void);
 static void SdCardSM_FailedDataTransfer(void);
 
 //static void SdCardSM_WaitReady(void);
-static void SdCardSM_WaitCommand(void);
-static void SdCardSM_WaitResponse(void);
+static void SdCardSM_Command(void);
 static void SdCardSM_WaitSSP(void);
 
 static void SdCardSM_Error(void);         
@@ -11,12 +11,12 @@ behavior.  This will be fixed on a future version. ****
 Provides the terminal interface and also a local command-driven debugging
 system for teh system.
 
-Since the system is small, debugger commands will be strictly numerical, 
-though each command will have a string name that can
-be requested by the user.  The debugger will print a list of these commands if 
-requested using en+c00.  Commands range from 01 to 99 (must include the leading 0
-for single-digit commands) and all commands must have the prefix en+c. 
-The current command list can be quickly checked in debug_x.h (where x is application-specific)
+Debugger commands are typed by name (e.g. "stack") or by number with the prefix
+en+c (e.g. en+c04; must include the leading 0 for single-digit commands), 
+optionally followed by a space and arguments.  "list" or en+c00 prints the 
+commands with their numbers.  The built-in commands are in Debug_asCommands; 
+other tasks add theirs with DebugCommandRegister() during initialization.  
+Numbers are assigned in registration order, so they can change between builds.
 
 This application requires a UART resource for input/output data.
 
@@ -36,6 +36,8 @@ GLOBALS
 It is cleared whenever DebugScanf() is called.
 - G_u8DebugScanfCharCount holds number of characters in Debug_au8ScanfBuffer.
 It is cleared whenever DebugScanf() is called.
+- G_au32DebugLogMask[] holds the modules enabled at each log level for the LOG_xxx() macros.  
+Change it with DebugLogSetLevel() and DebugLogSetModules().
 
 Copy the following into your task in section global "Existing variables":
 
@@ -43,6 +45,8 @@ extern u8 G_au8DebugScanfBuffer[DEBUG_SCANF_BUFFER_SIZE]; // From debug.c
 
 extern u8 G_u8DebugScanfCharCount;                        // From debug.c
 
+extern u32 G_au32DebugLogMask[];                          // From debug.c (only if LOG_xxx() is used)
+
 CONSTANTS
 - DEBUG_SCANF_BUFFER_SIZE is the size of G_au8DebugScanfBuffer and thus the max of G_u8DebugScanfCharCount
 
@@ -51,11 +55,18 @@ TYPES
 
 PUBLIC FUNCTIONS
 - u32 DebugPrintf(u8* u8String_)
+- u32 DebugWriteData(u32 u32Size_, u8* pu8Data_)
 - void DebugLineFeed(void)
 - void DebugPrintNumber(u32 u32Number_)
+- u32 DebugPrintFormat(u8* pu8Format_, ...)
 - u8 DebugScanf(u8* au8Buffer_)
 - void DebugSetPassthrough(void)
 - void DebugClearPassthrough(void)
+- void DebugLogSetLevel(u8 u8Level_)
+- void DebugLogSetModules(u32 u32Modules_)
+- bool DebugParseNumber(u8** ppu8Parser_, u8 u8Base_, u32* pu32Number_)
+- bool DebugCommandRegister(u8* pu8Name_, u8* pu8Help_, fnCode_type pfnCommand_)
+- u8* DebugCommandArguments(void)
 
 ***********************************************************************************************************************/
 
@@ -71,6 +82,14 @@ u32 G_u32DebugFlags;                                   /*!< @brief Debug flag re
 u8 G_au8DebugScanfBuffer[DEBUG_SCANF_BUFFER_SIZE];     /*!< @brief Space to latch characters for DebugScanf() */
 u8 G_u8DebugScanfCharCount = 0;                        /*!< @brief Counter for # of characters in Debug_au8ScanfBuffer */
 
+/*! @brief Modules enabled at each log level, tested by the LOG_xxx() macros.  Set up here so early
+messages are filtered before DebugInitialize() runs. */
+u32 G_au32DebugLogMask[DEBUG_LOG_LEVELS] = {0,
+                                            DEBUG_LOG_MASK_INIT(DEBUG_LOG_ERROR),
+                                            DEBUG_LOG_MASK_INIT(DEBUG_LOG_WARN),
+                                            DEBUG_LOG_MASK_INIT(DEBUG_LOG_INFO),
+                                            DEBUG_LOG_MASK_INIT(DEBUG_LOG_VERBOSE)};
+
 
 /*--------------------------------------------------------------------------------------------------------------------*/
 /* Existing variables (defined in other files -- should all contain the "extern" keyword) */
@@ -82,6 +101,11 @@ extern volatile u32 G_u32ApplicationFlags;             /*!< @brief From main.c *
 extern u8 G_au8UtilMessageON[];                        /*!< @brief From utilities.c */
 extern u8 G_au8UtilMessageOFF[];                       /*!< @brief From utilities.c */
 
+extern u32 G_u32MessagingFlags;                        /*!< @brief From messaging.c */
+extern volatile u32 G_u32TokenLogFlags;                /*!< @brief From tokenlog.c */
+extern volatile u32 G_u32TraceFlags;                   /*!< @brief From trace.c */
+extern u32 G_u32StackMonFlags;                         /*!< @brief From stackmon.c */
+
 
 /***********************************************************************************************************************
 Global variable definitions with scope limited to this local application.
@@ -103,20 +127,55 @@ static u8 *Debug_pu8CmdBufferNextChar;                   /*!< @brief Pointer to
 static u16 Debug_u16CommandSize;                         /*!< @brief Number of characters in the command buffer */
 
 static u8 Debug_u8Command;                               /*!< @brief A validated command number */
+static u8* Debug_pu8CommandArgs;                         /*!< @brief NULL-terminated arguments typed after the command name or number */
+
+static u8 Debug_u8LogLevel = DEBUG_LOG_LEVEL;            /*!< @brief Runtime log level */
+static u32 Debug_u32LogModules = _DEBUG_LOG_ALL;         /*!< @brief Runtime log module enables */
+
+/*! @brief Log module names in _DEBUG_LOG_xxx bit order */
+static u8* Debug_apu8LogModuleNames[DEBUG_LOG_MODULES] = {"SYSTEM", "LED", "BUTTON", "UART", "SSP", "TWI", "ADC",
+                                                          "TIMER", "MESSAGING", "LCD", "SD", "FATLOG", "RAWLOG", "USER"};
+static u8* Debug_apu8LogLevelNames[DEBUG_LOG_LEVELS] = {"NONE", "ERROR", "WARN", "INFO", "VERBOSE"};
+
+static DebugWatchType Debug_asWatch[DEBUG_WATCH_ENTRIES];  /*!< @brief Locations sampled by the watch list */
+static u8 Debug_u8WatchCount;                              /*!< @brief Entries in use in Debug_asWatch */
+static u32 Debug_u32WatchPeriod = DEBUG_WATCH_PERIOD_DEFAULT; /*!< @brief ms between watch samples */
+static u32 Debug_u32WatchTime;                             /*!< @brief Time of the last watch sample */
+static u32 Debug_u32WatchToken;                            /*!< @brief Message token of the last watch sample */
+static u32 Debug_u32WatchSkipped;                          /*!< @brief Samples skipped because the last one was still queued */
+
+/*! @brief Globals that can be added to the watch list by name */
+static DebugWatchNameType Debug_asWatchNames[] = { {"G_u32SystemTime1ms",    &G_u32SystemTime1ms},
+                                                   {"G_u32SystemFlags",      &G_u32SystemFlags},
+                                                   {"G_u32ApplicationFlags", &G_u32ApplicationFlags},
+                                                   {"G_u32DebugFlags",       &G_u32DebugFlags},
+                                                   {"G_u32MessagingFlags",   &G_u32MessagingFlags},
+                                                   {"G_u32TokenLogFlags",    &G_u32TokenLogFlags},
+                                                   {"G_u32TraceFlags",       &G_u32TraceFlags},
+                                                   {"G_u32StackMonFlags",    &G_u32StackMonFlags} };
+
+/*! @brief Built-in commands followed by those added with DebugCommandRegister().  A command's number is its 
+index here; update DEBUG_BUILTIN_COMMANDS in debug.h when adding to the initializer. */
+static DebugCommandType Debug_asCommands[DEBUG_COMMANDS_MAX] = 
+{ {"list",      "Show debug command list",          DebugCommandPrepareList},
+  {"ledtest",   "Toggle LED test",                  DebugCommandLedTestToggle},
+  {"timing",    "Toggle system timing warning",     DebugCommandSysTimeToggle},
+  {"logfilter", "Toggle log filter edit",           DebugCommandLogFilterToggle},
+  {"read",      "Read memory: addr [n] [B|H|W]",    DebugCommandMemoryRead},
+  {"write",     "Write memory: addr value [B|H|W]", DebugCommandMemoryWrite},
+  {"watch",     "Watch variables (? for help)",     DebugCommandWatch},
+#ifdef MPGL2
+  {"captouch",  "Toggle Captouch value display",    DebugCommandCaptouchValuesToggle},
+#endif /* MPGL2 */
+};
 
-/*! @brief Add commands by updating debug.h in the Command-Specific Definitions section, then update this list
-with the function name to call for the corresponding command: */
-#ifdef EIE1
-DebugCommandType Debug_au8Commands[DEBUG_COMMANDS] = { {DEBUG_CMD_NAME00, DebugCommandPrepareList},
-                                                       {DEBUG_CMD_NAME01, DebugCommandLedTestToggle},
-                                                       {DEBUG_CMD_NAME02, DebugCommandSysTimeToggle},
-                                                       {DEBUG_CMD_NAME03, DebugCommandDummy},
-                                                       {DEBUG_CMD_NAME04, DebugCommandDummy},
-                                                       {DEBUG_CMD_NAME05, DebugCommandDummy},
-                                                       {DEBUG_CMD_NAME06, DebugCommandDummy},
-                                                       {DEBUG_CMD_NAME07, DebugCommandDummy} 
-                                                     };
+static u8 Debug_u8CommandCount = DEBUG_BUILTIN_COMMANDS;   /*!< @brief Entries in use in Debug_asCommands */
+static u8 Debug_au8CommandOrder[DEBUG_COMMANDS_MAX];       /*!< @brief Command numbers sorted by name */
+static bool Debug_bCommandsSorted = FALSE;                 /*!< @brief TRUE while Debug_au8CommandOrder is current */
+static u8 Debug_u8ListNext;                                /*!< @brief Next command number to list */
+static u32 Debug_u32ListToken;                             /*!< @brief Message token of the last list line */
 
+#ifdef EIE1
 static u8 Debug_au8StartupMsg[] = "\n\n\r*** RAZOR SAM3U2 ASCII DEVELOPMENT BOARD\033[31m ANTTT\033[30m ***\n\n\r";
 #endif /* EIE1 */
 
@@ -166,6 +225,30 @@ u32 DebugPrintf(u8* u8String_)
 } /* end DebugPrintf() */
 
 
+/*!----------------------------------------------------------------------------------------------------------------------
+@fn u32 DebugWriteData(u32 u32Size_, u8* pu8Data_)
+
+@brief Queues binary data to the Debug port.  
+
+Unlike DebugPrintf() the data may contain NULL bytes.  Used by the token log.
+
+Requires:
+  - The debug UART resource has been setup for the debug application.
+@param u32Size_ is the number of bytes to send
+@param pu8Data_ points to the data
+
+Promises:
+  - The data is queued to the debug UART.
+  - The message token is returned (0 if the message could not be queued)
+
+*/
+u32 DebugWriteData(u32 u32Size_, u8* pu8Data_)
+{
+  return( UartWriteData(Debug_Uart, u32Size_, pu8Data_) );
+ 
+} /* end DebugWriteData() */
+
+
 /*!----------------------------------------------------------------------------------------------------------------------
 @fn void DebugLineFeed(void)
 
@@ -205,7 +288,6 @@ DebugPrintNumber(u32Number);
 
 
 Requires:
-  - Enough space is available on the heap to temporarily store the number array
 @param u32Number_ is the number to print.
 
 Promises:
@@ -214,53 +296,53 @@ Promises:
 */
 void DebugPrintNumber(u32 u32Number_)
 {
-  bool bFoundDigit = FALSE;
-  u8 au8AsciiNumber[10];
-  u8 u8CharCount = 0;
-  u32 u32Temp, u32Divider = 1000000000;
-  u8 *pu8Data;
-  
-  /* Parse out all the digits, start counting after leading zeros */
-  for(u8 index = 0; index < 10; index++)
-  {
-    au8AsciiNumber[index] = (u32Number_ / u32Divider) + 0x30;
-    if(au8AsciiNumber[index] != '0')
-    {
-      bFoundDigit = TRUE;
-    }
-    if(bFoundDigit)
-    {
-      u8CharCount++;
-    }
-    u32Number_ %= u32Divider;
-    u32Divider /= 10;
-  }
+  u8 au8AsciiNumber[11];
+  u8 u8CharCount;
   
-  /* Handle special case where u32Number == 0 */
-  if(!bFoundDigit)
-  {
-    u8CharCount = 1;
-  }
+  u8CharCount = NumberToAscii(u32Number_, &au8AsciiNumber[0]);
+  UartWriteData(Debug_Uart, u8CharCount, &au8AsciiNumber[0]);
   
-  /* Allocate memory for the right number and copy the array */
-  pu8Data = malloc(u8CharCount);
-  if (pu8Data == NULL)
-  {
-    Debug_u8ErrorCode = DEBUG_ERROR_MALLOC;
-    Debug_pfnStateMachine = DebugSM_Error;
-  }
+} /* end DebugDebugPrintNumber() */
+
+
+/*!-----------------------------------------------------------------------------/
+@fn u32 DebugPrintFormat(u8* pu8Format_, ...)
+
+@brief Formats a printf-style string and queues it as a single message.  
+
+Printing "value: 1234" with DebugPrintf(), DebugPrintNumber() and DebugLineFeed()
+takes three message slots; this takes one.  See StringFormat() for the supported
+conversions (%u %d %i %x %X %s %c with '-', '0' and width).  The result is
+truncated at DEBUG_FORMAT_BUFFER_SIZE - 1 characters.
+
+Example:
+
+DebugPrintFormat("Sector %u status 0x%02X\n\r", u32Sector, u8Status);
+
+
+Requires:
+  - The debug UART resource has been setup for the debug application.
+@param pu8Format_ is a NULL-terminated format string
+@param ... are the values for the conversions in pu8Format_
+
+Promises:
+  - The formatted string is queued to the debug UART.
+  - The message token is returned
+
+*/
+u32 DebugPrintFormat(u8* pu8Format_, ...)
+{
+  u8 au8Buffer[DEBUG_FORMAT_BUFFER_SIZE];
+  u16 u16Size;
+  va_list vaArgs;
   
-  u32Temp = 9;
-  for(u8 index = u8CharCount; index != 0; index--)
-  {
-    pu8Data[index - 1] = au8AsciiNumber[u32Temp--];
-  }
-    
-  /* Print the ascii string and free the memory */
-  UartWriteData(Debug_Uart, u8CharCount, pu8Data);
-  free(pu8Data);
+  va_start(vaArgs, pu8Format_);
+  u16Size = StringFormat(&au8Buffer[0], DEBUG_FORMAT_BUFFER_SIZE, pu8Format_, vaArgs);
+  va_end(vaArgs);
   
-} /* end DebugDebugPrintNumber() */
+  return( UartWriteData(Debug_Uart, u16Size, &au8Buffer[0]) );
+
+} /* end DebugPrintFormat() */
 
 
 /*!----------------------------------------------------------------------------------------------------------------------
@@ -361,6 +443,204 @@ void DebugClearPassthrough(void)
 } /* end DebugClearPassthrough */
 
 
+/*!----------------------------------------------------------------------------------------------------------------------
+@fn void DebugLogSetLevel(u8 u8Level_)
+
+@brief Selects the most detailed log level printed at run time.
+
+Levels above DEBUG_LOG_LEVEL are not compiled in, so selecting one has no further effect.
+
+Example:
+DebugLogSetLevel(DEBUG_LOG_ERROR);
+
+Requires:
+@param u8Level_ is DEBUG_LOG_NONE to DEBUG_LOG_VERBOSE
+
+Promises:
+  - Debug_u8LogLevel is u8Level_ (limited to DEBUG_LOG_VERBOSE)
+  - G_au32DebugLogMask is updated
+
+*/
+void DebugLogSetLevel(u8 u8Level_)
+{
+  if(u8Level_ >= DEBUG_LOG_LEVELS)
+  {
+    u8Level_ = DEBUG_LOG_LEVELS - 1;
+  }
+  
+  Debug_u8LogLevel = u8Level_;
+  DebugLogFilterApply();
+  
+} /* end DebugLogSetLevel() */
+
+
+/*!----------------------------------------------------------------------------------------------------------------------
+@fn void DebugLogSetModules(u32 u32Modules_)
+
+@brief Selects which modules print LOG_xxx() messages at run time.
+
+Example:
+DebugLogSetModules(_DEBUG_LOG_SYSTEM | _DEBUG_LOG_SD);
+
+Requires:
+@param u32Modules_ is any combination of _DEBUG_LOG_xxx bits
+
+Promises:
+  - Debug_u32LogModules is u32Modules_
+  - G_au32DebugLogMask is updated
+
+*/
+void DebugLogSetModules(u32 u32Modules_)
+{
+  Debug_u32LogModules = u32Modules_ & _DEBUG_LOG_ALL;
+  DebugLogFilterApply();
+  
+} /* end DebugLogSetModules() */
+
+
+/*!----------------------------------------------------------------------------------------------------------------------
+@fn bool DebugParseNumber(u8** ppu8Parser_, u8 u8Base_, u32* pu32Number_)
+
+@brief Reads one number from a command argument string and advances past it.
+
+Leading spaces are skipped.  In base 16 an optional 0x prefix is accepted.  
+On failure the parser is not moved, so the caller can try the text as something else.
+
+Example:
+u8* pu8Parser = pu8Arguments;
+u32 u32Address;
+
+if(DebugParseNumber(&pu8Parser, 16, &u32Address))
+{
+  ...
+}
+
+Requires:
+@param ppu8Parser_ points to the parser pointer into a NULL-terminated string
+@param u8Base_ is 10 or 16
+@param pu32Number_ receives the value
+
+Promises:
+  - Returns TRUE with *pu32Number_ loaded and *ppu8Parser_ advanced past the digits if there were any
+  - Returns FALSE otherwise
+
+*/
+bool DebugParseNumber(u8** ppu8Parser_, u8 u8Base_, u32* pu32Number_)
+{
+  u8* pu8Parser = *ppu8Parser_;
+  u32 u32Number = 0;
+  u8 u8Digit;
+  bool bDigits = FALSE;
+  
+  DebugSkipSpaces(&pu8Parser);
+  if( (u8Base_ == 16) && (pu8Parser[0] == '0') && ((pu8Parser[1] == 'x') || (pu8Parser[1] == 'X')) )
+  {
+    pu8Parser += 2;
+  }
+  
+  while(1)
+  {
+    if( (*pu8Parser >= '0') && (*pu8Parser <= '9') )
+    {
+      u8Digit = *pu8Parser - '0';
+    }
+    else if( (u8Base_ == 16) && (*pu8Parser >= 'A') && (*pu8Parser <= 'F') )
+    {
+      u8Digit = *pu8Parser - 'A' + 10;
+    }
+    else if( (u8Base_ == 16) && (*pu8Parser >= 'a') && (*pu8Parser <= 'f') )
+    {
+      u8Digit = *pu8Parser - 'a' + 10;
+    }
+    else
+    {
+      break;
+    }
+    
+    u32Number = (u32Number * u8Base_) + u8Digit;
+    bDigits = TRUE;
+    pu8Parser++;
+  }
+  
+  if(bDigits)
+  {
+    *pu32Number_ = u32Number;
+    *ppu8Parser_ = pu8Parser;
+  }
+  
+  return bDigits;
+  
+} /* end DebugParseNumber() */
+
+
+/*!----------------------------------------------------------------------------------------------------------------------
+@fn bool DebugCommandRegister(u8* pu8Name_, u8* pu8Help_, fnCode_type pfnCommand_)
+
+@brief Adds a command to the debug menu.
+
+Call from a task's initialization.  The command is run from the debug state 
+machine by typing its name, or en+cxx with the number shown by "list", followed by
+any arguments.  The handler gets the arguments from DebugCommandArguments().
+
+Example:
+DebugCommandRegister("stack", "Show stack and heap use", StackMonPrintReport);
+
+Requires:
+@param pu8Name_ is a constant string of 1 to DEBUG_CMD_NAME_LENGTH characters with no spaces
+@param pu8Help_ is a constant one-line description shown by "list"
+@param pfnCommand_ is the handler
+
+Promises:
+  - Returns TRUE with the command added to Debug_asCommands
+  - Returns FALSE if the name is invalid or already used, or the table is full
+
+*/
+bool DebugCommandRegister(u8* pu8Name_, u8* pu8Help_, fnCode_type pfnCommand_)
+{
+  u8 u8Length = 0;
+  u8 u8Command;
+  
+  while( (pu8Name_[u8Length] != '\0') && (pu8Name_[u8Length] != ' ') )
+  {
+    u8Length++;
+  }
+  
+  if( (u8Length == 0) || (u8Length > DEBUG_CMD_NAME_LENGTH) || (pu8Name_[u8Length] != '\0') ||
+      (Debug_u8CommandCount >= DEBUG_COMMANDS_MAX) || DebugCommandFind(pu8Name_, &u8Command) )
+  {
+    return FALSE;
+  }
+  
+  Debug_asCommands[Debug_u8CommandCount].pu8CommandName = pu8Name_;
+  Debug_asCommands[Debug_u8CommandCount].pu8Help = pu8Help_;
+  Debug_asCommands[Debug_u8CommandCount].DebugFunction = pfnCommand_;
+  Debug_u8CommandCount++;
+  Debug_bCommandsSorted = FALSE;
+  
+  return TRUE;
+  
+} /* end DebugCommandRegister() */
+
+
+/*!----------------------------------------------------------------------------------------------------------------------
+@fn u8* DebugCommandArguments(void)
+
+@brief Returns the text typed after the running command's name or number.
+
+Requires:
+  - Called from a command handler
+
+Promises:
+  - Returns a NULL-terminated string with leading spaces removed; it is empty if there were no arguments
+
+*/
+u8* DebugCommandArguments(void)
+{
+  return Debug_pu8CommandArgs;
+  
+} /* end DebugCommandArguments() */
+
+
 /*!----------------------------------------------------------------------------------------------------------------------
 @fn void SystemStatusReport(void)
 
@@ -391,16 +671,16 @@ Promises:
 void SystemStatusReport(void)
 {
   u8 au8SystemPassed[] = "No failed tasks.\n\r";
-  u8 au8SystemReady[] = "\n\rInitialization complete. Type en+c00 for debug menu.  Failed tasks:\n\r";
+  u8 au8SystemReady[] = "\n\rInitialization complete. Type list or en+c00 for debug menu.  Failed tasks:\n\r";
   u32 u32TaskFlagMaskBit = (u32)0x01;
   bool bNoFailedTasks = TRUE;
 
 #ifdef EIE1
-  u8 aau8AppShortNames[NUMBER_APPLICATIONS][MAX_TASK_NAME_SIZE] = {"LED", "BUTTON", "DEBUG", "LCD", "TIMER", "ADC", "SD"};
+  u8 aau8AppShortNames[NUMBER_APPLICATIONS][MAX_TASK_NAME_SIZE] = {"LED", "BUTTON", "DEBUG", "LCD", "TIMER", "ADC", "SD", "FATLOG", "RAWLOG", "TOKENLOG", "TRACE"};
 #endif /* EIE1 */
 
 #ifdef MPGL2
-  u8 aau8AppShortNames[NUMBER_APPLICATIONS][MAX_TASK_NAME_SIZE] = {"LED", "BUTTON", "DEBUG", "LCD", "ANT", "TIMER", "ADC", "CAPTOUCH"};
+  u8 aau8AppShortNames[NUMBER_APPLICATIONS][MAX_TASK_NAME_SIZE] = {"LED", "BUTTON", "DEBUG", "LCD", "ANT", "TIMER", "ADC", "CAPTOUCH", "TOKENLOG", "TRACE"};
 #endif /* MPGL2 */
 
   /* Announce init complete then report any tasks that failed init */
@@ -488,6 +768,8 @@ void DebugInitialize(void)
   {
     Debug_pfnStateMachine = DebugSM_Error;
 
+    /* Nothing can signal the task, and staying polled would keep SystemSleep() at one tick */
+    SchedulerSetEventDriven(PROFILER_TASK_DEBUG);
   }
   /* Otherwise send the first message, set "good" flag and head to Idle */
   else
@@ -497,6 +779,9 @@ void DebugInitialize(void)
     
     G_u32ApplicationFlags |= _APPLICATION_FLAGS_DEBUG;
     Debug_pfnStateMachine = DebugSM_Idle;
+
+    /* DebugRxCallback() signals the task for each character; DebugRunActiveState() keeps it going */
+    SchedulerSetEventDriven(PROFILER_TASK_DEBUG);
   }
   
 } /* end  DebugInitialize() */
@@ -515,11 +800,38 @@ Requires:
 
 Promises:
 - Calls the function to pointed by the state machine function pointer
+- The task stays scheduled while a command is processed, characters are unread or the command list is sending,
+  and is signalled for the next watch sample while the watch list is on
+
 */
 void DebugRunActiveState(void)
 {
   Debug_pfnStateMachine();
 
+  /* Stream the watch list */
+  if( (G_u32DebugFlags & _DEBUG_WATCH_ENABLE) && IsTimeUp(&Debug_u32WatchTime, Debug_u32WatchPeriod) )
+  {
+    Debug_u32WatchTime = G_u32SystemTime1ms;
+    DebugWatchSample();
+  }
+
+  /* Send the command list a line at a time */
+  if(G_u32DebugFlags & _DEBUG_LIST_ACTIVE)
+  {
+    DebugCommandListNext();
+  }
+
+  if( (Debug_pfnStateMachine != DebugSM_Idle) || (G_u32DebugFlags & _DEBUG_LIST_ACTIVE) ||
+      (Debug_pu8RxBufferParser != Debug_pu8RxBufferNextChar) )
+  {
+    SchedulerSignal(PROFILER_TASK_DEBUG);
+  }
+
+  if(G_u32DebugFlags & _DEBUG_WATCH_ENABLE)
+  {
+    SchedulerSignalAt(PROFILER_TASK_DEBUG, Debug_u32WatchTime + Debug_u32WatchPeriod);
+  }
+
 } /* end DebugRunActiveState */
 
 
@@ -534,6 +846,8 @@ Requires:
 
 Promises:
 @param Debug_pu8RxBufferNextChar is advanced safely
+- The Debug task is signalled to parse the character
+- Wait mode is held off so the next character is not lost
 
 */
 void DebugRxCallback(void)
@@ -544,6 +858,9 @@ void DebugRxCallback(void)
   {
     Debug_pu8RxBufferNextChar = &Debug_au8RxBuffer[0];
   }
+
+  SchedulerSignal(PROFILER_TASK_DEBUG);
+  SystemDeepSleepHoldoff();
   
 } /* end DebugRxCallback() */
 
@@ -555,104 +872,246 @@ void DebugRxCallback(void)
 /*!----------------------------------------------------------------------------------------------------------------------
 @fn static void DebugCommandPrepareList(void)
 
-@brief Queues the entire list of debug commands available in the system so 
-they will be sent out the debug UART for the user to view.
+@brief Starts sending the list of debug commands available in the system out 
+the debug UART for the user to view.
 
+The list can be longer than the message pool, so DebugCommandListNext() queues 
+one line at a time from DebugRunActiveState().
 
 Requires:
   - Message Sender application is running
 
 Promises:
-  - Command numbers and names of all installed commands are queued to messagesender.
+  - The heading is queued and _DEBUG_LIST_ACTIVE is set
 
 */
 static void DebugCommandPrepareList(void)
 {
-  u8 au8ListHeading[] = "\n\n\rAvailable commands:\n\r";
-  u8 au8CommandLine[DEBUG_CMD_PREFIX_LENGTH + DEBUG_CMD_NAME_LENGTH + DEBUG_CMD_POSTFIX_LENGTH];
+  u8 au8ListHeading[] = "\n\n\rAvailable commands (type the name or en+c and the number):\n\r";
   
-  /* Write static characters to command list line */
-  au8CommandLine[2] = ':';
-  au8CommandLine[3] = ' ';
-  au8CommandLine[DEBUG_CMD_PREFIX_LENGTH + DEBUG_CMD_NAME_LENGTH] = '\n';
-  au8CommandLine[DEBUG_CMD_PREFIX_LENGTH + DEBUG_CMD_NAME_LENGTH + 1] = '\r';
-  au8CommandLine[DEBUG_CMD_PREFIX_LENGTH + DEBUG_CMD_NAME_LENGTH + 2] = '\0';
+  Debug_u32ListToken = DebugPrintf(au8ListHeading);
+  Debug_u8ListNext = 0;
+  G_u32DebugFlags |= _DEBUG_LIST_ACTIVE;
+  
+} /* end DebugCommandPrepareList() */
+
+
+/*!----------------------------------------------------------------------------------------------------------------------
+@fn static void DebugCommandListNext(void)
+
+@brief Queues the next line of the command list once the previous one has left the queue.
 
-  /* Prepare a nicely formatted list of commands */
-  DebugPrintf(au8ListHeading);
+Requires:
+  - _DEBUG_LIST_ACTIVE is set
+
+Promises:
+  - At most one "number: name help" line is queued 
+  - _DEBUG_LIST_ACTIVE is cleared after the last command
+
+*/
+static void DebugCommandListNext(void)
+{
+  MessageStateType eStatus = QueryMessageStatus(Debug_u32ListToken);
   
-  /* Loop through the array of commands parsing out the command number
-  and printing it along with the command name. */  
-  for(u8 i = 0; i < DEBUG_COMMANDS; i++)
+  if( (eStatus == WAITING) || (eStatus == SENDING) )
   {
-    /* Get the command number in ASCII */
-    if(i >= 10)
-    {
-      au8CommandLine[0] = (i / 10) + 0x30;
-    }
-    else
+    return;
+  }
+  
+  if(Debug_u8ListNext < Debug_u8CommandCount)
+  {
+    Debug_u32ListToken = DebugPrintFormat("%02u: %-12s %s\n\r", Debug_u8ListNext,
+                                          Debug_asCommands[Debug_u8ListNext].pu8CommandName,
+                                          Debug_asCommands[Debug_u8ListNext].pu8Help);
+    Debug_u8ListNext++;
+  }
+  else
+  {
+    DebugLineFeed();
+    G_u32DebugFlags &= ~_DEBUG_LIST_ACTIVE;
+  }
+  
+} /* end DebugCommandListNext() */
+
+
+/*!----------------------------------------------------------------------------------------------------------------------
+@fn static s8 DebugCommandCompare(u8* pu8Token_, u8* pu8Name_)
+
+@brief Compares a typed word with a command name.
+
+Requires:
+@param pu8Token_ is a word ended by a space or NULL
+@param pu8Name_ is a NULL-terminated command name
+
+Promises:
+  - Returns negative, 0 or positive as the word sorts before, equal to or after the name
+
+*/
+static s8 DebugCommandCompare(u8* pu8Token_, u8* pu8Name_)
+{
+  u8 u8Token;
+  
+  while(1)
+  {
+    u8Token = *pu8Token_;
+    if(u8Token == ' ')
     {
-      au8CommandLine[0] = 0x30;
+      u8Token = '\0';
     }
     
-    au8CommandLine[1] = (i % 10) + 0x30;
-    
-    /* Read the command name */
-    for(u8 j = 0; j < DEBUG_CMD_NAME_LENGTH; j++)
+    if( (u8Token != *pu8Name_) || (u8Token == '\0') )
     {
-      au8CommandLine[DEBUG_CMD_PREFIX_LENGTH + j] = Debug_au8Commands[i].pu8CommandName[j];
+      break;
     }
     
-    /* Queue the command name to the UART */
-    DebugPrintf(au8CommandLine);
+    pu8Token_++;
+    pu8Name_++;
   }
-
-  DebugLineFeed();
   
-} /* end DebugCommandPrepareList() */
+  if(u8Token < *pu8Name_)
+  {
+    return -1;
+  }
+  
+  return (u8Token > *pu8Name_) ? 1 : 0;
+  
+} /* end DebugCommandCompare() */
 
 
 /*!----------------------------------------------------------------------------------------------------------------------
-@fn static void DebugCommandDummy(void)
+@fn static void DebugCommandSort(void)
 
-@brief A command place-holder.
-
-Use this function when adding new commands that do not exist yet.  This is 
-handy if you are out of space in the command list and might as well add a 
-group of new commands instead of just one.  Or perhaps you just need a
-temporary place holder.
+@brief Rebuilds Debug_au8CommandOrder if commands were added since the last sort.
 
+Insertion sort: the table is small and only changes during initialization.
 
 Requires:
-- NONE
+  - NONE
 
 Promises:
-- A string is printed to tell the user they are using a command 
-that does not exist.
+  - Debug_au8CommandOrder holds the command numbers in name order
 
 */
-static void DebugCommandDummy(void)
+static void DebugCommandSort(void)
 {
-  u8 au8DummyCommand[] = "\n\rDummy!\n\n\r";
+  u8 u8Command;
+  u8 j;
   
-  DebugPrintf(au8DummyCommand);
+  if(Debug_bCommandsSorted)
+  {
+    return;
+  }
   
-} /* end DebugCommandDummy() */
+  for(u8 i = 0; i < Debug_u8CommandCount; i++)
+  {
+    u8Command = i;
+    for(j = i; j > 0; j--)
+    {
+      if(DebugCommandCompare(Debug_asCommands[Debug_au8CommandOrder[j - 1]].pu8CommandName,
+                             Debug_asCommands[u8Command].pu8CommandName) <= 0)
+      {
+        break;
+      }
+      Debug_au8CommandOrder[j] = Debug_au8CommandOrder[j - 1];
+    }
+    Debug_au8CommandOrder[j] = u8Command;
+  }
+  
+  Debug_bCommandsSorted = TRUE;
+  
+} /* end DebugCommandSort() */
 
 
 /*!----------------------------------------------------------------------------------------------------------------------
-@fn static void DebugCommandLedTestToggle(void)
-
-@brief Toggles and reports the active state of the LED test.
-
-This implementation is specific to the target hardware.
+@fn static bool DebugCommandFind(u8* pu8Token_, u8* pu8Command_)
 
+@brief Binary searches the command names for a typed word.
 
 Requires:
-- NONE
+@param pu8Token_ is a word ended by a space or NULL
+@param pu8Command_ receives the command number
 
 Promises:
-@param G_u32DebugFlags flag _DEBUG_LED_TEST_ENABLE is toggled
+  - Returns TRUE with *pu8Command_ loaded if the word is a command name
+  - Returns FALSE otherwise
+
+*/
+static bool DebugCommandFind(u8* pu8Token_, u8* pu8Command_)
+{
+  u8 u8Low = 0;
+  u8 u8High = Debug_u8CommandCount;
+  u8 u8Middle;
+  s8 s8Result;
+  
+  DebugCommandSort();
+  
+  while(u8Low < u8High)
+  {
+    u8Middle = (u8Low + u8High) / 2;
+    s8Result = DebugCommandCompare(pu8Token_, Debug_asCommands[Debug_au8CommandOrder[u8Middle]].pu8CommandName);
+    
+    if(s8Result == 0)
+    {
+      *pu8Command_ = Debug_au8CommandOrder[u8Middle];
+      return TRUE;
+    }
+    
+    if(s8Result < 0)
+    {
+      u8High = u8Middle;
+    }
+    else
+    {
+      u8Low = u8Middle + 1;
+    }
+  }
+  
+  return FALSE;
+  
+} /* end DebugCommandFind() */
+
+
+/*!----------------------------------------------------------------------------------------------------------------------
+@fn static void DebugCommandDummy(void)
+
+@brief A command place-holder.
+
+Use this function when adding new commands that do not exist yet.  This is 
+handy if you are out of space in the command list and might as well add a 
+group of new commands instead of just one.  Or perhaps you just need a
+temporary place holder.
+
+
+Requires:
+- NONE
+
+Promises:
+- A string is printed to tell the user they are using a command 
+that does not exist.
+
+*/
+static void DebugCommandDummy(void)
+{
+  u8 au8DummyCommand[] = "\n\rDummy!\n\n\r";
+  
+  DebugPrintf(au8DummyCommand);
+  
+} /* end DebugCommandDummy() */
+
+
+/*!----------------------------------------------------------------------------------------------------------------------
+@fn static void DebugCommandLedTestToggle(void)
+
+@brief Toggles and reports the active state of the LED test.
+
+This implementation is specific to the target hardware.
+
+
+Requires:
+- NONE
+
+Promises:
+@param G_u32DebugFlags flag _DEBUG_LED_TEST_ENABLE is toggled
 
 */
 static void DebugCommandLedTestToggle(void)
@@ -1011,6 +1470,762 @@ static void DebugCommandSysTimeToggle(void)
 } /* end DebugCommandSysTimeToggle() */
 
 
+/*!----------------------------------------------------------------------------------------------------------------------
+@fn static void DebugCommandLogFilterToggle(void)
+
+@brief Toggles log filter edit mode and shows the current filter.
+
+While edit mode is on, typed characters are passed to DebugLogFilterCharacter().
+
+Requires:
+- NONE
+
+Promises:
+@param G_u32DebugFlags flag _DEBUG_LOG_FILTER_EDIT is toggled
+
+*/
+static void DebugCommandLogFilterToggle(void)
+{
+  u8 au8LogFilterMessage[] = "\n\rLog filter edit ";
+  
+  /* Print message and toggle the flag */
+  DebugPrintf(au8LogFilterMessage);
+  if(G_u32DebugFlags & _DEBUG_LOG_FILTER_EDIT)
+  {
+    G_u32DebugFlags &= ~_DEBUG_LOG_FILTER_EDIT;
+    DebugPrintf(G_au8UtilMessageOFF);
+  }
+  else
+  {
+    G_u32DebugFlags |= _DEBUG_LOG_FILTER_EDIT;
+    DebugPrintf(G_au8UtilMessageON);
+    DebugPrintFormat("%c-%c toggle a module, %c %c change the level\n\r",
+                     DEBUG_LOG_MODULE_KEY, DEBUG_LOG_MODULE_KEY + DEBUG_LOG_MODULES - 1,
+                     DEBUG_LOG_LEVEL_DOWN_KEY, DEBUG_LOG_LEVEL_UP_KEY);
+    DebugLogFilterPrint();
+  }
+  
+} /* end DebugCommandLogFilterToggle() */
+
+
+/*!----------------------------------------------------------------------------------------------------------------------
+@fn static void DebugLogFilterCharacter(u8 u8Char_)
+
+@brief Checks the character and changes the log filter if applicable.
+
+Only responds to UPPER CASE characters and the level keys so that typing the next command 
+does not change the filter.
+
+Requires:
+@param u8Char_ is the character to check
+
+Promises:
+  - A module key toggles the corresponding module; a level key moves the level by one
+  - The new setting is printed
+
+*/
+static void DebugLogFilterCharacter(u8 u8Char_)
+{
+  u8 u8Module;
+  
+  if( (u8Char_ >= DEBUG_LOG_MODULE_KEY) && (u8Char_ < (DEBUG_LOG_MODULE_KEY + DEBUG_LOG_MODULES)) )
+  {
+    u8Module = u8Char_ - DEBUG_LOG_MODULE_KEY;
+    DebugLogSetModules(Debug_u32LogModules ^ ((u32)1 << u8Module));
+    DebugPrintFormat("\n\r%s %s", Debug_apu8LogModuleNames[u8Module],
+                     (Debug_u32LogModules & ((u32)1 << u8Module)) ? G_au8UtilMessageON : G_au8UtilMessageOFF);
+  }
+  else if( (u8Char_ == DEBUG_LOG_LEVEL_DOWN_KEY) || (u8Char_ == DEBUG_LOG_LEVEL_UP_KEY) )
+  {
+    if( (u8Char_ == DEBUG_LOG_LEVEL_DOWN_KEY) && (Debug_u8LogLevel != DEBUG_LOG_NONE) )
+    {
+      DebugLogSetLevel(Debug_u8LogLevel - 1);
+    }
+    
+    if( (u8Char_ == DEBUG_LOG_LEVEL_UP_KEY) && (Debug_u8LogLevel < DEBUG_LOG_LEVEL) )
+    {
+      DebugLogSetLevel(Debug_u8LogLevel + 1);
+    }
+
+    DebugPrintFormat("\n\rLog level %s\n\r", Debug_apu8LogLevelNames[Debug_u8LogLevel]);
+  }
+  
+} /* end DebugLogFilterCharacter() */
+
+
+/*!----------------------------------------------------------------------------------------------------------------------
+@fn static void DebugLogFilterPrint(void)
+
+@brief Prints the runtime log level and the state of each module with its edit key.
+
+Requires:
+  - NONE
+
+Promises:
+  - One message for the level and one per module are queued
+
+*/
+static void DebugLogFilterPrint(void)
+{
+  DebugPrintFormat("Log level %s (compiled up to %s)\n\r", 
+                   Debug_apu8LogLevelNames[Debug_u8LogLevel], Debug_apu8LogLevelNames[DEBUG_LOG_LEVEL]);
+  
+  for(u8 i = 0; i < DEBUG_LOG_MODULES; i++)
+  {
+    DebugPrintFormat("%c %-10s%s", DEBUG_LOG_MODULE_KEY + i, Debug_apu8LogModuleNames[i],
+                     (Debug_u32LogModules & ((u32)1 << i)) ? G_au8UtilMessageON : G_au8UtilMessageOFF);
+  }
+  
+} /* end DebugLogFilterPrint() */
+
+
+/*!----------------------------------------------------------------------------------------------------------------------
+@fn static void DebugLogFilterApply(void)
+
+@brief Rebuilds G_au32DebugLogMask from the runtime level and module enables.
+
+Doing the work here keeps each LOG_xxx() test to a single array load and branch.
+
+Requires:
+  - Debug_u8LogLevel and Debug_u32LogModules are set
+
+Promises:
+  - G_au32DebugLogMask[i] is Debug_u32LogModules for each level i up to Debug_u8LogLevel, otherwise 0
+
+*/
+static void DebugLogFilterApply(void)
+{
+  G_au32DebugLogMask[DEBUG_LOG_NONE] = 0;
+  for(u8 i = DEBUG_LOG_ERROR; i < DEBUG_LOG_LEVELS; i++)
+  {
+    if(i <= Debug_u8LogLevel)
+    {
+      G_au32DebugLogMask[i] = Debug_u32LogModules;
+    }
+    else
+    {
+      G_au32DebugLogMask[i] = 0;
+    }
+  }
+  
+} /* end DebugLogFilterApply() */
+
+
+/*!----------------------------------------------------------------------------------------------------------------------
+@fn static void DebugCommandMemoryRead(void)
+
+@brief Prints memory or peripheral registers: read <hex address> [count] [B|H|W]
+
+count is decimal (default 1, max DEBUG_READ_MAX_ITEMS) and B, H or W selects byte, halfword
+or word access (default W).  Unmapped addresses print "bus error" instead of faulting.  Beware
+registers that change when read, e.g. receive holding registers and some status registers.
+
+Requires:
+  - Debug_pu8CommandArgs holds the arguments
+
+Promises:
+  - The values are queued to the debug port, DEBUG_READ_ITEMS_PER_LINE per line
+
+*/
+static void DebugCommandMemoryRead(void)
+{
+  u8 au8Line[DEBUG_FORMAT_BUFFER_SIZE];
+  u8* pu8Parser = Debug_pu8CommandArgs;
+  u8* pu8Line;
+  u32 u32Address;
+  u32 u32Count = 1;
+  u32 u32Value;
+  u8 u8Size;
+  
+  if( !DebugParseNumber(&pu8Parser, 16, &u32Address) )
+  {
+    DebugPrintf("\n\rUsage: read <hex address> [count] [B|H|W]\n\r");
+    return;
+  }
+  
+  DebugParseNumber(&pu8Parser, 10, &u32Count);
+  u8Size = DebugParseSize(&pu8Parser);
+  if( (u8Size == 0) || (u32Address & (u8Size - 1)) )
+  {
+    DebugPrintf("\n\rBad size or address not aligned to it\n\r");
+    return;
+  }
+
+  if(u32Count == 0)
+  {
+    u32Count = 1;
+  }
+  if(u32Count > DEBUG_READ_MAX_ITEMS)
+  {
+    u32Count = DEBUG_READ_MAX_ITEMS;
+  }
+  
+  DebugLineFeed();
+  for(u8 i = 0; i < u32Count; i++)
+  {
+    /* Start each line with its address */
+    if( (i % DEBUG_READ_ITEMS_PER_LINE) == 0 )
+    {
+      pu8Line = &au8Line[0];
+      *pu8Line++ = '0';
+      *pu8Line++ = 'x';
+      pu8Line = DebugPutHex(pu8Line, u32Address, 8);
+      *pu8Line++ = ':';
+    }
+    
+    *pu8Line++ = ' ';
+    if( !DebugMemoryAccess(u32Address, u8Size, FALSE, &u32Value) )
+    {
+      *pu8Line = '\0';
+      DebugPrintf(&au8Line[0]);
+      DebugPrintf("bus error\n\r");
+      return;
+    }
+    pu8Line = DebugPutHex(pu8Line, u32Value, u8Size * 2);
+    u32Address += u8Size;
+    
+    /* Send each full line and the last one */
+    if( ((i % DEBUG_READ_ITEMS_PER_LINE) == (DEBUG_READ_ITEMS_PER_LINE - 1)) || (i == u32Count - 1) )
+    {
+      *pu8Line++ = '\n';
+      *pu8Line++ = '\r';
+      *pu8Line = '\0';
+      DebugPrintf(&au8Line[0]);
+    }
+  }
+  
+} /* end DebugCommandMemoryRead() */
+
+
+/*!----------------------------------------------------------------------------------------------------------------------
+@fn static void DebugCommandMemoryWrite(void)
+
+@brief Writes memory or a peripheral register: write <hex address> <hex value> [B|H|W]
+
+The location is read first so an unmapped address is reported instead of faulting, then
+written and read back.
+
+Requires:
+  - Debug_pu8CommandArgs holds the arguments
+
+Promises:
+  - The location is written and the old, new and read-back values are printed
+
+*/
+static void DebugCommandMemoryWrite(void)
+{
+  u8* pu8Parser = Debug_pu8CommandArgs;
+  u32 u32Address;
+  u32 u32Value;
+  u32 u32Old;
+  u32 u32ReadBack = 0;
+  u8 u8Size;
+  
+  if( !DebugParseNumber(&pu8Parser, 16, &u32Address) || !DebugParseNumber(&pu8Parser, 16, &u32Value) )
+  {
+    DebugPrintf("\n\rUsage: write <hex address> <hex value> [B|H|W]\n\r");
+    return;
+  }
+  
+  u8Size = DebugParseSize(&pu8Parser);
+  if( (u8Size == 0) || (u32Address & (u8Size - 1)) )
+  {
+    DebugPrintf("\n\rBad size or address not aligned to it\n\r");
+    return;
+  }
+  
+  if( !DebugMemoryAccess(u32Address, u8Size, FALSE, &u32Old) ||
+      !DebugMemoryAccess(u32Address, u8Size, TRUE, &u32Value) )
+  {
+    DebugPrintFormat("\n\r0x%08X: bus error\n\r", u32Address);
+    return;
+  }
+  
+  DebugMemoryAccess(u32Address, u8Size, FALSE, &u32ReadBack);
+  DebugPrintFormat("\n\r0x%08X: 0x%X -> 0x%X, reads back 0x%X\n\r", u32Address, u32Old, u32Value, u32ReadBack);
+  
+} /* end DebugCommandMemoryWrite() */
+
+
+/*!----------------------------------------------------------------------------------------------------------------------
+@fn static void DebugCommandWatch(void)
+
+@brief Edits the watch list and starts or stops streaming it: watch [+|-|C|P|T|B|?] ...
+
+Streaming samples every entry each period from DebugRunActiveState() without stopping the
+core.  Text lines are "W <ms>: <values>"; binary frames are decoded by tools/tokenlog_decode.py.
+
+Requires:
+  - Debug_pu8CommandArgs holds the arguments
+
+Promises:
+  - The list, period or format is changed as requested and the result is printed
+
+*/
+static void DebugCommandWatch(void)
+{
+  u8 au8Names[DEBUG_FORMAT_BUFFER_SIZE];
+  u8* pu8Parser = Debug_pu8CommandArgs;
+  u8* pu8Names;
+  u8* pu8Name;
+  DebugWatchType sWatch;
+  u32 u32Period;
+  u8 u8Operation;
+  u8 u8Index;
+  
+  DebugSkipSpaces(&pu8Parser);
+  u8Operation = *pu8Parser;
+  if(u8Operation != '\0')
+  {
+    pu8Parser++;
+  }
+  
+  switch(u8Operation)
+  {
+    case '\0':
+    {
+      break;
+    }
+    
+    case '+':
+    {
+      if( !DebugWatchParseLocation(&pu8Parser, &sWatch) )
+      {
+        DebugPrintf("\n\rBad address, name or size\n\r");
+        return;
+      }
+      
+      if(Debug_u8WatchCount >= DEBUG_WATCH_ENTRIES)
+      {
+        DebugPrintf("\n\rWatch list full\n\r");
+        return;
+      }
+      
+      Debug_asWatch[Debug_u8WatchCount++] = sWatch;
+      break;
+    }
+    
+    case '-':
+    {
+      if( !DebugWatchParseLocation(&pu8Parser, &sWatch) )
+      {
+        DebugPrintf("\n\rBad address, name or size\n\r");
+        return;
+      }
+
+      /* Remove the entry and close the gap */
+      for(u8Index = 0; u8Index < Debug_u8WatchCount; u8Index++)
+      {
+        if(Debug_asWatch[u8Index].u32Address == sWatch.u32Address)
+        {
+          Debug_u8WatchCount--;
+          for(u8 i = u8Index; i < Debug_u8WatchCount; i++)
+          {
+            Debug_asWatch[i] = Debug_asWatch[i + 1];
+          }
+          break;
+        }
+      }
+      break;
+    }
+    
+    case 'C':
+    case 'c':
+    {
+      Debug_u8WatchCount = 0;
+      G_u32DebugFlags &= ~_DEBUG_WATCH_ENABLE;
+      break;
+    }
+    
+    case 'P':
+    case 'p':
+    {
+      if( !DebugParseNumber(&pu8Parser, 10, &u32Period) )
+      {
+        DebugPrintf("\n\rUsage: watch P <ms>\n\r");
+        return;
+      }
+      
+      if(u32Period == 0)
+      {
+        G_u32DebugFlags &= ~_DEBUG_WATCH_ENABLE;
+      }
+      else
+      {
+        Debug_u32WatchPeriod = (u32Period < DEBUG_WATCH_PERIOD_MIN) ? DEBUG_WATCH_PERIOD_MIN : u32Period;
+        Debug_u32WatchTime = G_u32SystemTime1ms;
+        Debug_u32WatchSkipped = 0;
+        G_u32DebugFlags |= _DEBUG_WATCH_ENABLE;
+      }
+      break;
+    }
+    
+    case 'T':
+    case 't':
+    {
+      G_u32DebugFlags &= ~_DEBUG_WATCH_BINARY;
+      break;
+    }
+    
+    case 'B':
+    case 'b':
+    {
+      G_u32DebugFlags |= _DEBUG_WATCH_BINARY;
+      break;
+    }
+    
+    default:
+    {
+      DebugPrintf("\n\rWatch list: watch followed by\n\r");
+      DebugPrintf("  + <hex address | name> [B|H|W]   add a location\n\r");
+      DebugPrintf("  - <hex address | name>           remove a location\n\r");
+      DebugPrintf("  C                                clear the list and stop\n\r");
+      DebugPrintf("  P <ms>                           stream every <ms>; 0 stops\n\r");
+      DebugPrintf("  T or B                           stream hex text or binary frames\n\r");
+      DebugPrintf("  (nothing)                        show the list\n\r");
+      
+      /* All the names on one line */
+      pu8Names = &au8Names[0];
+      for(u8 i = 0; i < (sizeof(Debug_asWatchNames) / sizeof(DebugWatchNameType)); i++)
+      {
+        pu8Name = Debug_asWatchNames[i].pu8Name;
+        *pu8Names++ = ' ';
+        while( (*pu8Name != '\0') && (pu8Names < &au8Names[DEBUG_FORMAT_BUFFER_SIZE - 3]) )
+        {
+          *pu8Names++ = *pu8Name++;
+        }
+      }
+      *pu8Names++ = '\n';
+      *pu8Names++ = '\r';
+      *pu8Names = '\0';
+      DebugPrintf("  Names:");
+      DebugPrintf(&au8Names[0]);
+      return;
+    }
+  } /* end switch(u8Operation) */
+  
+  DebugWatchPrintList();
+  
+} /* end DebugCommandWatch() */
+
+
+/*!----------------------------------------------------------------------------------------------------------------------
+@fn static bool DebugMemoryAccess(u32 u32Address_, u8 u8Size_, bool bWrite_, u32* pu32Value_)
+
+@brief Reads or writes one location without faulting on an unmapped address.
+
+The access runs with FAULTMASK set and CCR.BFHFNMIGN so a data bus error only sets BFSR.
+Interrupts are held off for the few cycles this takes.
+
+Requires:
+@param u32Address_ is aligned to u8Size_
+@param u8Size_ is 1, 2 or 4
+@param bWrite_ is TRUE to write *pu32Value_, FALSE to read into it
+@param pu32Value_ is the value to write or receives the value read
+
+Promises:
+  - Returns TRUE if the access completed without a bus error
+
+*/
+static bool DebugMemoryAccess(u32 u32Address_, u8 u8Size_, bool bWrite_, u32* pu32Value_)
+{
+  bool bResult;
+  
+  __set_FAULTMASK(1);
+  SCB->CFSR = DEBUG_SCB_CFSR_BUSFAULT;
+  SCB->CCR |= DEBUG_SCB_CCR_BFHFNMIGN;
+  __DSB();
+  __ISB();
+  
+  if(bWrite_)
+  {
+    switch(u8Size_)
+    {
+      case 1:  *(volatile u8*)u32Address_  = (u8)*pu32Value_;  break;
+      case 2:  *(volatile u16*)u32Address_ = (u16)*pu32Value_; break;
+      default: *(volatile u32*)u32Address_ = *pu32Value_;      break;
+    }
+  }
+  else
+  {
+    switch(u8Size_)
+    {
+      case 1:  *pu32Value_ = *(volatile u8*)u32Address_;  break;
+      case 2:  *pu32Value_ = *(volatile u16*)u32Address_; break;
+      default: *pu32Value_ = *(volatile u32*)u32Address_; break;
+    }
+  }
+  __DSB();
+  
+  bResult = !(SCB->CFSR & DEBUG_SCB_CFSR_BUSFAULT);
+  
+  SCB->CFSR = DEBUG_SCB_CFSR_BUSFAULT;
+  SCB->CCR &= ~DEBUG_SCB_CCR_BFHFNMIGN;
+  __DSB();
+  __ISB();
+  __set_FAULTMASK(0);
+  
+  return bResult;
+  
+} /* end DebugMemoryAccess() */
+
+
+/*!----------------------------------------------------------------------------------------------------------------------
+@fn static u8* DebugPutHex(u8* pu8Target_, u32 u32Value_, u8 u8Digits_)
+
+@brief Writes the low u8Digits_ hex digits of a value in upper case.
+
+Requires:
+@param pu8Target_ has room for u8Digits_ characters
+@param u32Value_ is the value
+@param u8Digits_ is 1 to 8
+
+Promises:
+  - Returns the position after the last digit
+
+*/
+static u8* DebugPutHex(u8* pu8Target_, u32 u32Value_, u8 u8Digits_)
+{
+  while(u8Digits_ != 0)
+  {
+    u8Digits_--;
+    *pu8Target_++ = HexToASCIICharUpper((u8)((u32Value_ >> (u8Digits_ * 4)) & 0x0F));
+  }
+  
+  return pu8Target_;
+  
+} /* end DebugPutHex() */
+
+
+/*!----------------------------------------------------------------------------------------------------------------------
+@fn static u8 DebugParseSize(u8** ppu8Parser_)
+
+@brief Reads an optional B, H or W access size argument.
+
+Requires:
+@param ppu8Parser_ points to the parser pointer into the arguments
+
+Promises:
+  - Returns 1, 2 or 4 for B, H or W and advances the parser
+  - Returns 4 if there are no more arguments
+  - Returns 0 for anything else
+
+*/
+static u8 DebugParseSize(u8** ppu8Parser_)
+{
+  DebugSkipSpaces(ppu8Parser_);
+  
+  switch(**ppu8Parser_)
+  {
+    case '\0':              return 4;
+    case 'B': case 'b':     (*ppu8Parser_)++; return 1;
+    case 'H': case 'h':     (*ppu8Parser_)++; return 2;
+    case 'W': case 'w':     (*ppu8Parser_)++; return 4;
+    default:                return 0;
+  }
+  
+} /* end DebugParseSize() */
+
+
+/*!----------------------------------------------------------------------------------------------------------------------
+@fn static void DebugSkipSpaces(u8** ppu8Parser_)
+
+@brief Advances a parser past spaces.
+
+Requires:
+@param ppu8Parser_ points to the parser pointer into a NULL-terminated string
+
+Promises:
+  - *ppu8Parser_ points at the first character that is not a space
+
+*/
+static void DebugSkipSpaces(u8** ppu8Parser_)
+{
+  while(**ppu8Parser_ == ' ')
+  {
+    (*ppu8Parser_)++;
+  }
+  
+} /* end DebugSkipSpaces() */
+
+
+/*!----------------------------------------------------------------------------------------------------------------------
+@fn static bool DebugWatchParseLocation(u8** ppu8Parser_, DebugWatchType* psWatch_)
+
+@brief Reads a watch location: a name from Debug_asWatchNames or a hex address and optional size.
+
+Requires:
+@param ppu8Parser_ points to the parser pointer into the arguments
+@param psWatch_ receives the location
+
+Promises:
+  - Returns TRUE if the location was read and can be accessed
+
+*/
+static bool DebugWatchParseLocation(u8** ppu8Parser_, DebugWatchType* psWatch_)
+{
+  u8* pu8Name;
+  u8* pu8Token;
+  u32 u32Value;
+  
+  DebugSkipSpaces(ppu8Parser_);
+  psWatch_->u8Size = 0;
+  
+  /* Names first */
+  for(u8 i = 0; i < (sizeof(Debug_asWatchNames) / sizeof(DebugWatchNameType)); i++)
+  {
+    pu8Name = Debug_asWatchNames[i].pu8Name;
+    pu8Token = *ppu8Parser_;
+    while( (*pu8Name != '\0') && (*pu8Name == *pu8Token) )
+    {
+      pu8Name++;
+      pu8Token++;
+    }
+    
+    if( (*pu8Name == '\0') && ((*pu8Token == ' ') || (*pu8Token == '\0')) )
+    {
+      psWatch_->u32Address = (u32)Debug_asWatchNames[i].pvAddress;
+      psWatch_->u8Size = sizeof(u32);
+      *ppu8Parser_ = pu8Token;
+      break;
+    }
+  }
+  
+  if(psWatch_->u8Size == 0)
+  {
+    if( !DebugParseNumber(ppu8Parser_, 16, &psWatch_->u32Address) )
+    {
+      return FALSE;
+    }
+    psWatch_->u8Size = DebugParseSize(ppu8Parser_);
+  }
+  
+  return( (psWatch_->u8Size != 0) && 
+          ((psWatch_->u32Address & (psWatch_->u8Size - 1)) == 0) &&
+          DebugMemoryAccess(psWatch_->u32Address, psWatch_->u8Size, FALSE, &u32Value) );
+  
+} /* end DebugWatchParseLocation() */
+
+
+/*!----------------------------------------------------------------------------------------------------------------------
+@fn static void DebugWatchPrintList(void)
+
+@brief Prints the watch settings and each entry with its current value.
+
+Requires:
+  - NONE
+
+Promises:
+  - One line for the settings and one per entry are queued to the debug port
+
+*/
+static void DebugWatchPrintList(void)
+{
+  u8* pu8Name;
+  u32 u32Value = 0;
+  
+  DebugPrintFormat("\n\rWatch list: %u of %u, every %u ms, %s, streaming %s (%u skipped)\n\r",
+                   Debug_u8WatchCount, DEBUG_WATCH_ENTRIES, Debug_u32WatchPeriod,
+                   (G_u32DebugFlags & _DEBUG_WATCH_BINARY) ? "binary" : "text",
+                   (G_u32DebugFlags & _DEBUG_WATCH_ENABLE) ? "on" : "off", Debug_u32WatchSkipped);
+  
+  for(u8 i = 0; i < Debug_u8WatchCount; i++)
+  {
+    pu8Name = "";
+    for(u8 j = 0; j < (sizeof(Debug_asWatchNames) / sizeof(DebugWatchNameType)); j++)
+    {
+      if( (u32)Debug_asWatchNames[j].pvAddress == Debug_asWatch[i].u32Address )
+      {
+        pu8Name = Debug_asWatchNames[j].pu8Name;
+      }
+    }
+    
+    DebugMemoryAccess(Debug_asWatch[i].u32Address, Debug_asWatch[i].u8Size, FALSE, &u32Value);
+    DebugPrintFormat("  %u: 0x%08X %u bytes = 0x%08X %s\n\r", i, Debug_asWatch[i].u32Address,
+                     Debug_asWatch[i].u8Size, u32Value, pu8Name);
+  }
+  
+} /* end DebugWatchPrintList() */
+
+
+/*!----------------------------------------------------------------------------------------------------------------------
+@fn static void DebugWatchSample(void)
+
+@brief Reads every watch entry and sends one line or frame.
+
+A sample is skipped if the previous one is still waiting to be sent, so a period that is too
+short for the baud rate slows the stream down instead of filling the message pool.
+
+Requires:
+  - Called each watch period while _DEBUG_WATCH_ENABLE is set
+
+Promises:
+  - Text: "W <ms>: <value> ..." with each value in hex of its size
+  - Binary: DEBUG_WATCH_FRAME_START, length, u32 time, then each value as a u32, all little-endian
+
+*/
+static void DebugWatchSample(void)
+{
+  u8 au8Sample[DEBUG_FORMAT_BUFFER_SIZE];
+  u8* pu8Sample = &au8Sample[0];
+  MessageStateType eState;
+  u32 u32Value;
+  u32 u32Time = G_u32SystemTime1ms;
+  
+  if(Debug_u32WatchToken != 0)
+  {
+    eState = QueryMessageStatus(Debug_u32WatchToken);
+    if( (eState == WAITING) || (eState == SENDING) )
+    {
+      Debug_u32WatchSkipped++;
+      return;
+    }
+  }
+  
+  if(G_u32DebugFlags & _DEBUG_WATCH_BINARY)
+  {
+    *pu8Sample++ = DEBUG_WATCH_FRAME_START;
+    *pu8Sample++ = sizeof(u32) * (1 + Debug_u8WatchCount);
+    for(u8 i = 0; i <= Debug_u8WatchCount; i++)
+    {
+      u32Value = 0;
+      if(i == 0)
+      {
+        u32Value = u32Time;
+      }
+      else
+      {
+        DebugMemoryAccess(Debug_asWatch[i - 1].u32Address, Debug_asWatch[i - 1].u8Size, FALSE, &u32Value);
+      }
+      
+      for(u8 j = 0; j < sizeof(u32); j++)
+      {
+        *pu8Sample++ = (u8)(u32Value >> (8 * j));
+      }
+    }
+  }
+  else
+  {
+    *pu8Sample++ = 'W';
+    *pu8Sample++ = ' ';
+    pu8Sample += NumberToAscii(u32Time, pu8Sample);
+    *pu8Sample++ = ':';
+    for(u8 i = 0; i < Debug_u8WatchCount; i++)
+    {
+      u32Value = 0;
+      DebugMemoryAccess(Debug_asWatch[i].u32Address, Debug_asWatch[i].u8Size, FALSE, &u32Value);
+      *pu8Sample++ = ' ';
+      pu8Sample = DebugPutHex(pu8Sample, u32Value, Debug_asWatch[i].u8Size * 2);
+    }
+    *pu8Sample++ = '\n';
+    *pu8Sample++ = '\r';
+  }
+  
+  Debug_u32WatchToken = DebugWriteData((u32)(pu8Sample - &au8Sample[0]), &au8Sample[0]);
+  
+} /* end DebugWatchSample() */
+
+
 #ifdef MPGL2 /* MPGL2 only tests */
 /*!----------------------------------------------------------------------------------------------------------------------
 @fn static void DebugCommandCaptouchValuesToggle(void)
@@ -1176,6 +2391,12 @@ void DebugSM_Idle(void)
       DebugLedTestCharacter(u8CurrentByte);
     }
     
+    /* If log filter edit is active, change the filter based on characters */
+    if(G_u32DebugFlags & _DEBUG_LOG_FILTER_EDIT)
+    {
+      DebugLogFilterCharacter(u8CurrentByte);
+    }
+    
     /* In all cases, advance the RxBufferParser pointer safely */
     Debug_pu8RxBufferParser++;
     if(Debug_pu8RxBufferParser >= &Debug_au8RxBuffer[DEBUG_RX_BUFFER_SIZE])
@@ -1185,6 +2406,16 @@ void DebugSM_Idle(void)
     
   } /* end while */
   
+  /* Characters that arrive in wait mode are lost, so stay out of it while a command or passthrough input is typed */
+  if( (Debug_u16CommandSize != 0) || (G_u32DebugFlags & _DEBUG_PASSTHROUGH) )
+  {
+    G_u32SystemFlags |= _SYSTEM_CLOCK_NO_STOP_DEBUG;
+  }
+  else
+  {
+    G_u32SystemFlags &= ~_SYSTEM_CLOCK_NO_STOP_DEBUG;
+  }
+  
   /* Clear out any completed messages */
   if(Debug_u32CurrentMessageToken != 0)
   {
@@ -1200,9 +2431,10 @@ void DebugSM_Idle(void)
 @brief Checks to see if a string entered is a valid command.
 
 At the start of this state, the command buffer has a candidate command terminated in CR.
-There is a strict rule that commands are of the form en+cxx where xx is any number
-from 0 to DEBUG_COMMANDS, so parsing can be done based on that rule.  All other 
-strings are invalid.  
+A command is either its name from the command list or en+cxx where xx is its two-digit
+number.  A space after the name or number starts arguments for the command, 
+e.g. "read 400E0800 4", which the command reads with DebugCommandArguments().  
+All other strings are invalid.  
 
 */
 void DebugSM_CheckCmd(void)        
@@ -1213,7 +2445,15 @@ void DebugSM_CheckCmd(void)
   u8 u8Index;
   s8 s8Temp;
   
-  /* Verify that the command starts with en+c */
+  /* Terminate the line at the CR so the arguments are a string */
+  u8Index = 0;
+  while( (u8Index < DEBUG_CMD_BUFFER_SIZE - 1) && (Debug_au8CommandBuffer[u8Index] != ASCII_CARRIAGE_RETURN) )
+  {
+    u8Index++;
+  }
+  Debug_au8CommandBuffer[u8Index] = '\0';
+  
+  /* Check if the command starts with en+c */
   u8Index = 0;
   do
   {
@@ -1244,18 +2484,32 @@ void DebugSM_CheckCmd(void)
       {
         Debug_u8Command += s8Temp;
         
-        /* Check that the command number is within the range of commands available and the last char is CR */
-        if( (Debug_u8Command < DEBUG_COMMANDS) && (Debug_au8CommandBuffer[u8Index] == ASCII_CARRIAGE_RETURN) )
+        /* Check that the command number is within the range of commands available and the number is the whole word */
+        if( (Debug_u8Command < Debug_u8CommandCount) && 
+            ((Debug_au8CommandBuffer[u8Index] == '\0') || (Debug_au8CommandBuffer[u8Index] == ' ')) )
         {
           bGoodCommand = TRUE;
         }
       }
     }
   }
+  /* Otherwise look the name up */
+  else
+  {
+    bGoodCommand = DebugCommandFind(&Debug_au8CommandBuffer[0], &Debug_u8Command);
+    
+    u8Index = 0;
+    while( (Debug_au8CommandBuffer[u8Index] != '\0') && (Debug_au8CommandBuffer[u8Index] != ' ') )
+    {
+      u8Index++;
+    }
+  }
            
   /* If still good command */
   if( bGoodCommand )
   {
+    Debug_pu8CommandArgs = &Debug_au8CommandBuffer[u8Index];
+    DebugSkipSpaces(&Debug_pu8CommandArgs);
     Debug_pfnStateMachine = DebugSM_ProcessCmd;
   }
   /* Otherwise print an error message and return to Idle */
@@ -1283,7 +2537,7 @@ void DebugSM_ProcessCmd(void)
   Debug_pfnStateMachine = DebugSM_Idle;
 
   /* Call the command function in the function array (may change next state ) */
-  Debug_au8Commands[Debug_u8Command].DebugFunction();
+  Debug_asCommands[Debug_u8Command].DebugFunction();
   
 } /* end DebugSM_ProcessCmd() */
 
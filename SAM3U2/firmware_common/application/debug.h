@@ -16,10 +16,32 @@ Type Definitions
 */
 typedef struct
 {
-  u8 *pu8CommandName;
-  fnCode_type DebugFunction;
+  u8 *pu8CommandName;                 /*!< @brief Name typed to run the command: no spaces, up to DEBUG_CMD_NAME_LENGTH */
+  u8 *pu8Help;                        /*!< @brief One line shown in the command list */
+  fnCode_type DebugFunction;          /*!< @brief Called to run the command; arguments from DebugCommandArguments() */
 } DebugCommandType;
 
+/*! 
+@struct DebugWatchType
+@brief One memory location sampled by the watch list. 
+*/
+typedef struct
+{
+  u32 u32Address;                     /*!< @brief Address to read */
+  u8 u8Size;                          /*!< @brief Access size in bytes: 1, 2 or 4 */
+  u8 au8Pad[3];
+} DebugWatchType;
+
+/*! 
+@struct DebugWatchNameType
+@brief A global that can be added to the watch list by name. 
+*/
+typedef struct
+{
+  u8* pu8Name;                        /*!< @brief Name as written in the source */
+  volatile void* pvAddress;           /*!< @brief Address of the variable (all are u32) */
+} DebugWatchNameType;
+
 
 /***********************************************************************************************************************
 * Function Declarations
@@ -29,13 +51,20 @@ typedef struct
 /*! @publicsection */                                                                                            
 /*--------------------------------------------------------------------------------------------------------------------*/
 u32 DebugPrintf(u8* u8String_);
+u32 DebugWriteData(u32 u32Size_, u8* pu8Data_);
 void DebugLineFeed(void);       
 void DebugPrintNumber(u32 u32Number_);
+u32 DebugPrintFormat(u8* pu8Format_, ...);
 
 u8 DebugScanf(u8* au8Buffer_);
 
 void DebugSetPassthrough(void);
 void DebugClearPassthrough(void);
+void DebugLogSetLevel(u8 u8Level_);
+void DebugLogSetModules(u32 u32Modules_);
+bool DebugParseNumber(u8** ppu8Parser_, u8 u8Base_, u32* pu32Number_);
+bool DebugCommandRegister(u8* pu8Name_, u8* pu8Help_, fnCode_type pfnCommand_);
+u8* DebugCommandArguments(void);
 
 void SystemStatusReport(void);
 
@@ -52,11 +81,29 @@ void DebugRxCallback(void);
 /*! @privatesection */                                                                                            
 /*--------------------------------------------------------------------------------------------------------------------*/
 static void DebugCommandPrepareList(void);           
+static void DebugCommandListNext(void);
+static s8 DebugCommandCompare(u8* pu8Token_, u8* pu8Name_);
+static void DebugCommandSort(void);
+static bool DebugCommandFind(u8* pu8Token_, u8* pu8Command_);
 static void DebugCommandDummy(void);
 
 static void DebugCommandLedTestToggle(void);
 static void DebugLedTestCharacter(u8 u8Char_);
 static void DebugCommandSysTimeToggle(void);
+static void DebugCommandLogFilterToggle(void);
+static void DebugLogFilterCharacter(u8 u8Char_);
+static void DebugLogFilterPrint(void);
+static void DebugLogFilterApply(void);
+static void DebugCommandMemoryRead(void);
+static void DebugCommandMemoryWrite(void);
+static void DebugCommandWatch(void);
+static bool DebugMemoryAccess(u32 u32Address_, u8 u8Size_, bool bWrite_, u32* pu32Value_);
+static u8* DebugPutHex(u8* pu8Target_, u32 u32Value_, u8 u8Digits_);
+static u8 DebugParseSize(u8** ppu8Parser_);
+static void DebugSkipSpaces(u8** ppu8Parser_);
+static bool DebugWatchParseLocation(u8** ppu8Parser_, DebugWatchType* psWatch_);
+static void DebugWatchPrintList(void);
+static void DebugWatchSample(void);
 
 #ifdef EIE1 /* EIE1-specific debug functions */
 #endif /* EIE1 */
@@ -81,11 +128,16 @@ static void DebugSM_Error(void);
 #define DEBUG_RX_BUFFER_SIZE           (u16)128             /*!< @brief Size of debug buffer for incoming messages */
 #define DEBUG_CMD_BUFFER_SIZE           (u8)64              /*!< @brief Size of debug buffer for a command */
 #define DEBUG_SCANF_BUFFER_SIZE         (u8)128             /*!< @brief Size of buffer for scanf messages */
+#define DEBUG_FORMAT_BUFFER_SIZE        (u16)(U16_MAX_TX_MESSAGE_LENGTH + 1) /*!< @brief One message plus the NULL for DebugPrintFormat() */
 
 /* G_u32DebugFlags */
 #define _DEBUG_LED_TEST_ENABLE         (u32)0x00000001      /*!< @brief G_u32DebugFlags set if LED test is enabled */
 #define _DEBUG_TIME_WARNING_ENABLE     (u32)0x00000002      /*!< @brief G_u32DebugFlags set if system time check is enabled */
 #define _DEBUG_PASSTHROUGH             (u32)0x00000004      /*!< @brief G_u32DebugFlags set if Passthrough mode is enabled */
+#define _DEBUG_LOG_FILTER_EDIT         (u32)0x00000008      /*!< @brief G_u32DebugFlags set while typed characters change the log filter */
+#define _DEBUG_WATCH_ENABLE            (u32)0x00000010      /*!< @brief G_u32DebugFlags set while the watch list is streamed */
+#define _DEBUG_WATCH_BINARY            (u32)0x00000020      /*!< @brief G_u32DebugFlags set to stream the watch list as binary frames instead of hex text */
+#define _DEBUG_LIST_ACTIVE             (u32)0x00000040      /*!< @brief G_u32DebugFlags set while the command list is being sent */
 
 #ifdef EIE1 /* EIE1-specific G_u32DebugFlags flags */
 #endif /* EIE1 */
@@ -97,6 +149,75 @@ static void DebugSM_Error(void);
 #define _DEBUG_FLAG_ERROR              (u32)0x80000000      /*!< @brief G_u32DebugFlags set if the debug Error state was reached */
 /* end of G_u32DebugFlags */
 
+/* Log levels for LOG_ERROR() etc.  A message is printed if its level is <= the runtime level and its module is enabled */
+#define DEBUG_LOG_NONE                  (u8)0               /*!< @brief Nothing is printed */
+#define DEBUG_LOG_ERROR                 (u8)1               /*!< @brief Failures that lose data or stop a task */
+#define DEBUG_LOG_WARN                  (u8)2               /*!< @brief Recovered problems */
+#define DEBUG_LOG_INFO                  (u8)3               /*!< @brief Normal events worth knowing about */
+#define DEBUG_LOG_VERBOSE               (u8)4               /*!< @brief Chatter for debugging one driver */
+#define DEBUG_LOG_LEVELS                (u8)5               /*!< @brief Number of levels including NONE */
+#define DEBUG_LOG_MODULE_KEY            (u8)'A'             /*!< @brief Filter edit key for module bit 0; the next bits follow alphabetically */
+#define DEBUG_LOG_LEVEL_DOWN_KEY        (u8)'<'             /*!< @brief Filter edit key to print fewer messages */
+#define DEBUG_LOG_LEVEL_UP_KEY          (u8)'>'             /*!< @brief Filter edit key to print more messages */
+
+/*! @brief Highest level compiled in.  Calls above it are removed entirely by the compiler. 
+Set in configuration.h to override. */
+#ifndef DEBUG_LOG_LEVEL
+#define DEBUG_LOG_LEVEL                 DEBUG_LOG_WARN
+#endif
+
+/* Module bits for the log filter: the order must match Debug_apu8LogModuleNames in debug.c */
+#define _DEBUG_LOG_SYSTEM               (u32)0x00000001     /*!< @brief main, bsp and other core code */
+#define _DEBUG_LOG_LED                  (u32)0x00000002
+#define _DEBUG_LOG_BUTTON               (u32)0x00000004
+#define _DEBUG_LOG_UART                 (u32)0x00000008
+#define _DEBUG_LOG_SSP                  (u32)0x00000010
+#define _DEBUG_LOG_TWI                  (u32)0x00000020
+#define _DEBUG_LOG_ADC                  (u32)0x00000040
+#define _DEBUG_LOG_TIMER                (u32)0x00000080
+#define _DEBUG_LOG_MESSAGING            (u32)0x00000100
+#define _DEBUG_LOG_LCD                  (u32)0x00000200
+#define _DEBUG_LOG_SD                   (u32)0x00000400
+#define _DEBUG_LOG_FATLOG               (u32)0x00000800
+#define _DEBUG_LOG_RAWLOG               (u32)0x00001000
+#define _DEBUG_LOG_USER                 (u32)0x00002000     /*!< @brief User applications */
+#define DEBUG_LOG_MODULES               (u8)14              /*!< @brief Number of module bits in use */
+#define _DEBUG_LOG_ALL                  (u32)0x00003FFF
+
+/*! @brief Startup value of G_au32DebugLogMask[Level_]: every module on up to DEBUG_LOG_LEVEL */
+#define DEBUG_LOG_MASK_INIT(Level_)     (((Level_) <= DEBUG_LOG_LEVEL) ? _DEBUG_LOG_ALL : 0)
+
+/*!
+@brief Filtered debug output: LOG_ERROR(module, format, ...) and friends.
+
+The format and arguments are the same as DebugPrintFormat().  A call above DEBUG_LOG_LEVEL
+compiles to nothing; otherwise a suppressed call is one load and one branch on
+G_au32DebugLogMask[level], which has a bit set for each module enabled at that level.
+
+Example:
+LOG_WARN(_DEBUG_LOG_SD, "SD clock divider now %u\n\r", u16Divider);
+*/
+#define DEBUG_LOG(Level_, Module_, ...) do { if( ((Level_) <= DEBUG_LOG_LEVEL) && (G_au32DebugLogMask[(Level_)] & (Module_)) ) \
+                                             DebugPrintFormat(__VA_ARGS__); } while(0)
+#define LOG_ERROR(Module_, ...)         DEBUG_LOG(DEBUG_LOG_ERROR, Module_, __VA_ARGS__)
+#define LOG_WARN(Module_, ...)          DEBUG_LOG(DEBUG_LOG_WARN, Module_, __VA_ARGS__)
+#define LOG_INFO(Module_, ...)          DEBUG_LOG(DEBUG_LOG_INFO, Module_, __VA_ARGS__)
+#define LOG_VERBOSE(Module_, ...)       DEBUG_LOG(DEBUG_LOG_VERBOSE, Module_, __VA_ARGS__)
+
+/* Memory read / write and the watch list */
+#define DEBUG_READ_MAX_ITEMS            (u8)64              /*!< @brief Most values printed by one memory read command */
+#define DEBUG_READ_ITEMS_PER_LINE       (u8)8               /*!< @brief Values on each line of a memory read */
+#define DEBUG_WATCH_ENTRIES             (u8)8               /*!< @brief Size of the watch list */
+#define DEBUG_WATCH_PERIOD_DEFAULT      (u32)100            /*!< @brief Default ms between watch samples */
+#define DEBUG_WATCH_PERIOD_MIN          (u32)10             /*!< @brief Shortest period; a full hex line takes ~8ms at 115200 baud */
+#define DEBUG_WATCH_FRAME_START         (u8)0x1C            /*!< @brief Binary watch frame: 0x1C, length, u32 time, then each value little-endian */
+#define DEBUG_WATCH_FRAME_SIZE          (u8)(2 + 4 + (4 * DEBUG_WATCH_ENTRIES))
+
+/*! @cond DOXYGEN_EXCLUDE */
+#define DEBUG_SCB_CCR_BFHFNMIGN         (u32)0x00000100     /* Priority -1 handlers ignore data bus faults */
+#define DEBUG_SCB_CFSR_BUSFAULT         (u32)0x0000FF00     /* BFSR byte of SCB->CFSR */
+/*! @endcond */
+
 #define MAX_TASK_NAME_SIZE              (u8)10              /*!< @brief Maximum string size for task name reported in SystemStatusReport */
 #define DEBUG_UART_TIMEOUT              (u32)2000           /*!< @brief Max time in ms for a command/message to be sent */
 
@@ -109,41 +230,19 @@ static void DebugSM_Error(void);
 /***********************************************************************************************************************
 * Command-Specific Definitions
 ***********************************************************************************************************************/
-#define DEBUG_CMD_PREFIX_LENGTH   (u8)4              /*!< @brief Size of command list prefix "00: " */
-#define DEBUG_CMD_NAME_LENGTH     (u8)32             /*!< @brief Max size for command name */
-#define DEBUG_CMD_POSTFIX_LENGTH  (u8)3              /*!< @brief Size of command list postfix "<CR><LF>\0" */
-
-/* New commands must update the definitions below. Valid commands are in the range
-00 - 99.  Command name string is a maximum of DEBUG_CMD_NAME_LENGTH characters. */
+/* Commands are typed by name ("read 400E0800 4") or by number ("en+c04 400E0800 4").  The built-in commands
+are in Debug_asCommands in debug.c; drivers and applications add theirs with DebugCommandRegister() during 
+initialization and are numbered in the order they register. */
+#define DEBUG_COMMANDS_MAX        (u8)40             /*!< @brief Size of the command table; numbers are 00 - 99 */
+#define DEBUG_CMD_NAME_LENGTH     (u8)12             /*!< @brief Max size for a command name */
 
 #ifdef EIE1
-#define DEBUG_COMMANDS          (u8)8   /*!< @brief Total number of debug commands */
-/*                              "0123456789ABCDEF0123456789ABCDEF"  Character position reference */
-#define DEBUG_CMD_NAME00        "Show debug command list         "  /* Command 0: List all commands */
-#define DEBUG_CMD_NAME01        "Toggle LED test                 "  /* Command 1: Test that allows characters to toggle LEDs */
-#define DEBUG_CMD_NAME02        "Toggle system timing warning    "  /* Command 2: Prints message if system tick has advanced more than 1 between main loop sleeps (i.e. tasks are taking too long) */
-#define DEBUG_CMD_NAME03        "Dummy3                          "  /* Command 3: */
-#define DEBUG_CMD_NAME04        "Dummy4                          "  /* Command 4: */
-#define DEBUG_CMD_NAME05        "Dummy5                          "  /* Command 5: */
-#define DEBUG_CMD_NAME06        "Dummy6                          "  /* Command 6: */
-#define DEBUG_CMD_NAME07        "Dummy7                          "  /* Command 7: */
+#define DEBUG_BUILTIN_COMMANDS    (u8)7              /*!< @brief Entries in the initializer of Debug_asCommands */
 #endif /* EIE1 */
 
 #ifdef MPGL2
-#define DEBUG_COMMANDS          (u8)8   /*!< @brief Total number of debug commands */
-/*                              "0123456789ABCDEF0123456789ABCDEF"  Character position reference */
-#define DEBUG_CMD_NAME00        "Show debug command list         "  /* Command 0: List all commands */
-#define DEBUG_CMD_NAME01        "Toggle LED test                 "  /* Command 1: Test that allows characters to toggle LEDs */
-#define DEBUG_CMD_NAME02        "Toggle system timing warning    "  /* Command 2: Prints message if system tick has advanced more than 1 between main loop sleeps (i.e. tasks are taking too long) */
-#define DEBUG_CMD_NAME03        "Toggle Captouch value display   "  /* Command 2: Test that shows Captouch sense values on debug port */
-#define DEBUG_CMD_NAME04        "Dummy4                          "  /* Command 4: */
-#define DEBUG_CMD_NAME05        "Dummy5                          "  /* Command 5: */
-#define DEBUG_CMD_NAME06        "Dummy6                          "  /* Command 6: */
-#define DEBUG_CMD_NAME07        "Dummy7                          "  /* Command 7: */
-#endif /* EIE1 */
-
-
-
+#define DEBUG_BUILTIN_COMMANDS    (u8)8              /*!< @brief Entries in the initializer of Debug_asCommands */
+#endif /* MPGL2 */
 
 
 #endif /* __DEBUG_H */
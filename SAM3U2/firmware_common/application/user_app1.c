@@ -96,11 +96,17 @@ void UserApp1Initialize(void)
   if( 1 )
   {
     UserApp1_pfStateMachine = UserApp1SM_Idle;
+
+    /* The app is polled, so its states run every pass, but that also keeps tickless idle off.  To run it 
+    only when it has work, call SchedulerSetEventDriven(PROFILER_TASK_USERAPP1) here and then
+    SchedulerSignal(PROFILER_TASK_USERAPP1) from whatever gives it work, including its own states while they
+    are busy, or SchedulerSignalAt() for a timeout (see scheduler.c). */
   }
   else
   {
     /* The task isn't properly initialized, so shut it down and don't run */
     UserApp1_pfStateMachine = UserApp1SM_Error;
+    SchedulerSetEventDriven(PROFILER_TASK_USERAPP1);
   }
 
 } /* end UserApp1Initialize() */
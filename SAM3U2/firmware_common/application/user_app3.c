@@ -96,11 +96,17 @@ void UserApp3Initialize(void)
   if( 1 )
   {
     UserApp3_pfStateMachine = UserApp3SM_Idle;
+
+    /* The app is polled, so its states run every pass, but that also keeps tickless idle off.  To run it 
+    only when it has work, call SchedulerSetEventDriven(PROFILER_TASK_USERAPP3) here and then
+    SchedulerSignal(PROFILER_TASK_USERAPP3) from whatever gives it work, including its own states while they
+    are busy, or SchedulerSignalAt() for a timeout (see scheduler.c). */
   }
   else
   {
     /* The task isn't properly initialized, so shut it down and don't run */
     UserApp3_pfStateMachine = UserApp3SM_Error;
+    SchedulerSetEventDriven(PROFILER_TASK_USERAPP3);
   }
 
 } /* end UserApp3Initialize() */
@@ -36,6 +36,15 @@ Runtime switches
 
 #define DEBUG_MODE                /*!< Define to enable certain debugging code */
 //#define STARTUP_SOUND              /*!< Define to include buzzer sound on startup */
+#define TASK_PROFILER             /*!< Define to measure the execution time of each super loop task (profiler.c) */
+#define DEBUG_LOG_LEVEL DEBUG_LOG_INFO /*!< Highest LOG_xxx() level compiled in (debug.h) */
+#define EVENT_TRACE               /*!< Define to record TRACE() events for the debug menu dump (trace.c) */
+#define STACK_MONITOR             /*!< Define to paint the stack and heap and track their high-watermarks (stackmon.c) */
+#define EVENT_SCHEDULER           /*!< Define to run event-driven tasks only when signalled (scheduler.c) */
+#define TICKLESS_IDLE             /*!< Define to skip SysTicks no event-driven task needs (SystemSleep(), needs EVENT_SCHEDULER) */
+#define TASK_DEADLINES            /*!< Define to defer lower priority tasks when the 1ms pass is nearly used (scheduler.c, needs EVENT_SCHEDULER) */
+#define DEEP_SLEEP                /*!< Define to use wait mode for long idle times (SystemSleep(), needs TICKLESS_IDLE) */
+#define RAM_FUNCTIONS             /*!< Define to run the functions marked RAMFUNC from SRAM instead of flash (exceptions.h) */
 
 //#define USE_SIMPLE_USART0   /*!< Define to use USART0 as a very simple byte-wise UART for debug purposes */
 
@@ -57,6 +66,7 @@ typedef enum {SPI, UART, USART0, USART1, USART2, USART3} PeripheralType;
 Includes
 ***********************************************************************************************************************/
 /* Common header files */
+#include <stdarg.h>
 #include <stdlib.h>
 #include <string.h>
 #include "AT91SAM3U4.h"
@@ -77,12 +87,23 @@ Includes
 #include "sam3u_ssp.h"
 #include "sam3u_uart.h"
 #include "adc12.h"
+#include "profiler.h"
+#include "scheduler.h"
+#include "protothread.h"
+#include "deferred.h"
+#include "softtimer.h"
+#include "tokenlog.h"
+#include "trace.h"
+#include "crashlog.h"
+#include "stackmon.h"
 
 /* EIEF1-PCB-01 specific header files */
 #ifdef EIE1
 #include "eief1-pcb-01.h"
 #include "lcd_nhd-c0220biz.h"
 #include "sdcard.h"
+#include "fatlog.h"
+#include "rawlog.h"
 #endif /* EIE1 */
 
 /* Common application header files */
@@ -1104,6 +1125,10 @@ BAUD desired = 1 Mbps
 => CD = 48
 */
 #define SD_US_BRGR_INIT (u32)0x00000030  /* VERIFY SPI CLOCK! */
+
+/* Data transfer rate once the card is initialized: MCK / 6 = 8 Mbps, the fastest the USART allows in SPI master mode.
+The SD driver doubles CD from here each time a transfer fails until it is back at SD_US_BRGR_INIT. */
+#define SD_US_BRGR_FAST (u32)0x00000006
 /*
     31-20 [0] Reserved
 
@@ -47,6 +47,7 @@ typedef const long sc32;    /*!< @brief EiE standard variable type name for read
 typedef const short sc16;   /*!< @brief EiE standard variable type name for read-only signed 16-bit variables */
 typedef const char sc8;     /*!< @brief EiE standard variable type name for read-only signed  8-bit variables */
 
+typedef unsigned long long u64; /*!< @brief EiE standard variable type name for unsigned 64-bit variables */
 typedef ULONG  u32;         /*!< @brief EiE standard variable type name for unsigned 32-bit variables */
 typedef USHORT u16;         /*!< @brief EiE standard variable type name for unsigned 16-bit variables */
 typedef UCHAR  u8;          /*!< @brief EiE standard variable type name for unsigned  8-bit variables */
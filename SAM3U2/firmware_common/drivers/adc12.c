@@ -55,6 +55,7 @@ extern volatile u32 G_u32SystemTime1ms;                /*!< @brief From main.c *
 extern volatile u32 G_u32SystemTime1s;                 /*!< @brief From main.c */
 extern volatile u32 G_u32SystemFlags;                  /*!< @brief From main.c */
 extern volatile u32 G_u32ApplicationFlags;             /*!< @brief From main.c */
+extern u32 G_au32DebugLogMask[];                       /*!< @brief From debug.c */
 
 
 /***********************************************************************************************************************
@@ -130,7 +131,7 @@ void Adc12AssignCallback(Adc12ChannelType eAdcChannel_, fnCode_u16_type pfUserCa
   }
   else
   {
-    DebugPrintf("Invalid channel\n\r");
+    LOG_ERROR(_DEBUG_LOG_ADC, "Invalid channel\n\r");
   }
   
 } /* end Adc12AssignCallback() */
@@ -207,6 +208,7 @@ Requires:
 Promises:
 - The ADC-12 peripheral is configured
 - ADC interrupt is enabled
+- The task is not polled by the super loop
 
 @param Adc12_pfnStateMachine set to Idle
 
@@ -242,11 +244,15 @@ void Adc12Initialize(void)
     DebugPrintf(au8Adc12Started);
     G_u32ApplicationFlags |= _APPLICATION_FLAGS_ADC;
     Adc12_pfnStateMachine = Adc12SM_Idle;
+    
+    /* Results go to the callbacks from the ISR and Idle has no work, so the task is never signalled */
+    SchedulerSetEventDriven(PROFILER_TASK_ADC);
   }
   else
   {
     /* The task isn't properly initialized, so shut it down and don't run */
     Adc12_pfnStateMachine = Adc12SM_Error;
+    SchedulerSetEventDriven(PROFILER_TASK_ADC);
   }
 
 } /* end Adc12Initialize() */
@@ -342,7 +348,7 @@ Promises:
 void Adc12DefaultCallback(u16 u16Result_)
 {
   /* This is an empty function */
-  DebugPrintf("\n\rDefault ADC call-back!\n\r");
+  LOG_VERBOSE(_DEBUG_LOG_ADC, "\n\rDefault ADC call-back!\n\r");
   
 } /* end Adc12DefaultCallback() */
 
@@ -4,7 +4,8 @@
 
 The application handles all debouncing and glitch filtering.
 All buttons use interrupts to trigger the start and end
-of the action.
+of the action.  The task is event-driven: it runs when a button 
+interrupt or a debounce timer (softtimer.c) signals it.
 
 ------------------------------------------------------------------------------------------------------------------------
 GLOBALS
@@ -45,7 +46,6 @@ All Global variable names shall start with "G_<type>Button"
 ***********************************************************************************************************************/
 /* New variables */
 volatile bool G_abButtonDebounceActive[TOTAL_BUTTONS];      /*!< @brief Flags for buttons being debounced */
-volatile u32 G_au32ButtonDebounceTimeStart[TOTAL_BUTTONS];  /*!< @brief Button debounce start time */
 
 /*--------------------------------------------------------------------------------------------------------------------*/
 /* Existing variables (defined in other files -- should all contain the "extern" keyword) */
@@ -65,6 +65,7 @@ static ButtonStateType Button_aeCurrentState[TOTAL_BUTTONS];/*!< @brief Current
 static ButtonStateType Button_aeNewState[TOTAL_BUTTONS];    /*!< @brief New (pending) pressed state of button */
 static u32 Button_au32HoldTimeStart[TOTAL_BUTTONS];         /*!< @brief System 1ms time when a button press started */
 static bool Button_abNewPress[TOTAL_BUTTONS];               /*!< @brief Flags to indicate a button was pressed */    
+static SoftTimerType Button_asDebounceTimer[TOTAL_BUTTONS]; /*!< @brief Debounce period of each button */
 
 
 /*!*********** %BUTTON% EDIT BOARD-SPECIFIC GPIO DEFINITIONS BELOW ***************/
@@ -255,6 +256,7 @@ Promises:
 - G_abButtonDebounceActive, Button_aeCurrentState and Button_aeNewState 
   are initialized
 - The button state machine is initialized to Idle
+- The task is event-driven
 
 */
 void ButtonInitialize(void)
@@ -299,6 +301,7 @@ void ButtonInitialize(void)
     
   /* Init complete: set function pointer and application flag */
   Button_pfnStateMachine = ButtonSM_Idle;
+  SchedulerSetEventDriven(PROFILER_TASK_BUTTON);
   G_u32ApplicationFlags |= _APPLICATION_FLAGS_BUTTON;
   DebugPrintf("Button task ready\n\r");
 
@@ -363,6 +366,18 @@ u32 GetButtonBitLocation(u8 u8Button_, ButtonPortType ePort_)
 /*! @privatesection */                                                                                            
 /*--------------------------------------------------------------------------------------------------------------------*/
 
+/*!----------------------------------------------------------------------------------------------------------------------
+@fn static void ButtonDebounceTimeUp(void)
+
+@brief Debounce timer callback: runs the button task to sample the button.
+
+*/
+static void ButtonDebounceTimeUp(void)
+{
+  SchedulerSignal(PROFILER_TASK_BUTTON);
+
+} /* end ButtonDebounceTimeUp() */
+
 
 /***********************************************************************************************************************
 State Machine Function Definitions
@@ -383,6 +398,7 @@ static void ButtonSM_Idle(void)
     if(G_abButtonDebounceActive[i])
     {
       Button_pfnStateMachine = ButtonSM_ButtonActive;
+      SchedulerSignal(PROFILER_TASK_BUTTON);
     }
   }
   
@@ -394,8 +410,8 @@ static void ButtonSM_Idle(void)
 
 @brief Process each button that is debouncing.
 
-Time out the debounce period and set the "pressed" state if button action is confirmed.
-Manage the hold timers.
+Start the debounce timer of a newly active button, and when it expires set the 
+"pressed" state if button action is confirmed.  Manage the hold timers.
 */
 static void ButtonSM_ButtonActive(void)         
 {
@@ -417,7 +433,14 @@ static void ButtonSM_ButtonActive(void)
       /* Still have an active button */
       Button_pfnStateMachine = ButtonSM_ButtonActive;
       
-      if( IsTimeUp((u32*)&G_au32ButtonDebounceTimeStart[i], BUTTON_DEBOUNCE_TIME) )
+      if( !SoftTimerExpired(&Button_asDebounceTimer[i]) )
+      {
+        if( !SoftTimerIsRunning(&Button_asDebounceTimer[i]) )
+        {
+          SoftTimerStart(&Button_asDebounceTimer[i], BUTTON_DEBOUNCE_TIME, 0, ButtonDebounceTimeUp);
+        }
+      }
+      else
       {
         /* Active low: get current state of button */
         if(Buttons_asArray[i].eActiveState == BUTTON_ACTIVE_LOW)
@@ -459,7 +482,7 @@ static void ButtonSM_ButtonActive(void)
         G_abButtonDebounceActive[i] = FALSE;
         *pu32InterruptAddress |= Button_au32ButtonPins[i];
         
-      } /* end if( IsTimeUp...) */
+      } /* end if( SoftTimerExpired...) */
     } /* end if(G_abButtonDebounceActive[index]) */
   } /* end for i */
   
@@ -55,6 +55,7 @@ u32 GetButtonBitLocation(u8 u8Button_, ButtonPortType ePort_);
 /*------------------------------------------------------------------------------------------------------------------*/
 /*! @privatesection */                                                                                            
 /*--------------------------------------------------------------------------------------------------------------------*/
+static void ButtonDebounceTimeUp(void);
 
 
 /***********************************************************************************************************************
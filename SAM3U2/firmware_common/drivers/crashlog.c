@@ -0,0 +1,370 @@
+/*!*********************************************************************************************************************
+@file crashlog.c
+@brief Post-mortem record of the last HardFault, kept through a reset.
+
+HardFault_Handler() (interrupts.c) passes the exception frame the core stacked to CrashLogCapture().  That frame,
+the fault status and address registers, and the last CRASHLOG_TRACE_RECORDS events of the event trace are stored
+in a record in the .noinit section.  The startup code does not clear .noinit, so the record is still there after
+the watchdog, a software reset or the reset button.  Only a power-up reset loses it.
+
+At boot CrashLogInitialize() checks the record.  If a crash has not been reported yet, a summary is printed on
+the debug port.  The full report, including the events before the fault, is available from the "crash" command until
+the next power-up.  u32Count counts the faults since power-up.
+
+Notes on reading the report:
+- PC is the instruction that faulted, or the one after it for imprecise bus errors (IMPRECISERR)
+- LR is the return address of the function that faulted
+- MemManage, BusFault and UsageFault are not enabled separately so they all arrive as a forced HardFault; CFSR
+  has the real cause
+- MMFAR and BFAR are only meaningful when MMARVALID / BFARVALID are in the cause list
+
+------------------------------------------------------------------------------------------------------------------------
+GLOBALS
+- NONE
+
+CONSTANTS
+- CRASHLOG_TRACE_RECORDS
+
+TYPES
+- CrashLogRecordType
+
+PUBLIC FUNCTIONS
+- void CrashLogPrintReport(void)
+
+PROTECTED FUNCTIONS
+- void CrashLogInitialize(void)
+- void CrashLogCapture(u32* pu32Frame_)
+- void CrashLogReset(void)
+
+**********************************************************************************************************************/
+
+#include "configuration.h"
+
+/*! @cond DOXYGEN_EXCLUDE */
+#if defined ( __ICCARM__ )
+#define CRASHLOG_NOINIT                 __no_init
+#elif defined (  __GNUC__  )
+#define CRASHLOG_NOINIT                 __attribute__((section(".noinit")))
+#endif
+
+#define CRASHLOG_CAUSE_BITS             (u8)17
+#define CRASHLOG_CAUSE_BUFFER_SIZE      (u8)96
+#define CRASHLOG_RESET_TYPES            (u8)5
+/*! @endcond */
+
+/***********************************************************************************************************************
+Global variable definitions with scope across entire project.
+All Global variable names shall start with "G_xxCrashLog"
+***********************************************************************************************************************/
+/* New variables */
+
+
+/*--------------------------------------------------------------------------------------------------------------------*/
+/* Existing variables (defined in other files -- should all contain the "extern" keyword) */
+extern volatile u32 G_u32SystemTime1ms;                /*!< @brief From main.c */
+extern volatile u32 G_u32SystemTime1s;                 /*!< @brief From main.c */
+extern volatile u32 G_u32SystemFlags;                  /*!< @brief From main.c */
+extern volatile u32 G_u32ApplicationFlags;             /*!< @brief From main.c */
+
+
+/***********************************************************************************************************************
+Global variable definitions with scope limited to this local application.
+Variable names shall start with "CrashLog_xx" and be declared as static.
+***********************************************************************************************************************/
+static CRASHLOG_NOINIT CrashLogRecordType CrashLog_sRecord;       /*!< @brief The crash record; survives a reset */
+static u32 CrashLog_u32ResetType;                                 /*!< @brief RSTC reset type read at boot */
+
+static u8* CrashLog_apu8ResetNames[CRASHLOG_RESET_TYPES] = {"power-up", "backup wake-up", "watchdog", "software",
+                                                            "reset button"};
+
+/*! @brief CFSR and HFSR bits listed as the cause, with their names from the ARMv7-M reference */
+static u32 CrashLog_au32CauseBits[CRASHLOG_CAUSE_BITS] = {0x00000001, 0x00000002, 0x00000008, 0x00000010,
+                                                          0x00000080, 0x00000100, 0x00000200, 0x00000400,
+                                                          0x00000800, 0x00001000, 0x00008000, 0x00010000,
+                                                          0x00020000, 0x00040000, 0x00080000, 0x01000000,
+                                                          0x02000000};
+static u8* CrashLog_apu8CauseNames[CRASHLOG_CAUSE_BITS] = {"IACCVIOL", "DACCVIOL", "MUNSTKERR", "MSTKERR",
+                                                           "MMARVALID", "IBUSERR", "PRECISERR", "IMPRECISERR",
+                                                           "UNSTKERR", "STKERR", "BFARVALID", "UNDEFINSTR",
+                                                           "INVSTATE", "INVPC", "NOCP", "UNALIGNED",
+                                                           "DIVBYZERO"};
+
+static u8* CrashLog_apu8EventNames[TRACE_EVENTS] = {
+#define TRACE_EVENT(Id_, Kind_, Track_, Name_)  Name_,
+#include "trace_events.h"
+#undef TRACE_EVENT
+};
+
+
+/**********************************************************************************************************************
+Function Definitions
+**********************************************************************************************************************/
+
+/*--------------------------------------------------------------------------------------------------------------------*/
+/*! @publicsection */
+/*--------------------------------------------------------------------------------------------------------------------*/
+
+/*!----------------------------------------------------------------------------------------------------------------------
+@fn void CrashLogPrintReport(void)
+
+@brief Debug menu command to print everything recorded about the last crash.
+
+Requires:
+- CrashLogInitialize() has run
+
+Promises:
+- The summary, the stacked registers and the events before the fault are queued to the debug port, or a note
+  that there has been no crash since power-up
+
+*/
+void CrashLogPrintReport(void)
+{
+  u32* pu32Frame = &CrashLog_sRecord.au32Frame[0];
+  TraceRecordType* psEvent;
+  u8* pu8Name;
+
+  if(CrashLog_sRecord.u32Count == 0)
+  {
+    DebugPrintFormat("\n\rNo crash since power-up (last reset: %s)\n\r",
+                     CrashLog_apu8ResetNames[CrashLog_u32ResetType]);
+    return;
+  }
+
+  CrashLogPrintSummary();
+  DebugPrintFormat("    R0 0x%08X R1 0x%08X R2 0x%08X R3 0x%08X R12 0x%08X\n\r",
+                   pu32Frame[CRASHLOG_R0], pu32Frame[CRASHLOG_R1], pu32Frame[CRASHLOG_R2],
+                   pu32Frame[CRASHLOG_R3], pu32Frame[CRASHLOG_R12]);
+  DebugPrintFormat("    SP 0x%08X xPSR 0x%08X MMFAR 0x%08X BFAR 0x%08X\n\r",
+                   CrashLog_sRecord.u32Sp, pu32Frame[CRASHLOG_XPSR],
+                   CrashLog_sRecord.u32Mmfar, CrashLog_sRecord.u32Bfar);
+
+  /* Events before the fault with their age in microseconds */
+  DebugPrintFormat("    Last %u events:\n\r", CrashLog_sRecord.u32TraceRecords);
+  for(u8 i = 0; i < CrashLog_sRecord.u32TraceRecords; i++)
+  {
+    psEvent = &CrashLog_sRecord.asTrace[i];
+    pu8Name = (psEvent->u8Event < TRACE_EVENTS) ? CrashLog_apu8EventNames[psEvent->u8Event] : (u8*)"?";
+
+    DebugPrintFormat("    -%8uus %-22s ctx %3u arg 0x%08X\n\r",
+                     (CrashLog_sRecord.u32Cycles - psEvent->u32Cycles) / (CCLK_VALUE / 1000000),
+                     pu8Name, psEvent->u8Context, psEvent->u32Arg);
+  }
+
+} /* end CrashLogPrintReport() */
+
+
+/*--------------------------------------------------------------------------------------------------------------------*/
+/*! @protectedsection */
+/*--------------------------------------------------------------------------------------------------------------------*/
+
+/*!----------------------------------------------------------------------------------------------------------------------
+@fn void CrashLogInitialize(void)
+
+@brief Validates the record kept through the reset and reports a crash that has not been reported.
+
+Requires:
+- DebugInitialize() has run
+
+Promises:
+- After a power-up, or if the record is corrupt, the record is cleared and the crash count is 0
+- If a crash is pending its summary is queued to the debug port and it is marked reported
+- "crash" is added to the debug menu
+
+*/
+void CrashLogInitialize(void)
+{
+  DebugCommandRegister("crash", "Show last crash report", CrashLogPrintReport);
+
+  CrashLog_u32ResetType = (AT91C_BASE_RSTC->RSTC_RSR & AT91C_RSTC_RSTTYP) >> 8;
+  if(CrashLog_u32ResetType >= CRASHLOG_RESET_TYPES)
+  {
+    CrashLog_u32ResetType = 0;
+  }
+
+  /* RAM contents are random after power-up */
+  if( ((AT91C_BASE_RSTC->RSTC_RSR & AT91C_RSTC_RSTTYP) == AT91C_RSTC_RSTTYP_GENERAL) ||
+      (CrashLog_sRecord.u32Magic != CRASHLOG_MAGIC) ||
+      (CrashLog_sRecord.u32Check != CrashLogChecksum()) )
+  {
+    CrashLog_sRecord.u32Magic = CRASHLOG_MAGIC;
+    CrashLog_sRecord.u32Count = 0;
+    CrashLog_sRecord.u32Pending = 0;
+    CrashLog_sRecord.u32Check = CrashLogChecksum();
+    return;
+  }
+
+  if(CrashLog_sRecord.u32Pending)
+  {
+    CrashLogPrintSummary();
+    DebugPrintf("    Details: type crash\n\r");
+
+    CrashLog_sRecord.u32Pending = 0;
+    CrashLog_sRecord.u32Check = CrashLogChecksum();
+  }
+
+} /* end CrashLogInitialize() */
+
+
+/*!----------------------------------------------------------------------------------------------------------------------
+@fn void CrashLogCapture(u32* pu32Frame_)
+
+@brief Stores the state at a fault in the record.
+
+Only called from HardFault_Handler().  Nothing here may fault or depend on interrupts.
+
+Requires:
+@param pu32Frame_ points to the exception frame stacked by the core (r0-r3, r12, lr, pc, xPSR)
+
+Promises:
+- The record holds the frame, the fault registers and the most recent trace events, and is marked pending
+- The crash count is incremented
+
+*/
+void CrashLogCapture(u32* pu32Frame_)
+{
+  /* A record that was never initialized (e.g. a fault during startup) counts from zero */
+  if( (CrashLog_sRecord.u32Magic != CRASHLOG_MAGIC) || (CrashLog_sRecord.u32Check != CrashLogChecksum()) )
+  {
+    CrashLog_sRecord.u32Magic = CRASHLOG_MAGIC;
+    CrashLog_sRecord.u32Count = 0;
+  }
+
+  CrashLog_sRecord.u32Count++;
+  CrashLog_sRecord.u32Pending = 1;
+  CrashLog_sRecord.u32Time = G_u32SystemTime1ms;
+  CrashLog_sRecord.u32Cycles = DWT_CYCCNT;
+
+  for(u8 i = 0; i < CRASHLOG_FRAME_WORDS; i++)
+  {
+    CrashLog_sRecord.au32Frame[i] = pu32Frame_[i];
+  }
+
+  /* The core may have pushed a pad word above the frame to align it */
+  CrashLog_sRecord.u32Sp = (u32)&pu32Frame_[CRASHLOG_FRAME_WORDS];
+  if(pu32Frame_[CRASHLOG_XPSR] & XPSR_STACK_ALIGNED)
+  {
+    CrashLog_sRecord.u32Sp += sizeof(u32);
+  }
+
+  CrashLog_sRecord.u32Cfsr  = SCB->CFSR;
+  CrashLog_sRecord.u32Hfsr  = SCB->HFSR;
+  CrashLog_sRecord.u32Mmfar = SCB->MMFAR;
+  CrashLog_sRecord.u32Bfar  = SCB->BFAR;
+
+  CrashLog_sRecord.u32TraceRecords = TraceCopyRecent(&CrashLog_sRecord.asTrace[0], CRASHLOG_TRACE_RECORDS);
+
+  CrashLog_sRecord.u32Check = CrashLogChecksum();
+
+} /* end CrashLogCapture() */
+
+
+/*!----------------------------------------------------------------------------------------------------------------------
+@fn void CrashLogReset(void)
+
+@brief Restarts the processor and peripherals after a crash has been captured.
+
+Requires:
+- NONE
+
+Promises:
+- Does not return; the crash record is kept through the reset
+
+*/
+void CrashLogReset(void)
+{
+  AT91C_BASE_RSTC->RSTC_RCR = CRASHLOG_RESET_KEY | AT91C_RSTC_PROCRST | AT91C_RSTC_PERRST;
+  while(1);
+
+} /* end CrashLogReset() */
+
+
+/*--------------------------------------------------------------------------------------------------------------------*/
+/*! @privatesection */
+/*--------------------------------------------------------------------------------------------------------------------*/
+
+/*!----------------------------------------------------------------------------------------------------------------------
+@fn static u32 CrashLogChecksum(void)
+
+@brief Computes the check word of the record.
+
+Requires:
+- u32Check is the last word of CrashLogRecordType
+
+Promises:
+- Returns the complement of the sum of every word before u32Check
+
+*/
+static u32 CrashLogChecksum(void)
+{
+  u32* pu32Word = (u32*)&CrashLog_sRecord;
+  u32 u32Sum = 0;
+
+  for(u8 i = 0; i < (sizeof(CrashLogRecordType) / sizeof(u32)) - 1; i++)
+  {
+    u32Sum += *pu32Word++;
+  }
+
+  return ~u32Sum;
+
+} /* end CrashLogChecksum() */
+
+
+/*!----------------------------------------------------------------------------------------------------------------------
+@fn static void CrashLogPrintSummary(void)
+
+@brief Prints the two-line summary of the recorded crash.
+
+Requires:
+- The record holds a crash
+
+Promises:
+- The crash count, time, PC, LR, fault status registers and decoded cause are queued to the debug port
+
+*/
+static void CrashLogPrintSummary(void)
+{
+  u8 au8Cause[CRASHLOG_CAUSE_BUFFER_SIZE];
+  u8* pu8Cause = &au8Cause[0];
+  u8* pu8Name;
+  u32 u32Status = CrashLog_sRecord.u32Cfsr;
+
+  /* List the names of the set status bits, stopping short of the end of the buffer */
+  for(u8 i = 0; i < CRASHLOG_CAUSE_BITS; i++)
+  {
+    if(u32Status & CrashLog_au32CauseBits[i])
+    {
+      pu8Name = CrashLog_apu8CauseNames[i];
+      if( (pu8Cause + 1 + 12) < &au8Cause[CRASHLOG_CAUSE_BUFFER_SIZE - 1] )
+      {
+        *pu8Cause++ = ' ';
+        while(*pu8Name != '\0')
+        {
+          *pu8Cause++ = *pu8Name++;
+        }
+      }
+    }
+  }
+
+  if( (CrashLog_sRecord.u32Hfsr & HFSR_VECTTBL) &&
+      ((pu8Cause + 1 + 12) < &au8Cause[CRASHLOG_CAUSE_BUFFER_SIZE - 1]) )
+  {
+    pu8Name = " VECTTBL";
+    while(*pu8Name != '\0')
+    {
+      *pu8Cause++ = *pu8Name++;
+    }
+  }
+  *pu8Cause = '\0';
+
+  DebugPrintFormat("\n\r*** Crash %u since power-up at %u ms: PC 0x%08X LR 0x%08X\n\r",
+                   CrashLog_sRecord.u32Count, CrashLog_sRecord.u32Time,
+                   CrashLog_sRecord.au32Frame[CRASHLOG_PC], CrashLog_sRecord.au32Frame[CRASHLOG_LR]);
+  DebugPrintFormat("    CFSR 0x%08X HFSR 0x%08X cause:%s\n\r",
+                   CrashLog_sRecord.u32Cfsr, CrashLog_sRecord.u32Hfsr, &au8Cause[0]);
+
+} /* end CrashLogPrintSummary() */
+
+
+/*--------------------------------------------------------------------------------------------------------------------*/
+/* End of File                                                                                                        */
+/*--------------------------------------------------------------------------------------------------------------------*/
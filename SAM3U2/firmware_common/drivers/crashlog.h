@@ -0,0 +1,87 @@
+/*!*********************************************************************************************************************
+@file crashlog.h
+@brief Header file for crashlog.c
+
+**********************************************************************************************************************/
+
+#ifndef __CRASHLOG_H
+#define __CRASHLOG_H
+
+/**********************************************************************************************************************
+Type Definitions
+**********************************************************************************************************************/
+
+/*!
+@enum CrashLogFrameType
+@brief Order of the registers the core stacks on exception entry.
+*/
+typedef enum {CRASHLOG_R0, CRASHLOG_R1, CRASHLOG_R2, CRASHLOG_R3, CRASHLOG_R12, CRASHLOG_LR, CRASHLOG_PC,
+              CRASHLOG_XPSR, CRASHLOG_FRAME_WORDS} CrashLogFrameType;
+
+
+/**********************************************************************************************************************
+Constants / Definitions
+**********************************************************************************************************************/
+#define CRASHLOG_TRACE_RECORDS          (u8)8               /*!< @brief Most recent TRACE() events kept with a crash */
+
+/*! @cond DOXYGEN_EXCLUDE */
+#define CRASHLOG_MAGIC                  (u32)0xC0DEFA17     /* Marks a record that survived a reset */
+#define CRASHLOG_RESET_KEY              (u32)0xA5000000     /* RSTC_RCR write key */
+#define XPSR_STACK_ALIGNED              (u32)0x00000200     /* Stacked xPSR bit 9: a pad word was pushed above the frame */
+#define HFSR_VECTTBL                    (u32)0x00000002
+/*! @endcond */
+
+/*!
+@struct CrashLogRecordType
+@brief Everything captured by CrashLogCapture().  Kept in .noinit RAM so it survives any reset except power-up.
+*/
+typedef struct
+{
+  u32 u32Magic;                                  /*!< @brief CRASHLOG_MAGIC when the record is valid */
+  u32 u32Count;                                  /*!< @brief Faults since power-up */
+  u32 u32Pending;                                /*!< @brief Non-zero until the crash is reported at boot */
+  u32 u32Time;                                   /*!< @brief G_u32SystemTime1ms at the fault */
+  u32 u32Cycles;                                 /*!< @brief DWT_CYCCNT at the fault */
+  u32 au32Frame[CRASHLOG_FRAME_WORDS];           /*!< @brief Stacked registers */
+  u32 u32Sp;                                     /*!< @brief Stack pointer before the exception */
+  u32 u32Cfsr;                                   /*!< @brief Configurable Fault Status Register */
+  u32 u32Hfsr;                                   /*!< @brief HardFault Status Register */
+  u32 u32Mmfar;                                  /*!< @brief MemManage Fault Address Register */
+  u32 u32Bfar;                                   /*!< @brief BusFault Address Register */
+  u32 u32TraceRecords;                           /*!< @brief Valid entries in asTrace */
+  TraceRecordType asTrace[CRASHLOG_TRACE_RECORDS]; /*!< @brief Events before the fault, oldest first */
+  u32 u32Check;                                  /*!< @brief Complement of the sum of all words above */
+} CrashLogRecordType;
+
+
+/**********************************************************************************************************************
+Function Declarations
+**********************************************************************************************************************/
+
+/*------------------------------------------------------------------------------------------------------------------*/
+/*! @publicsection */
+/*--------------------------------------------------------------------------------------------------------------------*/
+void CrashLogPrintReport(void);
+
+
+/*------------------------------------------------------------------------------------------------------------------*/
+/*! @protectedsection */
+/*--------------------------------------------------------------------------------------------------------------------*/
+void CrashLogInitialize(void);
+void CrashLogCapture(u32* pu32Frame_);
+void CrashLogReset(void);
+
+
+/*------------------------------------------------------------------------------------------------------------------*/
+/*! @privatesection */
+/*--------------------------------------------------------------------------------------------------------------------*/
+static u32 CrashLogChecksum(void);
+static void CrashLogPrintSummary(void);
+
+
+#endif /* __CRASHLOG_H */
+
+
+/*--------------------------------------------------------------------------------------------------------------------*/
+/* End of File                                                                                                        */
+/*--------------------------------------------------------------------------------------------------------------------*/
@@ -0,0 +1,232 @@
+/*!*********************************************************************************************************************
+@file deferred.c
+@brief Work posted by ISRs to run after them at the lowest interrupt priority.
+
+An ISR should only do what cannot wait: service the peripheral and clear the interrupt.  Bookkeeping such as
+updating message status, dequeuing messages or reporting errors is posted here with DeferredPost() and run by
+PendSV_Handler().  PendSV has the lowest priority, so it runs once every other ISR has finished (tail-chained,
+without returning to the super loop first) and the super loop never sees the work half done.  Items run in the
+order they were posted.  PendSV is still an interrupt, so the work must not queue debug messages; it counts what it
+wants reported and the owning task reports it.
+
+DeferredPost() is lock-free and may be called from any ISR or task.  A slot is claimed with LDREX/STREX on the
+queue head, then filled with the function written last, so PendSV_Handler() stops at a slot whose owner was
+interrupted before it finished writing it.  The owner pends PendSV again when it is done.  If the queue is full
+DeferredPost() returns FALSE and the caller does the work itself, as it did before.  DeferredCheck() in the super
+loop reports the overflows.
+
+------------------------------------------------------------------------------------------------------------------------
+GLOBALS
+- NONE
+
+CONSTANTS
+- DEFERRED_QUEUE_SIZE
+
+TYPES
+- fnDeferred_type
+- DeferredWorkType
+
+PUBLIC FUNCTIONS
+- bool DeferredPost(fnDeferred_type pfnWork_, u32 u32Arg_)
+
+PROTECTED FUNCTIONS
+- void DeferredInitialize(void)
+- void DeferredCheck(void)
+- void PendSV_Handler(void)
+
+**********************************************************************************************************************/
+
+#include "configuration.h"
+
+/***********************************************************************************************************************
+Global variable definitions with scope across entire project.
+All Global variable names shall start with "G_xxDeferred"
+***********************************************************************************************************************/
+/* New variables */
+
+
+/*--------------------------------------------------------------------------------------------------------------------*/
+/* Existing variables (defined in other files -- should all contain the "extern" keyword) */
+extern volatile u32 G_u32SystemTime1ms;                /*!< @brief From main.c */
+extern volatile u32 G_u32SystemTime1s;                 /*!< @brief From main.c */
+extern volatile u32 G_u32SystemFlags;                  /*!< @brief From main.c */
+extern volatile u32 G_u32ApplicationFlags;             /*!< @brief From main.c */
+
+extern u32 G_au32DebugLogMask[];                       /*!< @brief From debug.c */
+
+
+/***********************************************************************************************************************
+Global variable definitions with scope limited to this local application.
+Variable names shall start with "Deferred_xx" and be declared as static.
+***********************************************************************************************************************/
+static DeferredWorkType Deferred_asQueue[DEFERRED_QUEUE_SIZE]; /*!< @brief Work waiting to run */
+static volatile u32 Deferred_u32Head;                  /*!< @brief Next slot to claim; only DeferredPost() writes it */
+static volatile u32 Deferred_u32Tail;                  /*!< @brief Next slot to run; only PendSV_Handler() writes it */
+static volatile u32 Deferred_u32Overflows;             /*!< @brief Posts refused because the queue was full */
+static u32 Deferred_u32OverflowsReported;              /*!< @brief Deferred_u32Overflows when last reported */
+
+
+/**********************************************************************************************************************
+Function Definitions
+**********************************************************************************************************************/
+
+/*--------------------------------------------------------------------------------------------------------------------*/
+/*! @publicsection */
+/*--------------------------------------------------------------------------------------------------------------------*/
+
+/*!----------------------------------------------------------------------------------------------------------------------
+@fn bool DeferredPost(fnDeferred_type pfnWork_, u32 u32Arg_)
+
+@brief Queues a function to run from PendSV_Handler() after the current ISR.
+
+Safe to call from ISRs and tasks; does not disable interrupts.
+
+Example:
+if( !DeferredPost(UartTxComplete, (u32)Uart_psCurrentISR) )
+{
+  UartTxComplete((u32)Uart_psCurrentISR);
+}
+
+Requires:
+@param pfnWork_ is the function to run, not NULL
+@param u32Arg_ is passed to pfnWork_
+
+Promises:
+- Returns TRUE with the work queued and PendSV pending
+- Returns FALSE if the queue is full; the work is not queued and the overflow is counted
+
+*/
+bool DeferredPost(fnDeferred_type pfnWork_, u32 u32Arg_)
+{
+  u32 u32Head;
+  u32 u32Count;
+  DeferredWorkType* psSlot;
+
+  /* Claim the slot at the head.  STREX fails if an ISR claimed a slot in between, so try again. */
+  do
+  {
+    u32Head = __LDREXW((u32*)&Deferred_u32Head);
+    if( (u32Head - Deferred_u32Tail) >= DEFERRED_QUEUE_SIZE )
+    {
+      __CLREX();
+      do
+      {
+        u32Count = __LDREXW((u32*)&Deferred_u32Overflows);
+      } while( __STREXW(u32Count + 1, (u32*)&Deferred_u32Overflows) );
+
+      return FALSE;
+    }
+  } while( __STREXW(u32Head + 1, (u32*)&Deferred_u32Head) );
+
+  /* The function goes in last: it is what marks the slot ready to run */
+  psSlot = &Deferred_asQueue[u32Head & DEFERRED_QUEUE_MASK];
+  psSlot->u32Arg  = u32Arg_;
+  psSlot->pfnWork = pfnWork_;
+
+  AT91C_BASE_NVIC->NVIC_ICSR = AT91C_NVIC_PENDSVSET;
+  return TRUE;
+
+} /* end DeferredPost() */
+
+
+/*--------------------------------------------------------------------------------------------------------------------*/
+/*! @protectedsection */
+/*--------------------------------------------------------------------------------------------------------------------*/
+
+/*!----------------------------------------------------------------------------------------------------------------------
+@fn void DeferredInitialize(void)
+
+@brief Empties the queue and gives PendSV the lowest priority.
+
+Requires:
+- Called after InterruptSetup() and before any ISR that posts work is enabled
+
+Promises:
+- The queue is empty
+- PendSV is at the lowest priority so it runs after all other ISRs
+
+*/
+void DeferredInitialize(void)
+{
+  for(u8 i = 0; i < DEFERRED_QUEUE_SIZE; i++)
+  {
+    Deferred_asQueue[i].pfnWork = NULL;
+  }
+
+  Deferred_u32Head = 0;
+  Deferred_u32Tail = 0;
+  Deferred_u32Overflows = 0;
+  Deferred_u32OverflowsReported = 0;
+
+  NVIC_SetPriority(PendSV_IRQn, (1 << __NVIC_PRIO_BITS) - 1);
+
+} /* end DeferredInitialize() */
+
+
+/*!----------------------------------------------------------------------------------------------------------------------
+@fn void DeferredCheck(void)
+
+@brief Reports queue overflows from task context.
+
+Requires:
+- Called once per super loop pass
+
+Promises:
+- A warning is logged if posts were refused since the last call
+
+*/
+void DeferredCheck(void)
+{
+  u32 u32Overflows = Deferred_u32Overflows;
+
+  if(u32Overflows != Deferred_u32OverflowsReported)
+  {
+    Deferred_u32OverflowsReported = u32Overflows;
+    LOG_WARN(_DEBUG_LOG_SYSTEM, "\n\rDeferred work queue full: %u\n\r", u32Overflows);
+  }
+
+} /* end DeferredCheck() */
+
+
+/*!----------------------------------------------------------------------------------------------------------------------
+@fn ISR void PendSV_Handler(void)
+
+@brief Runs the queued work in the order it was posted.
+
+Requires:
+- Pended by DeferredPost()
+
+Promises:
+- Every slot from the tail up to the first one not yet filled in has been run and emptied
+
+*/
+void PendSV_Handler(void)
+{
+  DeferredWorkType* psSlot;
+  fnDeferred_type pfnWork;
+  u32 u32Arg;
+
+  /* Empty the slot before moving the tail past it so DeferredPost() cannot claim it while it is still full */
+  psSlot = &Deferred_asQueue[Deferred_u32Tail & DEFERRED_QUEUE_MASK];
+  while(psSlot->pfnWork != NULL)
+  {
+    pfnWork = psSlot->pfnWork;
+    u32Arg  = psSlot->u32Arg;
+    psSlot->pfnWork = NULL;
+    Deferred_u32Tail++;
+
+    pfnWork(u32Arg);
+    psSlot = &Deferred_asQueue[Deferred_u32Tail & DEFERRED_QUEUE_MASK];
+  }
+
+} /* end PendSV_Handler() */
+
+
+/*--------------------------------------------------------------------------------------------------------------------*/
+/*! @privatesection */
+/*--------------------------------------------------------------------------------------------------------------------*/
+
+
+/*--------------------------------------------------------------------------------------------------------------------*/
+/* End of File                                                                                                        */
+/*--------------------------------------------------------------------------------------------------------------------*/
@@ -0,0 +1,64 @@
+/*!*********************************************************************************************************************
+@file deferred.h
+@brief Header file for deferred.c
+
+**********************************************************************************************************************/
+
+#ifndef __DEFERRED_H
+#define __DEFERRED_H
+
+/**********************************************************************************************************************
+Type Definitions
+**********************************************************************************************************************/
+typedef void(*fnDeferred_type)(u32 u32Arg_);  /*!< @brief Deferred work function; u32Arg_ is the value given to DeferredPost() */
+
+/*!
+@struct DeferredWorkType
+@brief One slot of the deferred work queue.
+*/
+typedef struct
+{
+  volatile fnDeferred_type pfnWork;      /*!< @brief Function to run; NULL while the slot is empty or still being written */
+  volatile u32 u32Arg;                   /*!< @brief Argument for pfnWork */
+} DeferredWorkType;
+
+
+/**********************************************************************************************************************
+Constants / Definitions
+**********************************************************************************************************************/
+#define DEFERRED_QUEUE_SIZE             (u32)16             /*!< @brief Work items that can wait at once; a power of 2 */
+
+/*! @cond DOXYGEN_EXCLUDE */
+#define DEFERRED_QUEUE_MASK             (u32)(DEFERRED_QUEUE_SIZE - 1)
+/*! @endcond */
+
+
+/**********************************************************************************************************************
+Function Declarations
+**********************************************************************************************************************/
+
+/*------------------------------------------------------------------------------------------------------------------*/
+/*! @publicsection */
+/*--------------------------------------------------------------------------------------------------------------------*/
+bool DeferredPost(fnDeferred_type pfnWork_, u32 u32Arg_);
+
+
+/*------------------------------------------------------------------------------------------------------------------*/
+/*! @protectedsection */
+/*--------------------------------------------------------------------------------------------------------------------*/
+void DeferredInitialize(void);
+void DeferredCheck(void);
+void PendSV_Handler(void);
+
+
+/*------------------------------------------------------------------------------------------------------------------*/
+/*! @privatesection */
+/*--------------------------------------------------------------------------------------------------------------------*/
+
+
+#endif /* __DEFERRED_H */
+
+
+/*--------------------------------------------------------------------------------------------------------------------*/
+/* End of File                                                                                                        */
+/*--------------------------------------------------------------------------------------------------------------------*/
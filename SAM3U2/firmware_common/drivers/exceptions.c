@@ -129,7 +129,7 @@ WEAK void PendSV_Handler(void)
 //------------------------------------------------------------------------------
 // for Cortex M3
 //------------------------------------------------------------------------------
-WEAK void SysTick_Handler(void)
+WEAK RAMFUNC void SysTick_Handler(void)
 {
     while(1);
 }
@@ -56,6 +56,16 @@ typedef void( *IntFunc )( void );
 	#error "Unsupported compiler."
 #endif
 
+/// Runs a function from SRAM (copied from flash at startup) to avoid flash wait states
+/// when RAM_FUNCTIONS is defined.  Put it on the declaration and the definition.
+#if !defined ( RAM_FUNCTIONS )
+	#define RAMFUNC
+#elif defined ( __ICCARM__ )
+	#define RAMFUNC __ramfunc
+#elif defined (  __GNUC__  )
+	#define RAMFUNC __attribute__((section(".ramfunc"), long_call, noinline))
+#endif
+
 
 //------------------------------------------------------------------------------
 //         Global functions
@@ -73,7 +83,7 @@ void UsageFault_Handler( void );
 void SVC_Handler( void );
 void DebugMon_Handler( void );
 void PendSV_Handler( void );
-void SysTick_Handler( void );
+RAMFUNC void SysTick_Handler( void );
 void IrqHandlerNotUsed(void);
 
 
@@ -17,6 +17,7 @@ PUBLIC FUNCTIONS
 
 PROTECTED FUNCTIONS
 - void InterruptSetup(void)
+- void HardFaultReport(u32* pu32Frame_)
 
 Redefinition of WEAK defines in exceptions.c:
 - void HardFault_Handler(void);
@@ -33,17 +34,19 @@ Global variable definitions with scope across entire project.
 All Global variable names shall start with "G_xxISR"
 ***********************************************************************************************************************/
 /* New variables */
+volatile u32 G_u32ISRTickStepMs = 1;                   /*!< @brief ms added by the next SysTick; only SystemSleep() changes it */
 
 
 /*--------------------------------------------------------------------------------------------------------------------*/
 /* Existing variables (defined in other files -- should all contain the "extern" keyword)  */
 extern volatile u32 G_u32SystemTime1ms;                /*!< @brief From main.c */
+extern volatile u32 G_u32SystemTime1msWraps;           /*!< @brief From main.c */
 extern volatile u32 G_u32SystemTime1s;                 /*!< @brief From main.c */
 extern volatile u32 G_u32SystemFlags;                  /*!< @brief From main.c */
 extern volatile u32 G_u32ApplicationFlags;             /*!< @brief From main.c */
+extern volatile u32 G_u32TraceFlags;                   /*!< @brief From trace.c */
 
 extern volatile bool G_abButtonDebounceActive[TOTAL_BUTTONS];      /*!<@brief  From buttons.c    */
-extern volatile u32 G_au32ButtonDebounceTimeStart[TOTAL_BUTTONS];  /*!<@brief  From buttons.c    */
 
 
 /***********************************************************************************************************************
@@ -111,16 +114,61 @@ something extraordinary occurs.
 In many cases, this is referencing an invalid address, but can be other 
 events of various levels of mystery.  
 
+The handler has no prologue so the stack pointer still points at the exception
+frame.  Bit 2 of EXC_RETURN in LR tells which stack the frame is on.  The frame
+is passed to HardFaultReport().
+
 Requires:
 - NONE
 
 Promises:
+- Branches to HardFaultReport() with the exception frame address in R0
+
+*/
+#if defined ( __ICCARM__ )
+__stackless void HardFault_Handler(void)
+{
+  asm("TST LR, #4          \n"
+      "ITE EQ              \n"
+      "MRSEQ R0, MSP       \n"
+      "MRSNE R0, PSP       \n"
+      "B HardFaultReport   \n");
+  
+} /* end HardFault_Handler() */
+
+#elif defined (  __GNUC__  )
+__attribute__((naked)) void HardFault_Handler(void)
+{
+  __asm volatile("TST LR, #4          \n"
+                 "ITE EQ              \n"
+                 "MRSEQ R0, MSP       \n"
+                 "MRSNE R0, PSP       \n"
+                 "B HardFaultReport   \n");
+  
+} /* end HardFault_Handler() */
+#endif
+
+
+/*!----------------------------------------------------------------------------------------------------------------------
+@fn void HardFaultReport(u32* pu32Frame_)
+ 
+@brief Records the fault for the next boot and signals it on the LEDs.
+
+Runs in the HardFault exception.
+
+Requires:
+@param pu32Frame_ points to the exception frame stacked by the core
+
+Promises:
+- The crash is stored by CrashLogCapture() and reported at the next boot
 - Red LED is on, all others off
-- Code is held here for debug purposes
+- With DEBUG_MODE, code is held here for debug purposes; otherwise the board is reset
 
 */
-void HardFault_Handler(void)
+void HardFaultReport(u32* pu32Frame_)
 {
+  CrashLogCapture(pu32Frame_);
+  
 #ifdef EIE1
   LedOff(WHITE);
   LedOff(CYAN);
@@ -156,9 +204,13 @@ void HardFault_Handler(void)
 #endif /* MPGL2_R01 */
 #endif /* MPGL2 */
 
-  while(1);  /* !!!!! update to log and/or report error and/or restart */
+#ifdef DEBUG_MODE
+  while(1);  /* The crash is still reported after the reset button is pressed */
+#else
+  CrashLogReset();
+#endif /* DEBUG_MODE */
   
-} /* end HardFault_Handler() */
+} /* end HardFaultReport() */
 
 
 /*!----------------------------------------------------------------------------------------------------------------------
@@ -170,30 +222,44 @@ This interrupt is always enabled and running in
 the system and is essential for system timing and sleep wakeup.
 This ISR should be as fast as possible!
 
+Normally one tick is 1ms.  After a tickless sleep SystemSleep() sets 
+G_u32ISRTickStepMs to the time that passed so this tick catches the
+system time up.
+
 Requires:
 - NONE
 
 Promises:
 - System tick interrupt pending flag is cleared
 - G_u32SystemFlags _SYSTEM_SLEEPING cleared
+- G_u32ISRTickStepMs is back to 1
 
-@param G_u32SystemTime1ms counter is incremented by 1
+@param G_u32SystemTime1ms counter is incremented by G_u32ISRTickStepMs
+@param G_u32SystemTime1msWraps is incremented if G_u32SystemTime1ms wrapped
 
 */
-void SysTick_Handler(void)
+RAMFUNC void SysTick_Handler(void)
 {
   static u16 u16SecondCounter = 1000;
+  u32 u32StepMs = G_u32ISRTickStepMs;
   
   /* Update the 1ms system timer and clear sleep flag */
-  G_u32SystemTime1ms++;
+  G_u32SystemTime1ms += u32StepMs;
+  if(G_u32SystemTime1ms < u32StepMs)
+  {
+    G_u32SystemTime1msWraps++;
+  }
   G_u32SystemFlags &= ~_SYSTEM_SLEEPING;
+  G_u32ISRTickStepMs = 1;
 
   /* Update the 1 second timer if required */
-  if(--u16SecondCounter == 0)
+  while(u32StepMs >= u16SecondCounter)
   {
+    u32StepMs -= u16SecondCounter;
     u16SecondCounter = 1000;
     G_u32SystemTime1s++;
   }
+  u16SecondCounter -= u32StepMs;
     
 } /* end SysTickHandler(void) */
 
@@ -239,12 +305,13 @@ void PIOA_IrqHandler(void)
       u32CurrentButtonLocation = GetButtonBitLocation(i, BUTTON_PORTA);
       if(u32ButtonInterrupts & u32CurrentButtonLocation)
       {
-        /* Button has interrupted: disable the button's interrupt and start the button's debounce timer */ 
+        /* Button has interrupted: disable the button's interrupt and have the button task debounce it */ 
         AT91C_BASE_PIOA->PIO_IDR |= u32CurrentButtonLocation;
+        TRACE(TRACE_BUTTON_EDGE, i);
 
         /* Initialize the button's debouncing information */
         G_abButtonDebounceActive[i] = TRUE;
-        G_au32ButtonDebounceTimeStart[i] = G_u32SystemTime1ms;
+        SchedulerSignal(PROFILER_TASK_BUTTON);
       }
     }
   } /* end button interrupt checking */
@@ -296,12 +363,13 @@ void PIOB_IrqHandler(void)
       u32CurrentButtonLocation = GetButtonBitLocation(i, BUTTON_PORTB);
       if(u32ButtonInterrupts & u32CurrentButtonLocation)
       {
-        /* Button has interrupted: disable the button's interrupt and start the button's debounce timer */ 
+        /* Button has interrupted: disable the button's interrupt and have the button task debounce it */ 
         AT91C_BASE_PIOB->PIO_IDR |= u32CurrentButtonLocation;
+        TRACE(TRACE_BUTTON_EDGE, i);
 
         /* Initialize the button's debouncing information */
         G_abButtonDebounceActive[i] = TRUE;
-        G_au32ButtonDebounceTimeStart[i] = G_u32SystemTime1ms;
+        SchedulerSignal(PROFILER_TASK_BUTTON);
       }
     }
   } /* end button interrupt checking */
@@ -81,7 +81,7 @@ Function Declarations
 /*--------------------------------------------------------------------------------------------------------------------*/
 void InterruptSetup(void);
 void HardFault_Handler(void);
-void SysTick_Handler(void);
+RAMFUNC void SysTick_Handler(void);
 void PIOA_IrqHandler(void);
 void PIOB_IrqHandler(void);
 
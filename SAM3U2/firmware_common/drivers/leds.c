@@ -4,8 +4,10 @@
 
 This driver provides on, off, toggle, blink and PWM functionality.
 The basic on/off/toggle functionality is applied directly to the LEDs.
-Blinking and PWMing of LEDs rely on the EIE operating system to provide timing at
-regular 1ms calls to LedUpdate().
+Blinking and PWMing of LEDs rely on the EIE operating system to provide timing through
+calls to LedUpdate().  The LED task is event-driven (scheduler.c): it runs every 1ms
+only while an LED is PWMing, and otherwise only when the next blink toggle is due, so
+an idle or blinking LED does not keep the system awake.
 
 ------------------------------------------------------------------------------------------------------------------------
 GLOBALS
@@ -77,6 +79,7 @@ extern volatile u32 G_u32ApplicationFlags;             /*!< @brief From main.c *
 Global variable definitions with scope limited to this local application.
 Variable names shall start with "Led_<type>" and be declared as static.
 ***********************************************************************************************************************/
+static u32 Led_u32LastUpdate;                          /*!< @brief G_u32SystemTime1ms at the last LedUpdate() */
 
 /************ %LED% EDIT BOARD-SPECIFIC GPIO DEFINITIONS BELOW ***************/
 
@@ -324,6 +327,7 @@ void LedBlink(LedNumberType eLED_, LedRateType eBlinkRate_)
 	Leds_asLedArray[(u8)eLED_].eMode = LED_BLINK_MODE;
 	Leds_asLedArray[(u8)eLED_].eRate = eBlinkRate_;
 	Leds_asLedArray[(u8)eLED_].u16Count = eBlinkRate_;
+  SchedulerSignal(PROFILER_TASK_LED);
 
 } /* end LedBlink() */
 
@@ -360,6 +364,7 @@ void LedPWM(LedNumberType eLED_, LedRateType ePwmRate_)
 	Leds_asLedArray[(u8)eLED_].eRate = ePwmRate_;
 	Leds_asLedArray[(u8)eLED_].u16Count = (u16)ePwmRate_;
   Leds_asLedArray[(u8)eLED_].eCurrentDuty = LED_PWM_DUTY_HIGH;
+  SchedulerSignal(PROFILER_TASK_LED);
 
 } /* end LedPWM() */
 
@@ -486,6 +491,10 @@ void LedInitialize(void)
   /* Final setup and report that LED system is ready */
   G_u32ApplicationFlags |= _APPLICATION_FLAGS_LED;
   DebugPrintf(au8LedStartupMsg);
+
+  /* LedBlink() and LedPWM() signal the task; LedUpdate() keeps it scheduled while it has work */
+  Led_u32LastUpdate = G_u32SystemTime1ms;
+  SchedulerSetEventDriven(PROFILER_TASK_LED);
   
 } /* end LedInitialize() */
 
@@ -495,17 +504,27 @@ void LedInitialize(void)
 
 @brief Update all LEDs for the current cycle. 
 
-This impacts only LEDs that are set to be blinking or PWM.
+This impacts only LEDs that are set to be blinking or PWM.  PWM steps once per
+call and needs a call every 1ms; blinking counts the ms since the last call so it
+keeps time when ticks were skipped.
 
 Requires:
 - G_u32SystemTime1ms is counting
 
 Promises:
 - All LEDs updated based on their counters
+- The LED task is signalled for the next pass if an LED is PWMing, otherwise for
+  the next blink toggle if an LED is blinking
 
 */
 void LedUpdate(void)
 {
+  u32 u32ElapsedMs = G_u32SystemTime1ms - Led_u32LastUpdate;
+  u32 u32NextMs = 0;
+  bool bPwmActive = FALSE;
+
+  Led_u32LastUpdate = G_u32SystemTime1ms;
+
 	/* Loop through each LED */
   for(u8 i = 0; i < TOTAL_LEDS; i++)
   {
@@ -527,6 +546,7 @@ void LedUpdate(void)
       /* Otherwise, regular PWM: decrement counter; toggle and reload if counter reaches 0 */
       else
       {
+        bPwmActive = TRUE;
         if(--Leds_asLedArray[(LedNumberType)i].u16Count == 0)
         {
           if(Leds_asLedArray[(LedNumberType)i].eCurrentDuty == LED_PWM_DUTY_HIGH)
@@ -554,14 +574,33 @@ void LedUpdate(void)
     /* LED is in LED_BLINK_MODE mode */
     else if(Leds_asLedArray[(LedNumberType)i].eMode == LED_BLINK_MODE)
     {
-      /* Decrement counter; toggle and reload if counter reaches 0 */
-      if( --Leds_asLedArray[(LedNumberType)i].u16Count == 0)
+      /* Count down the elapsed time; toggle and reload if the counter reaches 0 */
+      if(Leds_asLedArray[(LedNumberType)i].u16Count <= u32ElapsedMs)
       {
         LedToggle( (LedNumberType)i );
         Leds_asLedArray[(LedNumberType)i].u16Count = Leds_asLedArray[(LedNumberType)i].eRate;
       }
+      else
+      {
+        Leds_asLedArray[(LedNumberType)i].u16Count -= (u16)u32ElapsedMs;
+      }
+
+      /* Track the soonest toggle */
+      if( (u32NextMs == 0) || (Leds_asLedArray[(LedNumberType)i].u16Count < u32NextMs) )
+      {
+        u32NextMs = Leds_asLedArray[(LedNumberType)i].u16Count;
+      }
     }
   } /* end for */
+
+  if(bPwmActive)
+  {
+    SchedulerSignal(PROFILER_TASK_LED);
+  }
+  else if(u32NextMs != 0)
+  {
+    SchedulerSignalAt(PROFILER_TASK_LED, G_u32SystemTime1ms + u32NextMs);
+  }
   
 } /* end LedUpdate() */
 
@@ -151,7 +151,7 @@ Requires:
 - No messaging in progress
 
 Promises:
-- Message queues are zeroed
+- All message slots are free and the message status queue is empty
 - Flags and state machine are initialized
 
 */
@@ -167,16 +167,11 @@ void MessagingInitialize(void)
     /* Clear the Slot value */
     Msg_asPool[i].bFree = TRUE;
     
-    /* Clear the slot's message values */
+    /* Clear the slot's message values.  The payload is not cleared: QueueMessage() 
+    writes it and only u32Size bytes of it are ever sent. */
     Msg_asPool[i].Message.u32Token = 0;
     Msg_asPool[i].Message.u32Size = 0;
     Msg_asPool[i].Message.psNextMessage = NULL;
-    
-    /* Clear the slot's message's contents */
-    for(u16 j = 0; j < U16_MAX_TX_MESSAGE_LENGTH; j++)
-    {
-      *(Msg_asPool[i].Message.pu8Message + j) = 0;
-    }
   }
 
   /* Clear the message status queue */
@@ -192,6 +187,10 @@ void MessagingInitialize(void)
   G_u32MessagingFlags = 0;
   Messaging_pfnStateMachine = MessagingSM_Idle;
 
+  /* Messages are moved by the peripheral tasks (their write functions signal them) and Idle has no work,
+  so the task is never signalled */
+  SchedulerSetEventDriven(PROFILER_TASK_MESSAGING);
+
 } /* end MessagingInitialize() */
 
 
@@ -234,7 +233,7 @@ Promises:
 - If the message is created successfully, the message token is returned; otherwise, NULL is returned
 
 */
-u32 QueueMessage(MessageType** ppsTargetTxBuffer_, u32 u32MessageSize_, u8* pu8MessageData_)
+RAMFUNC u32 QueueMessage(MessageType** ppsTargetTxBuffer_, u32 u32MessageSize_, u8* pu8MessageData_)
 {
   MessageSlotType *psSlotParser;
   MessageType *psNewMessage;
@@ -92,7 +92,7 @@ MessageStateType QueryMessageStatus(u32 u32Token_);
 void MessagingInitialize(void);
 void MessagingRunActiveState(void);
 
-u32 QueueMessage(MessageType** eTargetTxBuffer_, u32 u32MessageSize_, u8* pu8MessageData_);
+RAMFUNC u32 QueueMessage(MessageType** eTargetTxBuffer_, u32 u32MessageSize_, u8* pu8MessageData_);
 void DeQueueMessage(MessageType** pTargetQueue_);
 
 void UpdateMessageStatus(u32 u32Token_, MessageStateType eNewState_);
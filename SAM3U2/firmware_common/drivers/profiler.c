@@ -0,0 +1,567 @@
+/*!*********************************************************************************************************************
+@file profiler.c
+@brief Execution time profiler for the tasks in the main super loop.
+
+SystemTimeCheck() reports that a loop pass took longer than 1ms but not which task used the time.  Every task call in
+main.c is wrapped with PROFILER_RUN() which reads the Cortex-M3 DWT cycle counter before and after the call, so each
+task gets min / average / max cycle counts and a count of calls that went over its budget.
+
+A task's budget is its fair share of the loop: PROFILER_CYCLES_PER_MS / PROFILER_TASKS.  A task that is over budget is
+not necessarily a problem, but a task that is over budget often is where to look first when timing violations start.
+The whole active part of each loop pass is measured as well (PROFILER_LOOP) against the full 1ms.
+With TASK_DEADLINES the report also shows how often each task was deferred to the next pass because the pass ran
+past its deadline, and on the loop line how many passes deferred anything.
+
+Interrupts that fire during a task are counted in that task's time.
+
+SystemTimeCheck() calls ProfilerTimingViolation() when a tick was missed.  The time each task took in the pass that
+overran is still held in the statistics, so the longest task of that pass is recorded with the pass time in a
+history of the last PROFILER_VIOLATION_HISTORY violations for ProfilerPrintViolations().  If the pass itself was
+within 1ms, the time was lost outside the tasks, e.g. in a long interrupt or with interrupts disabled.
+
+Startup is measured the same way.  ProfilerBootStart() is the first call in main() and each initialization call is
+wrapped with PROFILER_BOOT(), so ProfilerPrintBoot() can show which calls keep the system from reaching its first
+loop pass and how long that took in total.
+
+The measurement is compiled in only when TASK_PROFILER is defined in configuration.h.  Cost per task is one register
+read before the call and a short function call after it.
+
+------------------------------------------------------------------------------------------------------------------------
+GLOBALS
+- NONE
+
+CONSTANTS
+- PROFILER_TASK_BUDGET_CYCLES
+
+TYPES
+- ProfilerTaskType
+- ProfilerStatsType
+
+PUBLIC FUNCTIONS
+- void ProfilerPrintReport(void)
+- void ProfilerReset(void)
+- void ProfilerPrintViolations(void)
+- void ProfilerPrintBoot(void)
+
+PROTECTED FUNCTIONS
+- void ProfilerBootStart(void)
+- void ProfilerBootStep(u8* pu8Name_, u32 u32StartCycles_)
+- void ProfilerInitialize(void)
+- void ProfilerRecord(ProfilerTaskType eTask_, u32 u32StartCycles_)
+- void ProfilerLoopStart(void)
+- void ProfilerLoopEnd(void)
+- void ProfilerTimingViolation(u32 u32Number_, u32 u32ElapsedMs_)
+- void ProfilerDeferred(ProfilerTaskType eTask_)
+
+**********************************************************************************************************************/
+
+#include "configuration.h"
+
+/***********************************************************************************************************************
+Global variable definitions with scope across entire project.
+All Global variable names shall start with "G_xxProfiler"
+***********************************************************************************************************************/
+/* New variables */
+
+
+/*--------------------------------------------------------------------------------------------------------------------*/
+/* Existing variables (defined in other files -- should all contain the "extern" keyword) */
+extern volatile u32 G_u32SystemTime1ms;                /*!< @brief From main.c */
+extern volatile u32 G_u32SystemTime1s;                 /*!< @brief From main.c */
+extern volatile u32 G_u32SystemFlags;                  /*!< @brief From main.c */
+extern volatile u32 G_u32ApplicationFlags;             /*!< @brief From main.c */
+
+
+/***********************************************************************************************************************
+Global variable definitions with scope limited to this local application.
+Variable names shall start with "Profiler_xx" and be declared as static.
+***********************************************************************************************************************/
+static ProfilerStatsType Profiler_asStats[PROFILER_TASKS + 1];  /*!< @brief Statistics for each task plus the loop */
+static u32 Profiler_u32LoopStart;                               /*!< @brief Cycle count at the start of the loop pass */
+static u32 Profiler_u32ResetTime;                               /*!< @brief G_u32SystemTime1ms when the stats were cleared */
+
+static ProfilerViolationType Profiler_asViolations[PROFILER_VIOLATION_HISTORY]; /*!< @brief Most recent timing violations */
+static u8 Profiler_u8ViolationNext;                             /*!< @brief Index of the next violation to write */
+static u32 Profiler_u32Violations;                              /*!< @brief Violations recorded since startup */
+
+static ProfilerBootStepType Profiler_asBootSteps[PROFILER_BOOT_STEPS]; /*!< @brief Initialization calls in the order they ran */
+static u8 Profiler_u8BootSteps;                                 /*!< @brief Entries used in Profiler_asBootSteps */
+static u32 Profiler_u32BootCycles;                              /*!< @brief DWT_CYCCNT at the first loop pass; 0 until then */
+static u32 Profiler_u32BootMs;                                  /*!< @brief G_u32SystemTime1ms at the first loop pass */
+
+/*! @brief Task names for the report in the order of ProfilerTaskType */
+static u8 Profiler_au8TaskNames[PROFILER_TASKS + 1][PROFILER_NAME_WIDTH + 1] =
+{"LED", "BUTTON", "UART", "TIMER", "SOFTTIMER", "SSP", "TWI", "ADC", "MESSAGING", "DEBUG", "TOKENLOG", "TRACE", "LCD",
+#ifdef EIE1
+ "SDCARD", "FATLOG", "RAWLOG",
+#endif /* EIE1 */
+ "USERAPP1", "USERAPP2", "USERAPP3", "LOOP"};
+
+
+/**********************************************************************************************************************
+Function Definitions
+**********************************************************************************************************************/
+
+/*--------------------------------------------------------------------------------------------------------------------*/
+/*! @publicsection */
+/*--------------------------------------------------------------------------------------------------------------------*/
+
+/*!----------------------------------------------------------------------------------------------------------------------
+@fn void ProfilerPrintReport(void)
+
+@brief Prints the statistics of every task sorted by the longest call, then clears them.
+
+Each line is a single DebugPrintFormat() so the report takes one message slot per task.
+All values are CPU cycles (48 per microsecond) except OVER and DEFER which are counts.
+
+Requires:
+- Debug is running
+
+Promises:
+- The loop line and one line per task are queued to the debug port, worst task first
+- Statistics are cleared so the next report covers only the time since this one
+
+*/
+void ProfilerPrintReport(void)
+{
+  u8 au8Heading[] = "\n\rTask profile (cycles) over the last %u ms\n\r%-10s%10s%10s%10s%10s%8s\n\r";
+  u8 au8Line[] = "%-10s%10u%10u%10u%10u%8u\n\r";
+  u8 au8Order[PROFILER_TASKS];
+  u8 u8Temp;
+  u8 u8Task;
+  u32 u32Average;
+
+#ifndef TASK_PROFILER
+  DebugPrintf("\n\rTASK_PROFILER is not defined\n\r");
+  return;
+#endif /* TASK_PROFILER */
+
+  /* Sort task indices by max cycles, longest first (insertion sort of a handful of entries) */
+  for(u8 i = 0; i < PROFILER_TASKS; i++)
+  {
+    au8Order[i] = i;
+    for(u8 j = i; (j > 0) && (Profiler_asStats[au8Order[j - 1]].u32MaxCycles < Profiler_asStats[i].u32MaxCycles); j--)
+    {
+      u8Temp = au8Order[j - 1];
+      au8Order[j - 1] = au8Order[j];
+      au8Order[j] = u8Temp;
+    }
+  }
+
+  DebugPrintFormat(au8Heading, G_u32SystemTime1ms - Profiler_u32ResetTime, "TASK", "MIN", "AVG", "MAX", "OVER", "DEFER");
+
+  /* The loop line goes first, then the sorted tasks */
+  for(u8 i = 0; i <= PROFILER_TASKS; i++)
+  {
+    u8Task = (i == 0) ? (u8)PROFILER_LOOP : au8Order[i - 1];
+
+    u32Average = 0;
+    if(Profiler_asStats[u8Task].u32Calls != 0)
+    {
+      u32Average = (u32)(Profiler_asStats[u8Task].u64TotalCycles / Profiler_asStats[u8Task].u32Calls);
+    }
+
+    DebugPrintFormat(au8Line, &Profiler_au8TaskNames[u8Task][0],
+                     Profiler_asStats[u8Task].u32Calls ? Profiler_asStats[u8Task].u32MinCycles : 0,
+                     u32Average, Profiler_asStats[u8Task].u32MaxCycles, Profiler_asStats[u8Task].u32Overruns,
+                     Profiler_asStats[u8Task].u32Deferred);
+  }
+
+  DebugLineFeed();
+  ProfilerReset();
+
+} /* end ProfilerPrintReport() */
+
+
+/*!----------------------------------------------------------------------------------------------------------------------
+@fn void ProfilerReset(void)
+
+@brief Clears the statistics of all tasks.
+
+Requires:
+- NONE
+
+Promises:
+- Profiler_asStats are all zero with the minimums at their maximum value
+- Profiler_u32ResetTime is the current time
+
+*/
+void ProfilerReset(void)
+{
+  for(u8 i = 0; i <= PROFILER_TASKS; i++)
+  {
+    Profiler_asStats[i].u32Calls       = 0;
+    Profiler_asStats[i].u32MinCycles   = 0xFFFFFFFF;
+    Profiler_asStats[i].u32MaxCycles   = 0;
+    Profiler_asStats[i].u64TotalCycles = 0;
+    Profiler_asStats[i].u32Overruns    = 0;
+    Profiler_asStats[i].u32Deferred    = 0;
+    Profiler_asStats[i].u32LastCycles  = 0;
+  }
+
+  Profiler_u32ResetTime = G_u32SystemTime1ms;
+
+} /* end ProfilerReset() */
+
+
+/*!----------------------------------------------------------------------------------------------------------------------
+@fn void ProfilerPrintViolations(void)
+
+@brief Prints the recorded timing violations, oldest first.
+
+Each line shows the longest task of the loop pass before the violation.  A LOOP value under 48000 cycles means
+the tasks finished in time and the tick was lost elsewhere.
+
+Requires:
+- Debug is running
+
+Promises:
+- A heading and one line per recorded violation are queued to the debug port
+- The history is not cleared
+
+*/
+void ProfilerPrintViolations(void)
+{
+  u8 au8Heading[] = "\n\r%u timing violations recorded\n\r%10s%8s%5s%10s  %-10s%10s\n\r";
+  u8 au8Line[] = "%10u%8u%5u%10u  %-10s%10u\n\r";
+  ProfilerViolationType* psViolation;
+  u8 u8Count;
+  u8 u8Index;
+
+#ifndef TASK_PROFILER
+  DebugPrintf("\n\rTASK_PROFILER is not defined\n\r");
+  return;
+#endif /* TASK_PROFILER */
+
+  DebugPrintFormat(au8Heading, Profiler_u32Violations, "TIME", "NUMBER", "MS", "LOOP", "TASK", "CYCLES");
+
+  u8Count = (Profiler_u32Violations < PROFILER_VIOLATION_HISTORY) ? (u8)Profiler_u32Violations : PROFILER_VIOLATION_HISTORY;
+  u8Index = (Profiler_u8ViolationNext + PROFILER_VIOLATION_HISTORY - u8Count) % PROFILER_VIOLATION_HISTORY;
+  
+  for(u8 i = 0; i < u8Count; i++)
+  {
+    psViolation = &Profiler_asViolations[u8Index];
+    DebugPrintFormat(au8Line, psViolation->u32Time, psViolation->u32Number, psViolation->u32ElapsedMs,
+                     psViolation->u32LoopCycles, &Profiler_au8TaskNames[psViolation->u8Task][0],
+                     psViolation->u32TaskCycles);
+    u8Index = (u8Index + 1) % PROFILER_VIOLATION_HISTORY;
+  }
+
+  DebugLineFeed();
+
+} /* end ProfilerPrintViolations() */
+
+
+/*!----------------------------------------------------------------------------------------------------------------------
+@fn void ProfilerPrintBoot(void)
+
+@brief Prints the time from reset to the first super loop pass and the initialization calls that took longest.
+
+Counts are CPU cycles from ProfilerBootStart().  The calls before ClockSetup() finishes run on the slow reset
+clock, so they are fewer cycles than their share of the time.
+
+Requires:
+- Debug is running
+
+Promises:
+- A heading and up to PROFILER_BOOT_REPORT_LINES calls, longest first, are queued to the debug port
+
+*/
+void ProfilerPrintBoot(void)
+{
+  u8 au8Heading[] = "\n\rFirst loop pass after %u cycles (%u ms of system time), %u calls timed\n\r%-28s%10s\n\r";
+  u8 au8Line[] = "%-28s%10u\n\r";
+  u8 au8Order[PROFILER_BOOT_STEPS];
+  u8 u8Temp;
+  u8 u8Lines;
+
+#ifndef TASK_PROFILER
+  DebugPrintf("\n\rTASK_PROFILER is not defined\n\r");
+  return;
+#endif /* TASK_PROFILER */
+
+  /* Sort step indices by cycles, longest first */
+  for(u8 i = 0; i < Profiler_u8BootSteps; i++)
+  {
+    au8Order[i] = i;
+    for(u8 j = i; (j > 0) && (Profiler_asBootSteps[au8Order[j - 1]].u32Cycles < Profiler_asBootSteps[i].u32Cycles); j--)
+    {
+      u8Temp = au8Order[j - 1];
+      au8Order[j - 1] = au8Order[j];
+      au8Order[j] = u8Temp;
+    }
+  }
+
+  DebugPrintFormat(au8Heading, Profiler_u32BootCycles, Profiler_u32BootMs, Profiler_u8BootSteps, "CALL", "CYCLES");
+
+  u8Lines = (Profiler_u8BootSteps < PROFILER_BOOT_REPORT_LINES) ? Profiler_u8BootSteps : PROFILER_BOOT_REPORT_LINES;
+  for(u8 i = 0; i < u8Lines; i++)
+  {
+    DebugPrintFormat(au8Line, Profiler_asBootSteps[au8Order[i]].pu8Name, Profiler_asBootSteps[au8Order[i]].u32Cycles);
+  }
+
+  DebugLineFeed();
+
+} /* end ProfilerPrintBoot() */
+
+
+/*--------------------------------------------------------------------------------------------------------------------*/
+/*! @protectedsection */
+/*--------------------------------------------------------------------------------------------------------------------*/
+
+/*!----------------------------------------------------------------------------------------------------------------------
+@fn void ProfilerBootStart(void)
+
+@brief Starts the DWT cycle counter from 0 so the initialization in main() can be timed.
+
+Requires:
+- First call in main()
+
+Promises:
+- DEMCR TRCENA is set and DWT_CYCCNT is counting up from 0
+
+*/
+void ProfilerBootStart(void)
+{
+  CoreDebug->DEMCR |= CoreDebug_DEMCR_TRCENA;
+  DWT_CYCCNT = 0;
+  DWT_CTRL |= DWT_CTRL_CYCCNTENA;
+
+} /* end ProfilerBootStart() */
+
+
+/*!----------------------------------------------------------------------------------------------------------------------
+@fn void ProfilerBootStep(u8* pu8Name_, u32 u32StartCycles_)
+
+@brief Records one initialization call.  Called by PROFILER_BOOT().
+
+Requires:
+@param pu8Name_ points to the call as a constant string
+@param u32StartCycles_ is DWT_CYCCNT from just before the call
+
+Promises:
+- The call is added to Profiler_asBootSteps unless PROFILER_BOOT_STEPS are already used
+
+*/
+void ProfilerBootStep(u8* pu8Name_, u32 u32StartCycles_)
+{
+  if(Profiler_u8BootSteps < PROFILER_BOOT_STEPS)
+  {
+    Profiler_asBootSteps[Profiler_u8BootSteps].pu8Name   = pu8Name_;
+    Profiler_asBootSteps[Profiler_u8BootSteps].u32Cycles = DWT_CYCCNT - u32StartCycles_;
+    Profiler_u8BootSteps++;
+  }
+
+} /* end ProfilerBootStep() */
+
+
+/*!----------------------------------------------------------------------------------------------------------------------
+@fn void ProfilerInitialize(void)
+
+@brief Starts the DWT cycle counter and clears the statistics.
+
+The counter runs whether or not a debugger is attached once TRCENA is set.
+
+Requires:
+- NONE
+
+Promises:
+- DEMCR TRCENA is set and DWT_CYCCNT is counting
+- All statistics are cleared
+- "profile", "violations" and "boot" are added to the debug menu
+
+*/
+void ProfilerInitialize(void)
+{
+  CoreDebug->DEMCR |= CoreDebug_DEMCR_TRCENA;
+  DWT_CTRL |= DWT_CTRL_CYCCNTENA;
+
+  ProfilerReset();
+
+  DebugCommandRegister("profile", "Show task profile", ProfilerPrintReport);
+  DebugCommandRegister("violations", "Show timing violations", ProfilerPrintViolations);
+  DebugCommandRegister("boot", "Show startup time", ProfilerPrintBoot);
+
+} /* end ProfilerInitialize() */
+
+
+/*!----------------------------------------------------------------------------------------------------------------------
+@fn void ProfilerRecord(ProfilerTaskType eTask_, u32 u32StartCycles_)
+
+@brief Adds one call of a task to its statistics.  Called by PROFILER_RUN().
+
+Requires:
+@param eTask_ is the task that just ran
+@param u32StartCycles_ is DWT_CYCCNT from just before the call
+
+Promises:
+- The statistics of eTask_ are updated with the elapsed cycles
+
+*/
+void ProfilerRecord(ProfilerTaskType eTask_, u32 u32StartCycles_)
+{
+  /* Unsigned subtraction handles counter wrap */
+  ProfilerUpdate(eTask_, DWT_CYCCNT - u32StartCycles_, PROFILER_TASK_BUDGET_CYCLES);
+
+} /* end ProfilerRecord() */
+
+
+/*!----------------------------------------------------------------------------------------------------------------------
+@fn void ProfilerLoopStart(void)
+
+@brief Marks the start of a super loop pass.
+
+Requires:
+- Called once at the top of the super loop
+
+Promises:
+- Profiler_u32LoopStart holds the current cycle count
+- On the first pass, the cycle count and system time are kept as the startup time
+
+*/
+void ProfilerLoopStart(void)
+{
+#ifdef TASK_PROFILER
+  Profiler_u32LoopStart = DWT_CYCCNT;
+
+  if(Profiler_u32BootCycles == 0)
+  {
+    Profiler_u32BootCycles = Profiler_u32LoopStart;
+    Profiler_u32BootMs = G_u32SystemTime1ms;
+  }
+#endif /* TASK_PROFILER */
+
+} /* end ProfilerLoopStart() */
+
+
+/*!----------------------------------------------------------------------------------------------------------------------
+@fn void ProfilerLoopEnd(void)
+
+@brief Marks the end of the active part of a super loop pass.
+
+Requires:
+- Called once just before SystemSleep()
+
+Promises:
+- The PROFILER_LOOP statistics are updated against the full 1ms budget
+
+*/
+void ProfilerLoopEnd(void)
+{
+#ifdef TASK_PROFILER
+  ProfilerUpdate(PROFILER_LOOP, DWT_CYCCNT - Profiler_u32LoopStart, PROFILER_CYCLES_PER_MS);
+#endif /* TASK_PROFILER */
+
+} /* end ProfilerLoopEnd() */
+
+
+/*!----------------------------------------------------------------------------------------------------------------------
+@fn void ProfilerTimingViolation(u32 u32Number_, u32 u32ElapsedMs_)
+
+@brief Records which task used the most time in the loop pass that just overran.
+
+Requires:
+- Called by SystemTimeCheck() before ProfilerLoopStart() so the statistics still hold the last pass
+@param u32Number_ is the timing violation counter
+@param u32ElapsedMs_ is the number of ticks the pass took
+
+Promises:
+- The violation is added to Profiler_asViolations, overwriting the oldest
+
+*/
+void ProfilerTimingViolation(u32 u32Number_, u32 u32ElapsedMs_)
+{
+#ifdef TASK_PROFILER
+  ProfilerViolationType* psViolation = &Profiler_asViolations[Profiler_u8ViolationNext];
+  u8 u8Worst = 0;
+
+  for(u8 i = 1; i < PROFILER_TASKS; i++)
+  {
+    if(Profiler_asStats[i].u32LastCycles > Profiler_asStats[u8Worst].u32LastCycles)
+    {
+      u8Worst = i;
+    }
+  }
+
+  psViolation->u32Time       = G_u32SystemTime1ms;
+  psViolation->u32Number     = u32Number_;
+  psViolation->u32ElapsedMs  = u32ElapsedMs_;
+  psViolation->u32LoopCycles = Profiler_asStats[PROFILER_LOOP].u32LastCycles;
+  psViolation->u32TaskCycles = Profiler_asStats[u8Worst].u32LastCycles;
+  psViolation->u8Task        = u8Worst;
+
+  Profiler_u8ViolationNext = (Profiler_u8ViolationNext + 1) % PROFILER_VIOLATION_HISTORY;
+  Profiler_u32Violations++;
+#endif /* TASK_PROFILER */
+
+} /* end ProfilerTimingViolation() */
+
+
+/*!----------------------------------------------------------------------------------------------------------------------
+@fn void ProfilerDeferred(ProfilerTaskType eTask_)
+
+@brief Counts a task that was not run because the pass was past its deadline.  Called by the scheduler.
+
+Requires:
+@param eTask_ is the deferred task, or PROFILER_LOOP for the first deferral of a pass
+
+Promises:
+- u32Deferred of eTask_ is incremented
+
+*/
+void ProfilerDeferred(ProfilerTaskType eTask_)
+{
+#ifdef TASK_PROFILER
+  Profiler_asStats[eTask_].u32Deferred++;
+#endif /* TASK_PROFILER */
+
+} /* end ProfilerDeferred() */
+
+
+/*--------------------------------------------------------------------------------------------------------------------*/
+/*! @privatesection */
+/*--------------------------------------------------------------------------------------------------------------------*/
+
+/*!----------------------------------------------------------------------------------------------------------------------
+@fn static void ProfilerUpdate(ProfilerTaskType eTask_, u32 u32Cycles_, u32 u32Budget_)
+
+@brief Adds one measurement to the statistics of a task.
+
+Requires:
+@param eTask_ is the task (or PROFILER_LOOP)
+@param u32Cycles_ is the measured time
+@param u32Budget_ is the time above which the call counts as an overrun
+
+Promises:
+- Calls, min, max, total, overruns and last call of eTask_ are updated
+
+*/
+static void ProfilerUpdate(ProfilerTaskType eTask_, u32 u32Cycles_, u32 u32Budget_)
+{
+  ProfilerStatsType* psStats = &Profiler_asStats[eTask_];
+
+  psStats->u32Calls++;
+  psStats->u64TotalCycles += u32Cycles_;
+  psStats->u32LastCycles = u32Cycles_;
+
+  if(u32Cycles_ < psStats->u32MinCycles)
+  {
+    psStats->u32MinCycles = u32Cycles_;
+  }
+
+  if(u32Cycles_ > psStats->u32MaxCycles)
+  {
+    psStats->u32MaxCycles = u32Cycles_;
+  }
+
+  if(u32Cycles_ > u32Budget_)
+  {
+    psStats->u32Overruns++;
+  }
+
+} /* end ProfilerUpdate() */
+
+
+/*--------------------------------------------------------------------------------------------------------------------*/
+/* End of File                                                                                                        */
+/*--------------------------------------------------------------------------------------------------------------------*/
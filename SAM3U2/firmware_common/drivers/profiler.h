@@ -0,0 +1,156 @@
+/*!*********************************************************************************************************************
+@file profiler.h
+@brief Header file for profiler.c
+
+**********************************************************************************************************************/
+
+#ifndef __PROFILER_H
+#define __PROFILER_H
+
+/**********************************************************************************************************************
+Type Definitions
+**********************************************************************************************************************/
+
+/*!
+@enum ProfilerTaskType
+@brief One entry per task called from the main super loop.
+
+The order must match Profiler_au8TaskNames in profiler.c.  The values are also the task ids for scheduler.c.
+PROFILER_LOOP is the active part of the whole loop pass (everything except SystemSleep) and is reported against the
+full 1ms budget.
+*/
+typedef enum {PROFILER_TASK_LED, PROFILER_TASK_BUTTON, PROFILER_TASK_UART, PROFILER_TASK_TIMER, PROFILER_TASK_SOFTTIMER,
+              PROFILER_TASK_SSP, PROFILER_TASK_TWI, PROFILER_TASK_ADC, PROFILER_TASK_MESSAGING, PROFILER_TASK_DEBUG,
+              PROFILER_TASK_TOKENLOG, PROFILER_TASK_TRACE, PROFILER_TASK_LCD,
+#ifdef EIE1
+              PROFILER_TASK_SDCARD, PROFILER_TASK_FATLOG, PROFILER_TASK_RAWLOG,
+#endif /* EIE1 */
+              PROFILER_TASK_USERAPP1, PROFILER_TASK_USERAPP2, PROFILER_TASK_USERAPP3,
+              PROFILER_TASKS, PROFILER_LOOP = PROFILER_TASKS} ProfilerTaskType;
+
+/*!
+@struct ProfilerStatsType
+@brief Execution time statistics for one task, all in CPU cycles.
+*/
+typedef struct
+{
+  u32 u32Calls;                       /*!< @brief Number of measured calls */
+  u32 u32MinCycles;                   /*!< @brief Shortest call */
+  u32 u32MaxCycles;                   /*!< @brief Longest call */
+  u64 u64TotalCycles;                 /*!< @brief Sum of all calls for the average */
+  u32 u32Overruns;                    /*!< @brief Calls that took longer than the task budget */
+  u32 u32Deferred;                    /*!< @brief Passes the task was deferred past its deadline (scheduler.c) */
+  u32 u32LastCycles;                  /*!< @brief Most recent call, i.e. this task's share of the last loop pass */
+} ProfilerStatsType;
+
+/*!
+@struct ProfilerViolationType
+@brief What the loop pass before a 1ms timing violation spent its time on.
+*/
+typedef struct
+{
+  u32 u32Time;                        /*!< @brief G_u32SystemTime1ms when the violation was detected */
+  u32 u32Number;                      /*!< @brief Value of the violation counter */
+  u32 u32ElapsedMs;                   /*!< @brief System ticks that passed instead of 1 */
+  u32 u32LoopCycles;                  /*!< @brief Active time of the pass */
+  u32 u32TaskCycles;                  /*!< @brief Time of the longest task in the pass */
+  u8 u8Task;                          /*!< @brief ProfilerTaskType of the longest task */
+  u8 au8Pad[3];
+} ProfilerViolationType;
+
+/*!
+@struct ProfilerBootStepType
+@brief One initialization call in main() timed by PROFILER_BOOT().
+*/
+typedef struct
+{
+  u8* pu8Name;                        /*!< @brief The call as written in main.c */
+  u32 u32Cycles;                      /*!< @brief Time the call took */
+} ProfilerBootStepType;
+
+
+/**********************************************************************************************************************
+Constants / Definitions
+**********************************************************************************************************************/
+/*! @cond DOXYGEN_EXCLUDE */
+/* Data Watchpoint and Trace unit registers (not in the CMSIS core_cm3.h used here) */
+#define DWT_CTRL                        (*(volatile u32*)0xE0001000)
+#define DWT_CYCCNT                      (*(volatile u32*)0xE0001004)
+#define DWT_CTRL_CYCCNTENA              (u32)0x00000001
+/*! @endcond */
+
+#define PROFILER_CYCLES_PER_MS          (u32)(CCLK_VALUE / 1000)                     /*!< @brief Super loop budget */
+#define PROFILER_TASK_BUDGET_CYCLES     (u32)(PROFILER_CYCLES_PER_MS / PROFILER_TASKS) /*!< @brief Fair share of the loop for one task */
+
+#define PROFILER_NAME_WIDTH             (u8)10              /*!< @brief Longest task name */
+#define PROFILER_VIOLATION_HISTORY      (u8)8               /*!< @brief Timing violations kept for ProfilerPrintViolations() */
+#define PROFILER_BOOT_STEPS             (u8)32              /*!< @brief Initialization calls that can be timed */
+#define PROFILER_BOOT_REPORT_LINES      (u8)12              /*!< @brief Longest calls shown by ProfilerPrintBoot() */
+
+/*!
+@brief Runs Call_ and adds its execution time to the statistics of task eTask_.
+
+Example:
+PROFILER_RUN(PROFILER_TASK_LED, LedUpdate());
+
+Without TASK_PROFILER defined this is just the call.
+*/
+#ifdef TASK_PROFILER
+#define PROFILER_RUN(eTask_, Call_)     { u32 u32ProfilerStart = DWT_CYCCNT; Call_; ProfilerRecord((eTask_), u32ProfilerStart); }
+#else
+#define PROFILER_RUN(eTask_, Call_)     Call_
+#endif /* TASK_PROFILER */
+
+/*!
+@brief Runs initialization call Call_ in main() and records how long it took for ProfilerPrintBoot().
+
+Example:
+PROFILER_BOOT(LcdInitialize());
+
+Without TASK_PROFILER defined this is just the call.
+*/
+#ifdef TASK_PROFILER
+#define PROFILER_BOOT(Call_)            { u32 u32ProfilerStart = DWT_CYCCNT; Call_; ProfilerBootStep((u8*)#Call_, u32ProfilerStart); }
+#else
+#define PROFILER_BOOT(Call_)            Call_
+#endif /* TASK_PROFILER */
+
+
+/**********************************************************************************************************************
+Function Declarations
+**********************************************************************************************************************/
+
+/*------------------------------------------------------------------------------------------------------------------*/
+/*! @publicsection */
+/*--------------------------------------------------------------------------------------------------------------------*/
+void ProfilerPrintReport(void);
+void ProfilerReset(void);
+void ProfilerPrintViolations(void);
+void ProfilerPrintBoot(void);
+
+
+/*------------------------------------------------------------------------------------------------------------------*/
+/*! @protectedsection */
+/*--------------------------------------------------------------------------------------------------------------------*/
+void ProfilerBootStart(void);
+void ProfilerBootStep(u8* pu8Name_, u32 u32StartCycles_);
+void ProfilerInitialize(void);
+void ProfilerRecord(ProfilerTaskType eTask_, u32 u32StartCycles_);
+void ProfilerLoopStart(void);
+void ProfilerLoopEnd(void);
+void ProfilerTimingViolation(u32 u32Number_, u32 u32ElapsedMs_);
+void ProfilerDeferred(ProfilerTaskType eTask_);
+
+
+/*------------------------------------------------------------------------------------------------------------------*/
+/*! @privatesection */
+/*--------------------------------------------------------------------------------------------------------------------*/
+static void ProfilerUpdate(ProfilerTaskType eTask_, u32 u32Cycles_, u32 u32Budget_);
+
+
+#endif /* __PROFILER_H */
+
+
+/*--------------------------------------------------------------------------------------------------------------------*/
+/* End of File                                                                                                        */
+/*--------------------------------------------------------------------------------------------------------------------*/
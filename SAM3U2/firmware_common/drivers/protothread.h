@@ -0,0 +1,100 @@
+/*!*********************************************************************************************************************
+@file protothread.h
+@brief Stackless coroutines (protothreads) for driver state machines.
+
+A protothread is a function that returns PtStatusType and is called again every pass until it has finished.  Its
+body reads top to bottom like blocking code; where it has to wait for I/O it returns, and the next call resumes at
+that point.  A sequence that took one state function per step (and a saved return state for each shared wait)
+becomes one function, and steps whose data is already there run in the same pass instead of one pass each.
+
+static PtStatusType TaskThread(ProtoThreadType* psPt_)
+{
+  PT_BEGIN(psPt_);
+
+  SspReadData(Task_Ssp, 4);
+  PT_WAIT_UNTIL(psPt_, SspQueryReceiveStatus(Task_Ssp) == SSP_RX_COMPLETE);
+
+  if(Task_au8RxBuffer[0] != TASK_EXPECTED)
+  {
+    PT_EXIT(psPt_);
+  }
+
+  PT_END(psPt_);
+}
+
+The state that owns it calls TaskThread(&Task_sThread) each pass after PT_INIT(&Task_sThread) and moves on when it
+returns PT_ENDED (finished) or PT_EXITED (gave up).
+
+The resume point is a case label in a switch around the whole body (the __LINE__ of the wait), which costs one
+u16 per thread and no stack.  The price is that:
+- Local variables do not survive a wait; anything needed after one must be static or in the task's variables
+- There must be no switch statement of its own around a wait, and at most one wait per source line
+- Only the protothread function itself can wait; a sub-sequence that waits is a child protothread run with PT_SPAWN()
+
+**********************************************************************************************************************/
+
+#ifndef __PROTOTHREAD_H
+#define __PROTOTHREAD_H
+
+/**********************************************************************************************************************
+Type Definitions
+**********************************************************************************************************************/
+/*! @brief Result of one call to a protothread; PT_EXITED and above mean it has finished */
+typedef enum {PT_WAITING = 0, PT_YIELDED, PT_EXITED, PT_ENDED} PtStatusType;
+
+/*!
+@struct ProtoThreadType
+@brief State of one protothread.  Set up with PT_INIT() before its first call.
+*/
+typedef struct
+{
+  u16 u16Resume;                         /*!< @brief Line to resume at; 0 starts from PT_BEGIN() */
+  PtStatusType eChild;                   /*!< @brief How the last child run with PT_SPAWN() finished */
+} ProtoThreadType;
+
+
+/**********************************************************************************************************************
+Constants / Definitions
+**********************************************************************************************************************/
+/*! @brief Starts (or restarts) a protothread from the top on its next call */
+#define PT_INIT(psPt_)                  ((psPt_)->u16Resume = 0)
+
+/*! @brief First statement of a protothread; jumps to where the last call left off */
+#define PT_BEGIN(psPt_)                 { bool bPtRun = TRUE; (void)bPtRun; switch((psPt_)->u16Resume) { case 0:
+
+/*! @brief Last statement of a protothread; it has finished and starts over if called again */
+#define PT_END(psPt_)                   } PT_INIT(psPt_); return PT_ENDED; }
+
+/*! @brief Returns PT_WAITING until Condition_ is true, then carries on in the same call */
+#define PT_WAIT_UNTIL(psPt_, Condition_) \
+  do { (psPt_)->u16Resume = __LINE__; case __LINE__: if( !(Condition_) ) { return PT_WAITING; } } while(0)
+
+/*! @brief Returns PT_WAITING while Condition_ is true */
+#define PT_WAIT_WHILE(psPt_, Condition_) PT_WAIT_UNTIL((psPt_), !(Condition_))
+
+/*! @brief Gives up the rest of this pass once, e.g. between steps of a long computation */
+#define PT_YIELD(psPt_) \
+  do { bPtRun = FALSE; (psPt_)->u16Resume = __LINE__; case __LINE__: if(!bPtRun) { return PT_YIELDED; } } while(0)
+
+/*! @brief Starts child protothread psChild_ and waits until Thread_ (the call that runs it) has finished.
+PT_CHILD_EXITED() then tells if it gave up. */
+#define PT_SPAWN(psPt_, psChild_, Thread_) \
+  do { PT_INIT(psChild_); (psPt_)->u16Resume = __LINE__; case __LINE__: \
+       if( ((psPt_)->eChild = (Thread_)) < PT_EXITED ) { return PT_WAITING; } } while(0)
+
+/*! @brief TRUE if the last child run with PT_SPAWN() finished with PT_EXIT() */
+#define PT_CHILD_EXITED(psPt_)          ((psPt_)->eChild == PT_EXITED)
+
+/*! @brief Gives up: the protothread returns PT_EXITED and starts over if called again */
+#define PT_EXIT(psPt_)                  do { PT_INIT(psPt_); return PT_EXITED; } while(0)
+
+/*! @brief Starts over from PT_BEGIN() on the next call */
+#define PT_RESTART(psPt_)               do { PT_INIT(psPt_); return PT_WAITING; } while(0)
+
+
+#endif /* __PROTOTHREAD_H */
+
+
+/*--------------------------------------------------------------------------------------------------------------------*/
+/* End of File                                                                                                        */
+/*--------------------------------------------------------------------------------------------------------------------*/
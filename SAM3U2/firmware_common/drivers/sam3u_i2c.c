@@ -115,6 +115,7 @@ bool TWI0ReadByte(u8 u8SlaveAddress_, u8* pu8RxBuffer_)
     {
       TWI_MessageBufferNextIndex = 0;
     }
+    SchedulerSignal(PROFILER_TASK_TWI);
     
     /* If the system is initializing, we want to manually cycle the TWI task through one iteration
       to send the message */
@@ -169,6 +170,7 @@ bool TWI0ReadData(u8 u8SlaveAddress_, u8* pu8RxBuffer_, u32 u32Size_)
     {
       TWI_MessageBufferNextIndex = 0;
     }
+    SchedulerSignal(PROFILER_TASK_TWI);
     
     /* If the system is initializing, we want to manually cycle the TWI task through one iteration
       to send the message */
@@ -230,6 +232,7 @@ u32 TWI0WriteByte(u8 u8SlaveAddress_, u8 u8Byte_, TWIStopType Send_)
       {
         TWI_MessageBufferNextIndex = 0;
       }
+      SchedulerSignal(PROFILER_TASK_TWI);
 
       /* If the system is initializing, we want to manually cycle the TWI task through one iteration
       to send the message */
@@ -294,6 +297,7 @@ u32 TWI0WriteData(u8 u8SlaveAddress_, u32 u32Size_, u8* u8Data_, TWIStopType Sen
       {
         TWI_MessageBufferNextIndex = 0;
       }
+      SchedulerSignal(PROFILER_TASK_TWI);
 
       /* If the system is initializing, manually cycle the TWI task through one iteration to send the message */
       if(G_u32SystemFlags & _SYSTEM_INITIALIZING)
@@ -364,6 +368,9 @@ void TWIInitialize(void)
 
   /* Set application pointer */
   TWI_StateMachine = TWISM_Idle;
+
+  /* The read and write functions signal the task */
+  SchedulerSetEventDriven(PROFILER_TASK_TWI);
   
 } /* end TWIInitialize() */
 
@@ -381,11 +388,18 @@ Requires:
 
 Promises:
   - Calls the function to pointed by the state machine function pointer
+  - The task stays scheduled while a message is queued or in progress; the transfer states
+    check for completion in the status register, so they need every pass
 */
 void TWIRunActiveState(void)
 {
   TWI_StateMachine();
 
+  if( (TWI_StateMachine != TWISM_Idle) || (TWI_MessageBufferNextIndex != TWI_MessageBufferCurIndex) )
+  {
+    SchedulerSignal(PROFILER_TASK_TWI);
+  }
+
 } /* end TWIRunActiveState */
 
 
@@ -23,6 +23,11 @@ void SspRelease(SspPeripheralType* psSspPeripheral_)
 If your task is done using the SSP it requested, call this function to "give it back" to the system.
 e.g. SspRelease(&MyTaskSsp);
 
+bool SspSetClockDivider(SspPeripheralType* psSspPeripheral_, u16 u16Divider_)
+Changes the SCK rate of a requested peripheral between transfers (SCK = MCK / u16Divider_).  To start every
+request at a given rate, set u16ClockDivider in the SspConfigurationType instead.
+e.g. SspSetClockDivider(MyTaskSsp, 12);
+
 u32 SspWriteByte(SspPeripheralType* psSspPeripheral_, u8 u8Byte_)
 Write a single byte to the SSP.  A token corresponding to the message is returned if you want to monitor
 if the byte sends correctly.
@@ -45,6 +50,11 @@ Creates a dummy byte array to transmit and subsequently receive u32Size_ bytes.
 to see when the message has been sent, and thus when the received data should be in the pre-configured receive buffer.
 e.g. u32CurrentMessageToken = SspReadData(&MyTaskSsp, 10);
 
+bool SspReadDataDirect(SspPeripheralType* psSspPeripheral_, u8* pu8Destination_, u16 u16Size_)
+Same as SspReadData() but the PDC receives straight into pu8Destination_ instead of the pre-configured receive
+buffer, so large blocks need no copy and no receive buffer of their own.  The size is not limited by the message size.
+e.g. bRequested = SspReadDataDirect(&MyTaskSsp, au8Sector, 512);
+
 
 INITIALIZATION (should take place in application's initialization function):
 1. Create a variable of SspConfigurationType in your application and initialize it to the desired SSP peripheral,
@@ -112,6 +122,8 @@ extern volatile u32 G_u32SystemTime1ms;                /*!< From main.c */
 extern volatile u32 G_u32SystemTime1s;                 /*!< From main.c */
 extern volatile u32 G_u32SystemFlags;                  /*!< From main.c */
 extern volatile u32 G_u32ApplicationFlags;             /*!< From main.c */
+extern volatile u32 G_u32TraceFlags;                   /*!< From trace.c */
+extern u32 G_au32DebugLogMask[];                       /*!< From debug.c */
 
 
 /***********************************************************************************************************************
@@ -225,6 +237,12 @@ SspPeripheralType* SspRequest(SspConfigurationType* psSspConfig_)
     return(NULL);
   }
 
+  /* The client may run the clock at a different rate than the board default */
+  if(psSspConfig_->u16ClockDivider != 0)
+  {
+    u32TargetBRGR = psSspConfig_->u16ClockDivider;
+  }
+
   /* Activate and configure the peripheral */
   AT91C_BASE_PMC->PMC_PCER |= (1 << psRequestedSsp->u8PeripheralId);
   
@@ -305,6 +323,7 @@ void SspRelease(SspPeripheralType* psSspPeripheral_)
   psSspPeripheral_->pCsGpioAddress = NULL;
   psSspPeripheral_->pu8RxBuffer    = NULL;
   psSspPeripheral_->ppu8RxNextByte  = NULL;
+  psSspPeripheral_->pu8RxDestination = NULL;
   psSspPeripheral_->u32PrivateFlags = 0;
   psSspPeripheral_->fnSlaveTxFlowCallback = NULL;
   psSspPeripheral_->fnSlaveRxFlowCallback = NULL;
@@ -360,6 +379,35 @@ void SspDeAssertCS(SspPeripheralType* psSspPeripheral_)
 } /* end SspDessertCS() */
 
 
+/*----------------------------------------------------------------------------------------------------------------------
+Function: SspSetClockDivider
+
+Description:
+Changes the bit rate of a requested peripheral while it is in use.  The new rate only lasts until the
+peripheral is released; set u16ClockDivider in the configuration to keep it for the next SspRequest().
+
+Requires:
+  - psSspPeripheral_ has been requested.
+  - u16Divider_ is the baud rate generator CD value: SCK = MCK / u16Divider_ in SPI mode (minimum 6 for master)
+
+Promises:
+  - If no transfer is in progress, loads the new divider and returns TRUE
+  - Returns FALSE if a transfer is in progress or u16Divider_ is less than SSP_MIN_CLOCK_DIVIDER
+*/
+bool SspSetClockDivider(SspPeripheralType* psSspPeripheral_, u16 u16Divider_)
+{
+  if( (u16Divider_ < SSP_MIN_CLOCK_DIVIDER) ||
+      (psSspPeripheral_->u32PrivateFlags & (_SSP_PERIPHERAL_TX | _SSP_PERIPHERAL_RX)) )
+  {
+    return FALSE;
+  }
+  
+  psSspPeripheral_->pBaseAddress->US_BRGR = u16Divider_;
+  return TRUE;
+  
+} /* end SspSetClockDivider() */
+
+
 /*----------------------------------------------------------------------------------------------------------------------
 Function: SspWriteByte
 
@@ -383,6 +431,8 @@ u32 SspWriteByte(SspPeripheralType* psSspPeripheral_, u8 u8Byte_)
   u32Token = QueueMessage(&psSspPeripheral_->psTransmitBuffer, 1, &u8Data);
   if( u32Token != 0 )
   {
+    SchedulerSignal(PROFILER_TASK_SSP);
+
     /* If the system is initializing, we want to manually cycle the SSP task through one iteration
     to send the message */
     if(G_u32SystemFlags & _SYSTEM_INITIALIZING)
@@ -424,6 +474,7 @@ u32 SspWriteData(SspPeripheralType* psSspPeripheral_, u32 u32Size_, u8* pu8Data_
   {
     return(0);
   }
+  SchedulerSignal(PROFILER_TASK_SSP);
   
   /* If the system is initializing, manually cycle the SSP task through one iteration to send the message */
   if(G_u32SystemFlags & _SYSTEM_INITIALIZING)
@@ -462,6 +513,7 @@ bool SspReadByte(SspPeripheralType* psSspPeripheral_)
   
   /* Load the counter and return success */
   psSspPeripheral_->u16RxBytes = 1;
+  SchedulerSignal(PROFILER_TASK_SSP);
   return TRUE;
   
 } /* end SspReadByte() */
@@ -488,7 +540,7 @@ bool SspReadData(SspPeripheralType* psSspPeripheral_, u16 u16Size_)
   /* Do not allow if requested size is too large */
   if(u16Size_ > U16_MAX_TX_MESSAGE_LENGTH)
   {
-    DebugPrintf(au8MsgTooBig);
+    LOG_ERROR(_DEBUG_LOG_SSP, "%s", au8MsgTooBig);
     return FALSE;
   }
   
@@ -500,11 +552,46 @@ bool SspReadData(SspPeripheralType* psSspPeripheral_, u16 u16Size_)
   
   /* Load the counter and return success */
   psSspPeripheral_->u16RxBytes = u16Size_;
+  SchedulerSignal(PROFILER_TASK_SSP);
   return TRUE;
     
 } /* end SspReadData() */
 
 
+/*----------------------------------------------------------------------------------------------------------------------
+Function: SspReadDataDirect
+
+Description:
+Gets multiple bytes from the slave directly into a client buffer.  The buffer also sources the dummy bytes
+that are transmitted, so its contents are overwritten with SSP_DUMMY_BYTE before the transfer starts.
+
+Requires:
+  - If CS is under manual control for the target SSP peripheral, it should already be asserted
+  - pu8Destination_ points to at least u16Size_ bytes that are not touched until SspQueryReceiveStatus()
+    reports SSP_RX_COMPLETE
+  - u16Size_ is the number of bytes to receive
+
+Promises:
+  - Returns TRUE if the read is queued
+  - Returns FALSE if the peripheral already has a read request
+*/
+bool SspReadDataDirect(SspPeripheralType* psSspPeripheral_, u8* pu8Destination_, u16 u16Size_)
+{
+  /* Make sure no receive function is already in progress based on the bytes in the buffer */
+  if( (psSspPeripheral_->u16RxBytes != 0) || (u16Size_ == 0) )
+  {
+    return FALSE;
+  }
+  
+  /* Load the destination and counter and return success */
+  psSspPeripheral_->pu8RxDestination = pu8Destination_;
+  psSspPeripheral_->u16RxBytes = u16Size_;
+  SchedulerSignal(PROFILER_TASK_SSP);
+  return TRUE;
+    
+} /* end SspReadDataDirect() */
+
+
 /*----------------------------------------------------------------------------------------------------------------------
 Function: SspQueryReceiveStatus
 
@@ -580,6 +667,7 @@ void SspInitialize(void)
   SSP_Peripheral0.pu8RxBuffer      = NULL;
   SSP_Peripheral0.u16RxBufferSize  = 0;
   SSP_Peripheral0.ppu8RxNextByte    = NULL;
+  SSP_Peripheral0.pu8RxDestination  = NULL;
   SSP_Peripheral0.u32PrivateFlags  = 0;
   SSP_Peripheral0.u8PeripheralId   = AT91C_ID_US0;
   
@@ -589,6 +677,7 @@ void SspInitialize(void)
   SSP_Peripheral1.pu8RxBuffer      = NULL;
   SSP_Peripheral1.u16RxBufferSize  = 0;
   SSP_Peripheral1.ppu8RxNextByte    = NULL;
+  SSP_Peripheral1.pu8RxDestination  = NULL;
   SSP_Peripheral1.u32PrivateFlags  = 0;
   SSP_Peripheral1.u8PeripheralId   = AT91C_ID_US1;
 
@@ -598,6 +687,7 @@ void SspInitialize(void)
   SSP_Peripheral2.pu8RxBuffer      = NULL;
   SSP_Peripheral2.u16RxBufferSize  = 0;
   SSP_Peripheral2.ppu8RxNextByte    = NULL;
+  SSP_Peripheral2.pu8RxDestination  = NULL;
   SSP_Peripheral2.u32PrivateFlags  = 0;
   SSP_Peripheral2.u8PeripheralId   = AT91C_ID_US2;
 
@@ -610,6 +700,9 @@ void SspInitialize(void)
   Ssp_pfnStateMachine = SspSM_Idle;
   DebugPrintf(au8SspStartupMessage);
 
+  /* The write and read functions signal the task, as do the ISRs when a transfer finishes */
+  SchedulerSetEventDriven(PROFILER_TASK_SSP);
+
 } /* end SspInitialize() */
 
 
@@ -626,11 +719,17 @@ Requires:
 
 Promises:
   - Calls the function to pointed by the state machine function pointer
+  - The task stays scheduled while a peripheral has a transfer that has not started
 */
 void SspRunActiveState(void)
 {
   Ssp_pfnStateMachine();
 
+  if( (Ssp_pfnStateMachine != SspSM_Idle) || SspTransferWaiting() )
+  {
+    SchedulerSignal(PROFILER_TASK_SSP);
+  }
+
 } /* end SspRunActiveState */
 
 
@@ -670,6 +769,63 @@ void SspManualMode(void)
 /* Private functions */
 /*--------------------------------------------------------------------------------------------------------------------*/
 
+/*----------------------------------------------------------------------------------------------------------------------
+Function: SspTxComplete
+
+Description:
+Finishes a sent message: the part of ENDTX handling that SspGenericHandler() defers to PendSV_Handler().
+
+Requires:
+  - The peripheral's transmitter and ENDTX interrupt are disabled
+  - u32Peripheral_ is the SspPeripheralType* of the SSP that sent the message
+
+Promises:
+  - The message is marked COMPLETE and dequeued
+  - _SSP_PERIPHERAL_TX is cleared and the task signalled so SspSM_Idle() can start the next transfer
+*/
+static void SspTxComplete(u32 u32Peripheral_)
+{
+  SspPeripheralType* psSsp = (SspPeripheralType*)u32Peripheral_;
+
+  UpdateMessageStatus(psSsp->psTransmitBuffer->u32Token, COMPLETE);
+  DeQueueMessage( &psSsp->psTransmitBuffer );
+  psSsp->u32PrivateFlags &= ~_SSP_PERIPHERAL_TX;
+  SchedulerSignal(PROFILER_TASK_SSP);
+
+} /* end SspTxComplete() */
+
+
+/*----------------------------------------------------------------------------------------------------------------------
+Function: SspTransferWaiting
+
+Description:
+Checks if any SSP peripheral has a message or read that SspSM_Idle() has yet to start.  SspSM_Idle() looks at one
+peripheral per pass, so the task needs more passes while this is TRUE.
+
+Requires:
+  - 
+
+Promises:
+  - Returns TRUE if a peripheral has a queued message or read request and is not already transferring
+*/
+static bool SspTransferWaiting(void)
+{
+  SspPeripheralType* apsSsps[] = {&SSP_Peripheral0, &SSP_Peripheral1, &SSP_Peripheral2};
+
+  for(u8 i = 0; i < (sizeof(apsSsps) / sizeof(SspPeripheralType*)); i++)
+  {
+    if( ( (apsSsps[i]->psTransmitBuffer != NULL) || (apsSsps[i]->u16RxBytes != 0) ) &&
+       !(apsSsps[i]->u32PrivateFlags & (_SSP_PERIPHERAL_TX | _SSP_PERIPHERAL_RX)) )
+    {
+      return TRUE;
+    }
+  }
+
+  return FALSE;
+
+} /* end SspTransferWaiting() */
+
+
 
 /*----------------------------------------------------------------------------------------------------------------------
 Interrupt Service Routine: SSP0_IRQHandler
@@ -764,11 +920,12 @@ Requires:
   - A different SSP peripheral cannot interrupt this ISR
 
 Promises:
-  - Status of message that has completed transferring will be set to COMPLETE.
+  - Status of message that has completed transferring will be set to COMPLETE (after ENDTX, by SspTxComplete()
+    from PendSV_Handler() before the super loop runs again)
   - For Master peripherals, the CS line is cleared and the PDC is disabled
   - _SSP_PERIPHERAL_RX/TX is cleared
 */
-void SspGenericHandler(void)
+RAMFUNC void SspGenericHandler(void)
 {
   u32 u32Byte;
   u32 u32Timeout;
@@ -834,6 +991,7 @@ void SspGenericHandler(void)
       SSP_psCurrentISR->u32PrivateFlags &= ~_SSP_PERIPHERAL_TX;  
       UpdateMessageStatus(SSP_psCurrentISR->psTransmitBuffer->u32Token, COMPLETE);
       DeQueueMessage(&SSP_psCurrentISR->psTransmitBuffer);
+      SchedulerSignal(PROFILER_TASK_SSP);
  
       /* Re-enable Rx interrupt, clean-up the operation and make final call to callback */    
       SSP_psCurrentISR->pBaseAddress->US_IER = AT91C_US_RXRDY;
@@ -880,11 +1038,13 @@ void SspGenericHandler(void)
     if( (SSP_psCurrentISR->eSspMode == SPI_MASTER_AUTO_CS) ||
         (SSP_psCurrentISR->eSspMode == SPI_MASTER_MANUAL_CS) ) 
     {
-      /* Reset the byte counter and clear the RX flag */
+      /* Reset the byte counter and destination and clear the RX flag */
       SSP_psCurrentISR->u16RxBytes = 0;
+      SSP_psCurrentISR->pu8RxDestination = NULL;
       SSP_psCurrentISR->u32PrivateFlags &= ~_SSP_PERIPHERAL_RX;
       SSP_psCurrentISR->u32PrivateFlags |=  _SSP_PERIPHERAL_RX_COMPLETE;
       SSP_u32RxCounter++;
+      SchedulerSignal(PROFILER_TASK_SSP);
       
       /* Deassert CS for SPI_MASTER_AUTO_CS transfers */
       if(SSP_psCurrentSsp->eSspMode == SPI_MASTER_AUTO_CS)
@@ -895,6 +1055,8 @@ void SspGenericHandler(void)
       /* Disable the receiver and transmitter */
       SSP_psCurrentISR->pBaseAddress->US_PTCR = AT91C_PDC_RXTDIS | AT91C_PDC_TXTDIS;
       SSP_psCurrentISR->pBaseAddress->US_IDR  = AT91C_US_ENDRX;
+      SystemDeepSleepRelease(SSP_psCurrentISR->u8PeripheralId);
+      TRACE(TRACE_SSP_ENDRX, TRACE_INSTANCE_ARG(SSP_psCurrentISR->u8PeripheralId, 0));
     }
     /* Otherwise the peripheral is a Slave that just received a byte */
     /* ENDRX Interrupt when a byte has been received (RNCR is moved to RCR; RNPR is copied to RPR))*/
@@ -920,14 +1082,18 @@ void SspGenericHandler(void)
   if( (SSP_psCurrentISR->pBaseAddress->US_IMR & AT91C_US_ENDTX) && 
       (u32Current_CSR & AT91C_US_ENDTX) )
   {
-    /* Update this message token status and then DeQueue it */
-    UpdateMessageStatus(SSP_psCurrentISR->psTransmitBuffer->u32Token, COMPLETE);
-    DeQueueMessage( &SSP_psCurrentISR->psTransmitBuffer );
-    SSP_psCurrentISR->u32PrivateFlags &= ~_SSP_PERIPHERAL_TX;
-        
+    TRACE(TRACE_SSP_ENDTX, TRACE_INSTANCE_ARG(SSP_psCurrentISR->u8PeripheralId, SSP_psCurrentISR->psTransmitBuffer->u32Size));
+
     /* Disable the transmitter and interrupt source */
     SSP_psCurrentISR->pBaseAddress->US_PTCR = AT91C_PDC_TXTDIS;
     SSP_psCurrentISR->pBaseAddress->US_IDR  = AT91C_US_ENDTX;
+    SystemDeepSleepRelease(SSP_psCurrentISR->u8PeripheralId);
+
+    /* Update this message token status and then DeQueue it after the ISR (here if the queue is full) */
+    if( !DeferredPost(SspTxComplete, (u32)SSP_psCurrentISR) )
+    {
+      SspTxComplete((u32)SSP_psCurrentISR);
+    }
 
     /* Allow the peripheral to finish clocking out the Tx byte */
     u32Timeout = 0;
@@ -967,6 +1133,7 @@ void SspSM_Idle(void)
 {
  static u8 au8SspErrorInvalidSsp[] = "Invalid SSP attempt\r\n";
  u32 u32Byte;
+ u8* pu8RxTarget;
   
   /* Check all SPI/SSP peripherals for message activity or skip the current peripheral if it is already busy.
   Slave devices receive outside of the state machine.
@@ -990,12 +1157,22 @@ void SspSM_Idle(void)
       SSP_psCurrentSsp->u32PrivateFlags |= _SSP_PERIPHERAL_RX;    
       
       /* Clear the receive buffer so we can see (most) data changes but also so we send
-      predictable dummy bytes since we'll point to this buffer to source the transmit dummies */
-      memset(SSP_psCurrentSsp->pu8RxBuffer, SSP_DUMMY_BYTE, SSP_psCurrentSsp->u16RxBufferSize);
+      predictable dummy bytes since we'll point to this buffer to source the transmit dummies.
+      A client destination buffer is used the same way so the data lands there with no copy. */
+      if(SSP_psCurrentSsp->pu8RxDestination != NULL)
+      {
+        pu8RxTarget = SSP_psCurrentSsp->pu8RxDestination;
+        memset(pu8RxTarget, SSP_DUMMY_BYTE, SSP_psCurrentSsp->u16RxBytes);
+      }
+      else
+      {
+        pu8RxTarget = SSP_psCurrentSsp->pu8RxBuffer;
+        memset(pu8RxTarget, SSP_DUMMY_BYTE, SSP_psCurrentSsp->u16RxBufferSize);
+      }
 
       /* Load the PDC counter and pointer registers */
-      SSP_psCurrentSsp->pBaseAddress->US_RPR = (unsigned int)SSP_psCurrentSsp->pu8RxBuffer; 
-      SSP_psCurrentSsp->pBaseAddress->US_TPR = (unsigned int)SSP_psCurrentSsp->pu8RxBuffer; 
+      SSP_psCurrentSsp->pBaseAddress->US_RPR = (unsigned int)pu8RxTarget; 
+      SSP_psCurrentSsp->pBaseAddress->US_TPR = (unsigned int)pu8RxTarget; 
       SSP_psCurrentSsp->pBaseAddress->US_RCR = SSP_psCurrentSsp->u16RxBytes;
       SSP_psCurrentSsp->pBaseAddress->US_TCR = SSP_psCurrentSsp->u16RxBytes;
 
@@ -1003,6 +1180,8 @@ void SspSM_Idle(void)
       SSP_psCurrentSsp->pBaseAddress->US_IER = AT91C_US_ENDRX;
       
       /* Enable the receiver and transmitter to start the transfer */
+      TRACE(TRACE_SSP_RX_START, TRACE_INSTANCE_ARG(SSP_psCurrentSsp->u8PeripheralId, SSP_psCurrentSsp->u16RxBytes));
+      SystemDeepSleepVeto(SSP_psCurrentSsp->u8PeripheralId);
       SSP_psCurrentSsp->pBaseAddress->US_PTCR = AT91C_PDC_RXTEN | AT91C_PDC_TXTEN;
     } /* End of receive function */
     else
@@ -1049,6 +1228,8 @@ void SspSM_Idle(void)
         SSP_psCurrentSsp->pBaseAddress->US_IER = AT91C_US_ENDTX;
         
         /* Enable the transmitter to start the transfer */
+        TRACE(TRACE_SSP_TX_START, TRACE_INSTANCE_ARG(SSP_psCurrentSsp->u8PeripheralId, SSP_psCurrentSsp->psTransmitBuffer->u32Size));
+        SystemDeepSleepVeto(SSP_psCurrentSsp->u8PeripheralId);
         SSP_psCurrentSsp->pBaseAddress->US_PTCR = AT91C_PDC_TXTEN;
       }
     } /* End of transmitting function */
@@ -1071,7 +1252,7 @@ void SspSM_Idle(void)
       break;
 
     default:
-      DebugPrintf(au8SspErrorInvalidSsp);
+      LOG_ERROR(_DEBUG_LOG_SSP, "%s", au8SspErrorInvalidSsp);
       SSP_psCurrentSsp = &SSP_Peripheral0;
       break;
   } /* end switch */
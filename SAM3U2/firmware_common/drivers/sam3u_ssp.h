@@ -30,7 +30,7 @@ typedef struct
   u8* pu8RxBufferAddress;             /* Address to circular receive buffer */
   u8** ppu8RxNextByte;                /* Location of pointer to next byte to write in buffer for SPI_SLAVE_FLOW_CONTROL only */
   u16 u16RxBufferSize;                /* Size of receive buffer in bytes */
-  u16 u16Pad;                         /* Preserve 4-byte alignment */
+  u16 u16ClockDivider;                /* Baud rate generator CD value; 0 to use the peripheral's _US_BRGR_INIT */
 } SspConfigurationType;
 
 typedef struct 
@@ -45,6 +45,7 @@ typedef struct
   fnCode_type fnSlaveRxFlowCallback;  /* Callback function for SPI SLAVE receive that uses flow control */
   u8* pu8RxBuffer;                    /* Pointer to receive buffer in user application */
   u8** ppu8RxNextByte;                /* Pointer to buffer location where next received byte will be placed (SPI_SLAVE_FLOW_CONTROL only) */
+  u8* pu8RxDestination;               /* Client buffer for the current master receive; NULL to use pu8RxBuffer */
   u16 u16RxBufferSize;                /* Size of receive buffer in bytes */
   u16 u16RxBytes;                     /* Number of bytes to receive (DMA transfers) */
   u8 u8PeripheralId;                  /* Simple peripheral ID number */
@@ -82,6 +83,7 @@ Constants / Definitions
 
 #define SSP_DUMMY_BYTE                (u8)0x00          /* Byte to send for dummy */
 
+#define SSP_MIN_CLOCK_DIVIDER         (u16)6             /* Smallest baud rate CD allowed for a USART SPI master (SCK = MCK / 6) */
 #define SSP_TXEMPTY_TIMEOUT           (u32)100           /* Instruction cycles of a while loop that waits for a register to clear */
 
 
@@ -97,11 +99,13 @@ void SspRelease(SspPeripheralType* psSspPeripheral_);
 
 void SspAssertCS(SspPeripheralType* psSspPeripheral_);
 void SspDeAssertCS(SspPeripheralType* psSspPeripheral_);
+bool SspSetClockDivider(SspPeripheralType* psSspPeripheral_, u16 u16Divider_);
 
 u32 SspWriteByte(SspPeripheralType* psSspPeripheral_, u8 u8Byte_);
 u32 SspWriteData(SspPeripheralType* psSspPeripheral_, u32 u32Size_, u8* u8Data_);
 
 bool SspReadData(SspPeripheralType* psSspPeripheral_, u16 u16Size_);
+bool SspReadDataDirect(SspPeripheralType* psSspPeripheral_, u8* pu8Destination_, u16 u16Size_);
 bool SspReadByte(SspPeripheralType* psSspPeripheral_);
 SspRxStatusType SspQueryReceiveStatus(SspPeripheralType* psSspPeripheral_);
 
@@ -118,10 +122,13 @@ void SspManualMode(void);
 /*--------------------------------------------------------------------------------------------------------------------*/
 /* Private functions */
 /*--------------------------------------------------------------------------------------------------------------------*/
+static void SspTxComplete(u32 u32Peripheral_);
+static bool SspTransferWaiting(void);
+
 void SSP0_IRQHandler(void);
 void SSP1_IRQHandler(void);
 void SSP2_IRQHandler(void);
-void SspGenericHandler(void);
+RAMFUNC void SspGenericHandler(void);
 
 
 /***********************************************************************************************************************
@@ -82,6 +82,8 @@ extern volatile u32 G_u32SystemTime1ms;          /*!< @brief From main.c */
 extern volatile u32 G_u32SystemTime1s;           /*!< @brief From main.c */
 extern volatile u32 G_u32SystemFlags;            /*!< @brief From main.c */
 extern volatile u32 G_u32ApplicationFlags;       /*!< @brief From main.c */
+extern volatile u32 G_u32TraceFlags;             /*!< @brief From trace.c */
+extern u32 G_au32DebugLogMask[];                 /*!< @brief From debug.c */
 
 
 
@@ -94,6 +96,8 @@ static fnCode_type Uart_pfnStateMachine;         /*!< @brief The UART applicatio
 static u32 Uart_u32Timer;                        /*!< @brief Counter used across states */
 static u32 Uart_u32Flags;                        /*!< @brief Application flags for UART */
 static u8 Uart_u8ActiveUarts = 0;                /*!< @brief Counting semaphore for # of active UARTs */
+static volatile u32 Uart_u32SyncErrors;          /*!< @brief Times UartTxComplete() found Uart_u8ActiveUarts at 0 */
+static u32 Uart_u32SyncErrorsReported;           /*!< @brief Uart_u32SyncErrors when last reported */
 
 static UartPeripheralType Uart_sPeripheral;      /*!< @brief UART peripheral object */
 static UartPeripheralType Uart_sPeripheral0;     /*!< @brief USART0 peripheral object (used as UART) */
@@ -431,6 +435,8 @@ u32 UartWriteByte(UartPeripheralType* psUartPeripheral_, u8 u8Byte_)
   
   if( u32Token != NULL )
   {
+    SchedulerSignal(PROFILER_TASK_UART);
+
     /* If the system is initializing, we want to manually cycle the UART task through one iteration
     to send the message */
     if(G_u32SystemFlags & _SYSTEM_INITIALIZING)
@@ -476,6 +482,8 @@ u32 UartWriteData(UartPeripheralType* psUartPeripheral_, u32 u32Size_, u8* u8Dat
   u32Token = QueueMessage(&psUartPeripheral_->psTransmitBuffer, u32Size_, u8Data_);
   if(u32Token)
   {
+    SchedulerSignal(PROFILER_TASK_UART);
+
     /* If the system is initializing, manually cycle the UART task through one iteration to send the message */
     if(G_u32SystemFlags & _SYSTEM_INITIALIZING)
     {
@@ -511,6 +519,8 @@ Promises:
 void UartInitialize(void)
 {
   Uart_u32Flags = 0;
+  Uart_u32SyncErrors = 0;
+  Uart_u32SyncErrorsReported = 0;
 
 #ifdef USE_SIMPLE_USART0
   /* Setup USART0 for use as a basic debug port */
@@ -609,6 +619,9 @@ void UartInitialize(void)
 
   /* Set application pointer */
   Uart_pfnStateMachine = UartSM_Idle;
+
+  /* The write functions and UartTxComplete() signal the task; receiving is all done in the ISR */
+  SchedulerSetEventDriven(PROFILER_TASK_UART);
   
 } /* end UartInitialize() */
 
@@ -626,12 +639,29 @@ Requires:
 
 Promises:
 - Calls the function to pointed by the state machine function pointer
+- Reports an active UART counter error found by UartTxComplete() since the last call
+- The task stays scheduled while a peripheral has a queued message that has not started
 
 */
 void UartRunActiveState(void)
 {
+  u32 u32SyncErrors = Uart_u32SyncErrors;
+
+  /* UartTxComplete() runs in PendSV where it cannot queue a debug message, so it is reported here */
+  if(u32SyncErrors != Uart_u32SyncErrorsReported)
+  {
+    Uart_u32SyncErrorsReported = u32SyncErrors;
+    Uart_u32Flags |= _UART_NO_ACTIVE_UARTS;
+    LOG_ERROR(_DEBUG_LOG_UART, "\n\rUART counter out of sync\n\r");
+  }
+
   Uart_pfnStateMachine();
 
+  if( (Uart_pfnStateMachine != UartSM_Idle) || UartTxWaiting() )
+  {
+    SchedulerSignal(PROFILER_TASK_UART);
+  }
+
 } /* end UartRunActiveState */
 
 
@@ -669,6 +699,75 @@ static void UartManualMode(void)
 } /* end UartManualMode() */
 
 
+/*!----------------------------------------------------------------------------------------------------------------------
+@fn static void UartTxComplete(u32 u32Peripheral_)
+
+@brief Finishes a sent message: the part of ENDTX handling that UartGenericHandler() defers to PendSV_Handler().
+
+Requires:
+- The peripheral's transmitter and ENDTX interrupt are disabled
+@param u32Peripheral_ is the UartPeripheralType* of the UART that sent the message
+
+Promises:
+- The message is marked COMPLETE and dequeued
+- _UART_PERIPHERAL_TX is cleared and the task signalled so UartSM_Idle() can start the next message
+- Uart_u8ActiveUarts is decremented, or Uart_u32SyncErrors is counted for UartRunActiveState() to report
+
+*/
+static void UartTxComplete(u32 u32Peripheral_)
+{
+  UartPeripheralType* psUart = (UartPeripheralType*)u32Peripheral_;
+
+  UpdateMessageStatus(psUart->psTransmitBuffer->u32Token, COMPLETE);
+  DeQueueMessage( &psUart->psTransmitBuffer );
+  psUart->u32PrivateFlags &= ~_UART_PERIPHERAL_TX;
+  SchedulerSignal(PROFILER_TASK_UART);
+
+  /* Decrement # of active UARTs */
+  if(Uart_u8ActiveUarts != 0)
+  {
+    Uart_u8ActiveUarts--;
+  }
+  else
+  {
+    /* If Uart_u8ActiveUarts is already 0, then we are not properly synchronized */
+    Uart_u32SyncErrors++;
+  }
+
+} /* end UartTxComplete() */
+
+
+/*!----------------------------------------------------------------------------------------------------------------------
+@fn static bool UartTxWaiting(void)
+
+@brief Checks if any UART peripheral has a message that UartSM_Idle() has yet to start.
+
+UartSM_Idle() looks at one peripheral per pass, so the task needs more passes while this is TRUE.
+
+Requires:
+- NONE
+
+Promises:
+- Returns TRUE if a peripheral has a queued message and is not already transmitting
+
+*/
+static bool UartTxWaiting(void)
+{
+  UartPeripheralType* apsUarts[] = {&Uart_sPeripheral, &Uart_sPeripheral0, &Uart_sPeripheral1, &Uart_sPeripheral2};
+
+  for(u8 i = 0; i < (sizeof(apsUarts) / sizeof(UartPeripheralType*)); i++)
+  {
+    if( (apsUarts[i]->psTransmitBuffer != NULL) && !(apsUarts[i]->u32PrivateFlags & _UART_PERIPHERAL_TX) )
+    {
+      return TRUE;
+    }
+  }
+
+  return FALSE;
+
+} /* end UartTxWaiting() */
+
+
 #ifdef USE_SIMPLE_USART0
 /*----------------------------------------------------------------------------------------------------------------------
 Interrupt Service Routine: UART0_IRQHandler
@@ -849,10 +948,10 @@ and to manage dummy bytes.  All data reception is done with DMA, but only 1 byte
 the two reception pointers to ensure no data is missed.
 
 Transmit: All data bytes in the transmit buffer are sent using DMA and interrupts. Once the full message has been sent,
-the message status is updated.
+the transmitter is stopped here and UartTxComplete() is posted to run after the ISR to update the message status.
 
 */
-void UartGenericHandler(void)
+RAMFUNC void UartGenericHandler(void)
 {
   /* ENDRX Interrupt when a byte has been received (RNCR is moved to RCR; RNPR is copied to RPR) */
   if( (Uart_psCurrentISR->pBaseAddress->US_IMR & AT91C_US_ENDRX) && 
@@ -881,25 +980,17 @@ void UartGenericHandler(void)
   if( (Uart_psCurrentISR->pBaseAddress->US_IMR & AT91C_US_ENDTX) && 
       (Uart_psCurrentISR->pBaseAddress->US_CSR & AT91C_US_ENDTX) )
   {
-    /* Update this message's token status and then DeQueue it */
-    UpdateMessageStatus(Uart_psCurrentISR->psTransmitBuffer->u32Token, COMPLETE);
-    DeQueueMessage( &Uart_psCurrentISR->psTransmitBuffer );
-    Uart_psCurrentISR->u32PrivateFlags &= ~_UART_PERIPHERAL_TX;
-        
+    TRACE(TRACE_UART_ENDTX, TRACE_INSTANCE_ARG(Uart_psCurrentISR->u8PeripheralId, Uart_psCurrentISR->psTransmitBuffer->u32Size));
+
     /* Disable the transmitter and interrupt source */
     Uart_psCurrentISR->pBaseAddress->US_PTCR = AT91C_PDC_TXTDIS;
     Uart_psCurrentISR->pBaseAddress->US_IDR  = AT91C_US_ENDTX;
+    SystemDeepSleepRelease(Uart_psCurrentISR->u8PeripheralId);
     
-    /* Decrement # of active UARTs */
-    if(Uart_u8ActiveUarts != 0)
-    {
-      Uart_u8ActiveUarts--;
-    }
-    else
+    /* Update this message's token status and then DeQueue it after the ISR (here if the queue is full) */
+    if( !DeferredPost(UartTxComplete, (u32)Uart_psCurrentISR) )
     {
-      /* If Uart_u8ActiveUarts is already 0, then we are not properly synchronized */
-      DebugPrintf("\n\rUART counter out of sync\n\r");
-      Uart_u32Flags |= _UART_NO_ACTIVE_UARTS;
+      UartTxComplete((u32)Uart_psCurrentISR);
     }
     
   } /* end of ENDTX interrupt processing */
@@ -978,9 +1069,11 @@ void UartSM_Idle(void)
     if(Uart_u8ActiveUarts > U8_MAX_NUM_UARTS)
     {
       /* Alert that the number of actual UARTs has been exceeded */
-      DebugPrintf("\n\rToo many UARTs!\n\r");
+      LOG_ERROR(_DEBUG_LOG_UART, "\n\rToo many UARTs!\n\r");
       Uart_u32Flags |= _UART_TOO_MANY_UARTS;
     }
+    TRACE(TRACE_UART_TX_START, TRACE_INSTANCE_ARG(Uart_psCurrentUart->u8PeripheralId, Uart_psCurrentUart->psTransmitBuffer->u32Size));
+    SystemDeepSleepVeto(Uart_psCurrentUart->u8PeripheralId);
     Uart_psCurrentUart->pBaseAddress->US_PTCR = AT91C_PDC_TXTEN;
   }
   
@@ -109,6 +109,8 @@ void UartInitialize(void);
 void UartRunActiveState(void);
 
 static void UartManualMode(void);
+static void UartTxComplete(u32 u32Peripheral_);
+static bool UartTxWaiting(void);
 
 
 /*--------------------------------------------------------------------------------------------------------------------*/
@@ -121,7 +123,7 @@ void UART_IRQHandler(void);
 void UART0_IRQHandler(void);
 void UART1_IRQHandler(void);
 void UART2_IRQHandler(void);
-void UartGenericHandler(void);
+RAMFUNC void UartGenericHandler(void);
 
 
 /***********************************************************************************************************************
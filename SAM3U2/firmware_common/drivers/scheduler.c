@@ -0,0 +1,392 @@
+/*!*********************************************************************************************************************
+@file scheduler.c
+@brief Event-driven selection of the super loop tasks.
+
+Every task in main.c is called through SCHEDULER_RUN() with its ProfilerTaskType as its id.  A task is either
+polled, which is how every task starts and runs every pass exactly as before, or event-driven, which it selects
+in its Initialize function with SchedulerSetEventDriven().  An event-driven task runs only in a pass after
+something called SchedulerSignal() for it: an ISR that has data for it, another task that queued it work, or the
+task itself when its state machine is not finished and needs the next pass too.
+
+SchedulerLoopStart() takes the pending events for the pass in one step, so a signal from an ISR while the tasks
+are running is kept for the next pass rather than lost.  A skipped task costs one bit test, so a pass where the
+drivers are idle reaches SystemSleep() sooner.
+
+A task waiting on a timeout instead of an event uses SchedulerSignalAt() so it is signalled once that time has
+come.  Since those times and the pending events are all the scheduler needs to know, SchedulerIdleTime() can tell
+SystemSleep() how many ticks may pass with nothing to run, which is what tickless idle (TICKLESS_IDLE) uses.
+A single polled task needs every tick, so every driver task selects event-driven in its Initialize function,
+including when it fails and goes to its Error state.  The user app templates stay polled so that code added to
+their states runs as written; tickless idle only engages once every user app in the loop has opted in as its
+Initialize function describes.
+
+The state machines themselves are unchanged.  A typical event-driven task re-signals itself from its
+RunActiveState function whenever its state machine has left Idle:
+
+void TaskRunActiveState(void)
+{
+  Task_pfnStateMachine();
+  if(Task_pfnStateMachine != TaskSM_Idle)
+  {
+    SchedulerSignal(PROFILER_TASK_TASK);
+  }
+}
+
+Each task also has a SchedulerPriorityType in Scheduler_aePriority, which tells what happens when a pass runs
+late, e.g. because a user app took most of the 1ms.  With TASK_DEADLINES defined, SCHEDULER_RUN() checks the time
+since the start of the pass before calling a task that is not CRITICAL: past SCHEDULER_NORMAL_DEADLINE (or
+SCHEDULER_BACKGROUND_DEADLINE) the task is signalled for the next pass instead, so the time left goes to the
+CRITICAL drivers.  main.c calls the CRITICAL tasks first, then NORMAL, then BACKGROUND, so a slow task only delays
+tasks of its own priority or lower.  The run order is the order of the calls in main.c, so the priorities are fixed
+with it: a task that changes priority moves both its entry in Scheduler_aePriority and its SCHEDULER_RUN() line.
+A task deferred in one pass runs in the next whatever the time, so it is never held off for more than one pass.
+The profiler counts deferrals per task ("profile" DEFER column).
+
+Without EVENT_SCHEDULER defined in configuration.h, SCHEDULER_RUN() calls every task every pass.
+
+------------------------------------------------------------------------------------------------------------------------
+GLOBALS
+- G_u32SchedulerEvents
+- G_u32SchedulerReady
+
+CONSTANTS
+- SCHEDULER_NORMAL_DEADLINE
+- SCHEDULER_BACKGROUND_DEADLINE
+
+TYPES
+- SchedulerPriorityType
+
+PUBLIC FUNCTIONS
+- void SchedulerSignal(ProfilerTaskType eTask_)
+- void SchedulerSignalAt(ProfilerTaskType eTask_, u32 u32Time_)
+- void SchedulerSetEventDriven(ProfilerTaskType eTask_)
+
+PROTECTED FUNCTIONS
+- void SchedulerInitialize(void)
+- void SchedulerLoopStart(void)
+- u32 SchedulerIdleTime(u32 u32MaxMs_)
+- bool SchedulerBeforeDeadline(ProfilerTaskType eTask_)
+
+**********************************************************************************************************************/
+
+#include "configuration.h"
+
+/***********************************************************************************************************************
+Global variable definitions with scope across entire project.
+All Global variable names shall start with "G_xxScheduler"
+***********************************************************************************************************************/
+/* New variables */
+volatile u32 G_u32SchedulerEvents;                     /*!< @brief Tasks signalled since the start of the current pass */
+u32 G_u32SchedulerReady = SCHEDULER_ALL_TASKS;         /*!< @brief Tasks that run in the current pass (SCHEDULER_RUN) */
+
+
+/*--------------------------------------------------------------------------------------------------------------------*/
+/* Existing variables (defined in other files -- should all contain the "extern" keyword) */
+extern volatile u32 G_u32SystemTime1ms;                /*!< @brief From main.c */
+extern volatile u32 G_u32SystemTime1s;                 /*!< @brief From main.c */
+extern volatile u32 G_u32SystemFlags;                  /*!< @brief From main.c */
+extern volatile u32 G_u32ApplicationFlags;             /*!< @brief From main.c */
+
+
+/***********************************************************************************************************************
+Global variable definitions with scope limited to this local application.
+Variable names shall start with "Scheduler_xx" and be declared as static.
+***********************************************************************************************************************/
+static u32 Scheduler_u32Polled = SCHEDULER_ALL_TASKS;  /*!< @brief Tasks that run every pass */
+static u32 Scheduler_u32Timed;                         /*!< @brief Tasks with a time set by SchedulerSignalAt() */
+static u32 Scheduler_au32SignalTime[PROFILER_TASKS];   /*!< @brief G_u32SystemTime1ms to signal each timed task */
+
+static u32 Scheduler_u32PassStart;                     /*!< @brief DWT_CYCCNT at the start of the pass */
+static u32 Scheduler_u32Deferred;                      /*!< @brief Tasks deferred in the current pass */
+static u32 Scheduler_u32Overdue;                       /*!< @brief Tasks deferred in the last pass; they run regardless */
+
+/*! @brief Pass time in cycles after which tasks of each priority are deferred */
+static u32 Scheduler_au32Deadline[SCHEDULER_PRIORITIES] =
+{0xFFFFFFFF, SCHEDULER_NORMAL_DEADLINE, SCHEDULER_BACKGROUND_DEADLINE};
+
+/*! @brief Priority of each task in the order of ProfilerTaskType; must match the groups main.c calls them in */
+static const SchedulerPriorityType Scheduler_aePriority[PROFILER_TASKS] =
+{
+  SCHEDULER_PRIORITY_NORMAL,       /* LED */
+  SCHEDULER_PRIORITY_NORMAL,       /* BUTTON */
+  SCHEDULER_PRIORITY_CRITICAL,     /* UART */
+  SCHEDULER_PRIORITY_CRITICAL,     /* TIMER */
+  SCHEDULER_PRIORITY_CRITICAL,     /* SOFTTIMER */
+  SCHEDULER_PRIORITY_CRITICAL,     /* SSP */
+  SCHEDULER_PRIORITY_CRITICAL,     /* TWI */
+  SCHEDULER_PRIORITY_NORMAL,       /* ADC */
+  SCHEDULER_PRIORITY_CRITICAL,     /* MESSAGING */
+  SCHEDULER_PRIORITY_NORMAL,       /* DEBUG */
+  SCHEDULER_PRIORITY_BACKGROUND,   /* TOKENLOG */
+  SCHEDULER_PRIORITY_BACKGROUND,   /* TRACE */
+  SCHEDULER_PRIORITY_BACKGROUND,   /* LCD */
+#ifdef EIE1
+  SCHEDULER_PRIORITY_NORMAL,       /* SDCARD */
+  SCHEDULER_PRIORITY_BACKGROUND,   /* FATLOG */
+  SCHEDULER_PRIORITY_BACKGROUND,   /* RAWLOG */
+#endif /* EIE1 */
+  SCHEDULER_PRIORITY_NORMAL,       /* USERAPP1 */
+  SCHEDULER_PRIORITY_NORMAL,       /* USERAPP2 */
+  SCHEDULER_PRIORITY_NORMAL        /* USERAPP3 */
+};
+
+
+/**********************************************************************************************************************
+Function Definitions
+**********************************************************************************************************************/
+
+/*--------------------------------------------------------------------------------------------------------------------*/
+/*! @publicsection */
+/*--------------------------------------------------------------------------------------------------------------------*/
+
+/*!----------------------------------------------------------------------------------------------------------------------
+@fn void SchedulerSignal(ProfilerTaskType eTask_)
+
+@brief Makes a task ready to run in the next pass of the super loop.
+
+Safe to call from ISRs and from code that already has interrupts disabled: the interrupt mask is restored
+rather than re-enabled.  Signalling a polled task has no effect.
+
+Requires:
+@param eTask_ is the task to run
+
+Promises:
+- The task's bit is set in G_u32SchedulerEvents
+
+*/
+void SchedulerSignal(ProfilerTaskType eTask_)
+{
+  u32 u32Primask = __get_PRIMASK();
+
+  __disable_irq();
+  G_u32SchedulerEvents |= SCHEDULER_TASK_BIT(eTask_);
+  __set_PRIMASK(u32Primask);
+
+} /* end SchedulerSignal() */
+
+
+/*!----------------------------------------------------------------------------------------------------------------------
+@fn void SchedulerSignalAt(ProfilerTaskType eTask_, u32 u32Time_)
+
+@brief Signals a task once G_u32SystemTime1ms reaches a given time.
+
+For timeouts and periodic work in event-driven tasks.  Each task has one time; a new call replaces it.  
+Call from task context only.
+
+Example:
+SchedulerSignalAt(PROFILER_TASK_BUTTON, G_u32SystemTime1ms + BUTTON_DEBOUNCE_TIME);
+
+Requires:
+@param eTask_ is the task to run
+@param u32Time_ is the G_u32SystemTime1ms value at which to run it, less than 2^31 ms from now
+
+Promises:
+- The task is signalled by the first SchedulerLoopStart() at or after u32Time_
+
+*/
+void SchedulerSignalAt(ProfilerTaskType eTask_, u32 u32Time_)
+{
+  Scheduler_au32SignalTime[eTask_] = u32Time_;
+  Scheduler_u32Timed |= SCHEDULER_TASK_BIT(eTask_);
+
+} /* end SchedulerSignalAt() */
+
+
+/*!----------------------------------------------------------------------------------------------------------------------
+@fn void SchedulerSetEventDriven(ProfilerTaskType eTask_)
+
+@brief Stops calling a task every pass; it runs only after SchedulerSignal().
+
+Call from the task's Initialize function.
+
+Requires:
+@param eTask_ is the calling task
+
+Promises:
+- The task is no longer polled
+- The task is signalled once so its state machine gets a first pass
+
+*/
+void SchedulerSetEventDriven(ProfilerTaskType eTask_)
+{
+#ifdef EVENT_SCHEDULER
+  Scheduler_u32Polled &= ~SCHEDULER_TASK_BIT(eTask_);
+  SchedulerSignal(eTask_);
+#endif /* EVENT_SCHEDULER */
+
+} /* end SchedulerSetEventDriven() */
+
+
+/*--------------------------------------------------------------------------------------------------------------------*/
+/*! @protectedsection */
+/*--------------------------------------------------------------------------------------------------------------------*/
+
+/*!----------------------------------------------------------------------------------------------------------------------
+@fn void SchedulerInitialize(void)
+
+@brief Starts with every task polled.
+
+Requires:
+- Called before any task's Initialize function
+
+Promises:
+- All tasks are polled and no events are pending
+
+*/
+void SchedulerInitialize(void)
+{
+  Scheduler_u32Polled = SCHEDULER_ALL_TASKS;
+  Scheduler_u32Timed = 0;
+  G_u32SchedulerEvents = 0;
+  G_u32SchedulerReady = SCHEDULER_ALL_TASKS;
+
+} /* end SchedulerInitialize() */
+
+
+/*!----------------------------------------------------------------------------------------------------------------------
+@fn void SchedulerLoopStart(void)
+
+@brief Selects the tasks that run in this pass.
+
+Requires:
+- Called once at the start of each super loop pass, before the first SCHEDULER_RUN()
+
+Promises:
+- Timed tasks whose time has come are signalled
+- G_u32SchedulerReady holds the polled tasks and those signalled since the last call
+- G_u32SchedulerEvents is cleared
+- The pass deadlines are measured from now and tasks deferred in the last pass are overdue
+
+*/
+void SchedulerLoopStart(void)
+{
+#ifdef EVENT_SCHEDULER
+  u32 u32Timed = Scheduler_u32Timed;
+  u8 u8Task;
+
+  /* Usually no task is waiting on a time, so this costs one test */
+  for(u8Task = 0; u32Timed != 0; u8Task++, u32Timed >>= 1)
+  {
+    if( (u32Timed & 1) && ((s32)(G_u32SystemTime1ms - Scheduler_au32SignalTime[u8Task]) >= 0) )
+    {
+      Scheduler_u32Timed &= ~SCHEDULER_TASK_BIT(u8Task);
+      SchedulerSignal((ProfilerTaskType)u8Task);
+    }
+  }
+
+  __disable_irq();
+  G_u32SchedulerReady = G_u32SchedulerEvents | Scheduler_u32Polled;
+  G_u32SchedulerEvents = 0;
+  __enable_irq();
+
+#ifdef TASK_DEADLINES
+  Scheduler_u32Overdue = Scheduler_u32Deferred;
+  Scheduler_u32Deferred = 0;
+  Scheduler_u32PassStart = DWT_CYCCNT;
+#endif /* TASK_DEADLINES */
+#endif /* EVENT_SCHEDULER */
+
+} /* end SchedulerLoopStart() */
+
+
+/*!----------------------------------------------------------------------------------------------------------------------
+@fn u32 SchedulerIdleTime(u32 u32MaxMs_)
+
+@brief Returns how many 1ms ticks may pass before any task needs to run.
+
+Requires:
+- Called from SystemSleep() at the end of a pass with interrupts disabled so a new event cannot be missed
+@param u32MaxMs_ is the longest time the caller can sleep
+
+Promises:
+- Returns 1 if any task is polled or already signalled, i.e. the next tick is needed
+- Otherwise returns the time until the earliest SchedulerSignalAt() time, up to u32MaxMs_
+
+*/
+u32 SchedulerIdleTime(u32 u32MaxMs_)
+{
+#ifdef EVENT_SCHEDULER
+  u32 u32Timed = Scheduler_u32Timed;
+  u32 u32IdleMs = u32MaxMs_;
+  s32 s32Remaining;
+  u8 u8Task;
+
+  if(Scheduler_u32Polled || G_u32SchedulerEvents)
+  {
+    return 1;
+  }
+
+  for(u8Task = 0; u32Timed != 0; u8Task++, u32Timed >>= 1)
+  {
+    if( !(u32Timed & 1) )
+    {
+      continue;
+    }
+
+    s32Remaining = (s32)(Scheduler_au32SignalTime[u8Task] - G_u32SystemTime1ms);
+    if(s32Remaining <= 1)
+    {
+      return 1;
+    }
+
+    if((u32)s32Remaining < u32IdleMs)
+    {
+      u32IdleMs = (u32)s32Remaining;
+    }
+  }
+
+  return u32IdleMs;
+#else
+  return 1;
+#endif /* EVENT_SCHEDULER */
+
+} /* end SchedulerIdleTime() */
+
+
+/*!----------------------------------------------------------------------------------------------------------------------
+@fn bool SchedulerBeforeDeadline(ProfilerTaskType eTask_)
+
+@brief Decides if a ready task still has time to run in this pass.  Called by SCHEDULER_RUN().
+
+Requires:
+- SchedulerLoopStart() was called at the start of the pass
+@param eTask_ is the task about to be called
+
+Promises:
+- Returns TRUE if eTask_ is CRITICAL, was deferred in the last pass or the pass is within its deadline
+- Otherwise returns FALSE, signals eTask_ for the next pass and counts the deferral with the profiler
+
+*/
+bool SchedulerBeforeDeadline(ProfilerTaskType eTask_)
+{
+  u32 u32TaskBit = SCHEDULER_TASK_BIT(eTask_);
+
+  if( (Scheduler_u32Overdue & u32TaskBit) ||
+      ((DWT_CYCCNT - Scheduler_u32PassStart) < Scheduler_au32Deadline[Scheduler_aePriority[eTask_]]) )
+  {
+    return TRUE;
+  }
+
+  /* Out of time: run it at the next pass instead.  The first deferral of a pass counts the pass. */
+  if(Scheduler_u32Deferred == 0)
+  {
+    ProfilerDeferred(PROFILER_LOOP);
+  }
+
+  Scheduler_u32Deferred |= u32TaskBit;
+  SchedulerSignal(eTask_);
+  ProfilerDeferred(eTask_);
+
+  return FALSE;
+
+} /* end SchedulerBeforeDeadline() */
+
+
+/*--------------------------------------------------------------------------------------------------------------------*/
+/*! @privatesection */
+/*--------------------------------------------------------------------------------------------------------------------*/
+
+
+/*--------------------------------------------------------------------------------------------------------------------*/
+/* End of File                                                                                                        */
+/*--------------------------------------------------------------------------------------------------------------------*/
@@ -0,0 +1,83 @@
+/*!*********************************************************************************************************************
+@file scheduler.h
+@brief Header file for scheduler.c
+
+**********************************************************************************************************************/
+
+#ifndef __SCHEDULER_H
+#define __SCHEDULER_H
+
+/**********************************************************************************************************************
+Type Definitions
+**********************************************************************************************************************/
+/*!
+@enum SchedulerPriorityType
+@brief How a task is treated when a loop pass runs out of time.
+
+CRITICAL tasks always run; the others wait for the next pass once the pass has used up their deadline.
+Each task's priority is fixed in Scheduler_aePriority and matches where main.c calls it.
+*/
+typedef enum {SCHEDULER_PRIORITY_CRITICAL = 0, SCHEDULER_PRIORITY_NORMAL, SCHEDULER_PRIORITY_BACKGROUND,
+              SCHEDULER_PRIORITIES} SchedulerPriorityType;
+
+
+/**********************************************************************************************************************
+Constants / Definitions
+**********************************************************************************************************************/
+#define SCHEDULER_TASK_BIT(eTask_)      ((u32)1 << (eTask_))                 /*!< @brief Event bit of a ProfilerTaskType */
+#define SCHEDULER_ALL_TASKS             (u32)(SCHEDULER_TASK_BIT(PROFILER_TASKS) - 1) /*!< @brief Every task's bit */
+
+#define SCHEDULER_NORMAL_DEADLINE       (u32)(PROFILER_CYCLES_PER_MS * 4 / 5) /*!< @brief Pass time after which NORMAL tasks are deferred */
+#define SCHEDULER_BACKGROUND_DEADLINE   (u32)(PROFILER_CYCLES_PER_MS / 2)     /*!< @brief Pass time after which BACKGROUND tasks are deferred */
+
+/*!
+@brief Runs Call_ (profiled) if task eTask_ is polled or was signalled since its last run.
+
+Example:
+SCHEDULER_RUN(PROFILER_TASK_TIMER, TimerRunActiveState());
+
+With TASK_DEADLINES defined a task that is not CRITICAL is also skipped (and signalled for the next pass) when the
+pass has already run past its deadline.  Without EVENT_SCHEDULER defined every task runs every pass as before.
+*/
+#if defined(EVENT_SCHEDULER) && defined(TASK_DEADLINES)
+#define SCHEDULER_RUN(eTask_, Call_)    do { if( (G_u32SchedulerReady & SCHEDULER_TASK_BIT(eTask_)) && SchedulerBeforeDeadline(eTask_) ) \
+                                             { PROFILER_RUN((eTask_), Call_); } } while(0)
+#elif defined(EVENT_SCHEDULER)
+#define SCHEDULER_RUN(eTask_, Call_)    do { if(G_u32SchedulerReady & SCHEDULER_TASK_BIT(eTask_)) { PROFILER_RUN((eTask_), Call_); } } while(0)
+#else
+#define SCHEDULER_RUN(eTask_, Call_)    do { PROFILER_RUN((eTask_), Call_); } while(0)
+#endif /* EVENT_SCHEDULER */
+
+
+/**********************************************************************************************************************
+Function Declarations
+**********************************************************************************************************************/
+
+/*------------------------------------------------------------------------------------------------------------------*/
+/*! @publicsection */
+/*--------------------------------------------------------------------------------------------------------------------*/
+void SchedulerSignal(ProfilerTaskType eTask_);
+void SchedulerSignalAt(ProfilerTaskType eTask_, u32 u32Time_);
+void SchedulerSetEventDriven(ProfilerTaskType eTask_);
+
+
+/*------------------------------------------------------------------------------------------------------------------*/
+/*! @protectedsection */
+/*--------------------------------------------------------------------------------------------------------------------*/
+void SchedulerInitialize(void);
+void SchedulerLoopStart(void);
+u32 SchedulerIdleTime(u32 u32MaxMs_);
+bool SchedulerBeforeDeadline(ProfilerTaskType eTask_);
+
+
+/*------------------------------------------------------------------------------------------------------------------*/
+/*! @privatesection */
+/*--------------------------------------------------------------------------------------------------------------------*/
+
+
+#endif /* __SCHEDULER_H */
+
+
+/*--------------------------------------------------------------------------------------------------------------------*/
+/* End of File                                                                                                        */
+/*--------------------------------------------------------------------------------------------------------------------*/
@@ -0,0 +1,514 @@
+/*!*********************************************************************************************************************
+@file softtimer.c
+@brief Software timers on a hierarchical timing wheel driven by the 1ms system tick.
+
+A task that needs a timeout starts a SoftTimerType instead of saving G_u32SystemTime1ms and calling IsTimeUp() every
+pass.  When the timer expires its bExpired flag is set (read with SoftTimerExpired()) and its callback, if any, is
+called from SoftTimerRunActiveState().  An event-driven task usually passes a callback that calls SchedulerSignal()
+for itself so it only runs when the time is up.  Timers are one-shot or periodic and may be started, restarted or
+stopped at any time from task context; none of these functions may be called from an ISR.
+
+The timers are kept on SOFTTIMER_LEVELS wheels of SOFTTIMER_SLOTS slots.  Wheel 0 has one slot per ms, and each
+wheel above it has slots SOFTTIMER_SLOTS times longer, so the four 32-slot wheels cover about 17 minutes (longer
+timers are parked on the top wheel and moved down when they get closer).  A timer goes into the slot of the wheel
+that covers its remaining time, and each time wheel 0 wraps, the next slot of the wheel above is emptied onto the
+wheels below.  Starting and stopping are O(1) list operations.  Each tick only looks at one wheel 0 slot, and ticks
+with nothing in wheel 0 are skipped up to the next wrap, so the cost does not grow with the number of timers.
+
+The task is event-driven: it asks the scheduler to signal it at the next tick that has anything to do (at least
+once per wheel 0 wrap while any timer runs), so with no timers running it costs nothing.
+
+------------------------------------------------------------------------------------------------------------------------
+GLOBALS
+- NONE
+
+CONSTANTS
+- SOFTTIMER_LEVELS
+- SOFTTIMER_SLOT_BITS
+
+TYPES
+- SoftTimerType
+
+PUBLIC FUNCTIONS
+- void SoftTimerStart(SoftTimerType* psTimer_, u32 u32DelayMs_, u32 u32PeriodMs_, fnCode_type pfnCallback_)
+- void SoftTimerStop(SoftTimerType* psTimer_)
+- bool SoftTimerExpired(SoftTimerType* psTimer_)
+- bool SoftTimerIsRunning(SoftTimerType* psTimer_)
+
+PROTECTED FUNCTIONS
+- void SoftTimerInitialize(void)
+- void SoftTimerRunActiveState(void)
+
+**********************************************************************************************************************/
+
+#include "configuration.h"
+
+/***********************************************************************************************************************
+Global variable definitions with scope across entire project.
+All Global variable names shall start with "G_xxSoftTimer"
+***********************************************************************************************************************/
+/* New variables */
+
+
+/*--------------------------------------------------------------------------------------------------------------------*/
+/* Existing variables (defined in other files -- should all contain the "extern" keyword) */
+extern volatile u32 G_u32SystemTime1ms;                /*!< @brief From main.c */
+extern volatile u32 G_u32SystemTime1s;                 /*!< @brief From main.c */
+extern volatile u32 G_u32SystemFlags;                  /*!< @brief From main.c */
+extern volatile u32 G_u32ApplicationFlags;             /*!< @brief From main.c */
+
+
+/***********************************************************************************************************************
+Global variable definitions with scope limited to this local application.
+Variable names shall start with "SoftTimer_xx" and be declared as static.
+***********************************************************************************************************************/
+static SoftTimerType* SoftTimer_apsWheel[SOFTTIMER_LEVELS][SOFTTIMER_SLOTS]; /*!< @brief First timer in each slot */
+static u32 SoftTimer_au32Occupied[SOFTTIMER_LEVELS];  /*!< @brief One bit per non-empty slot of each wheel */
+static u32 SoftTimer_u32Time;                          /*!< @brief Next tick to process; every earlier tick is done */
+static u32 SoftTimer_u32Running;                       /*!< @brief Number of timers in the wheels */
+
+
+/**********************************************************************************************************************
+Function Definitions
+**********************************************************************************************************************/
+
+/*--------------------------------------------------------------------------------------------------------------------*/
+/*! @publicsection */
+/*--------------------------------------------------------------------------------------------------------------------*/
+
+/*!----------------------------------------------------------------------------------------------------------------------
+@fn void SoftTimerStart(SoftTimerType* psTimer_, u32 u32DelayMs_, u32 u32PeriodMs_, fnCode_type pfnCallback_)
+
+@brief Starts (or restarts) a timer.
+
+A running timer is stopped first, so this is also how a timeout is pushed back.  The callback
+runs in task context from SoftTimerRunActiveState().
+
+Example:
+static SoftTimerType UserApp1_sBlinkTimer;
+
+SoftTimerStart(&UserApp1_sBlinkTimer, 500, 500, NULL);
+...
+if( SoftTimerExpired(&UserApp1_sBlinkTimer) )
+{
+  LedToggle(RED);
+}
+
+Requires:
+- Called from task context, not from an ISR
+@param psTimer_ points to the caller's timer, which must stay valid while it runs
+@param u32DelayMs_ is the time in ms until the first expiry
+@param u32PeriodMs_ is the time in ms between expiries after the first, or 0 for a one-shot timer
+@param pfnCallback_ is called on each expiry, or NULL for none
+
+Promises:
+- The timer is running and its bExpired flag is clear
+- The timer task is signalled so it can plan for the new timer
+
+*/
+void SoftTimerStart(SoftTimerType* psTimer_, u32 u32DelayMs_, u32 u32PeriodMs_, fnCode_type pfnCallback_)
+{
+  SoftTimerStop(psTimer_);
+
+  /* With the wheels empty their time may be old, so bring it up to the present */
+  if( (SoftTimer_u32Running == 0) && ((s32)(G_u32SystemTime1ms - SoftTimer_u32Time) > 0) )
+  {
+    SoftTimer_u32Time = G_u32SystemTime1ms;
+  }
+
+  psTimer_->u32Expiry   = G_u32SystemTime1ms + u32DelayMs_;
+  psTimer_->u32Period   = u32PeriodMs_;
+  psTimer_->pfnCallback = pfnCallback_;
+  psTimer_->bRunning    = TRUE;
+  SoftTimer_u32Running++;
+  SoftTimerInsert(psTimer_);
+
+  SchedulerSignal(PROFILER_TASK_SOFTTIMER);
+
+} /* end SoftTimerStart() */
+
+
+/*!----------------------------------------------------------------------------------------------------------------------
+@fn void SoftTimerStop(SoftTimerType* psTimer_)
+
+@brief Stops a timer.  Stopping a timer that is not running has no effect.
+
+Requires:
+- Called from task context, not from an ISR
+@param psTimer_ points to the timer
+
+Promises:
+- The timer is not running and its bExpired flag is clear
+
+*/
+void SoftTimerStop(SoftTimerType* psTimer_)
+{
+  if(psTimer_->bRunning)
+  {
+    SoftTimerUnlink(psTimer_);
+    psTimer_->bRunning = FALSE;
+    SoftTimer_u32Running--;
+  }
+
+  psTimer_->bExpired = FALSE;
+
+} /* end SoftTimerStop() */
+
+
+/*!----------------------------------------------------------------------------------------------------------------------
+@fn bool SoftTimerExpired(SoftTimerType* psTimer_)
+
+@brief Returns and clears the timer's expired flag.
+
+Requires:
+@param psTimer_ points to the timer
+
+Promises:
+- Returns TRUE if the timer has expired since the last call (several expiries read as one)
+- The bExpired flag is clear
+
+*/
+bool SoftTimerExpired(SoftTimerType* psTimer_)
+{
+  if(psTimer_->bExpired)
+  {
+    psTimer_->bExpired = FALSE;
+    return TRUE;
+  }
+
+  return FALSE;
+
+} /* end SoftTimerExpired() */
+
+
+/*!----------------------------------------------------------------------------------------------------------------------
+@fn bool SoftTimerIsRunning(SoftTimerType* psTimer_)
+
+@brief Checks if a timer is running.
+
+Requires:
+@param psTimer_ points to the timer
+
+Promises:
+- Returns TRUE from SoftTimerStart() until a one-shot timer expires or the timer is stopped
+
+*/
+bool SoftTimerIsRunning(SoftTimerType* psTimer_)
+{
+  return psTimer_->bRunning;
+
+} /* end SoftTimerIsRunning() */
+
+
+/*--------------------------------------------------------------------------------------------------------------------*/
+/*! @protectedsection */
+/*--------------------------------------------------------------------------------------------------------------------*/
+
+/*!----------------------------------------------------------------------------------------------------------------------
+@fn void SoftTimerInitialize(void)
+
+@brief Empties the wheels.
+
+Requires:
+- SchedulerInitialize() has run
+- Called before any driver that starts a timer in its Initialize function
+
+Promises:
+- No timer is running
+- The task is event-driven
+
+*/
+void SoftTimerInitialize(void)
+{
+  for(u8 i = 0; i < SOFTTIMER_LEVELS; i++)
+  {
+    for(u8 j = 0; j < SOFTTIMER_SLOTS; j++)
+    {
+      SoftTimer_apsWheel[i][j] = NULL;
+    }
+    SoftTimer_au32Occupied[i] = 0;
+  }
+
+  SoftTimer_u32Time = G_u32SystemTime1ms;
+  SoftTimer_u32Running = 0;
+
+  SchedulerSetEventDriven(PROFILER_TASK_SOFTTIMER);
+
+} /* end SoftTimerInitialize() */
+
+
+/*!----------------------------------------------------------------------------------------------------------------------
+@fn void SoftTimerRunActiveState(void)
+
+@brief Processes every tick up to G_u32SystemTime1ms and expires the timers that are due.
+
+Requires:
+- Called from the super loop
+
+Promises:
+- Every timer due at or before G_u32SystemTime1ms has expired
+- If any timer is running, the task is set to be signalled at the next tick with work to do
+
+*/
+void SoftTimerRunActiveState(void)
+{
+  u32 u32Now = G_u32SystemTime1ms;
+  u32 u32Tick;
+  u32 u32Next;
+
+  while( (s32)(u32Now - SoftTimer_u32Time) >= 0 )
+  {
+    if(SoftTimer_u32Running == 0)
+    {
+      SoftTimer_u32Time = u32Now + 1;
+      break;
+    }
+
+    /* Wheel 0 wraps: bring the next slot of each wheel above down, stopping at the first that does not wrap */
+    u32Tick = SoftTimer_u32Time;
+    if( (u32Tick & SOFTTIMER_SLOT_MASK) == 0 )
+    {
+      for(u8 u8Level = 1; u8Level < SOFTTIMER_LEVELS; u8Level++)
+      {
+        SoftTimerCascade(u8Level);
+        if( ((u32Tick >> (u8Level * SOFTTIMER_SLOT_BITS)) & SOFTTIMER_SLOT_MASK) != 0 )
+        {
+          break;
+        }
+      }
+    }
+
+    /* Nothing in wheel 0 means nothing can expire before the next wrap */
+    if(SoftTimer_au32Occupied[0] == 0)
+    {
+      u32Next = (u32Tick | SOFTTIMER_SLOT_MASK) + 1;
+      if( (s32)(u32Next - (u32Now + 1)) > 0 )
+      {
+        u32Next = u32Now + 1;
+      }
+      SoftTimer_u32Time = u32Next;
+      continue;
+    }
+
+    /* Timers started from callbacks count from the next tick */
+    SoftTimer_u32Time = u32Tick + 1;
+    SoftTimerExpire(u32Tick);
+  }
+
+  if(SoftTimer_u32Running != 0)
+  {
+    SchedulerSignalAt(PROFILER_TASK_SOFTTIMER, SoftTimerNextTick());
+  }
+
+} /* end SoftTimerRunActiveState() */
+
+
+/*--------------------------------------------------------------------------------------------------------------------*/
+/*! @privatesection */
+/*--------------------------------------------------------------------------------------------------------------------*/
+
+/*!----------------------------------------------------------------------------------------------------------------------
+@fn static void SoftTimerInsert(SoftTimerType* psTimer_)
+
+@brief Adds a timer to the end of the slot that covers its expiry.
+
+Requires:
+@param psTimer_ points to a timer with u32Expiry set that is not in a wheel
+
+Promises:
+- The timer is the last in its slot, so timers added while a slot is expiring go after the due ones
+- A timer already due goes in the slot of the next tick
+
+*/
+static void SoftTimerInsert(SoftTimerType* psTimer_)
+{
+  u32 u32Delta = psTimer_->u32Expiry - SoftTimer_u32Time;
+  u32 u32SlotTime = psTimer_->u32Expiry;
+  SoftTimerType* psHead;
+  SoftTimerType* psTail;
+  u8 u8Level = 0;
+
+  if( (s32)u32Delta < 0 )
+  {
+    u32Delta = 0;
+    u32SlotTime = SoftTimer_u32Time;
+  }
+  else if(u32Delta > SOFTTIMER_MAX_DELTA)
+  {
+    u32Delta = SOFTTIMER_MAX_DELTA;
+    u32SlotTime = SoftTimer_u32Time + SOFTTIMER_MAX_DELTA;
+  }
+
+  while( (u8Level < (SOFTTIMER_LEVELS - 1)) && (u32Delta >= ((u32)1 << ((u8Level + 1) * SOFTTIMER_SLOT_BITS))) )
+  {
+    u8Level++;
+  }
+
+  psTimer_->u8Level = u8Level;
+  psTimer_->u8Slot  = (u8)((u32SlotTime >> (u8Level * SOFTTIMER_SLOT_BITS)) & SOFTTIMER_SLOT_MASK);
+
+  /* Each slot is a circular list so the last timer is psHead->psPrev */
+  psHead = SoftTimer_apsWheel[u8Level][psTimer_->u8Slot];
+  if(psHead == NULL)
+  {
+    psTimer_->psNext = psTimer_;
+    psTimer_->psPrev = psTimer_;
+    SoftTimer_apsWheel[u8Level][psTimer_->u8Slot] = psTimer_;
+    SoftTimer_au32Occupied[u8Level] |= ((u32)1 << psTimer_->u8Slot);
+  }
+  else
+  {
+    psTail = psHead->psPrev;
+    psTimer_->psNext = psHead;
+    psTimer_->psPrev = psTail;
+    psTail->psNext = psTimer_;
+    psHead->psPrev = psTimer_;
+  }
+
+} /* end SoftTimerInsert() */
+
+
+/*!----------------------------------------------------------------------------------------------------------------------
+@fn static void SoftTimerUnlink(SoftTimerType* psTimer_)
+
+@brief Takes a timer out of its slot.
+
+Requires:
+@param psTimer_ points to a timer in a wheel
+
+Promises:
+- The timer is no longer in any slot
+
+*/
+static void SoftTimerUnlink(SoftTimerType* psTimer_)
+{
+  SoftTimerType* psNext = psTimer_->psNext;
+  SoftTimerType* psPrev = psTimer_->psPrev;
+
+  if(psNext == psTimer_)
+  {
+    SoftTimer_apsWheel[psTimer_->u8Level][psTimer_->u8Slot] = NULL;
+    SoftTimer_au32Occupied[psTimer_->u8Level] &= ~((u32)1 << psTimer_->u8Slot);
+  }
+  else
+  {
+    psPrev->psNext = psNext;
+    psNext->psPrev = psPrev;
+    if(SoftTimer_apsWheel[psTimer_->u8Level][psTimer_->u8Slot] == psTimer_)
+    {
+      SoftTimer_apsWheel[psTimer_->u8Level][psTimer_->u8Slot] = psNext;
+    }
+  }
+
+} /* end SoftTimerUnlink() */
+
+
+/*!----------------------------------------------------------------------------------------------------------------------
+@fn static void SoftTimerCascade(u8 u8Level_)
+
+@brief Moves the timers in the current slot of a wheel to the wheels below.
+
+Requires:
+- SoftTimer_u32Time is the tick being processed, where the wheel below wraps
+@param u8Level_ is the wheel, 1 or higher
+
+Promises:
+- The wheel's current slot is empty and its timers are in the slots that cover their remaining time
+
+*/
+static void SoftTimerCascade(u8 u8Level_)
+{
+  u8 u8Slot = (u8)((SoftTimer_u32Time >> (u8Level_ * SOFTTIMER_SLOT_BITS)) & SOFTTIMER_SLOT_MASK);
+  SoftTimerType* psTimer;
+
+  while( (psTimer = SoftTimer_apsWheel[u8Level_][u8Slot]) != NULL )
+  {
+    SoftTimerUnlink(psTimer);
+    SoftTimerInsert(psTimer);
+  }
+
+} /* end SoftTimerCascade() */
+
+
+/*!----------------------------------------------------------------------------------------------------------------------
+@fn static void SoftTimerExpire(u32 u32Tick_)
+
+@brief Expires the timers due at a tick.
+
+Requires:
+- SoftTimer_u32Time is already past u32Tick_
+@param u32Tick_ is the tick being processed
+
+Promises:
+- Each timer in the tick's wheel 0 slot is expired: bExpired is set, a periodic timer is started again
+  one period after its last expiry, and the callback is called
+
+*/
+static void SoftTimerExpire(u32 u32Tick_)
+{
+  u8 u8Slot = (u8)(u32Tick_ & SOFTTIMER_SLOT_MASK);
+  SoftTimerType* psTimer;
+
+  /* Every timer already in the slot is due; any added by a callback is later and at the end */
+  while( ((psTimer = SoftTimer_apsWheel[0][u8Slot]) != NULL) &&
+         ((s32)(psTimer->u32Expiry - u32Tick_) <= 0) )
+  {
+    SoftTimerUnlink(psTimer);
+    psTimer->bExpired = TRUE;
+
+    if(psTimer->u32Period != 0)
+    {
+      psTimer->u32Expiry += psTimer->u32Period;
+      SoftTimerInsert(psTimer);
+    }
+    else
+    {
+      psTimer->bRunning = FALSE;
+      SoftTimer_u32Running--;
+    }
+
+    if(psTimer->pfnCallback != NULL)
+    {
+      psTimer->pfnCallback();
+    }
+  }
+
+} /* end SoftTimerExpire() */
+
+
+/*!----------------------------------------------------------------------------------------------------------------------
+@fn static u32 SoftTimerNextTick(void)
+
+@brief Finds the next tick with something to do.
+
+Requires:
+- At least one timer is running
+
+Promises:
+- Returns the tick of the next non-empty wheel 0 slot before the next wrap, or the tick of the wrap
+
+*/
+static u32 SoftTimerNextTick(void)
+{
+  u32 u32Slots = SoftTimer_au32Occupied[0] >> (SoftTimer_u32Time & SOFTTIMER_SLOT_MASK);
+  u32 u32Tick = SoftTimer_u32Time;
+
+  if(u32Slots == 0)
+  {
+    return (SoftTimer_u32Time | SOFTTIMER_SLOT_MASK) + 1;
+  }
+
+  while( !(u32Slots & 1) )
+  {
+    u32Slots >>= 1;
+    u32Tick++;
+  }
+
+  return u32Tick;
+
+} /* end SoftTimerNextTick() */
+
+
+/*--------------------------------------------------------------------------------------------------------------------*/
+/* End of File                                                                                                        */
+/*--------------------------------------------------------------------------------------------------------------------*/
@@ -0,0 +1,80 @@
+/*!*********************************************************************************************************************
+@file softtimer.h
+@brief Header file for softtimer.c
+
+**********************************************************************************************************************/
+
+#ifndef __SOFTTIMER_H
+#define __SOFTTIMER_H
+
+/**********************************************************************************************************************
+Type Definitions
+**********************************************************************************************************************/
+
+/*!
+@struct SoftTimerType
+@brief One software timer.  Owned (usually as a static) by the task that uses it; only softtimer.c writes the fields.
+*/
+typedef struct
+{
+  void* psNext;                          /*!< @brief Next timer in the same wheel slot */
+  void* psPrev;                          /*!< @brief Previous timer in the same wheel slot */
+  u32 u32Expiry;                         /*!< @brief G_u32SystemTime1ms at which the timer expires */
+  u32 u32Period;                         /*!< @brief Reload time in ms for a periodic timer; 0 for one-shot */
+  fnCode_type pfnCallback;               /*!< @brief Called on expiry from SoftTimerRunActiveState(); may be NULL */
+  u8 u8Level;                            /*!< @brief Wheel the timer is in */
+  u8 u8Slot;                             /*!< @brief Slot the timer is in */
+  bool bRunning;                         /*!< @brief TRUE while the timer is in the wheel */
+  bool bExpired;                         /*!< @brief Set on expiry; read and cleared by SoftTimerExpired() */
+} SoftTimerType;
+
+
+/**********************************************************************************************************************
+Constants / Definitions
+**********************************************************************************************************************/
+#define SOFTTIMER_LEVELS                (u8)4               /*!< @brief Wheels; each is SOFTTIMER_SLOTS times coarser */
+#define SOFTTIMER_SLOT_BITS             (u8)5               /*!< @brief log2 of the slots per wheel */
+
+/*! @cond DOXYGEN_EXCLUDE */
+#define SOFTTIMER_SLOTS                 (u32)(1 << SOFTTIMER_SLOT_BITS)
+#define SOFTTIMER_SLOT_MASK             (u32)(SOFTTIMER_SLOTS - 1)
+#define SOFTTIMER_MAX_DELTA             (u32)((1 << (SOFTTIMER_LEVELS * SOFTTIMER_SLOT_BITS)) - 1) /* 17.5 minutes */
+/*! @endcond */
+
+
+/**********************************************************************************************************************
+Function Declarations
+**********************************************************************************************************************/
+
+/*------------------------------------------------------------------------------------------------------------------*/
+/*! @publicsection */
+/*--------------------------------------------------------------------------------------------------------------------*/
+void SoftTimerStart(SoftTimerType* psTimer_, u32 u32DelayMs_, u32 u32PeriodMs_, fnCode_type pfnCallback_);
+void SoftTimerStop(SoftTimerType* psTimer_);
+bool SoftTimerExpired(SoftTimerType* psTimer_);
+bool SoftTimerIsRunning(SoftTimerType* psTimer_);
+
+
+/*------------------------------------------------------------------------------------------------------------------*/
+/*! @protectedsection */
+/*--------------------------------------------------------------------------------------------------------------------*/
+void SoftTimerInitialize(void);
+void SoftTimerRunActiveState(void);
+
+
+/*------------------------------------------------------------------------------------------------------------------*/
+/*! @privatesection */
+/*--------------------------------------------------------------------------------------------------------------------*/
+static void SoftTimerInsert(SoftTimerType* psTimer_);
+static void SoftTimerUnlink(SoftTimerType* psTimer_);
+static void SoftTimerCascade(u8 u8Level_);
+static void SoftTimerExpire(u32 u32Tick_);
+static u32 SoftTimerNextTick(void);
+
+
+#endif /* __SOFTTIMER_H */
+
+
+/*--------------------------------------------------------------------------------------------------------------------*/
+/* End of File                                                                                                        */
+/*--------------------------------------------------------------------------------------------------------------------*/
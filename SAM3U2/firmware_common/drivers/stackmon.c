@@ -0,0 +1,300 @@
+/*!*********************************************************************************************************************
+@file stackmon.c
+@brief Stack and heap high-watermark monitor.
+
+The stack sits directly below the end of RAM (GCC: __StackLimit to __StackTop in board_cstartup_gcc.S; IAR: the
+CSTACK block) with the statics below it, so an overflow silently corrupts Msg_asPool and friends.  At startup
+StackMonInitialize() fills the unused stack and the heap with STACKMON_PAINT.  Any word that no longer holds the
+pattern has been used, so the lowest such word is the stack's high-watermark.
+
+StackMonCheck() runs once per loop pass and looks at only STACKMON_WORDS_PER_CHECK words, sweeping up from
+__StackLimit towards the current watermark, so a 4KB stack is fully rechecked every 64ms for a few hundred cycles.
+When the watermark reaches the bottom STACKMON_GUARD_BYTES of the stack _STACKMON_GUARD_HIT is set and an error is
+logged once; if the lowest word itself changes, _STACKMON_OVERFLOW is set.
+
+StackMonPrintReport() ("stack" in the debug menu) does a full scan of the stack and heap and prints peak use against the size
+of each, which is the number to check before growing a buffer such as the message pool.
+
+The monitor is compiled in only when STACK_MONITOR is defined in configuration.h.
+
+------------------------------------------------------------------------------------------------------------------------
+GLOBALS
+- G_u32StackMonFlags
+
+CONSTANTS
+- STACKMON_GUARD_BYTES
+
+TYPES
+- NONE
+
+PUBLIC FUNCTIONS
+- void StackMonPrintReport(void)
+
+PROTECTED FUNCTIONS
+- void StackMonInitialize(void)
+- void StackMonCheck(void)
+
+**********************************************************************************************************************/
+
+#include "configuration.h"
+
+/*! @cond DOXYGEN_EXCLUDE */
+/* Stack and heap boundaries from the linker */
+#if defined ( __ICCARM__ )
+#pragma section = "CSTACK"
+#pragma section = "HEAP"
+#define STACKMON_STACK_LIMIT            ((u32*)__section_begin("CSTACK"))
+#define STACKMON_STACK_TOP              ((u32*)__section_end("CSTACK"))
+#define STACKMON_HEAP_BASE              ((u32*)__section_begin("HEAP"))
+#define STACKMON_HEAP_LIMIT             ((u32*)__section_end("HEAP"))
+#elif defined (  __GNUC__  )
+extern u32 __StackLimit[];
+extern u32 __StackTop[];
+extern u32 __HeapBase[];
+extern u32 __HeapLimit[];
+#define STACKMON_STACK_LIMIT            (&__StackLimit[0])
+#define STACKMON_STACK_TOP              (&__StackTop[0])
+#define STACKMON_HEAP_BASE              (&__HeapBase[0])
+#define STACKMON_HEAP_LIMIT             (&__HeapLimit[0])
+#endif
+/*! @endcond */
+
+/***********************************************************************************************************************
+Global variable definitions with scope across entire project.
+All Global variable names shall start with "G_xxStackMon"
+***********************************************************************************************************************/
+/* New variables */
+u32 G_u32StackMonFlags;                                /*!< @brief Global state flags */
+
+
+/*--------------------------------------------------------------------------------------------------------------------*/
+/* Existing variables (defined in other files -- should all contain the "extern" keyword) */
+extern volatile u32 G_u32SystemTime1ms;                /*!< @brief From main.c */
+extern volatile u32 G_u32SystemTime1s;                 /*!< @brief From main.c */
+extern volatile u32 G_u32SystemFlags;                  /*!< @brief From main.c */
+extern volatile u32 G_u32ApplicationFlags;             /*!< @brief From main.c */
+
+extern u32 G_au32DebugLogMask[];                       /*!< @brief From debug.c */
+
+
+/***********************************************************************************************************************
+Global variable definitions with scope limited to this local application.
+Variable names shall start with "StackMon_xx" and be declared as static.
+***********************************************************************************************************************/
+static u32* StackMon_pu32Lowest;                       /*!< @brief Lowest stack word found in use */
+static u32* StackMon_pu32Cursor;                       /*!< @brief Next word for StackMonCheck() to examine */
+
+
+/**********************************************************************************************************************
+Function Definitions
+**********************************************************************************************************************/
+
+/*--------------------------------------------------------------------------------------------------------------------*/
+/*! @publicsection */
+/*--------------------------------------------------------------------------------------------------------------------*/
+
+/*!----------------------------------------------------------------------------------------------------------------------
+@fn void StackMonPrintReport(void)
+
+@brief Scans the whole stack and heap and prints the peak use of each.
+
+Requires:
+- Debug is running
+
+Promises:
+- The stack watermark is brought up to date
+- One line each for the stack and the heap, plus any guard or overflow warning, are queued to the debug port
+
+*/
+void StackMonPrintReport(void)
+{
+#ifdef STACK_MONITOR
+  u32 u32StackSize = (u32)STACKMON_STACK_TOP - (u32)STACKMON_STACK_LIMIT;
+  u32 u32HeapSize  = (u32)STACKMON_HEAP_LIMIT - (u32)STACKMON_HEAP_BASE;
+  u32 u32StackPeak;
+  u32 u32HeapPeak;
+
+  StackMon_pu32Lowest = StackMonLowestUsed(STACKMON_STACK_LIMIT, StackMon_pu32Lowest);
+  u32StackPeak = (u32)STACKMON_STACK_TOP - (u32)StackMon_pu32Lowest;
+  u32HeapPeak  = (u32)StackMonHighestUsed(STACKMON_HEAP_BASE, STACKMON_HEAP_LIMIT) - (u32)STACKMON_HEAP_BASE;
+
+  DebugPrintFormat("\n\rStack: peak %u of %u bytes (%u%%), now %u, guard %u\n\r",
+                   u32StackPeak, u32StackSize, (u32StackPeak * 100) / u32StackSize,
+                   (u32)STACKMON_STACK_TOP - __get_MSP(), STACKMON_GUARD_BYTES);
+  DebugPrintFormat("Heap:  peak %u of %u bytes\n\r", u32HeapPeak, u32HeapSize);
+
+  if(G_u32StackMonFlags & _STACKMON_OVERFLOW)
+  {
+    DebugPrintf("*** Stack overflowed: statics below the stack may be corrupt\n\r");
+  }
+  else if(G_u32StackMonFlags & _STACKMON_GUARD_HIT)
+  {
+    DebugPrintf("*** Stack reached the guard band\n\r");
+  }
+#else
+  DebugPrintf("\n\rSTACK_MONITOR is not defined\n\r");
+#endif /* STACK_MONITOR */
+
+} /* end StackMonPrintReport() */
+
+
+/*--------------------------------------------------------------------------------------------------------------------*/
+/*! @protectedsection */
+/*--------------------------------------------------------------------------------------------------------------------*/
+
+/*!----------------------------------------------------------------------------------------------------------------------
+@fn void StackMonInitialize(void)
+
+@brief Paints the unused stack and the heap.
+
+Call first thing in main() so the watermark includes initialization.  The STACKMON_PAINT_MARGIN_WORDS words just
+below the current stack pointer are left alone since this function's own frame is there.
+
+Requires:
+- Nothing has been allocated from the heap
+
+Promises:
+- Every stack word from the limit to the margin below SP, and every heap word, holds STACKMON_PAINT
+- The watermark starts at the painted boundary
+- "stack" is added to the debug menu
+
+*/
+void StackMonInitialize(void)
+{
+  G_u32StackMonFlags = 0;
+  DebugCommandRegister("stack", "Show stack and heap use", StackMonPrintReport);
+
+#ifdef STACK_MONITOR
+  u32* pu32Word;
+  u32* pu32PaintEnd;
+
+  pu32PaintEnd = (u32*)__get_MSP() - STACKMON_PAINT_MARGIN_WORDS;
+
+  for(pu32Word = STACKMON_STACK_LIMIT; pu32Word < pu32PaintEnd; pu32Word++)
+  {
+    *pu32Word = STACKMON_PAINT;
+  }
+
+  for(pu32Word = STACKMON_HEAP_BASE; pu32Word < STACKMON_HEAP_LIMIT; pu32Word++)
+  {
+    *pu32Word = STACKMON_PAINT;
+  }
+
+  StackMon_pu32Lowest = pu32PaintEnd;
+  StackMon_pu32Cursor = STACKMON_STACK_LIMIT;
+#endif /* STACK_MONITOR */
+
+} /* end StackMonInitialize() */
+
+
+/*!----------------------------------------------------------------------------------------------------------------------
+@fn void StackMonCheck(void)
+
+@brief Examines the next few stack words for a new watermark and checks the guard band.
+
+Requires:
+- StackMonInitialize() has run
+- Called once per pass of the super loop
+
+Promises:
+- StackMon_pu32Lowest is lowered if a used word is found below it
+- _STACKMON_GUARD_HIT / _STACKMON_OVERFLOW are set and logged the first time they happen
+
+*/
+void StackMonCheck(void)
+{
+#ifdef STACK_MONITOR
+  u32* pu32Cursor = StackMon_pu32Cursor;
+
+  for(u8 i = 0; (i < STACKMON_WORDS_PER_CHECK) && (pu32Cursor < StackMon_pu32Lowest); i++)
+  {
+    if(*pu32Cursor != STACKMON_PAINT)
+    {
+      StackMon_pu32Lowest = pu32Cursor;
+      break;
+    }
+    pu32Cursor++;
+  }
+
+  /* Start a new sweep from the bottom once the watermark is reached */
+  if(pu32Cursor >= StackMon_pu32Lowest)
+  {
+    pu32Cursor = STACKMON_STACK_LIMIT;
+  }
+  StackMon_pu32Cursor = pu32Cursor;
+
+  if( !(G_u32StackMonFlags & _STACKMON_GUARD_HIT) &&
+      ((u32)StackMon_pu32Lowest < ((u32)STACKMON_STACK_LIMIT + STACKMON_GUARD_BYTES)) )
+  {
+    G_u32StackMonFlags |= _STACKMON_GUARD_HIT;
+    LOG_ERROR(_DEBUG_LOG_SYSTEM, "\n\r*** Stack within %u bytes of its limit\n\r",
+              (u32)StackMon_pu32Lowest - (u32)STACKMON_STACK_LIMIT);
+  }
+
+  if( !(G_u32StackMonFlags & _STACKMON_OVERFLOW) && (*STACKMON_STACK_LIMIT != STACKMON_PAINT) )
+  {
+    G_u32StackMonFlags |= _STACKMON_OVERFLOW;
+    LOG_ERROR(_DEBUG_LOG_SYSTEM, "\n\r*** Stack overflow\n\r");
+  }
+#endif /* STACK_MONITOR */
+
+} /* end StackMonCheck() */
+
+
+/*--------------------------------------------------------------------------------------------------------------------*/
+/*! @privatesection */
+/*--------------------------------------------------------------------------------------------------------------------*/
+
+/*!----------------------------------------------------------------------------------------------------------------------
+@fn static u32* StackMonLowestUsed(u32* pu32Bottom_, u32* pu32Top_)
+
+@brief Finds the lowest word that no longer holds the paint pattern.
+
+Requires:
+@param pu32Bottom_ is the first word to check
+@param pu32Top_ is the end of the search
+
+Promises:
+- Returns the address of the lowest used word, or pu32Top_ if none is used
+
+*/
+static u32* StackMonLowestUsed(u32* pu32Bottom_, u32* pu32Top_)
+{
+  while( (pu32Bottom_ < pu32Top_) && (*pu32Bottom_ == STACKMON_PAINT) )
+  {
+    pu32Bottom_++;
+  }
+
+  return pu32Bottom_;
+
+} /* end StackMonLowestUsed() */
+
+
+/*!----------------------------------------------------------------------------------------------------------------------
+@fn static u32* StackMonHighestUsed(u32* pu32Bottom_, u32* pu32Top_)
+
+@brief Finds the end of the highest word that no longer holds the paint pattern.
+
+Requires:
+@param pu32Bottom_ is the start of the search
+@param pu32Top_ is the end of the region
+
+Promises:
+- Returns the address just past the highest used word, or pu32Bottom_ if none is used
+
+*/
+static u32* StackMonHighestUsed(u32* pu32Bottom_, u32* pu32Top_)
+{
+  while( (pu32Top_ > pu32Bottom_) && (*(pu32Top_ - 1) == STACKMON_PAINT) )
+  {
+    pu32Top_--;
+  }
+
+  return pu32Top_;
+
+} /* end StackMonHighestUsed() */
+
+
+/*--------------------------------------------------------------------------------------------------------------------*/
+/* End of File                                                                                                        */
+/*--------------------------------------------------------------------------------------------------------------------*/
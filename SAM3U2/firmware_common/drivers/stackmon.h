@@ -0,0 +1,62 @@
+/*!*********************************************************************************************************************
+@file stackmon.h
+@brief Header file for stackmon.c
+
+**********************************************************************************************************************/
+
+#ifndef __STACKMON_H
+#define __STACKMON_H
+
+/**********************************************************************************************************************
+Type Definitions
+**********************************************************************************************************************/
+
+
+/**********************************************************************************************************************
+Constants / Definitions
+**********************************************************************************************************************/
+#define STACKMON_PAINT                  (u32)0xDEADBEEF     /*!< @brief Pattern in unused stack and heap words */
+#define STACKMON_PAINT_MARGIN_WORDS     (u8)32              /*!< @brief Words below the SP at painting left alone for the painting call itself */
+#define STACKMON_WORDS_PER_CHECK        (u8)16              /*!< @brief Words examined by each StackMonCheck() */
+
+/*! @brief Stack bytes above __StackLimit that should never be used.  Set in configuration.h to override. */
+#ifndef STACKMON_GUARD_BYTES
+#define STACKMON_GUARD_BYTES            (u32)256
+#endif
+
+/* G_u32StackMonFlags */
+#define _STACKMON_GUARD_HIT             (u32)0x00000001     /*!< @brief Stack use has reached the guard band */
+#define _STACKMON_OVERFLOW              (u32)0x00000002     /*!< @brief The lowest stack word was overwritten */
+/* end G_u32StackMonFlags */
+
+
+/**********************************************************************************************************************
+Function Declarations
+**********************************************************************************************************************/
+
+/*------------------------------------------------------------------------------------------------------------------*/
+/*! @publicsection */
+/*--------------------------------------------------------------------------------------------------------------------*/
+void StackMonPrintReport(void);
+
+
+/*------------------------------------------------------------------------------------------------------------------*/
+/*! @protectedsection */
+/*--------------------------------------------------------------------------------------------------------------------*/
+void StackMonInitialize(void);
+void StackMonCheck(void);
+
+
+/*------------------------------------------------------------------------------------------------------------------*/
+/*! @privatesection */
+/*--------------------------------------------------------------------------------------------------------------------*/
+static u32* StackMonLowestUsed(u32* pu32Bottom_, u32* pu32Top_);
+static u32* StackMonHighestUsed(u32* pu32Bottom_, u32* pu32Top_);
+
+
+#endif /* __STACKMON_H */
+
+
+/*--------------------------------------------------------------------------------------------------------------------*/
+/* End of File                                                                                                        */
+/*--------------------------------------------------------------------------------------------------------------------*/
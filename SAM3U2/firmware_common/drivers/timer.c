@@ -41,6 +41,7 @@ extern volatile u32 G_u32SystemTime1ms;            /*!< @brief From main.c */
 extern volatile u32 G_u32SystemTime1s;             /*!< @brief From main.c */
 extern volatile u32 G_u32SystemFlags;              /*!< @brief From main.c */
 extern volatile u32 G_u32ApplicationFlags;         /*!< @brief From main.c */
+extern u32 G_au32DebugLogMask[];                   /*!< @brief From debug.c */
 
 
 /***********************************************************************************************************************
@@ -196,7 +197,7 @@ void TimerAssignCallback(TimerChannelType eTimerChannel_, fnCode_type fpUserCall
     }
     default:
     {
-      DebugPrintf("Invalid channel\n\r");
+      LOG_ERROR(_DEBUG_LOG_TIMER, "Invalid channel\n\r");
     }
   } /* end switch(eTimerChannel_) */
   
@@ -217,6 +218,7 @@ Requires:
 
 Promises:
 - Timer 1 is configured per timer.h INIT settings
+- The task is not polled by the super loop
 
 */
 void TimerInitialize(void)
@@ -246,6 +248,9 @@ void TimerInitialize(void)
     Timer_fpStateMachine = TimerSM_Idle;
     DebugPrintf(au8TimerStarted);
     
+    /* Callbacks run in the ISR and Idle has no work, so the task is never signalled */
+    SchedulerSetEventDriven(PROFILER_TASK_TIMER);
+    
     /* Flag that the Timer task is ready */
     G_u32ApplicationFlags |= _APPLICATION_FLAGS_TIMER;
   }
@@ -253,6 +258,7 @@ void TimerInitialize(void)
   {
     /* The task isn't properly initialized, so shut it down and don't run */
     Timer_fpStateMachine = TimerSM_Error;
+    SchedulerSetEventDriven(PROFILER_TASK_TIMER);
   }
 
 } /* end TimerInitialize() */
@@ -0,0 +1,425 @@
+/*!*********************************************************************************************************************
+@file tokenlog.c
+@brief Tokenized binary logging on the debug port.
+
+DebugPrintf() sends whole strings, and each call takes a message slot.  Verbose logging through it saturates
+the UART and the message pool.  A token log call stores only the message id, the time and up to
+TOKENLOG_MAX_ARGS raw u32 argument values in a RAM ring.  The format strings never leave the host:
+tools/tokenlog_decode.py reads them from tokenlog_messages.h, which is also the source of the ids, so both
+sides are generated from the same table.
+
+The ring is drained in the background by TokenLogRunActiveState().  Records are packed as compact frames (see
+tokenlog.h) into a single message of up to TOKENLOG_TX_BUFFER_SIZE bytes, and only one message is in the queue at a
+time, so logging uses at most one slot of the message pool.  If the ring fills, the newest records are dropped and a
+TOKENLOG_DROPPED record reports how many.
+
+Logging is off at startup and is toggled by the "tokenlog" command.  When it is off, a TOKENLOGn() call is a single
+flag test.
+
+------------------------------------------------------------------------------------------------------------------------
+GLOBALS
+- G_u32TokenLogFlags
+
+CONSTANTS
+- TOKENLOG_MAX_ARGS, TOKENLOG_RING_SIZE
+
+TYPES
+- TokenLogIdType
+- TokenLogRecordType
+
+PUBLIC FUNCTIONS
+- void TokenLogWrite(TokenLogIdType eId_, u8 u8Args_, u32 u32Arg0_, u32 u32Arg1_, u32 u32Arg2_)
+- void TokenLogEnable(void)
+- void TokenLogDisable(void)
+- void TokenLogToggle(void)
+
+PROTECTED FUNCTIONS
+- void TokenLogInitialize(void)
+- void TokenLogRunActiveState(void)
+
+**********************************************************************************************************************/
+
+#include "configuration.h"
+
+/***********************************************************************************************************************
+Global variable definitions with scope across entire project.
+All Global variable names shall start with "G_xxTokenLog"
+***********************************************************************************************************************/
+/* New variables */
+volatile u32 G_u32TokenLogFlags;                       /*!< @brief Global state flags */
+
+
+/*--------------------------------------------------------------------------------------------------------------------*/
+/* Existing variables (defined in other files -- should all contain the "extern" keyword) */
+extern volatile u32 G_u32SystemTime1ms;                /*!< @brief From main.c */
+extern volatile u32 G_u32SystemTime1s;                 /*!< @brief From main.c */
+extern volatile u32 G_u32SystemFlags;                  /*!< @brief From main.c */
+extern volatile u32 G_u32ApplicationFlags;             /*!< @brief From main.c */
+
+extern u8 G_au8UtilMessageON[];                        /*!< @brief From utilities.c */
+extern u8 G_au8UtilMessageOFF[];                       /*!< @brief From utilities.c */
+
+
+/***********************************************************************************************************************
+Global variable definitions with scope limited to this local application.
+Variable names shall start with "TokenLog_xx" and be declared as static.
+***********************************************************************************************************************/
+static fnCode_type TokenLog_pfStateMachine;                       /*!< @brief The state machine function pointer */
+
+static TokenLogRecordType TokenLog_asRing[TOKENLOG_RING_SIZE];    /*!< @brief Records waiting to be sent */
+static volatile u8 TokenLog_u8RingHead;                           /*!< @brief Next record to send */
+static volatile u8 TokenLog_u8RingCount;                          /*!< @brief Records in the ring */
+static volatile u32 TokenLog_u32Dropped;                          /*!< @brief Records lost to a full ring since the last report */
+
+static u8 TokenLog_au8TxBuffer[TOKENLOG_TX_BUFFER_SIZE];          /*!< @brief Frames for the next message */
+static u32 TokenLog_u32LastTime;                                  /*!< @brief Time of the last record sent */
+static u32 TokenLog_u32MessageToken;                              /*!< @brief Token of the message being sent */
+
+
+/**********************************************************************************************************************
+Function Definitions
+**********************************************************************************************************************/
+
+/*--------------------------------------------------------------------------------------------------------------------*/
+/*! @publicsection */
+/*--------------------------------------------------------------------------------------------------------------------*/
+
+/*!----------------------------------------------------------------------------------------------------------------------
+@fn void TokenLogWrite(TokenLogIdType eId_, u8 u8Args_, u32 u32Arg0_, u32 u32Arg1_, u32 u32Arg2_)
+
+@brief Stores one log record in the ring.  Use the TOKENLOGn() macros rather than calling this directly.
+
+Interrupts are disabled only while the record is stored so the function can be used from interrupts.
+
+Requires:
+@param eId_ is the message id from tokenlog_messages.h
+@param u8Args_ is the number of arguments the format uses (max TOKENLOG_MAX_ARGS)
+@param u32Arg0_ - u32Arg2_ are the argument values
+
+Promises:
+- The record is added to the ring, or TokenLog_u32Dropped is incremented if the ring is full
+- The TokenLog task is signalled to send it
+
+*/
+void TokenLogWrite(TokenLogIdType eId_, u8 u8Args_, u32 u32Arg0_, u32 u32Arg1_, u32 u32Arg2_)
+{
+  TokenLogRecordType* psRecord;
+
+  __disable_irq();
+
+  if(TokenLog_u8RingCount == TOKENLOG_RING_SIZE)
+  {
+    TokenLog_u32Dropped++;
+  }
+  else
+  {
+    psRecord = &TokenLog_asRing[(TokenLog_u8RingHead + TokenLog_u8RingCount) % TOKENLOG_RING_SIZE];
+    psRecord->u32Time     = G_u32SystemTime1ms;
+    psRecord->u16Id       = (u16)eId_;
+    psRecord->u8Args      = u8Args_;
+    psRecord->au32Args[0] = u32Arg0_;
+    psRecord->au32Args[1] = u32Arg1_;
+    psRecord->au32Args[2] = u32Arg2_;
+    TokenLog_u8RingCount++;
+  }
+
+  __enable_irq();
+
+  SchedulerSignal(PROFILER_TASK_TOKENLOG);
+
+} /* end TokenLogWrite() */
+
+
+/*!----------------------------------------------------------------------------------------------------------------------
+@fn void TokenLogEnable(void)
+
+@brief Starts recording and sending log calls.
+
+Requires:
+- NONE
+
+Promises:
+- _TOKENLOG_ENABLED is set and a TOKENLOG_ENABLED record is logged with the absolute time
+  so the decoder can resynchronize
+
+*/
+void TokenLogEnable(void)
+{
+  G_u32TokenLogFlags |= _TOKENLOG_ENABLED;
+
+  TOKENLOG1(TOKENLOG_ENABLED, G_u32SystemTime1ms);
+
+} /* end TokenLogEnable() */
+
+
+/*!----------------------------------------------------------------------------------------------------------------------
+@fn void TokenLogDisable(void)
+
+@brief Stops recording log calls.  Records already in the ring are still sent.
+
+Requires:
+- NONE
+
+Promises:
+- _TOKENLOG_ENABLED is cleared
+
+*/
+void TokenLogDisable(void)
+{
+  G_u32TokenLogFlags &= ~_TOKENLOG_ENABLED;
+
+} /* end TokenLogDisable() */
+
+
+/*!----------------------------------------------------------------------------------------------------------------------
+@fn void TokenLogToggle(void)
+
+@brief Debug menu command to switch the token log on or off.
+
+Requires:
+- NONE
+
+Promises:
+- The log is enabled if it was disabled and vice versa, and the new state is printed
+
+*/
+void TokenLogToggle(void)
+{
+  DebugPrintf("\n\rToken log ");
+
+  if(G_u32TokenLogFlags & _TOKENLOG_ENABLED)
+  {
+    TokenLogDisable();
+    DebugPrintf(G_au8UtilMessageOFF);
+  }
+  else
+  {
+    DebugPrintf(G_au8UtilMessageON);
+    TokenLogEnable();
+  }
+
+} /* end TokenLogToggle() */
+
+
+/*--------------------------------------------------------------------------------------------------------------------*/
+/*! @protectedsection */
+/*--------------------------------------------------------------------------------------------------------------------*/
+
+/*!----------------------------------------------------------------------------------------------------------------------
+@fn void TokenLogInitialize(void)
+
+@brief Clears the ring and starts the state machine.
+
+Requires:
+- DebugInitialize() has run
+
+Promises:
+- The ring is empty and logging is disabled
+- The state machine is in Idle, or Error if the debug port is not available
+- "tokenlog" is added to the debug menu
+
+*/
+void TokenLogInitialize(void)
+{
+  G_u32TokenLogFlags = 0;
+  TokenLog_u8RingHead = 0;
+  TokenLog_u8RingCount = 0;
+  TokenLog_u32Dropped = 0;
+  TokenLog_u32MessageToken = 0;
+  TokenLog_u32LastTime = 0;
+
+  if(G_u32ApplicationFlags & _APPLICATION_FLAGS_DEBUG)
+  {
+    G_u32ApplicationFlags |= _APPLICATION_FLAGS_TOKENLOG;
+    DebugCommandRegister("tokenlog", "Toggle binary token log", TokenLogToggle);
+    TokenLog_pfStateMachine = TokenLogSM_Idle;
+  }
+  else
+  {
+    TokenLog_pfStateMachine = TokenLogSM_Error;
+  }
+
+  /* TokenLogWrite() signals the task */
+  SchedulerSetEventDriven(PROFILER_TASK_TOKENLOG);
+
+} /* end TokenLogInitialize() */
+
+
+/*!----------------------------------------------------------------------------------------------------------------------
+@fn void TokenLogRunActiveState(void)
+
+@brief Selects and runs one iteration of the current state in the state machine.
+
+All state machines have a TOTAL of 1ms to execute, so on average n state machines
+may take 1ms / n to execute.
+
+Requires:
+- State machine function pointer points at current state
+
+Promises:
+- Calls the function to pointed by the state machine function pointer
+- The task stays scheduled until the ring is sent
+
+*/
+void TokenLogRunActiveState(void)
+{
+  TokenLog_pfStateMachine();
+
+  if( (TokenLog_pfStateMachine == TokenLogSM_WaitSent) || (TokenLog_u8RingCount != 0) || (TokenLog_u32Dropped != 0) )
+  {
+    SchedulerSignal(PROFILER_TASK_TOKENLOG);
+  }
+
+} /* end TokenLogRunActiveState */
+
+
+/*--------------------------------------------------------------------------------------------------------------------*/
+/*! @privatesection */
+/*--------------------------------------------------------------------------------------------------------------------*/
+
+/*!----------------------------------------------------------------------------------------------------------------------
+@fn static u8* TokenLogPutVarint(u8* pu8Target_, u32 u32Value_)
+
+@brief Writes a value as an unsigned LEB128 varint: 7 bits per byte, low bits first, bit 7 set on all but the last.
+
+Requires:
+@param pu8Target_ has room for TOKENLOG_VARINT_MAX_SIZE bytes
+@param u32Value_ is the value to write
+
+Promises:
+- Returns the location after the last byte written
+
+*/
+static u8* TokenLogPutVarint(u8* pu8Target_, u32 u32Value_)
+{
+  while(u32Value_ >= 0x80)
+  {
+    *pu8Target_++ = (u8)(u32Value_ | 0x80);
+    u32Value_ >>= 7;
+  }
+  *pu8Target_++ = (u8)u32Value_;
+
+  return pu8Target_;
+
+} /* end TokenLogPutVarint() */
+
+
+/*!----------------------------------------------------------------------------------------------------------------------
+@fn static u8 TokenLogEncode(TokenLogRecordType* psRecord_, u8* pu8Target_)
+
+@brief Encodes one record as a frame.
+
+Requires:
+@param psRecord_ is the record to encode
+@param pu8Target_ has room for TOKENLOG_FRAME_MAX_SIZE bytes
+
+Promises:
+- The frame is written to pu8Target_ and its size is returned
+- TokenLog_u32LastTime is the time of this record
+
+*/
+static u8 TokenLogEncode(TokenLogRecordType* psRecord_, u8* pu8Target_)
+{
+  u8* pu8Parser = pu8Target_ + TOKENLOG_FRAME_HEADER_SIZE;
+
+  pu8Parser = TokenLogPutVarint(pu8Parser, psRecord_->u16Id);
+  pu8Parser = TokenLogPutVarint(pu8Parser, psRecord_->u32Time - TokenLog_u32LastTime);
+  for(u8 i = 0; i < psRecord_->u8Args; i++)
+  {
+    pu8Parser = TokenLogPutVarint(pu8Parser, psRecord_->au32Args[i]);
+  }
+
+  TokenLog_u32LastTime = psRecord_->u32Time;
+
+  pu8Target_[0] = TOKENLOG_FRAME_START;
+  pu8Target_[1] = (u8)(pu8Parser - pu8Target_ - TOKENLOG_FRAME_HEADER_SIZE);
+
+  return (u8)(pu8Parser - pu8Target_);
+
+} /* end TokenLogEncode() */
+
+
+/***********************************************************************************************************************
+State Machine Function Definitions
+***********************************************************************************************************************/
+
+/*-------------------------------------------------------------------------------------------------------------------*/
+/* Pack waiting records into one message and queue it to the debug port */
+static void TokenLogSM_Idle(void)
+{
+  TokenLogRecordType sDropped;
+  u16 u16Size = 0;
+  u8 u8Records = 0;
+
+  /* Report lost records first so the gap shows up in the right place in the decoded log */
+  if(TokenLog_u32Dropped != 0)
+  {
+    __disable_irq();
+    sDropped.au32Args[0] = TokenLog_u32Dropped;
+    TokenLog_u32Dropped = 0;
+    __enable_irq();
+
+    sDropped.u32Time = G_u32SystemTime1ms;
+    sDropped.u16Id   = TOKENLOG_DROPPED;
+    sDropped.u8Args  = 1;
+    u16Size = TokenLogEncode(&sDropped, &TokenLog_au8TxBuffer[0]);
+  }
+
+  /* Only this task removes records, so the head can be read without locking */
+  while( (TokenLog_u8RingCount != 0) && ((u16Size + TOKENLOG_FRAME_MAX_SIZE) <= TOKENLOG_TX_BUFFER_SIZE) )
+  {
+    u16Size += TokenLogEncode(&TokenLog_asRing[TokenLog_u8RingHead], &TokenLog_au8TxBuffer[u16Size]);
+    u8Records++;
+
+    __disable_irq();
+    TokenLog_u8RingHead = (TokenLog_u8RingHead + 1) % TOKENLOG_RING_SIZE;
+    TokenLog_u8RingCount--;
+    __enable_irq();
+  }
+
+  if(u16Size != 0)
+  {
+    TokenLog_u32MessageToken = DebugWriteData(u16Size, &TokenLog_au8TxBuffer[0]);
+
+    /* A full message queue loses this batch; count it so the decoder sees the gap */
+    if(TokenLog_u32MessageToken == 0)
+    {
+      __disable_irq();
+      TokenLog_u32Dropped += u8Records;
+      __enable_irq();
+    }
+    else
+    {
+      TokenLog_pfStateMachine = TokenLogSM_WaitSent;
+    }
+  }
+
+} /* end TokenLogSM_Idle() */
+
+
+/*-------------------------------------------------------------------------------------------------------------------*/
+/* Wait for the last message to leave the queue before packing the next one */
+static void TokenLogSM_WaitSent(void)
+{
+  MessageStateType eStatus = QueryMessageStatus(TokenLog_u32MessageToken);
+
+  if( (eStatus != WAITING) && (eStatus != SENDING) )
+  {
+    TokenLog_pfStateMachine = TokenLogSM_Idle;
+  }
+
+} /* end TokenLogSM_WaitSent() */
+
+
+/*-------------------------------------------------------------------------------------------------------------------*/
+/* No debug port: records are discarded */
+static void TokenLogSM_Error(void)
+{
+  TokenLog_u8RingCount = 0;
+
+} /* end TokenLogSM_Error() */
+
+
+/*--------------------------------------------------------------------------------------------------------------------*/
+/* End of File                                                                                                        */
+/*--------------------------------------------------------------------------------------------------------------------*/
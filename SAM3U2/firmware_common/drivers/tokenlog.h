@@ -0,0 +1,120 @@
+/*!*********************************************************************************************************************
+@file tokenlog.h
+@brief Header file for tokenlog.c
+
+**********************************************************************************************************************/
+
+#ifndef __TOKENLOG_H
+#define __TOKENLOG_H
+
+/**********************************************************************************************************************
+Type Definitions
+**********************************************************************************************************************/
+
+/*!
+@enum TokenLogIdType
+@brief Message ids, one per entry of tokenlog_messages.h in the same order.
+*/
+typedef enum {
+#define TOKENLOG_MESSAGE(Id_, Format_)  Id_,
+#include "tokenlog_messages.h"
+#undef TOKENLOG_MESSAGE
+              TOKENLOG_MESSAGES} TokenLogIdType;
+
+/*!
+@struct TokenLogRecordType
+@brief One log call as stored in the ring.  Encoding for the wire happens when the ring is drained.
+*/
+typedef struct
+{
+  u32 u32Time;                        /*!< @brief G_u32SystemTime1ms of the call */
+  u16 u16Id;                          /*!< @brief TokenLogIdType */
+  u8 u8Args;                          /*!< @brief Number of valid entries in au32Args */
+  u8 u8Pad;
+  u32 au32Args[3];                    /*!< @brief Argument values (TOKENLOG_MAX_ARGS) */
+} TokenLogRecordType;
+
+
+/**********************************************************************************************************************
+Constants / Definitions
+**********************************************************************************************************************/
+#define TOKENLOG_MAX_ARGS               (u8)3               /*!< @brief Arguments per record */
+#define TOKENLOG_RING_SIZE              (u8)32              /*!< @brief Records held until they are sent */
+
+/* G_u32TokenLogFlags */
+#define _TOKENLOG_ENABLED               (u32)0x00000001     /*!< @brief Set to record and send log calls */
+/* end G_u32TokenLogFlags */
+
+/*! @cond DOXYGEN_EXCLUDE */
+/*----------------------------------------------------------------------------------------------------------------------
+Wire format
+
+Records are sent on the debug port mixed with normal ASCII output.  Each record is a frame:
+  [0] TOKENLOG_FRAME_START (ASCII RS, never used in text output)
+  [1] number of bytes that follow
+  [2] id, then time since the previous record in ms, then each argument, all as unsigned LEB128 varints
+
+A record with small arguments is typically 5-8 bytes where the formatted text would be 30-60.
+*/
+#define TOKENLOG_FRAME_START            (u8)0x1E
+#define TOKENLOG_FRAME_HEADER_SIZE      (u8)2
+#define TOKENLOG_VARINT_MAX_SIZE        (u8)5               /* Bytes to hold any u32 */
+#define TOKENLOG_FRAME_MAX_SIZE         (u8)(TOKENLOG_FRAME_HEADER_SIZE + ((2 + TOKENLOG_MAX_ARGS) * TOKENLOG_VARINT_MAX_SIZE))
+#define TOKENLOG_TX_BUFFER_SIZE         (u16)U16_MAX_TX_MESSAGE_LENGTH  /* One message slot of frames at a time */
+/*! @endcond */
+
+/*!
+@brief Log call macros: TOKENLOGn(id, n arguments).
+
+When the log is disabled a call costs one flag test.  Safe to use from interrupts.
+
+Example:
+TOKENLOG2(TOKENLOG_RAWLOG_BLOCK, u32Sequence, u32Sector);
+*/
+#define TOKENLOG0(Id_)                  do { if(G_u32TokenLogFlags & _TOKENLOG_ENABLED) TokenLogWrite((Id_), 0, 0, 0, 0); } while(0)
+#define TOKENLOG1(Id_, A_)              do { if(G_u32TokenLogFlags & _TOKENLOG_ENABLED) TokenLogWrite((Id_), 1, (u32)(A_), 0, 0); } while(0)
+#define TOKENLOG2(Id_, A_, B_)          do { if(G_u32TokenLogFlags & _TOKENLOG_ENABLED) TokenLogWrite((Id_), 2, (u32)(A_), (u32)(B_), 0); } while(0)
+#define TOKENLOG3(Id_, A_, B_, C_)      do { if(G_u32TokenLogFlags & _TOKENLOG_ENABLED) TokenLogWrite((Id_), 3, (u32)(A_), (u32)(B_), (u32)(C_)); } while(0)
+
+
+/**********************************************************************************************************************
+Function Declarations
+**********************************************************************************************************************/
+
+/*------------------------------------------------------------------------------------------------------------------*/
+/*! @publicsection */
+/*--------------------------------------------------------------------------------------------------------------------*/
+void TokenLogWrite(TokenLogIdType eId_, u8 u8Args_, u32 u32Arg0_, u32 u32Arg1_, u32 u32Arg2_);
+void TokenLogEnable(void);
+void TokenLogDisable(void);
+void TokenLogToggle(void);
+
+
+/*------------------------------------------------------------------------------------------------------------------*/
+/*! @protectedsection */
+/*--------------------------------------------------------------------------------------------------------------------*/
+void TokenLogInitialize(void);
+void TokenLogRunActiveState(void);
+
+
+/*------------------------------------------------------------------------------------------------------------------*/
+/*! @privatesection */
+/*--------------------------------------------------------------------------------------------------------------------*/
+static u8* TokenLogPutVarint(u8* pu8Target_, u32 u32Value_);
+static u8 TokenLogEncode(TokenLogRecordType* psRecord_, u8* pu8Target_);
+
+
+/***********************************************************************************************************************
+State Machine Declarations
+***********************************************************************************************************************/
+static void TokenLogSM_Idle(void);
+static void TokenLogSM_WaitSent(void);
+static void TokenLogSM_Error(void);
+
+
+#endif /* __TOKENLOG_H */
+
+
+/*--------------------------------------------------------------------------------------------------------------------*/
+/* End of File                                                                                                        */
+/*--------------------------------------------------------------------------------------------------------------------*/
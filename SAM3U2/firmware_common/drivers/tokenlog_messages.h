@@ -0,0 +1,35 @@
+/*!*********************************************************************************************************************
+@file tokenlog_messages.h
+@brief Message table for the token log (tokenlog.c).
+
+Each entry is TOKENLOG_MESSAGE(id, format).  The firmware builds TokenLogIdType from this list, so the id sent on the
+wire is the position of the entry.  tools/tokenlog_decode.py reads this same file to turn ids back into text, so the
+decoder must be run against the tree the firmware was built from.
+
+Rules for entries:
+- Only append new entries or replace retired ones in place; reordering changes the ids of logs already recorded
+- Formats may use %u %d %i %x %X %c with optional flags and width, at most TOKENLOG_MAX_ARGS conversions
+- %s is not supported since only the argument values are sent
+- Do not add include guards: the file is included once for each expansion of TOKENLOG_MESSAGE
+
+**********************************************************************************************************************/
+
+/* Reserved: generated by the token log itself */
+TOKENLOG_MESSAGE(TOKENLOG_DROPPED,            "*** %u log records dropped ***")
+TOKENLOG_MESSAGE(TOKENLOG_ENABLED,            "Token log enabled at %u ms")
+
+/* System */
+TOKENLOG_MESSAGE(TOKENLOG_TIMING_VIOLATION,   "1ms timing violation %u: loop pass took %u ms")
+
+/* SD card */
+TOKENLOG_MESSAGE(TOKENLOG_SD_CARD_READY,      "SD card ready")
+TOKENLOG_MESSAGE(TOKENLOG_SD_CLOCK_REDUCED,   "SD clock divider increased to %u")
+TOKENLOG_MESSAGE(TOKENLOG_SD_REQUEST_FAILED,  "SD request %u failed")
+
+/* Raw log recorder */
+TOKENLOG_MESSAGE(TOKENLOG_RAWLOG_BLOCK,       "RawLog block %u written to sector 0x%08x")
+
+
+/*--------------------------------------------------------------------------------------------------------------------*/
+/* End of File                                                                                                        */
+/*--------------------------------------------------------------------------------------------------------------------*/
@@ -0,0 +1,429 @@
+/*!*********************************************************************************************************************
+@file trace.c
+@brief Event trace: a flight recorder of driver and interrupt events with CPU cycle timestamps.
+
+TRACE(event, argument) stores the event id, one u32 argument, the DWT cycle count and the active exception number
+in a RAM ring of TRACE_RING_SIZE records.  The ring always holds the most recent events, so after something goes
+wrong the lead-up to it can be dumped with the "trace" command.  Because ISRs and tasks write to the same ring with a
+common clock, the dump shows the order and spacing of events such as a transfer start in a task and the ENDRX
+interrupt that finishes it.
+
+The dump is sent in binary as frames (see trace.h) paced at one message at a time so it never fills the message
+pool.  Recording pauses during the dump and the ring is cleared after it.  tools/trace_export.py turns a capture
+of the debug port into a Chrome trace JSON file that can be opened in Perfetto (ui.perfetto.dev) or
+chrome://tracing.  Event names and tracks come from trace_events.h, which is also the source of the ids.
+
+Recording starts at initialization when EVENT_TRACE is defined in configuration.h.  When EVENT_TRACE is not
+defined the TRACE() calls compile to nothing.
+
+------------------------------------------------------------------------------------------------------------------------
+GLOBALS
+- G_u32TraceFlags
+
+CONSTANTS
+- TRACE_RING_SIZE
+
+TYPES
+- TraceEventType
+- TraceRecordType
+
+PUBLIC FUNCTIONS
+- void TraceEvent(TraceEventType eEvent_, u32 u32Arg_)
+- void TraceDump(void)
+- u8 TraceCopyRecent(TraceRecordType* psTarget_, u8 u8Count_)
+
+PROTECTED FUNCTIONS
+- void TraceInitialize(void)
+- void TraceRunActiveState(void)
+
+**********************************************************************************************************************/
+
+#include "configuration.h"
+
+/***********************************************************************************************************************
+Global variable definitions with scope across entire project.
+All Global variable names shall start with "G_xxTrace"
+***********************************************************************************************************************/
+/* New variables */
+volatile u32 G_u32TraceFlags;                          /*!< @brief Global state flags */
+
+
+/*--------------------------------------------------------------------------------------------------------------------*/
+/* Existing variables (defined in other files -- should all contain the "extern" keyword) */
+extern volatile u32 G_u32SystemTime1ms;                /*!< @brief From main.c */
+extern volatile u32 G_u32SystemTime1s;                 /*!< @brief From main.c */
+extern volatile u32 G_u32SystemFlags;                  /*!< @brief From main.c */
+extern volatile u32 G_u32ApplicationFlags;             /*!< @brief From main.c */
+
+
+/***********************************************************************************************************************
+Global variable definitions with scope limited to this local application.
+Variable names shall start with "Trace_xx" and be declared as static.
+***********************************************************************************************************************/
+static fnCode_type Trace_pfStateMachine;                          /*!< @brief The state machine function pointer */
+
+static TraceRecordType Trace_asRing[TRACE_RING_SIZE];             /*!< @brief The most recent events */
+static volatile u16 Trace_u16Next;                                /*!< @brief Index of the next record to write */
+static volatile u32 Trace_u32Total;                               /*!< @brief Records written since the last dump */
+
+static u16 Trace_u16DumpIndex;                                    /*!< @brief Next record to send */
+static u16 Trace_u16DumpRemaining;                                /*!< @brief Records left to send */
+static bool Trace_bResume;                                        /*!< @brief TRUE to restart recording after the dump */
+
+static u8 Trace_au8TxBuffer[TRACE_TX_BUFFER_SIZE];                /*!< @brief The frame being sent */
+static u32 Trace_u32MessageToken;                                 /*!< @brief Token of the frame being sent */
+
+
+/**********************************************************************************************************************
+Function Definitions
+**********************************************************************************************************************/
+
+/*--------------------------------------------------------------------------------------------------------------------*/
+/*! @publicsection */
+/*--------------------------------------------------------------------------------------------------------------------*/
+
+/*!----------------------------------------------------------------------------------------------------------------------
+@fn void TraceEvent(TraceEventType eEvent_, u32 u32Arg_)
+
+@brief Stores one event in the ring.  Use the TRACE() macro rather than calling this directly.
+
+Interrupts are disabled only while the record is stored so the function can be used from interrupts.
+
+Requires:
+@param eEvent_ is the event id from trace_events.h
+@param u32Arg_ is the event argument
+
+Promises:
+- The record is written over the oldest one in the ring
+
+*/
+void TraceEvent(TraceEventType eEvent_, u32 u32Arg_)
+{
+  TraceRecordType* psRecord;
+
+  __disable_irq();
+
+  psRecord = &Trace_asRing[Trace_u16Next];
+  psRecord->u32Cycles = DWT_CYCCNT;
+  psRecord->u32Arg    = u32Arg_;
+  psRecord->u8Event   = (u8)eEvent_;
+  psRecord->u8Context = (u8)(SCB->ICSR & SCB_ICSR_VECTACTIVE);
+  Trace_u16Next = (Trace_u16Next + 1) & TRACE_RING_MASK;
+  Trace_u32Total++;
+
+  __enable_irq();
+
+} /* end TraceEvent() */
+
+
+/*!----------------------------------------------------------------------------------------------------------------------
+@fn void TraceDump(void)
+
+@brief Debug menu command to send the contents of the ring.
+
+Capture the debug port and convert it with tools/trace_export.py.
+
+Requires:
+- NONE
+
+Promises:
+- _TRACE_DUMP_REQUEST is set; the dump starts on the next pass of the Trace task
+
+*/
+void TraceDump(void)
+{
+  DebugPrintFormat("\n\rEvent trace: dumping %u records\n\r",
+                   (Trace_u32Total < TRACE_RING_SIZE) ? Trace_u32Total : TRACE_RING_SIZE);
+  G_u32TraceFlags |= _TRACE_DUMP_REQUEST;
+  SchedulerSignal(PROFILER_TASK_TRACE);
+
+} /* end TraceDump() */
+
+
+/*!----------------------------------------------------------------------------------------------------------------------
+@fn u8 TraceCopyRecent(TraceRecordType* psTarget_, u8 u8Count_)
+
+@brief Copies the most recent records out of the ring, oldest first.
+
+Used by the crash log to keep the lead-up to a fault.  The ring is not locked, so call it from a fault handler or
+with interrupts disabled.
+
+Requires:
+@param psTarget_ points to room for u8Count_ records
+@param u8Count_ is the most records to copy
+
+Promises:
+- Up to u8Count_ records are copied to psTarget_
+- Returns the number copied
+
+*/
+u8 TraceCopyRecent(TraceRecordType* psTarget_, u8 u8Count_)
+{
+  u16 u16Index;
+
+  if(Trace_u32Total < u8Count_)
+  {
+    u8Count_ = (u8)Trace_u32Total;
+  }
+
+  u16Index = (Trace_u16Next - u8Count_) & TRACE_RING_MASK;
+  for(u8 i = 0; i < u8Count_; i++)
+  {
+    psTarget_[i] = Trace_asRing[u16Index];
+    u16Index = (u16Index + 1) & TRACE_RING_MASK;
+  }
+
+  return u8Count_;
+
+} /* end TraceCopyRecent() */
+
+
+/*--------------------------------------------------------------------------------------------------------------------*/
+/*! @protectedsection */
+/*--------------------------------------------------------------------------------------------------------------------*/
+
+/*!----------------------------------------------------------------------------------------------------------------------
+@fn void TraceInitialize(void)
+
+@brief Clears the ring, starts the cycle counter and starts recording.
+
+Requires:
+- DebugInitialize() has run
+
+Promises:
+- DWT_CYCCNT is counting
+- The ring is empty and recording is enabled if EVENT_TRACE is defined
+- The state machine is in Idle, or Error if the debug port is not available
+- "trace" is added to the debug menu
+- The task runs only when a dump is requested or in progress
+
+*/
+void TraceInitialize(void)
+{
+  /* The profiler may also use the counter, so only start it */
+  CoreDebug->DEMCR |= CoreDebug_DEMCR_TRCENA;
+  DWT_CTRL |= DWT_CTRL_CYCCNTENA;
+
+  G_u32TraceFlags = 0;
+  Trace_u16Next = 0;
+  Trace_u32Total = 0;
+  Trace_u32MessageToken = 0;
+
+  if(G_u32ApplicationFlags & _APPLICATION_FLAGS_DEBUG)
+  {
+#ifdef EVENT_TRACE
+    G_u32TraceFlags |= _TRACE_ENABLED;
+#endif /* EVENT_TRACE */
+
+    G_u32ApplicationFlags |= _APPLICATION_FLAGS_TRACE;
+    DebugCommandRegister("trace", "Dump event trace", TraceDump);
+    SchedulerSetEventDriven(PROFILER_TASK_TRACE);
+    Trace_pfStateMachine = TraceSM_Idle;
+  }
+  else
+  {
+    /* Without the debug task there are no dumps, so the task never needs to run */
+    SchedulerSetEventDriven(PROFILER_TASK_TRACE);
+    Trace_pfStateMachine = TraceSM_Error;
+  }
+
+} /* end TraceInitialize() */
+
+
+/*!----------------------------------------------------------------------------------------------------------------------
+@fn void TraceRunActiveState(void)
+
+@brief Selects and runs one iteration of the current state in the state machine.
+
+All state machines have a TOTAL of 1ms to execute, so on average n state machines
+may take 1ms / n to execute.
+
+Requires:
+- State machine function pointer points at current state
+
+Promises:
+- Calls the function to pointed by the state machine function pointer
+- The task stays scheduled until a dump is finished
+
+*/
+void TraceRunActiveState(void)
+{
+  Trace_pfStateMachine();
+
+  if( (Trace_pfStateMachine != TraceSM_Idle) || (G_u32TraceFlags & _TRACE_DUMP_REQUEST) )
+  {
+    SchedulerSignal(PROFILER_TASK_TRACE);
+  }
+
+} /* end TraceRunActiveState */
+
+
+/*--------------------------------------------------------------------------------------------------------------------*/
+/*! @privatesection */
+/*--------------------------------------------------------------------------------------------------------------------*/
+
+/*!----------------------------------------------------------------------------------------------------------------------
+@fn static u8* TracePutU32(u8* pu8Target_, u32 u32Value_)
+
+@brief Writes a value as 4 little-endian bytes.
+
+Requires:
+@param pu8Target_ has room for 4 bytes
+@param u32Value_ is the value to write
+
+Promises:
+- Returns the location after the last byte written
+
+*/
+static u8* TracePutU32(u8* pu8Target_, u32 u32Value_)
+{
+  for(u8 i = 0; i < 4; i++)
+  {
+    *pu8Target_++ = (u8)u32Value_;
+    u32Value_ >>= 8;
+  }
+
+  return pu8Target_;
+
+} /* end TracePutU32() */
+
+
+/*!----------------------------------------------------------------------------------------------------------------------
+@fn static bool TraceSendFrame(u8 u8Type_, u8 u8Size_)
+
+@brief Adds the frame start, length and type to the data in Trace_au8TxBuffer and queues it.
+
+Requires:
+@param u8Type_ is the frame type
+@param u8Size_ is the number of data bytes already written from Trace_au8TxBuffer[TRACE_FRAME_OVERHEAD]
+
+Promises:
+- Returns TRUE if the frame was queued and Trace_u32MessageToken is its token
+- Returns FALSE if the message queue is full
+
+*/
+static bool TraceSendFrame(u8 u8Type_, u8 u8Size_)
+{
+  Trace_au8TxBuffer[0] = TRACE_FRAME_START;
+  Trace_au8TxBuffer[1] = u8Size_ + 1;
+  Trace_au8TxBuffer[2] = u8Type_;
+
+  Trace_u32MessageToken = DebugWriteData(u8Size_ + TRACE_FRAME_OVERHEAD, &Trace_au8TxBuffer[0]);
+
+  return (Trace_u32MessageToken != 0);
+
+} /* end TraceSendFrame() */
+
+
+/***********************************************************************************************************************
+State Machine Function Definitions
+***********************************************************************************************************************/
+
+/*-------------------------------------------------------------------------------------------------------------------*/
+/* Wait for a dump request, then freeze the ring and send the header */
+static void TraceSM_Idle(void)
+{
+  u8* pu8Parser;
+  u16 u16Count;
+
+  if( !(G_u32TraceFlags & _TRACE_DUMP_REQUEST) )
+  {
+    return;
+  }
+
+  /* Stop recording so the records being sent are not overwritten */
+  Trace_bResume = (bool)((G_u32TraceFlags & _TRACE_ENABLED) != 0);
+  G_u32TraceFlags &= ~_TRACE_ENABLED;
+
+  u16Count = (Trace_u32Total < TRACE_RING_SIZE) ? (u16)Trace_u32Total : TRACE_RING_SIZE;
+
+  pu8Parser = &Trace_au8TxBuffer[TRACE_FRAME_OVERHEAD];
+  *pu8Parser++ = TRACE_FORMAT_VERSION;
+  *pu8Parser++ = (u8)sizeof(TraceRecordType);
+  *pu8Parser++ = (u8)u16Count;
+  *pu8Parser++ = (u8)(u16Count >> 8);
+  pu8Parser = TracePutU32(pu8Parser, CCLK_VALUE);
+  pu8Parser = TracePutU32(pu8Parser, Trace_u32Total - u16Count);
+  pu8Parser = TracePutU32(pu8Parser, DWT_CYCCNT);
+  pu8Parser = TracePutU32(pu8Parser, G_u32SystemTime1ms);
+
+  /* A full message queue leaves the request set to try again next time */
+  if(TraceSendFrame(TRACE_FRAME_HEADER, TRACE_HEADER_SIZE))
+  {
+    G_u32TraceFlags &= ~_TRACE_DUMP_REQUEST;
+    Trace_u16DumpRemaining = u16Count;
+    Trace_u16DumpIndex = (Trace_u16Next - u16Count) & TRACE_RING_MASK;
+    Trace_pfStateMachine = TraceSM_WaitSent;
+  }
+  else if(Trace_bResume)
+  {
+    G_u32TraceFlags |= _TRACE_ENABLED;
+  }
+
+} /* end TraceSM_Idle() */
+
+
+/*-------------------------------------------------------------------------------------------------------------------*/
+/* Send the next frame of records, or finish the dump */
+static void TraceSM_SendRecords(void)
+{
+  u8 u8Records = 0;
+  u8* pu8Parser = &Trace_au8TxBuffer[TRACE_FRAME_OVERHEAD];
+
+  if(Trace_u16DumpRemaining == 0)
+  {
+    /* Start a fresh recording so the next dump only has new events */
+    Trace_u32Total = 0;
+    if(Trace_bResume)
+    {
+      G_u32TraceFlags |= _TRACE_ENABLED;
+    }
+
+    Trace_pfStateMachine = TraceSM_Idle;
+    return;
+  }
+
+  while( (u8Records < TRACE_FRAME_RECORDS_MAX) && (u8Records < Trace_u16DumpRemaining) )
+  {
+    memcpy(pu8Parser, &Trace_asRing[(Trace_u16DumpIndex + u8Records) & TRACE_RING_MASK], sizeof(TraceRecordType));
+    pu8Parser += sizeof(TraceRecordType);
+    u8Records++;
+  }
+
+  /* Retry next time if the message queue is full */
+  if(TraceSendFrame(TRACE_FRAME_RECORDS, (u8)(pu8Parser - &Trace_au8TxBuffer[TRACE_FRAME_OVERHEAD])))
+  {
+    Trace_u16DumpIndex = (Trace_u16DumpIndex + u8Records) & TRACE_RING_MASK;
+    Trace_u16DumpRemaining -= u8Records;
+    Trace_pfStateMachine = TraceSM_WaitSent;
+  }
+
+} /* end TraceSM_SendRecords() */
+
+
+/*-------------------------------------------------------------------------------------------------------------------*/
+/* Wait for the last frame to leave the queue before building the next one */
+static void TraceSM_WaitSent(void)
+{
+  MessageStateType eStatus = QueryMessageStatus(Trace_u32MessageToken);
+
+  if( (eStatus != WAITING) && (eStatus != SENDING) )
+  {
+    Trace_pfStateMachine = TraceSM_SendRecords;
+  }
+
+} /* end TraceSM_WaitSent() */
+
+
+/*-------------------------------------------------------------------------------------------------------------------*/
+/* No debug port: events are recorded but cannot be dumped */
+static void TraceSM_Error(void)
+{
+  G_u32TraceFlags &= ~_TRACE_DUMP_REQUEST;
+
+} /* end TraceSM_Error() */
+
+
+/*--------------------------------------------------------------------------------------------------------------------*/
+/* End of File                                                                                                        */
+/*--------------------------------------------------------------------------------------------------------------------*/
@@ -0,0 +1,135 @@
+/*!*********************************************************************************************************************
+@file trace.h
+@brief Header file for trace.c
+
+**********************************************************************************************************************/
+
+#ifndef __TRACE_H
+#define __TRACE_H
+
+/**********************************************************************************************************************
+Type Definitions
+**********************************************************************************************************************/
+
+/*!
+@enum TraceEventType
+@brief Event ids, one per entry of trace_events.h in the same order.
+*/
+typedef enum {
+#define TRACE_EVENT(Id_, Kind_, Track_, Name_)  Id_,
+#include "trace_events.h"
+#undef TRACE_EVENT
+              TRACE_EVENTS} TraceEventType;
+
+/*!
+@struct TraceRecordType
+@brief One event in the ring.  The dump sends the records as they are stored (little-endian, 12 bytes).
+*/
+typedef struct
+{
+  u32 u32Cycles;                      /*!< @brief DWT_CYCCNT when the event was recorded */
+  u32 u32Arg;                         /*!< @brief Event argument */
+  u8 u8Event;                         /*!< @brief TraceEventType */
+  u8 u8Context;                       /*!< @brief Active exception number: 0 for the main loop, 16+ for interrupts */
+  u16 u16Pad;
+} TraceRecordType;
+
+
+/**********************************************************************************************************************
+Constants / Definitions
+**********************************************************************************************************************/
+#define TRACE_RING_SIZE                 (u16)256            /*!< @brief Records kept; must be a power of 2 */
+#define TRACE_RING_MASK                 (u16)(TRACE_RING_SIZE - 1)
+
+/* G_u32TraceFlags */
+#define _TRACE_ENABLED                  (u32)0x00000001     /*!< @brief Set to record events */
+#define _TRACE_DUMP_REQUEST             (u32)0x00000002     /*!< @brief Set to start a dump of the ring */
+/* end G_u32TraceFlags */
+
+/*! @cond DOXYGEN_EXCLUDE */
+/*----------------------------------------------------------------------------------------------------------------------
+Dump format
+
+The ring is sent on the debug port as frames mixed with normal ASCII output:
+  [0] TRACE_FRAME_START (ASCII GS, never used in text output)
+  [1] number of bytes that follow
+  [2] frame type, then the frame data (all values little-endian)
+
+TRACE_FRAME_HEADER: u8 version, u8 record size, u16 record count, u32 CPU clock in Hz, u32 records lost to
+                    overwriting, u32 DWT_CYCCNT and u32 G_u32SystemTime1ms at the start of the dump
+TRACE_FRAME_RECORDS: up to TRACE_FRAME_RECORDS_MAX TraceRecordType records, oldest first
+*/
+#define TRACE_FRAME_START               (u8)0x1D
+#define TRACE_FRAME_OVERHEAD            (u8)3
+#define TRACE_FRAME_HEADER              (u8)'H'
+#define TRACE_FRAME_RECORDS             (u8)'R'
+#define TRACE_FORMAT_VERSION            (u8)1
+#define TRACE_HEADER_SIZE               (u8)20
+#define TRACE_FRAME_RECORDS_MAX         (u8)((U16_MAX_TX_MESSAGE_LENGTH - TRACE_FRAME_OVERHEAD) / sizeof(TraceRecordType))
+#define TRACE_TX_BUFFER_SIZE            (u16)U16_MAX_TX_MESSAGE_LENGTH
+
+#define SCB_ICSR_VECTACTIVE             (u32)0x000001FF     /* Active exception number in SCB->ICSR */
+/*! @endcond */
+
+/*!
+@brief Packs an instance number and a value into one argument for the "b" / "e" events of trace_events.h.
+*/
+#define TRACE_INSTANCE_ARG(Instance_, Value_)  ( ((u32)(Instance_) << 16) | ((u32)(Value_) & 0xFFFF) )
+
+/*!
+@brief Records one event: TRACE(id, argument).
+
+When tracing is off a call costs one flag test.  Without EVENT_TRACE defined the call is removed.
+Safe to use from interrupts.
+
+Example:
+TRACE(TRACE_BUTTON_EDGE, u8Button);
+*/
+#ifdef EVENT_TRACE
+#define TRACE(Event_, Arg_)             do { if(G_u32TraceFlags & _TRACE_ENABLED) TraceEvent((Event_), (u32)(Arg_)); } while(0)
+#else
+#define TRACE(Event_, Arg_)
+#endif /* EVENT_TRACE */
+
+
+/**********************************************************************************************************************
+Function Declarations
+**********************************************************************************************************************/
+
+/*------------------------------------------------------------------------------------------------------------------*/
+/*! @publicsection */
+/*--------------------------------------------------------------------------------------------------------------------*/
+void TraceEvent(TraceEventType eEvent_, u32 u32Arg_);
+void TraceDump(void);
+u8 TraceCopyRecent(TraceRecordType* psTarget_, u8 u8Count_);
+
+
+/*------------------------------------------------------------------------------------------------------------------*/
+/*! @protectedsection */
+/*--------------------------------------------------------------------------------------------------------------------*/
+void TraceInitialize(void);
+void TraceRunActiveState(void);
+
+
+/*------------------------------------------------------------------------------------------------------------------*/
+/*! @privatesection */
+/*--------------------------------------------------------------------------------------------------------------------*/
+static u8* TracePutU32(u8* pu8Target_, u32 u32Value_);
+static bool TraceSendFrame(u8 u8Type_, u8 u8Size_);
+
+
+/***********************************************************************************************************************
+State Machine Declarations
+***********************************************************************************************************************/
+static void TraceSM_Idle(void);
+static void TraceSM_SendRecords(void);
+static void TraceSM_WaitSent(void);
+static void TraceSM_Error(void);
+
+
+#endif /* __TRACE_H */
+
+
+/*--------------------------------------------------------------------------------------------------------------------*/
+/* End of File                                                                                                        */
+/*--------------------------------------------------------------------------------------------------------------------*/
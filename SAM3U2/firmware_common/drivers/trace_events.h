@@ -0,0 +1,44 @@
+/*!*********************************************************************************************************************
+@file trace_events.h
+@brief Event table for the event trace (trace.c).
+
+Each entry is TRACE_EVENT(id, kind, track, name).  The firmware builds TraceEventType from the ids, so the id stored
+in a record is the position of the entry.  tools/trace_export.py reads this same file to name the events when it
+builds the timeline, so it must be run against the tree the firmware was built from.
+
+kind is the Chrome trace event phase used on the host:
+- "i" instant event
+- "B" / "E" begin and end of a slice on the track.  Slices on one track must nest.
+- "b" / "e" begin and end of an overlapping (async) slice.  The upper 16 bits of the record argument identify the
+  instance (use TRACE_INSTANCE_ARG()), so transfers on several peripherals can overlap on one track.
+
+Rules for entries:
+- Only append new entries or replace retired ones in place; reordering changes the ids of dumps already captured
+- Do not add include guards: the file is included once for each expansion of TRACE_EVENT
+
+**********************************************************************************************************************/
+
+/* System */
+TRACE_EVENT(TRACE_MARK,                 "i", "System",  "Mark")
+TRACE_EVENT(TRACE_TIMING_VIOLATION,     "i", "System",  "1ms timing violation")
+
+/* Buttons: argument is the button number */
+TRACE_EVENT(TRACE_BUTTON_EDGE,          "i", "Buttons", "Button edge")
+
+/* UART: argument is TRACE_INSTANCE_ARG(peripheral id, bytes) */
+TRACE_EVENT(TRACE_UART_TX_START,        "b", "UART",    "UART tx")
+TRACE_EVENT(TRACE_UART_ENDTX,           "e", "UART",    "UART tx")
+
+/* SSP: argument is TRACE_INSTANCE_ARG(peripheral id, bytes) */
+TRACE_EVENT(TRACE_SSP_TX_START,         "b", "SSP",     "SSP tx")
+TRACE_EVENT(TRACE_SSP_ENDTX,            "e", "SSP",     "SSP tx")
+TRACE_EVENT(TRACE_SSP_RX_START,         "b", "SSP",     "SSP rx")
+TRACE_EVENT(TRACE_SSP_ENDRX,            "e", "SSP",     "SSP rx")
+
+/* SD card: argument is the address of the new state function */
+TRACE_EVENT(TRACE_SD_STATE,             "i", "SD",      "SD state")
+
+
+/*--------------------------------------------------------------------------------------------------------------------*/
+/* End of File                                                                                                        */
+/*--------------------------------------------------------------------------------------------------------------------*/
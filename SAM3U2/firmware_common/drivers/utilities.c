@@ -20,6 +20,8 @@ PUBLIC FUNCTIONS
 - u8 HexToASCIICharLower(u8 u8Char_);
 - u8 NumberToAscii(u32 u32Number_, u8* pu8AsciiString_);
 - bool SearchString(u8* pu8TargetString_, u8* pu8MatchString_);
+- u32 Crc32(u32 u32Crc_, u8* pu8Data_, u32 u32Size_);
+- u16 StringFormat(u8* pu8Target_, u16 u16Size_, u8* pu8Format_, va_list vaArgs_);
 
 PROTECTED FUNCTIONS
 - NONE
@@ -66,8 +68,10 @@ Function Definitions
 @brief Checks if the difference between the current G_u32SystemTime1ms and the 
 saved G_u32SystemTime1ms is greater than the period specified. 
 
-The referenced current time is always G_u32SystemTime1ms.  The function 
-handles rollover of G_u32SystemTime1ms.
+The referenced current time is always G_u32SystemTime1ms.  Unsigned 
+subtraction handles rollover of G_u32SystemTime1ms without a special case.
+Tasks with timeouts that do not need to be checked every pass should use 
+a SoftTimerType (softtimer.c) instead.
 
 Example
 #define U32_PERIOD    (u32)1000
@@ -91,27 +95,8 @@ Promises:
 */
 bool IsTimeUp(u32 *pu32SavedTick_, u32 u32Period_)
 {
-  u32 u32TimeElapsed;
-  
-  /* Check to see if the timer in question has rolled */
-  if(G_u32SystemTime1ms >= *pu32SavedTick_)
-  {
-    u32TimeElapsed = G_u32SystemTime1ms - *pu32SavedTick_;
-  }
-  else
-  {
-    u32TimeElapsed = (0xFFFFFFFF - *pu32SavedTick_) + G_u32SystemTime1ms;
-  }
-
-  /* Now determine if time is up */
-  if(u32TimeElapsed < u32Period_)
-  {
-    return(FALSE);
-  }
-  else
-  {
-    return(TRUE);
-  }
+  /* Modulo 2^32 arithmetic gives the right answer across a rollover */
+  return( (G_u32SystemTime1ms - *pu32SavedTick_) >= u32Period_ );
 
 } /* end IsTimeUp() */
 
@@ -221,6 +206,8 @@ u8 HexToASCIICharLower(u8 u8Char_)
 
 @brief Converts a long into an ASCII string.  Maximum of 10 digits + NULL.
 
+Digits are found with a reciprocal multiply instead of division (see UtilDecimalDigits()).
+
 Requires:
 @param u32Number_ is the number to convert
 @param *pu8AsciiString_ points to the destination string location which must
@@ -233,45 +220,18 @@ Promises:
 */
 u8 NumberToAscii(u32 u32Number_, u8* pu8AsciiString_)
 {
-  bool bFoundDigit = FALSE;
-  u8 au8AsciiNumber[11];
-  u8 u8CharCount = 0;
-  u32 u32Divider = 1000000000;
-  u8 u8Temp;
+  u8 au8AsciiNumber[10];
+  u8 u8CharCount;
   
-  /* Parse out all the digits, start counting after leading zeros */
-  for(u8 i = 0; i < 10; i++)
-  {
-    u8Temp = (u32Number_ / u32Divider);
-    
-    /* Check for first non-leading zero */
-    if(u8Temp != 0)
-    {
-      bFoundDigit = TRUE;
-    }
-
-    /* As long as a non-leading zero has been found, add the ASCII char */
-    if(bFoundDigit)
-    {
-      au8AsciiNumber[u8CharCount] = u8Temp + 0x30;
-      u8CharCount++;
-    }
-    
-    /* Update for next iteration */
-    u32Number_ %= u32Divider;
-    u32Divider /= 10;
-  }
+  /* Digits are written backwards from the end of the array */
+  u8CharCount = UtilDecimalDigits(u32Number_, &au8AsciiNumber[10]);
   
-  /* Handle special case where u32Number == 0 */
-  if(!bFoundDigit)
+  /* Copy to the destination and add the null */
+  for(u8 i = 0; i < u8CharCount; i++)
   {
-    u8CharCount = 1;
-    au8AsciiNumber[0] = '0';
+    pu8AsciiString_[i] = au8AsciiNumber[10 - u8CharCount + i];
   }
-  
-  /* Add the null and copy to destination */
-  au8AsciiNumber[u8CharCount] = '\0';
-  strcpy((char *)pu8AsciiString_, (const char*)au8AsciiNumber);
+  pu8AsciiString_[u8CharCount] = '\0';
   
   return(u8CharCount);
 
@@ -355,6 +315,248 @@ bool SearchString(u8* pu8TargetString_, u8* pu8MatchString_)
 } /* end SearchString */
 
 
+/*!----------------------------------------------------------------------------------------------------------------------
+@fn u32 Crc32(u32 u32Crc_, u8* pu8Data_, u32 u32Size_)
+
+@brief Updates a standard CRC-32 (IEEE 802.3, reflected polynomial 0xEDB88320) over a block of data.
+
+A 16-entry table is used so each byte takes two lookups instead of eight shifts.  The result
+matches zlib's crc32() so host tools can check the same data.
+
+Example
+u32 u32Crc = Crc32(0, au8Block, sizeof(au8Block));
+
+Requires:
+@param u32Crc_ is 0 to start or the result of a previous call to continue
+@param pu8Data_ points to the data
+@param u32Size_ is the number of bytes
+
+Promises:
+- Returns the updated CRC
+
+*/
+u32 Crc32(u32 u32Crc_, u8* pu8Data_, u32 u32Size_)
+{
+  static const u32 au32Crc32Nibble[16] =
+  {
+    0x00000000, 0x1DB71064, 0x3B6E20C8, 0x26D930AC, 0x76DC4190, 0x6B6B51F4, 0x4DB26158, 0x5005713C,
+    0xEDB88320, 0xF00F9344, 0xD6D6A3E8, 0xCB61B38C, 0x9B64C2B0, 0x86D3D2D4, 0xA00AE278, 0xBDBDF21C
+  };
+
+  u32Crc_ = ~u32Crc_;
+  while(u32Size_--)
+  {
+    u32Crc_ ^= *pu8Data_++;
+    u32Crc_ = (u32Crc_ >> 4) ^ au32Crc32Nibble[u32Crc_ & 0x0F];
+    u32Crc_ = (u32Crc_ >> 4) ^ au32Crc32Nibble[u32Crc_ & 0x0F];
+  }
+
+  return(~u32Crc_);
+
+} /* end Crc32() */
+
+
+/*!----------------------------------------------------------------------------------------------------------------------
+@fn u16 StringFormat(u8* pu8Target_, u16 u16Size_, u8* pu8Format_, va_list vaArgs_)
+
+@brief Renders a printf-style format string into a buffer.
+
+A small subset of printf so that a whole line can be built without the C library:
+  %u %d %i   decimal (arguments are 32 bits)
+  %x %X      hex, lower or upper case
+  %s         NULL-terminated string
+  %c         character
+  %%         a percent sign
+Each conversion may have a '-' flag (left justify), a '0' flag (pad numbers with zeros) and a
+width, e.g. "%-10s" or "%08X".  No division is used: decimal digits come from a reciprocal
+multiply and hex digits from shifts.
+
+Example:
+va_list vaArgs;
+va_start(vaArgs, pu8Format_);
+u16Length = StringFormat(au8Buffer, sizeof(au8Buffer), pu8Format_, vaArgs);
+va_end(vaArgs);
+
+Requires:
+@param pu8Target_ is the destination buffer
+@param u16Size_ is the size of the destination including the NULL
+@param pu8Format_ is the NULL-terminated format string
+@param vaArgs_ holds the arguments for the conversions
+
+Promises:
+- pu8Target_ holds the NULL-terminated result, truncated if it would not fit
+- Returns the number of characters written, not counting the NULL
+
+*/
+u16 StringFormat(u8* pu8Target_, u16 u16Size_, u8* pu8Format_, va_list vaArgs_)
+{
+  u8 au8Digits[10];
+  u8* pu8Field;
+  u8* pu8End = pu8Target_ + u16Size_ - 1;
+  u8* pu8Output = pu8Target_;
+  u8 u8FieldLength;
+  u8 u8Width;
+  u8 u8Fill;
+  u8 u8Pad;
+  u8 u8Char;
+  bool bLeftJustify;
+  bool bNegative;
+  u32 u32Value;
+  
+  if(u16Size_ == 0)
+  {
+    return(0);
+  }
+  
+  while( (*pu8Format_ != '\0') && (pu8Output < pu8End) )
+  {
+    /* Plain characters are copied */
+    if(*pu8Format_ != '%')
+    {
+      *pu8Output++ = *pu8Format_++;
+      continue;
+    }
+    pu8Format_++;
+    
+    /* Flags and width */
+    bLeftJustify = FALSE;
+    u8Pad = ' ';
+    u8Width = 0;
+    while( (*pu8Format_ == '-') || (*pu8Format_ == '0') )
+    {
+      if(*pu8Format_ == '-')
+      {
+        bLeftJustify = TRUE;
+      }
+      else
+      {
+        u8Pad = '0';
+      }
+      pu8Format_++;
+    }
+    while( (*pu8Format_ >= '0') && (*pu8Format_ <= '9') )
+    {
+      u8Width = (u8Width * 10) + (*pu8Format_ - '0');
+      pu8Format_++;
+    }
+    
+    /* Render the field into au8Digits (numbers, backwards from the end) or point at the string */
+    bNegative = FALSE;
+    u8Char = *pu8Format_;
+    if(u8Char != '\0')
+    {
+      pu8Format_++;
+    }
+    
+    switch(u8Char)
+    {
+      case 'd':
+      case 'i':
+      {
+        u32Value = va_arg(vaArgs_, u32);
+        if((s32)u32Value < 0)
+        {
+          bNegative = TRUE;
+          u32Value = (u32)(-(s32)u32Value);
+        }
+        u8FieldLength = UtilDecimalDigits(u32Value, &au8Digits[10]);
+        pu8Field = &au8Digits[10 - u8FieldLength];
+        break;
+      }
+      
+      case 'u':
+      {
+        u8FieldLength = UtilDecimalDigits(va_arg(vaArgs_, u32), &au8Digits[10]);
+        pu8Field = &au8Digits[10 - u8FieldLength];
+        break;
+      }
+      
+      case 'x':
+      case 'X':
+      {
+        u32Value = va_arg(vaArgs_, u32);
+        pu8Field = &au8Digits[10];
+        do
+        {
+          pu8Field--;
+          *pu8Field = (u8Char == 'x') ? HexToASCIICharLower(u32Value & 0x0F) : HexToASCIICharUpper(u32Value & 0x0F);
+          u32Value >>= 4;
+        } while(u32Value != 0);
+        u8FieldLength = (u8)(&au8Digits[10] - pu8Field);
+        break;
+      }
+      
+      case 's':
+      {
+        pu8Field = va_arg(vaArgs_, u8*);
+        u8Pad = ' ';
+        for(u8FieldLength = 0; (pu8Field[u8FieldLength] != '\0') && (u8FieldLength < 0xFF); u8FieldLength++);
+        break;
+      }
+      
+      case 'c':
+      {
+        au8Digits[0] = (u8)va_arg(vaArgs_, u32);
+        pu8Field = &au8Digits[0];
+        u8FieldLength = 1;
+        u8Pad = ' ';
+        break;
+      }
+      
+      default:
+      {
+        /* %% and anything unknown is copied as is */
+        au8Digits[0] = u8Char;
+        pu8Field = &au8Digits[0];
+        u8FieldLength = (u8Char == '\0') ? 0 : 1;
+        u8Width = 0;
+        break;
+      }
+    } /* end switch(u8Char) */
+    
+    /* Pad to the width (the sign counts as part of the field) */
+    u8Fill = 0;
+    if(u8Width > (u8FieldLength + (bNegative ? 1 : 0)))
+    {
+      u8Fill = u8Width - (u8FieldLength + (bNegative ? 1 : 0));
+    }
+    
+    /* A zero-padded negative number has the sign before the zeros */
+    if(bNegative && (u8Pad == '0') && (pu8Output < pu8End))
+    {
+      *pu8Output++ = '-';
+      bNegative = FALSE;
+    }
+
+    while( !bLeftJustify && (u8Fill != 0) && (pu8Output < pu8End) )
+    {
+      *pu8Output++ = u8Pad;
+      u8Fill--;
+    }
+
+    if(bNegative && (pu8Output < pu8End))
+    {
+      *pu8Output++ = '-';
+    }
+    
+    for(u8 i = 0; (i < u8FieldLength) && (pu8Output < pu8End); i++)
+    {
+      *pu8Output++ = pu8Field[i];
+    }
+    
+    while( (u8Fill != 0) && (pu8Output < pu8End) )
+    {
+      *pu8Output++ = ' ';
+      u8Fill--;
+    }
+  } /* end while */
+  
+  *pu8Output = '\0';
+  return((u16)(pu8Output - pu8Target_));
+
+} /* end StringFormat() */
+
+
 /*--------------------------------------------------------------------------------------------------------------------*/
 /*! @protectedsection */                                                                                            
 /*--------------------------------------------------------------------------------------------------------------------*/
@@ -363,6 +565,40 @@ bool SearchString(u8* pu8TargetString_, u8* pu8MatchString_)
 /*! @privatesection */                                                                                            
 /*--------------------------------------------------------------------------------------------------------------------*/
 
+/*!----------------------------------------------------------------------------------------------------------------------
+@fn static u8 UtilDecimalDigits(u32 u32Number_, u8* pu8End_)
+
+@brief Writes the decimal digits of a number backwards, ending just before pu8End_.
+
+The Cortex-M3 divide takes up to 12 cycles and the old digit loop needed two divisions
+and a modulo for each of 10 digits.  Here each digit costs one 32x32->64 multiply:
+n / 10 == (n * 0xCCCCCCCD) >> 35 holds for every 32-bit n.
+
+Requires:
+@param u32Number_ is the number to convert
+@param pu8End_ points one past the last digit; up to 10 bytes before it are written
+
+Promises:
+- The ASCII digits (no leading zeros, "0" for zero) end at pu8End_ - 1
+- Returns the number of digits
+
+*/
+static u8 UtilDecimalDigits(u32 u32Number_, u8* pu8End_)
+{
+  u8* pu8Digit = pu8End_;
+  u32 u32Quotient;
+  
+  do
+  {
+    u32Quotient = (u32)(((u64)u32Number_ * 0xCCCCCCCDull) >> 35);
+    *--pu8Digit = (u8)(u32Number_ - (u32Quotient * 10)) + NUMBER_ASCII_TO_DEC;
+    u32Number_ = u32Quotient;
+  } while(u32Number_ != 0);
+  
+  return((u8)(pu8End_ - pu8Digit));
+
+} /* end UtilDecimalDigits() */
+
 
 
 
@@ -54,6 +54,8 @@ u8 HexToASCIICharUpper(u8 u8Char_);
 u8 HexToASCIICharLower(u8 u8Char_);
 u8 NumberToAscii(u32 u32Number_, u8* pu8AsciiString_);
 bool SearchString(u8* pu8TargetString_, u8* pu8MatchString_);
+u32 Crc32(u32 u32Crc_, u8* pu8Data_, u32 u32Size_);
+u16 StringFormat(u8* pu8Target_, u16 u16Size_, u8* pu8Format_, va_list vaArgs_);
 
 
 /*--------------------------------------------------------------------------------------------------------------------*/
@@ -64,6 +66,7 @@ bool SearchString(u8* pu8TargetString_, u8* pu8MatchString_);
 /*--------------------------------------------------------------------------------------------------------------------*/
 /*! @privatesection */                                                                                            
 /*--------------------------------------------------------------------------------------------------------------------*/
+static u8 UtilDecimalDigits(u32 u32Number_, u8* pu8End_);
 
 
 #endif /* __UTILITIES_H */
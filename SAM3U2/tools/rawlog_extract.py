@@ -0,0 +1,98 @@
+#!/usr/bin/env python3
+"""Extract records written by firmware_ascii/drivers/rawlog.c from an SD card image.
+
+Make an image of the card first, e.g.
+  dd if=/dev/sdX of=card.img bs=512 skip=1048576 count=1048576
+and pass --first-sector 0 for a partial image like this one, or read the whole card and
+use the defaults.
+
+Valid blocks (magic and CRC-32 correct) are sorted by sequence number so the output is
+in the order the records were logged, across any number of wraps of the region.
+"""
+
+import argparse
+import struct
+import sys
+import zlib
+
+BLOCK_SIZE = 512
+HEADER_FORMAT = "<IIHH"
+HEADER_SIZE = struct.calcsize(HEADER_FORMAT)
+CRC_OFFSET = BLOCK_SIZE - 4
+MAGIC = 0x474F4C52
+
+# Defaults match rawlog.h
+DEFAULT_FIRST_SECTOR = 0x00100000
+DEFAULT_SECTOR_COUNT = 0x00100000
+
+
+def read_blocks(image, first_sector, sector_count):
+    """Yield (index, sequence, records) for every valid block in the region."""
+    image.seek(first_sector * BLOCK_SIZE)
+    for index in range(sector_count):
+        block = image.read(BLOCK_SIZE)
+        if len(block) < BLOCK_SIZE:
+            break
+
+        magic, sequence, count, record_size = struct.unpack_from(HEADER_FORMAT, block)
+        if magic != MAGIC:
+            continue
+        (crc,) = struct.unpack_from("<I", block, CRC_OFFSET)
+        if crc != zlib.crc32(block[:CRC_OFFSET]):
+            continue
+        if record_size == 0 or HEADER_SIZE + count * record_size > CRC_OFFSET:
+            continue
+
+        records = [block[HEADER_SIZE + i * record_size:HEADER_SIZE + (i + 1) * record_size]
+                   for i in range(count)]
+        yield index, sequence, records
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__,
+                                     formatter_class=argparse.RawDescriptionHelpFormatter)
+    parser.add_argument("image", help="card image file")
+    parser.add_argument("-o", "--output", help="output file (default stdout)")
+    parser.add_argument("--first-sector", type=lambda s: int(s, 0), default=DEFAULT_FIRST_SECTOR,
+                        help="first sector of the region in the image (default 0x%X)" % DEFAULT_FIRST_SECTOR)
+    parser.add_argument("--sector-count", type=lambda s: int(s, 0), default=DEFAULT_SECTOR_COUNT,
+                        help="sectors in the region (default 0x%X)" % DEFAULT_SECTOR_COUNT)
+    parser.add_argument("--format", choices=("hex", "csv", "bin"), default="hex",
+                        help="hex: one record per line; csv: sequence,record,hex; bin: raw records")
+    args = parser.parse_args()
+
+    with open(args.image, "rb") as image:
+        blocks = sorted(read_blocks(image, args.first_sector, args.sector_count),
+                        key=lambda block: block[1])
+
+    if not blocks:
+        sys.stderr.write("No valid blocks found\n")
+        return 1
+
+    gaps = sum(1 for a, b in zip(blocks, blocks[1:]) if b[1] != a[1] + 1)
+    sys.stderr.write("%d blocks, sequence %d to %d, %d gaps\n"
+                     % (len(blocks), blocks[0][1], blocks[-1][1], gaps))
+
+    if args.format == "bin":
+        out = open(args.output, "wb") if args.output else sys.stdout.buffer
+        for _, _, records in blocks:
+            for record in records:
+                out.write(record)
+    else:
+        out = open(args.output, "w") if args.output else sys.stdout
+        if args.format == "csv":
+            out.write("sequence,record,data\n")
+        for _, sequence, records in blocks:
+            for number, record in enumerate(records):
+                if args.format == "csv":
+                    out.write("%d,%d,%s\n" % (sequence, number, record.hex()))
+                else:
+                    out.write(record.hex() + "\n")
+
+    if out not in (sys.stdout, sys.stdout.buffer):
+        out.close()
+    return 0
+
+
+if __name__ == "__main__":
+    sys.exit(main())
@@ -0,0 +1,178 @@
+#!/usr/bin/env python3
+"""Decode token log frames (firmware_common/drivers/tokenlog.c) from a capture of the debug port.
+
+The capture can be a file written by a terminal program or the serial port itself, e.g.
+  tokenlog_decode.py capture.bin
+  tokenlog_decode.py --port /dev/ttyUSB0
+Normal ASCII output from the board is passed through unchanged; frames are replaced with
+"[time ms] message" lines.  Binary watch list samples (debug command "Watch variables") become
+"[time ms] watch: value ..." lines.
+
+Message ids are the order of the TOKENLOG_MESSAGE() entries in tokenlog_messages.h, so use the
+file from the tree the firmware was built from.  --table writes the id table as JSON.
+"""
+
+import argparse
+import json
+import os
+import re
+import struct
+import sys
+
+FRAME_START = 0x1E
+TRACE_FRAME_START = 0x1D    # Event trace dump frames (tools/trace_export.py) are skipped
+WATCH_FRAME_START = 0x1C
+DEFAULT_MESSAGES = os.path.join(os.path.dirname(os.path.abspath(__file__)),
+                                "..", "firmware_common", "drivers", "tokenlog_messages.h")
+
+# Ids generated by tokenlog.c itself
+ID_ENABLED = "TOKENLOG_ENABLED"
+
+MESSAGE_RE = re.compile(r'^\s*TOKENLOG_MESSAGE\(\s*(\w+)\s*,\s*"((?:[^"\\]|\\.)*)"\s*\)', re.M)
+CONVERSION_RE = re.compile(r"%([-+ #0]*\d*)([udixXc%])")
+
+
+def load_messages(path):
+    """Return a list of (name, format) in id order."""
+    with open(path) as source:
+        text = source.read()
+    # Drop comments so commented-out entries do not shift the ids
+    text = re.sub(r"/\*.*?\*/", "", text, flags=re.S)
+    text = re.sub(r"//[^\n]*", "", text)
+    return [(name, bytes(fmt, "ascii").decode("unicode_escape")) for name, fmt in MESSAGE_RE.findall(text)]
+
+
+def read_varint(data, index):
+    value = 0
+    shift = 0
+    while True:
+        byte = data[index]
+        index += 1
+        value |= (byte & 0x7F) << shift
+        shift += 7
+        if not byte & 0x80:
+            return value, index
+
+
+def render(fmt, args):
+    """Apply a printf format to u32 argument values."""
+    values = iter(args)
+
+    def convert(match):
+        flags, kind = match.groups()
+        if kind == "%":
+            return "%"
+        value = next(values, 0)
+        if kind in "di" and value & 0x80000000:
+            value -= 1 << 32
+        if kind == "u":
+            kind = "d"
+        return ("%" + flags + kind) % value
+
+    return CONVERSION_RE.sub(convert, fmt)
+
+
+class Decoder:
+    def __init__(self, messages, out):
+        self.messages = messages
+        self.out = out
+        self.time = 0
+        self.pending = bytearray()
+        self.text = bytearray()
+
+    def feed(self, data):
+        self.pending += data
+        index = 0
+        while index < len(self.pending):
+            byte = self.pending[index]
+            if byte not in (FRAME_START, TRACE_FRAME_START, WATCH_FRAME_START):
+                self.text.append(byte)
+                index += 1
+                continue
+            if index + 2 > len(self.pending) or index + 2 + self.pending[index + 1] > len(self.pending):
+                break
+            size = self.pending[index + 1]
+            if byte == FRAME_START:
+                self.flush_text()
+                self.frame(bytes(self.pending[index + 2:index + 2 + size]))
+            elif byte == WATCH_FRAME_START:
+                self.flush_text()
+                self.watch(bytes(self.pending[index + 2:index + 2 + size]))
+            index += 2 + size
+        del self.pending[:index]
+        self.flush_text()
+
+    def flush_text(self):
+        if self.text:
+            self.out.write(self.text.decode("latin-1"))
+            self.text.clear()
+
+    def frame(self, payload):
+        try:
+            values = []
+            index = 0
+            while index < len(payload):
+                value, index = read_varint(payload, index)
+                values.append(value)
+        except IndexError:
+            self.out.write("\n[ bad frame %s ]\n" % payload.hex())
+            return
+
+        if len(values) < 2:
+            self.out.write("\n[ bad frame %s ]\n" % payload.hex())
+            return
+
+        message_id, delta, args = values[0], values[1], values[2:]
+        self.time += delta
+        if message_id < len(self.messages):
+            name, fmt = self.messages[message_id]
+            if name == ID_ENABLED and args:
+                self.time = args[0]
+            text = render(fmt, args)
+        else:
+            text = "unknown id %d %s" % (message_id, " ".join("0x%x" % a for a in args))
+        self.out.write("\n[%10d] %s\n" % (self.time, text))
+
+
+    def watch(self, payload):
+        if len(payload) < 4 or len(payload) % 4:
+            self.out.write("\n[ bad watch frame %s ]\n" % payload.hex())
+            return
+        values = struct.unpack("<%dI" % (len(payload) // 4), payload)
+        self.out.write("\n[%10d] watch: %s\n" % (values[0], " ".join("0x%08x" % v for v in values[1:])))
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__,
+                                     formatter_class=argparse.RawDescriptionHelpFormatter)
+    parser.add_argument("capture", nargs="?", help="capture file ('-' for stdin)")
+    parser.add_argument("--port", help="read from a serial port instead (needs pyserial)")
+    parser.add_argument("--baud", type=int, default=115200, help="serial baud rate (default 115200)")
+    parser.add_argument("--messages", default=DEFAULT_MESSAGES, help="path to tokenlog_messages.h")
+    parser.add_argument("--table", help="write the id table as JSON to this file and exit")
+    args = parser.parse_args()
+
+    messages = load_messages(args.messages)
+
+    if args.table:
+        with open(args.table, "w") as table:
+            json.dump([{"id": i, "name": n, "format": f} for i, (n, f) in enumerate(messages)], table, indent=2)
+        return 0
+
+    decoder = Decoder(messages, sys.stdout)
+    if args.port:
+        import serial
+        with serial.Serial(args.port, args.baud, timeout=0.1) as port:
+            while True:
+                decoder.feed(port.read(256))
+                sys.stdout.flush()
+    elif args.capture:
+        source = sys.stdin.buffer if args.capture == "-" else open(args.capture, "rb")
+        decoder.feed(source.read())
+    else:
+        parser.error("give a capture file or --port")
+    return 0
+
+
+if __name__ == "__main__":
+    sys.exit(main())
@@ -0,0 +1,225 @@
+#!/usr/bin/env python3
+"""Convert an event trace dump (firmware_common/drivers/trace.c) into a Chrome trace JSON timeline.
+
+Start a capture of the debug port, run the "Dump event trace" debug command, then e.g.
+  trace_export.py capture.bin -o trace.json
+  trace_export.py --port /dev/ttyUSB0 -o trace.json
+and open trace.json in https://ui.perfetto.dev or chrome://tracing.
+
+Event names, kinds and tracks are read from trace_events.h, so use the file from the tree the firmware was built
+from.  Timestamps are in microseconds of G_u32SystemTime1ms, so they line up with the token log and the board's
+own time printouts.  --symbols takes the output of "arm-none-eabi-nm firmware.elf" to name SD state addresses.
+"""
+
+import argparse
+import json
+import os
+import re
+import struct
+import sys
+import time
+
+TRACE_FRAME_START = 0x1D
+TOKENLOG_FRAME_START = 0x1E
+WATCH_FRAME_START = 0x1C
+FRAME_HEADER = ord("H")
+FRAME_RECORDS = ord("R")
+FORMAT_VERSION = 1
+HEADER_FORMAT = "<BBHIIII"
+RECORD_FORMAT = "<IIBBH"
+RECORD_SIZE = struct.calcsize(RECORD_FORMAT)
+
+DEFAULT_EVENTS = os.path.join(os.path.dirname(os.path.abspath(__file__)),
+                              "..", "firmware_common", "drivers", "trace_events.h")
+
+EVENT_RE = re.compile(r'^\s*TRACE_EVENT\(\s*(\w+)\s*,\s*"(\w)"\s*,\s*"([^"]*)"\s*,\s*"([^"]*)"\s*\)', re.M)
+
+# Cortex-M3 exception numbers that can be active when an event is recorded
+EXCEPTION_NAMES = {0: "main", 2: "NMI", 3: "HardFault", 4: "MemManage", 5: "BusFault", 6: "UsageFault",
+                   11: "SVCall", 12: "DebugMon", 14: "PendSV", 15: "SysTick"}
+
+
+def load_events(path):
+    """Return a list of (id, kind, track, name) in id order."""
+    with open(path) as source:
+        text = source.read()
+    # Drop comments so commented-out entries do not shift the ids
+    text = re.sub(r"/\*.*?\*/", "", text, flags=re.S)
+    text = re.sub(r"//[^\n]*", "", text)
+    return EVENT_RE.findall(text)
+
+
+def load_symbols(path):
+    """Read nm output ("address type name" lines) into {address: name}."""
+    symbols = {}
+    with open(path) as source:
+        for line in source:
+            fields = line.split()
+            if len(fields) == 3:
+                try:
+                    symbols[int(fields[0], 16)] = fields[2]
+                except ValueError:
+                    pass
+    return symbols
+
+
+def context_name(context):
+    if context >= 16:
+        return "IRQ%d" % (context - 16)
+    return EXCEPTION_NAMES.get(context, "exception %d" % context)
+
+
+class Dump:
+    def __init__(self, header):
+        (self.version, self.record_size, self.count, self.hz,
+         self.lost, self.cycles, self.time_ms) = header
+        self.records = []
+
+    def complete(self):
+        return len(self.records) >= self.count
+
+
+def find_dumps(data):
+    """Pull the trace frames out of a capture and group them into dumps."""
+    dumps = []
+    index = 0
+    while index + 2 <= len(data):
+        start = data[index]
+        if start not in (TRACE_FRAME_START, TOKENLOG_FRAME_START, WATCH_FRAME_START):
+            index += 1
+            continue
+        size = data[index + 1]
+        if index + 2 + size > len(data):
+            break
+        payload = data[index + 2:index + 2 + size]
+        index += 2 + size
+
+        # Token log and watch frames share the port; skip them whole so their bytes are not mistaken for trace frames
+        if start != TRACE_FRAME_START or not payload:
+            continue
+
+        if payload[0] == FRAME_HEADER and len(payload) == 1 + struct.calcsize(HEADER_FORMAT):
+            dumps.append(Dump(struct.unpack(HEADER_FORMAT, payload[1:])))
+        elif payload[0] == FRAME_RECORDS and dumps and not dumps[-1].complete():
+            body = payload[1:]
+            for offset in range(0, len(body) - RECORD_SIZE + 1, RECORD_SIZE):
+                dumps[-1].records.append(struct.unpack(RECORD_FORMAT, body[offset:offset + RECORD_SIZE]))
+    return dumps
+
+
+def export(dump, events, symbols):
+    """Build the Chrome trace event list for one dump."""
+    tracks = []
+    for _, _, track, _ in events:
+        if track not in tracks:
+            tracks.append(track)
+
+    trace = [{"ph": "M", "pid": 1, "name": "process_name", "args": {"name": "SAM3U2"}}]
+    for tid, track in enumerate(tracks, 1):
+        trace.append({"ph": "M", "pid": 1, "tid": tid, "name": "thread_name", "args": {"name": track}})
+        trace.append({"ph": "M", "pid": 1, "tid": tid, "name": "thread_sort_index", "args": {"sort_index": tid}})
+
+    # Work back from the counter value at the dump so each gap is unwrapped separately
+    ages = [0] * len(dump.records)
+    previous = dump.cycles
+    age = 0
+    for i in range(len(dump.records) - 1, -1, -1):
+        age += (previous - dump.records[i][0]) & 0xFFFFFFFF
+        ages[i] = age
+        previous = dump.records[i][0]
+
+    cycles_per_us = dump.hz / 1e6
+    end_us = dump.time_ms * 1000.0
+
+    if dump.lost:
+        first = end_us - ages[0] / cycles_per_us if ages else end_us
+        trace.append({"ph": "i", "s": "g", "pid": 1, "tid": 1, "ts": first,
+                      "name": "%d older events overwritten" % dump.lost})
+
+    for (cycles, arg, event, context, _), age in zip(dump.records, ages):
+        entry = {"pid": 1, "ts": end_us - age / cycles_per_us, "args": {"context": context_name(context)}}
+        if event >= len(events):
+            entry.update({"ph": "i", "s": "t", "tid": 1, "name": "unknown event %d" % event})
+            entry["args"]["arg"] = "0x%08x" % arg
+            trace.append(entry)
+            continue
+
+        name_id, kind, track, name = events[event]
+        entry.update({"ph": kind, "tid": tracks.index(track) + 1, "name": name})
+        if kind in "be":
+            entry["cat"] = track
+            entry["id"] = arg >> 16
+            entry["args"]["bytes"] = arg & 0xFFFF
+        else:
+            if kind == "i":
+                entry["s"] = "t"
+            entry["args"]["arg"] = arg
+            symbol = symbols.get(arg & ~1)
+            if symbol:
+                entry["args"]["symbol"] = symbol
+                if kind == "i":
+                    entry["name"] = "%s: %s" % (name, symbol)
+        trace.append(entry)
+
+    return {"traceEvents": trace, "displayTimeUnit": "ns"}
+
+
+def read_port(port_name, baud, idle):
+    """Read the port until nothing arrives for idle seconds after the first byte."""
+    import serial
+    data = bytearray()
+    with serial.Serial(port_name, baud, timeout=0.1) as port:
+        last = None
+        while last is None or time.time() - last < idle:
+            chunk = port.read(4096)
+            if chunk:
+                data += chunk
+                last = time.time()
+    return bytes(data)
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__,
+                                     formatter_class=argparse.RawDescriptionHelpFormatter)
+    parser.add_argument("capture", nargs="?", help="capture file ('-' for stdin)")
+    parser.add_argument("--port", help="read from a serial port instead (needs pyserial)")
+    parser.add_argument("--baud", type=int, default=115200, help="serial baud rate (default 115200)")
+    parser.add_argument("--idle", type=float, default=2.0, help="seconds of silence that end a --port capture")
+    parser.add_argument("--events", default=DEFAULT_EVENTS, help="path to trace_events.h")
+    parser.add_argument("--symbols", help="nm output used to name addresses in event arguments")
+    parser.add_argument("--dump", type=int, default=-1, help="which dump in the capture to export (default last)")
+    parser.add_argument("-o", "--output", default="trace.json", help="output file (default trace.json)")
+    args = parser.parse_args()
+
+    if args.port:
+        data = read_port(args.port, args.baud, args.idle)
+    elif args.capture:
+        source = sys.stdin.buffer if args.capture == "-" else open(args.capture, "rb")
+        data = source.read()
+    else:
+        parser.error("give a capture file or --port")
+
+    dumps = find_dumps(data)
+    if not dumps:
+        sys.stderr.write("no trace dump found\n")
+        return 1
+    try:
+        dump = dumps[args.dump]
+    except IndexError:
+        sys.stderr.write("capture has %d dumps\n" % len(dumps))
+        return 1
+    if dump.version != FORMAT_VERSION or dump.record_size != RECORD_SIZE:
+        sys.stderr.write("unsupported dump format %d / record size %d\n" % (dump.version, dump.record_size))
+        return 1
+    if not dump.complete():
+        sys.stderr.write("dump incomplete: %d of %d records\n" % (len(dump.records), dump.count))
+
+    symbols = load_symbols(args.symbols) if args.symbols else {}
+    with open(args.output, "w") as output:
+        json.dump(export(dump, load_events(args.events), symbols), output, indent=1)
+    sys.stderr.write("%d events written to %s\n" % (len(dump.records), args.output))
+    return 0
+
+
+if __name__ == "__main__":
+    sys.exit(main())